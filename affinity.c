@@ -0,0 +1,119 @@
+#define _GNU_SOURCE
+
+#include "affinity.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Read a comma-separated list of CPU numbers, with - for a thread left free to run anywhere
+ * \param   spec    The list, e.g. "2,3,-"
+ * \param   cpus    Receives count CPU numbers; entries past the end of the list are
+ *                  AFFINITY_ANY_CPU
+ * \param   count   The most CPU numbers to read
+ * \return          NULL on success, otherwise a message explaining what is wrong with the list
+ */
+const char *affinity_parse(const char *spec, int *cpus, int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    cpus[i] = AFFINITY_ANY_CPU;
+  }
+  const char *p = spec;
+  for (int i = 0; *p != '\0'; i++)
+  {
+    if (i == count)
+    {
+      return "too many CPUs";
+    }
+    if (*p == '-')
+    {
+      p++;
+    }
+    else if (isdigit((unsigned char)*p))
+    {
+      char *end;
+      long cpu = strtol(p, &end, 10);
+      if (cpu >= CPU_SETSIZE)
+      {
+        return "no such CPU";
+      }
+      cpus[i] = (int)cpu;
+      p = end;
+    }
+    else
+    {
+      return "expected a CPU number or -";
+    }
+
+    if (*p == ',')
+    {
+      p++;
+    }
+    else if (*p != '\0')
+    {
+      return "expected a comma between CPUs";
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Pin a thread and set its priority as its placement asks. Anything refused is recorded in the
+ * placement and the thread carries on without it.
+ * \param   thread      The thread to place
+ * \param   placement   Where it should run; receives the errors
+ * \return              true if everything asked for took effect
+ */
+bool affinity_apply(pthread_t thread, thread_placement_t *placement)
+{
+  placement->pin_error = 0;
+  placement->priority_error = 0;
+  if (placement->cpu != AFFINITY_ANY_CPU)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(placement->cpu, &set);
+    placement->pin_error = pthread_setaffinity_np(thread, sizeof(set), &set);
+  }
+  if (placement->priority > 0)
+  {
+    struct sched_param param = {.sched_priority = placement->priority};
+    placement->priority_error = pthread_setschedparam(thread, SCHED_FIFO, &param);
+  }
+  return placement->pin_error == 0 && placement->priority_error == 0;
+}
+
+/**
+ * Print where a thread was asked to run and whether it got there
+ */
+void affinity_report(const thread_placement_t *placement, FILE *out)
+{
+  fprintf(out, "%s thread: ", placement->label);
+  if (placement->cpu == AFFINITY_ANY_CPU)
+  {
+    fprintf(out, "any CPU");
+  }
+  else if (placement->pin_error == 0)
+  {
+    fprintf(out, "pinned to CPU %d", placement->cpu);
+  }
+  else
+  {
+    fprintf(out, "could not pin to CPU %d (%s), ran on any CPU", placement->cpu,
+            strerror(placement->pin_error));
+  }
+  if (placement->priority > 0 && placement->priority_error == 0)
+  {
+    fprintf(out, ", SCHED_FIFO priority %d", placement->priority);
+  }
+  else if (placement->priority > 0)
+  {
+    fprintf(out, ", SCHED_FIFO priority %d refused (%s), ran normally", placement->priority,
+            strerror(placement->priority_error));
+  }
+  fprintf(out, "\n");
+}
@@ -0,0 +1,55 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// A CPU number that leaves a thread free to run on any CPU
+#define AFFINITY_ANY_CPU -1
+
+// Real-time priority asked for the simulation thread: above every normal thread, well below the
+// kernel's own real-time threads
+#define AFFINITY_REALTIME_PRIORITY 10
+
+/**
+ * Where a thread should run, and what became of asking for it. Pinning keeps a thread's caches
+ * warm and stops the kernel migrating it in the middle of a tick; a SCHED_FIFO priority stops
+ * normal threads preempting it at all. Either can be refused (a CPU that is offline or outside
+ * the process's cpuset, real-time scheduling without CAP_SYS_NICE or RLIMIT_RTPRIO), in which
+ * case the thread runs as it would have anyway and the reason is kept for the report.
+ */
+typedef struct thread_placement
+{
+  const char *label; // names the thread in the report
+  int cpu;           // the CPU to pin to, or AFFINITY_ANY_CPU
+  int priority;      // SCHED_FIFO priority, or 0 for normal scheduling
+  int pin_error;     // errno from pinning, or 0
+  int priority_error; // errno from setting the priority, or 0
+} thread_placement_t;
+
+/**
+ * Read a comma-separated list of CPU numbers, with - for a thread left free to run anywhere
+ * \param   spec    The list, e.g. "2,3,-"
+ * \param   cpus    Receives count CPU numbers; entries past the end of the list are
+ *                  AFFINITY_ANY_CPU
+ * \param   count   The most CPU numbers to read
+ * \return          NULL on success, otherwise a message explaining what is wrong with the list
+ */
+const char *affinity_parse(const char *spec, int *cpus, int count);
+
+/**
+ * Pin a thread and set its priority as its placement asks. Anything refused is recorded in the
+ * placement and the thread carries on without it.
+ * \param   thread      The thread to place
+ * \param   placement   Where it should run; receives the errors
+ * \return              true if everything asked for took effect
+ */
+bool affinity_apply(pthread_t thread, thread_placement_t *placement);
+
+/**
+ * Print where a thread was asked to run and whether it got there
+ */
+void affinity_report(const thread_placement_t *placement, FILE *out);
+
+#endif
@@ -0,0 +1,111 @@
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Round a size up to the arena's alignment
+ */
+static size_t align_size(size_t size)
+{
+  return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/**
+ * Set up an arena
+ * \param   arena   The arena to initialize
+ * \param   size    The size of its buffer to start with
+ */
+void arena_init(arena_t *arena, size_t size)
+{
+  arena->size = align_size(size > 0 ? size : ARENA_ALIGN);
+  arena->base = aligned_alloc(ARENA_ALIGN, arena->size);
+  if (arena->base == NULL)
+  {
+    perror("aligned_alloc");
+    exit(2);
+  }
+  arena->used = 0;
+  arena->wanted = 0;
+  arena->overflow = NULL;
+  arena->overflow_count = 0;
+}
+
+/**
+ * Allocate memory that lasts until the arena is reset. Exits if memory runs out.
+ * \return          size bytes aligned to ARENA_ALIGN
+ */
+void *arena_alloc(arena_t *arena, size_t size)
+{
+  size = align_size(size > 0 ? size : 1);
+  arena->wanted += size;
+  if (size <= arena->size - arena->used)
+  {
+    void *memory = arena->base + arena->used;
+    arena->used += size;
+    return memory;
+  }
+
+  // Out of room for this round; the reset makes room for next time
+  arena_block_t *block = aligned_alloc(ARENA_ALIGN, sizeof(arena_block_t) + size);
+  if (block == NULL)
+  {
+    perror("aligned_alloc");
+    exit(2);
+  }
+  block->next = arena->overflow;
+  arena->overflow = block;
+  arena->overflow_count++;
+  return block->data;
+}
+
+/**
+ * Free the blocks allocated when the buffer ran out
+ */
+static void free_overflow(arena_t *arena)
+{
+  while (arena->overflow != NULL)
+  {
+    arena_block_t *next = arena->overflow->next;
+    free(arena->overflow);
+    arena->overflow = next;
+  }
+}
+
+/**
+ * Release everything allocated from an arena, growing its buffer if the allocations since the
+ * last reset did not all fit
+ */
+void arena_reset(arena_t *arena)
+{
+  free_overflow(arena);
+  if (arena->wanted > arena->size)
+  {
+    size_t size = arena->size;
+    while (size < arena->wanted)
+    {
+      size *= 2;
+    }
+    free(arena->base);
+    arena->base = aligned_alloc(ARENA_ALIGN, size);
+    if (arena->base == NULL)
+    {
+      perror("aligned_alloc");
+      exit(2);
+    }
+    arena->size = size;
+  }
+  arena->used = 0;
+  arena->wanted = 0;
+}
+
+/**
+ * Release an arena's memory
+ */
+void arena_free(arena_t *arena)
+{
+  free_overflow(arena);
+  free(arena->base);
+  arena->base = NULL;
+  arena->size = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Alignment of every allocation from an arena
+#define ARENA_ALIGN 16
+
+// A block allocated when an arena's buffer ran out, freed when the arena is reset
+typedef struct arena_block
+{
+  struct arena_block *next;
+  _Alignas(ARENA_ALIGN) uint8_t data[];
+} arena_block_t;
+
+/**
+ * Scratch memory for one round: allocations bump a pointer through a single buffer and are all
+ * released at once by resetting the arena at the start of the next round.
+ *
+ * An allocation that does not fit gets a block of its own from malloc, freed at the reset, and
+ * the reset grows the buffer to what the round needed in all. After a round or two of the same
+ * work the buffer is big enough and a round makes no heap allocations at all.
+ */
+typedef struct arena
+{
+  uint8_t *base;
+  size_t size;
+  size_t used;
+  size_t wanted;            // bytes asked for since the last reset, whether or not they fitted
+  arena_block_t *overflow;  // blocks for allocations that did not fit
+  uint64_t overflow_count;  // allocations that did not fit, over the arena's life
+} arena_t;
+
+/**
+ * Set up an arena
+ * \param   arena   The arena to initialize
+ * \param   size    The size of its buffer to start with
+ */
+void arena_init(arena_t *arena, size_t size);
+
+/**
+ * Allocate memory that lasts until the arena is reset. Exits if memory runs out.
+ * \return          size bytes aligned to ARENA_ALIGN
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * Release everything allocated from an arena, growing its buffer if the allocations since the
+ * last reset did not all fit
+ */
+void arena_reset(arena_t *arena);
+
+/**
+ * Release an arena's memory
+ */
+void arena_free(arena_t *arena);
+
+#endif
@@ -0,0 +1,1105 @@
+#define _GNU_SOURCE
+
+#include <curses.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "affinity.h"
+#include "bitboard.h"
+#include "game.h"
+#include "headless.h"
+#include "history.h"
+#include "host.h"
+#include "pacer.h"
+#include "render.h"
+#include "replay.h"
+#include "scheduler.h"
+#include "search.h"
+#include "util.h"
+
+// How long the host benchmark runs its matches, and how many it runs by default
+#define HOST_SECONDS 5
+#define HOST_DEFAULT_MATCHES 100
+
+// Number of flood fills timed for each implementation
+#define FLOOD_RUNS 2000
+
+// Number of positions searched for each thread count and time limit
+#define SEARCH_POSITIONS 20
+
+// Ticks played at random before each searched position
+#define SEARCH_OPENING_TICKS 600
+
+// How long each pacing loop runs, and the work it does per tick
+#define PACING_SECONDS 3
+#define PACING_WORK_NS 1000000
+
+// Work per period in the game's three loops, for comparing them as threads and as tasks: a tick
+// with two bots, a frame drawn, and a keyboard poll that finds nothing
+#define LOOP_TICK_WORK_NS 200000
+#define LOOP_FRAME_WORK_NS 500000
+#define LOOP_INPUT_WORK_NS 0
+
+// Frames drawn per renderer workload, and ticks played between in-game frames (a frame every
+// 33 ms against a tick every 5 ms)
+#define RENDER_FRAMES 2000
+#define RENDER_FRAME_TICKS 7
+
+// Synthetic matches in the history benchmark, the players they are drawn from, and the matches
+// added after the statistics are saved
+#define HISTORY_MATCHES 1000000
+#define HISTORY_PLAYERS 10000
+#define HISTORY_TAIL 1000
+
+
+/**
+ * Reference flood fill: a breadth-first search over a plain array of cells, the way whole-board
+ * queries worked before the occupancy bitboard.
+ * \param   cells   width * height cells, zero for empty
+ * \param   queue   Scratch space for width * height cell indices
+ * \param   seen    Scratch space for width * height flags
+ * \return          The number of empty cells reachable from (row, col)
+ */
+int flood_fill_cells(const uint8_t *cells, int width, int height, int row, int col, int *queue,
+                     uint8_t *seen)
+{
+  if (cells[row * width + col] != 0)
+  {
+    return 0;
+  }
+  memset(seen, 0, (size_t)width * height);
+
+  int head = 0;
+  int tail = 0;
+  queue[tail++] = row * width + col;
+  seen[row * width + col] = 1;
+  while (head < tail)
+  {
+    int index = queue[head++];
+    int r = index / width;
+    int c = index % width;
+    int neighbors[4] = {r > 0 ? index - width : -1, r < height - 1 ? index + width : -1,
+                        c > 0 ? index - 1 : -1, c < width - 1 ? index + 1 : -1};
+    for (int i = 0; i < 4; i++)
+    {
+      int n = neighbors[i];
+      if (n >= 0 && !seen[n] && cells[n] == 0)
+      {
+        seen[n] = 1;
+        queue[tail++] = n;
+      }
+    }
+  }
+  return tail;
+}
+
+/**
+ * Cover part of a board in random trails, recording them in both representations
+ */
+void make_trails(uint8_t *cells, bitboard_t *occupied, int width, int height, int percent)
+{
+  int target = width * height * percent / 100;
+  int filled = 0;
+  while (filled < target)
+  {
+    // Each trail is a random walk that turns now and then, like a bike
+    int r = rand() % height;
+    int c = rand() % width;
+    int dir = rand() % 4;
+    for (int step = 0; step < 200 && filled < target; step++)
+    {
+      if (r < 0 || r >= height || c < 0 || c >= width)
+      {
+        break;
+      }
+      if (cells[r * width + c] == 0)
+      {
+        cells[r * width + c] = 1;
+        bitboard_set(occupied, r, c);
+        filled++;
+      }
+      if (rand() % 8 == 0)
+      {
+        dir = (dir + (rand() % 2 ? 1 : 3)) % 4;
+      }
+      r += (dir == 2) - (dir == 0);
+      c += (dir == 1) - (dir == 3);
+    }
+  }
+}
+
+/**
+ * Time flood fills from the same random seeds on a plain cell array and on the bitboard with each
+ * instruction set the CPU supports, checking that they agree.
+ * \param   width    The board width in cells
+ * \param   height   The board height in cells
+ * \param   percent  How much of the board to cover in trails
+ */
+void bench_flood(int width, int height, int percent)
+{
+  uint8_t *cells = calloc((size_t)width * height, 1);
+  uint8_t *seen = malloc((size_t)width * height);
+  int *queue = malloc(sizeof(int) * width * height);
+  int *seeds = malloc(sizeof(int) * FLOOD_RUNS);
+  int *expected = malloc(sizeof(int) * FLOOD_RUNS);
+  if (cells == NULL || seen == NULL || queue == NULL || seeds == NULL || expected == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+
+  bitboard_t occupied;
+  bitboard_t region;
+  bitboard_init(&occupied, width, height, true);
+  bitboard_init(&region, width, height, false);
+  make_trails(cells, &occupied, width, height, percent);
+  for (int i = 0; i < FLOOD_RUNS; i++)
+  {
+    seeds[i] = rand() % (width * height);
+  }
+
+  printf("flood fill on a %dx%d board, %d%% trails, %d fills\n", width, height, percent,
+         FLOOD_RUNS);
+
+  uint64_t start = time_ns();
+  for (int i = 0; i < FLOOD_RUNS; i++)
+  {
+    expected[i] = flood_fill_cells(cells, width, height, seeds[i] / width, seeds[i] % width,
+                                   queue, seen);
+  }
+  double base_ns = (double)(time_ns() - start) / FLOOD_RUNS;
+  printf("  %-14s %10.0f ns/fill\n", "cells (BFS)", base_ns);
+
+  bitboard_isa_t isas[] = {BITBOARD_SCALAR, BITBOARD_SSE2, BITBOARD_AVX2};
+  for (int i = 0; i < (int)(sizeof(isas) / sizeof(isas[0])); i++)
+  {
+    if (!bitboard_use_isa(isas[i]))
+    {
+      continue;
+    }
+
+    start = time_ns();
+    bool agree = true;
+    for (int j = 0; j < FLOOD_RUNS; j++)
+    {
+      int area = bitboard_flood_fill(&occupied, seeds[j] / width, seeds[j] % width, &region);
+      agree &= area == expected[j];
+    }
+    double ns = (double)(time_ns() - start) / FLOOD_RUNS;
+
+    char name[32];
+    snprintf(name, sizeof(name), "bitboard %s", bitboard_isa_name());
+    printf("  %-14s %10.0f ns/fill  %5.1fx%s\n", name, ns, base_ns / ns,
+           agree ? "" : "  MISMATCH");
+  }
+
+  bitboard_free(&occupied);
+  bitboard_free(&region);
+  free(cells);
+  free(seen);
+  free(queue);
+  free(seeds);
+  free(expected);
+}
+
+/**
+ * Set up a two-player game part way through a round: both players wander at random, turning away
+ * from anything straight ahead, until the opening is over. Rounds that end early are replayed.
+ */
+void make_position(game_t *game)
+{
+  static const int dir_rows[4] = {-1, 0, 1, 0};
+  static const int dir_cols[4] = {0, 1, 0, -1};
+  for (;;)
+  {
+    game_reset(game);
+    int result = -1;
+    for (int tick = 0; tick < SEARCH_OPENING_TICKS && result < 0; tick++)
+    {
+      for (int i = 0; i < 2; i++)
+      {
+        player_t *p = &game->players[i];
+        if (!game_move_due(game, i))
+        {
+          continue;
+        }
+        int dir = rand() % 6 == 0 ? (p->dir + (rand() % 2 ? 1 : 3)) % 4 : p->dir;
+        for (int turn = 0; turn < 4; turn++)
+        {
+          int d = (dir + turn) % 4;
+          if (d != (p->dir + 2) % 4 &&
+              !bitboard_test(&game->occupied, p->row + dir_rows[d], p->col + dir_cols[d]))
+          {
+            dir = d;
+            break;
+          }
+        }
+        game_steer(game, i, dir);
+      }
+      result = game_tick(game);
+    }
+    if (result < 0)
+    {
+      // The search starts from a player that is about to move
+      while (!game_move_due(game, 0))
+      {
+        if (game_tick(game) >= 0)
+        {
+          break;
+        }
+      }
+      if (game->players[0].alive && game->players[1].alive)
+      {
+        return;
+      }
+    }
+  }
+}
+
+/**
+ * Measure how deep the alpha-beta search gets in a fixed time on the same positions, and how many
+ * nodes per second it visits, with each number of threads up to max_threads
+ */
+void bench_search(int width, int height, int max_threads)
+{
+  game_config_t config = {.width = width, .height = height, .num_players = 2};
+  game_t game;
+  game_init(&game, &config);
+
+  // One simulation tick, one bot decision and one whole horizontal move
+  uint64_t budgets[] = {SIM_TICK_INTERVAL * 1000000ull, player_HORIZONTAL_INTERVAL * 1000000ull};
+
+  printf("alpha-beta search on a %dx%d board, %d positions\n", width, height, SEARCH_POSITIONS);
+  for (int b = 0; b < (int)(sizeof(budgets) / sizeof(budgets[0])); b++)
+  {
+    for (int threads = 1; threads <= max_threads; threads *= 2)
+    {
+      search_t search;
+      search_init(&search, &game, threads);
+
+      srand(2);
+      uint64_t nodes = 0;
+      uint64_t elapsed = 0;
+      int depth_total = 0;
+      int depth_min = SEARCH_MAX_DEPTH;
+      for (int i = 0; i < SEARCH_POSITIONS; i++)
+      {
+        make_position(&game);
+        search_result_t result;
+        search_run(&search, &game, 0, budgets[b], &result);
+        nodes += result.nodes;
+        elapsed += result.elapsed_ns;
+        depth_total += result.depth;
+        depth_min = result.depth < depth_min ? result.depth : depth_min;
+      }
+      printf("  %5.1f ms, %2d threads: depth %4.1f (min %2d), %10.0f nodes/s\n",
+             budgets[b] / 1e6, threads, (double)depth_total / SEARCH_POSITIONS, depth_min,
+             nodes * 1e9 / elapsed);
+      search_free(&search);
+    }
+  }
+  game_free(&game);
+}
+
+/**
+ * Record an hour of wandering two-player rounds, then time playing the replay back through a
+ * memory-mapped reader and seeking into the middle of it
+ */
+void bench_replay(const char *path)
+{
+  game_config_t config = {.width = DEFAULT_BOARD_WIDTH,
+                          .height = DEFAULT_BOARD_HEIGHT,
+                          .num_players = 2};
+  game_t game;
+  game_init(&game, &config);
+  bot_t *bots[2] = {NULL, NULL};
+
+  replay_writer_t writer;
+  uint64_t seed = 1;
+  uint64_t rng = seed;
+  replay_writer_init(&writer, &config, seed);
+  uint64_t ticks = 0;
+  int rounds = 0;
+  while (ticks < 3600 * 1000 / SIM_TICK_INTERVAL)
+  {
+    headless_match(&game, bots, &rng, &ticks, &writer);
+    rounds++;
+  }
+  if (!replay_save(&writer, path))
+  {
+    perror(path);
+    exit(2);
+  }
+  replay_writer_free(&writer);
+
+  replay_t replay;
+  const char *error = replay_open(&replay, path);
+  if (error != NULL)
+  {
+    fprintf(stderr, "%s: %s\n", path, error);
+    exit(2);
+  }
+  printf("replay of %d rounds, %llu ticks (%.0f minutes of play): %zu bytes, %.2f bytes/tick\n",
+         rounds, (unsigned long long)ticks, ticks * SIM_TICK_INTERVAL / 60000.0, replay.size,
+         (double)replay.size / ticks);
+
+  replay_stats_t stats;
+  bool ok = replay_play(&replay, &game, &stats);
+  printf("  %-14s %10.3f ms  %d keyframes, %d mismatches%s\n", "play all", stats.elapsed_ns / 1e6,
+         stats.keyframes, stats.mismatches, ok ? "" : "  CORRUPT");
+
+  uint64_t start = time_ns();
+  ok = replay_seek(&replay, &game, rounds / 2, 1000);
+  printf("  %-14s %10.3f ms%s\n", "seek", (time_ns() - start) / 1e6, ok ? "" : "  FAILED");
+
+  replay_close(&replay);
+  unlink(path);
+  game_free(&game);
+}
+
+// Tells the threads loading the CPU to stop
+static atomic_bool unloaded;
+
+/**
+ * Run in a thread to keep a CPU busy
+ */
+static void *burn(void *arg)
+{
+  volatile uint64_t n = 0;
+  while (!atomic_load_explicit(&unloaded, memory_order_relaxed))
+  {
+    n++;
+  }
+  return NULL;
+}
+
+/**
+ * Spin for a while, standing in for a tick's work
+ */
+static void work(uint64_t ns)
+{
+  uint64_t start = time_ns();
+  while (time_ns() - start < ns)
+  {
+  }
+}
+
+/**
+ * Run a tick loop paced by sleeping a whole interval after the work, the way the simulation used
+ * to, and the same loop paced by a pacer, each doing PACING_WORK_NS of work per tick while other
+ * threads load the CPU. Reports how far each drifted from real time.
+ * \param   load    The number of threads spinning alongside
+ */
+void bench_pacing(int load)
+{
+  uint64_t period = SIM_TICK_INTERVAL * 1000000ull;
+  uint64_t ticks = PACING_SECONDS * 1000000000ull / period;
+  pthread_t threads[load > 0 ? load : 1];
+  atomic_store(&unloaded, false);
+  for (int i = 0; i < load; i++)
+  {
+    pthread_create(&threads[i], NULL, burn, NULL);
+  }
+  printf("%llu ticks of %d ms with %.1f ms of work each, %d threads of load\n",
+         (unsigned long long)ticks, SIM_TICK_INTERVAL, PACING_WORK_NS / 1e6, load);
+
+  uint64_t start = time_ns();
+  for (uint64_t i = 0; i < ticks; i++)
+  {
+    work(PACING_WORK_NS);
+    sleep_ms(SIM_TICK_INTERVAL);
+  }
+  uint64_t elapsed = time_ns() - start;
+  printf("  %-8s %8.3f s for %.3f s of game time, drift %+.1f%%\n", "sleep_ms", elapsed / 1e9,
+         ticks * period / 1e9, (elapsed / (double)(ticks * period) - 1) * 100);
+
+  pacer_t pacer;
+  pacer_init(&pacer, period, SIM_MAX_CATCH_UP);
+  start = time_ns();
+  pacer_start(&pacer);
+  int due = 1;
+  for (uint64_t i = 0; i < ticks; i++)
+  {
+    work(PACING_WORK_NS);
+    if (--due == 0)
+    {
+      due = pacer_wait(&pacer);
+    }
+  }
+  elapsed = time_ns() - start;
+  printf("  %-8s %8.3f s for %.3f s of game time, drift %+.1f%%\n", "pacer", elapsed / 1e9,
+         ticks * period / 1e9, (elapsed / (double)(ticks * period) - 1) * 100);
+  pacer_report(&pacer.stats, "  pacer", stdout);
+
+  atomic_store(&unloaded, true);
+  for (int i = 0; i < load; i++)
+  {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+// One run of the pinning benchmark: where the tick thread and the load run
+typedef struct pinning_run
+{
+  const char *label;
+  thread_placement_t placement; // for the tick thread
+  bool spare_cpu;               // keep the load off the tick thread's CPU, as on a tuned host
+  pacer_t pacer;
+} pinning_run_t;
+
+/**
+ * Run in a thread to play PACING_SECONDS of ticks with a pacer, PACING_WORK_NS of work each
+ */
+static void *paced_ticks(void *arg)
+{
+  pacer_t *pacer = arg;
+  uint64_t ticks = PACING_SECONDS * 1000000000ull / pacer->period_ns;
+  pacer_start(pacer);
+  int due = 1;
+  for (uint64_t i = 0; i < ticks; i++)
+  {
+    work(PACING_WORK_NS);
+    if (--due == 0)
+    {
+      due = pacer_wait(pacer);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Run the simulation's paced tick loop in a thread of its own while a thread per CPU spins
+ * alongside: free to run anywhere, pinned to a CPU, pinned with the load kept off that CPU, and
+ * pinned at a SCHED_FIFO priority. Reports each one's tick jitter.
+ * \param   cpu     The CPU to pin the tick thread to
+ */
+void bench_pinning(int cpu)
+{
+  int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  pinning_run_t runs[] = {
+      {.label = "unpinned", .placement = {.cpu = AFFINITY_ANY_CPU}},
+      {.label = "pinned", .placement = {.cpu = cpu}},
+      {.label = "spare cpu", .placement = {.cpu = cpu}, .spare_cpu = true},
+      {.label = "realtime",
+       .placement = {.cpu = cpu, .priority = AFFINITY_REALTIME_PRIORITY}},
+  };
+  printf("%d ms ticks with %.1f ms of work each for %d s, %d threads of load, pinned to CPU %d\n",
+         SIM_TICK_INTERVAL, PACING_WORK_NS / 1e6, PACING_SECONDS, cpus, cpu);
+
+  for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++)
+  {
+    pinning_run_t *run = &runs[r];
+    run->placement.label = run->label;
+    pacer_init(&run->pacer, SIM_TICK_INTERVAL * 1000000ull, SIM_MAX_CATCH_UP);
+
+    // The load can only be kept off the tick thread's CPU when there is another one for it
+    cpu_set_t spare;
+    CPU_ZERO(&spare);
+    for (int i = 0; i < cpus; i++)
+    {
+      if (i != cpu)
+      {
+        CPU_SET(i, &spare);
+      }
+    }
+    pthread_t load[cpus];
+    atomic_store(&unloaded, false);
+    for (int i = 0; i < cpus; i++)
+    {
+      pthread_create(&load[i], NULL, burn, NULL);
+      if (run->spare_cpu && cpus > 1)
+      {
+        pthread_setaffinity_np(load[i], sizeof(spare), &spare);
+      }
+    }
+
+    pthread_t ticker;
+    pthread_create(&ticker, NULL, paced_ticks, &run->pacer);
+    affinity_apply(ticker, &run->placement);
+    pthread_join(ticker, NULL);
+    atomic_store(&unloaded, true);
+    for (int i = 0; i < cpus; i++)
+    {
+      pthread_join(load[i], NULL);
+    }
+
+    char label[32];
+    snprintf(label, sizeof(label), "  %-9s", run->label);
+    pacer_report(&run->pacer.stats, label, stdout);
+    if (run->placement.pin_error != 0 || run->placement.priority_error != 0)
+    {
+      printf("  ");
+      affinity_report(&run->placement, stdout);
+    }
+    if (run->spare_cpu && cpus == 1)
+    {
+      printf("  (only one CPU, so the load shared it)\n");
+    }
+  }
+}
+
+// One of the game's loops in the threads vs. tasks benchmark
+typedef struct loop
+{
+  pacer_t pacer;
+  uint64_t work_ns;
+  pthread_mutex_t *lock; // held while working, as the simulation holds the board lock
+} loop_t;
+
+// The simulation, render and input loops, shared with the task functions, which take no arguments
+static loop_t loops[3];
+
+/**
+ * Run one of the game's loops for PACING_SECONDS
+ */
+static void *run_loop(void *arg)
+{
+  loop_t *loop = arg;
+  uint64_t periods = PACING_SECONDS * 1000000000ull / loop->pacer.period_ns;
+  pacer_start(&loop->pacer);
+  for (uint64_t i = 0; i < periods; i++)
+  {
+    pthread_mutex_lock(loop->lock);
+    work(loop->work_ns);
+    pthread_mutex_unlock(loop->lock);
+    pacer_wait(&loop->pacer);
+  }
+  return NULL;
+}
+
+static void run_tick_loop()
+{
+  run_loop(&loops[0]);
+}
+
+static void run_frame_loop()
+{
+  run_loop(&loops[1]);
+}
+
+static void run_input_loop()
+{
+  run_loop(&loops[2]);
+}
+
+/**
+ * Get the CPU time used so far and the number of times the process's threads were switched out
+ */
+static double usage_now(long *switches)
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  *switches = usage.ru_nvcsw + usage.ru_nivcsw;
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec +
+         usage.ru_stime.tv_usec / 1e6;
+}
+
+/**
+ * Run the game's simulation, render and input loops with their usual periods and some work each,
+ * first as threads and then as tasks on the scheduler. Reports the CPU time, context switches and
+ * tick jitter of each.
+ */
+void bench_tasks(void)
+{
+  pthread_mutex_t board_lock = PTHREAD_MUTEX_INITIALIZER;
+  pthread_mutex_t input_lock = PTHREAD_MUTEX_INITIALIZER;
+  uint64_t periods[3] = {SIM_TICK_INTERVAL, 33, SIM_TICK_INTERVAL};
+  uint64_t work_ns[3] = {LOOP_TICK_WORK_NS, LOOP_FRAME_WORK_NS, LOOP_INPUT_WORK_NS};
+  pthread_mutex_t *locks[3] = {&board_lock, &board_lock, &input_lock};
+  printf("simulation, render and input loops for %d s\n", PACING_SECONDS);
+
+  for (int green = 0; green <= 1; green++)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      pacer_init(&loops[i].pacer, periods[i] * 1000000ull, i == 0 ? SIM_MAX_CATCH_UP : 1);
+      loops[i].pacer.sleep_until = green ? task_sleep_until : NULL;
+      loops[i].work_ns = work_ns[i];
+      loops[i].lock = locks[i];
+    }
+
+    long switches_before;
+    double cpu_before = usage_now(&switches_before);
+    uint64_t start = time_ns();
+    if (green)
+    {
+      scheduler_init();
+      task_t tasks[3];
+      task_create(&tasks[0], run_tick_loop);
+      task_create(&tasks[1], run_frame_loop);
+      task_create(&tasks[2], run_input_loop);
+      for (int i = 0; i < 3; i++)
+      {
+        task_wait(tasks[i]);
+      }
+    }
+    else
+    {
+      pthread_t threads[3];
+      for (int i = 0; i < 3; i++)
+      {
+        pthread_create(&threads[i], NULL, run_loop, &loops[i]);
+      }
+      for (int i = 0; i < 3; i++)
+      {
+        pthread_join(threads[i], NULL);
+      }
+    }
+    double elapsed = (time_ns() - start) / 1e9;
+    long switches;
+    double cpu = usage_now(&switches) - cpu_before;
+    switches -= switches_before;
+
+    printf("  %-7s %.3f s of CPU (%.1f%%), %.0f context switches/s\n", green ? "tasks" : "threads",
+           cpu, cpu / elapsed * 100, switches / elapsed);
+    pacer_report(&loops[0].pacer.stats, "    ticks", stdout);
+    pacer_report(&loops[1].pacer.stats, "    frames", stdout);
+  }
+}
+
+// Bytes curses has written to its output
+static atomic_uint_least64_t curses_bytes;
+
+/**
+ * Run in a thread to count and discard what curses writes to a pipe
+ */
+static void *drain(void *arg)
+{
+  int fd = *(int *)arg;
+  char buffer[65536];
+  ssize_t n;
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+  {
+    atomic_fetch_add(&curses_bytes, n);
+  }
+  return NULL;
+}
+
+/**
+ * Wait until the counting thread has read everything curses wrote
+ */
+static void settle(FILE *out, int read_fd)
+{
+  fflush(out);
+  int pending;
+  while (ioctl(read_fd, FIONREAD, &pending) == 0 && pending > 0)
+  {
+    usleep(1000);
+  }
+  usleep(1000); // the last read may still be being counted
+}
+
+/**
+ * Play four-player wandering rounds, keeping the board every RENDER_FRAME_TICKS ticks as a frame
+ * \param   frames  Filled with RENDER_FRAMES boards
+ */
+static void make_frames(game_t *game, uint8_t *frames)
+{
+  size_t cells = (size_t)game->width * game->height;
+  uint64_t rng = 1;
+  game_reset(game);
+  for (int f = 0; f < RENDER_FRAMES; f++)
+  {
+    for (int t = 0; t < RENDER_FRAME_TICKS; t++)
+    {
+      for (int i = 0; i < game->num_players; i++)
+      {
+        if (game_move_due(game, i))
+        {
+          wander_steer(game, i, &rng);
+        }
+      }
+      if (game_tick(game) >= 0)
+      {
+        game_reset(game);
+      }
+    }
+    memcpy(frames + f * cells, game->cells, cells);
+  }
+}
+
+/**
+ * Draw the same frames with each renderer backend into /dev/null: once repainting every cell of
+ * every frame, and once drawing only the cells that changed, as in a game. Reports frames per
+ * second and the bytes each frame would send to the terminal.
+ */
+void bench_render(void)
+{
+  game_config_t config = {.width = DEFAULT_BOARD_WIDTH,
+                          .height = DEFAULT_BOARD_HEIGHT,
+                          .num_players = 4};
+  game_t game;
+  game_init(&game, &config);
+  size_t cells = (size_t)game.width * game.height;
+  uint8_t *frames = malloc(cells * RENDER_FRAMES);
+  if (frames == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  make_frames(&game, frames);
+
+  // curses writes to a pipe, where a thread counts its output; the ansi backend counts its own
+  // and writes straight to /dev/null
+  int null_fd = open("/dev/null", O_WRONLY);
+  FILE *in = fopen("/dev/null", "r");
+  int pipe_fds[2];
+  if (null_fd < 0 || in == NULL || pipe(pipe_fds) != 0)
+  {
+    perror("/dev/null");
+    exit(2);
+  }
+  FILE *out = fdopen(pipe_fds[1], "w");
+  pthread_t drainer;
+  pthread_create(&drainer, NULL, drain, &pipe_fds[0]);
+  setenv("LINES", "60", 1);
+  setenv("COLUMNS", "200", 1);
+  SCREEN *screen = newterm("xterm-256color", out, in);
+  if (screen == NULL)
+  {
+    fprintf(stderr, "No terminal description for xterm-256color.\n");
+    exit(2);
+  }
+
+  printf("%d frames of a %dx%d board, %d players\n", RENDER_FRAMES, game.width, game.height,
+         game.num_players);
+  const char *backends[] = {"curses", "ansi"};
+  for (int b = 0; b < 2; b++)
+  {
+    renderer_t *renderer = render_create(backends[b], game.width, game.height, 2, 2, null_fd);
+    for (int full = 1; full >= 0; full--)
+    {
+      render_invalidate(renderer);
+      clear();
+      refresh();
+      settle(out, pipe_fds[0]);
+      uint64_t bytes = renderer->bytes + atomic_load(&curses_bytes);
+      uint64_t start = time_ns();
+      for (int f = 0; f < RENDER_FRAMES; f++)
+      {
+        const uint8_t *frame = frames + f * cells;
+        const uint8_t *last = f > 0 ? frame - cells : NULL;
+        if (full)
+        {
+          render_invalidate(renderer);
+          clearok(stdscr, true); // curses keeps no other way to forget the screen
+        }
+        for (size_t i = 0; i < cells; i++)
+        {
+          if (full || last == NULL || frame[i] != last[i])
+          {
+            render_cell(renderer, i / game.width, i % game.width, frame[i]);
+          }
+        }
+        render_flush(renderer);
+      }
+      uint64_t elapsed = time_ns() - start;
+      settle(out, pipe_fds[0]);
+      bytes = renderer->bytes + atomic_load(&curses_bytes) - bytes;
+      printf("  %-7s %-8s %10.0f frames/s %10.1f bytes/frame\n", backends[b],
+             full ? "repaint" : "in game", RENDER_FRAMES / (elapsed / 1e9),
+             (double)bytes / RENDER_FRAMES);
+    }
+    render_free(renderer);
+  }
+
+  endwin();
+  delscreen(screen);
+  fclose(out);
+  pthread_join(drainer, NULL);
+  close(pipe_fds[0]);
+  fclose(in);
+  close(null_fd);
+  free(frames);
+  game_free(&game);
+}
+
+/**
+ * Append synthetic matches to a history: two to four players each, drawn at random, where the
+ * player with the lower number tends to survive longer
+ */
+static void make_history(history_writer_t *writer, int matches, uint64_t *rng)
+{
+  for (int m = 0; m < matches; m++)
+  {
+    char names[4][HISTORY_NAME_LEN + 1];
+    history_match_t match = {.num_players = 2 + rng_next(rng) % 3};
+    uint32_t best = 0;
+    for (int i = 0; i < match.num_players; i++)
+    {
+      uint32_t player = rng_next(rng) % HISTORY_PLAYERS;
+      snprintf(names[i], sizeof(names[i]), "player%u", player);
+      match.names[i] = names[i];
+      match.lasted[i] = rng_next(rng) % 500 + (HISTORY_PLAYERS - player) / 40;
+      match.deaths[i] = DEATH_WALL + rng_next(rng) % 4;
+      if (match.lasted[i] >= match.lasted[best])
+      {
+        best = match.lasted[i] == match.lasted[best] && i > 0 ? best : i;
+      }
+    }
+    match.ticks = match.lasted[best];
+    match.winner = best + 1;
+    match.deaths[best] = DEATH_NONE;
+    history_writer_add(writer, &match);
+  }
+}
+
+/**
+ * Write a large match history, then time bringing its statistics up to date from scratch against
+ * loading saved statistics and folding in only the matches added since, and finding the top ten
+ */
+void bench_history(const char *path)
+{
+  char stats_path[4096];
+  snprintf(stats_path, sizeof(stats_path), "%s%s", path, HISTORY_STATS_SUFFIX);
+  unlink(path);
+  unlink(stats_path);
+  uint64_t rng = 1;
+
+  history_writer_t writer;
+  if (!history_writer_open(&writer, path))
+  {
+    perror(path);
+    exit(2);
+  }
+  uint64_t start = time_ns();
+  make_history(&writer, HISTORY_MATCHES, &rng);
+  history_writer_flush(&writer);
+  uint64_t elapsed = time_ns() - start;
+  struct stat st;
+  stat(path, &st);
+  printf("%d matches among %d players: written at %.0f ns each, %.1f bytes each\n",
+         HISTORY_MATCHES, HISTORY_PLAYERS, (double)elapsed / HISTORY_MATCHES,
+         (double)st.st_size / HISTORY_MATCHES);
+
+  history_stats_t stats;
+  history_stats_init(&stats);
+  start = time_ns();
+  history_stats_update(&stats, path);
+  elapsed = time_ns() - start;
+  printf("full scan:            %8.1f ms (%.0f ns per match)\n", elapsed / 1e6,
+         (double)elapsed / HISTORY_MATCHES);
+  history_stats_save(&stats, path);
+  history_stats_free(&stats);
+
+  // A few more games are played after the statistics were saved
+  make_history(&writer, HISTORY_TAIL, &rng);
+  history_writer_close(&writer);
+  history_stats_init(&stats);
+  start = time_ns();
+  history_stats_load(&stats, path);
+  elapsed = time_ns() - start;
+  printf("saved + %d new:      %8.1f ms\n", HISTORY_TAIL, elapsed / 1e6);
+
+  uint32_t top[10];
+  start = time_ns();
+  history_stats_top(&stats, 10, top);
+  elapsed = time_ns() - start;
+  printf("top 10 by rating:     %8.1f ms, best %s at %.0f\n", elapsed / 1e6,
+         stats.players[top[0]].name, stats.players[top[0]].rating);
+  history_stats_free(&stats);
+  unlink(path);
+  unlink(stats_path);
+}
+
+// The pty masters the host benchmark's matches draw on
+typedef struct host_ptys
+{
+  int *fds;
+  int count;
+  atomic_bool done;
+} host_ptys_t;
+
+/**
+ * Run in a thread to read and discard what the hosted matches draw, as their terminals would
+ */
+static void *drain_ptys(void *arg)
+{
+  host_ptys_t *ptys = arg;
+  struct pollfd *fds = malloc(ptys->count * sizeof(struct pollfd));
+  if (fds == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  for (int i = 0; i < ptys->count; i++)
+  {
+    fds[i] = (struct pollfd){.fd = ptys->fds[i], .events = POLLIN};
+  }
+  char buffer[65536];
+  while (!atomic_load(&ptys->done))
+  {
+    if (poll(fds, ptys->count, 100) <= 0)
+    {
+      continue;
+    }
+    for (int i = 0; i < ptys->count; i++)
+    {
+      if (fds[i].revents & POLLIN)
+      {
+        ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+        (void)n;
+      }
+    }
+  }
+  free(fds);
+  return NULL;
+}
+
+/**
+ * Host matches of two bots each, every one on its own pseudo-terminal, from one thread for a few
+ * seconds. The host reports its CPU time and memory per match and how well it kept to the ticks.
+ * \param   matches The number of matches
+ */
+void bench_host(int matches)
+{
+  if (matches < 1 || matches > HOST_MAX_MATCHES)
+  {
+    fprintf(stderr, "Between 1 and %d matches, please.\n", HOST_MAX_MATCHES);
+    exit(1);
+  }
+  host_ptys_t ptys = {.fds = malloc(matches * sizeof(int)), .count = matches};
+  char(*names)[64] = malloc(matches * sizeof(*names));
+  const char **ttys = malloc(matches * sizeof(char *));
+  if (ptys.fds == NULL || names == NULL || ttys == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  struct winsize size = {.ws_row = 40, .ws_col = 120};
+  for (int i = 0; i < matches; i++)
+  {
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0 || ioctl(fd, TIOCSWINSZ, &size) != 0)
+    {
+      perror("posix_openpt");
+      exit(2);
+    }
+    snprintf(names[i], sizeof(names[i]), "%s", ptsname(fd));
+    ttys[i] = names[i];
+    ptys.fds[i] = fd;
+  }
+  setenv("TERM", "xterm-256color", 0);
+
+  pthread_t drainer;
+  pthread_create(&drainer, NULL, drain_ptys, &ptys);
+  host_options_t options = {.config = {.width = DEFAULT_BOARD_WIDTH,
+                                       .height = DEFAULT_BOARD_HEIGHT,
+                                       .num_players = 2},
+                            .bots = 2,
+                            .seconds = HOST_SECONDS};
+  host_run(&options, ttys, matches);
+  atomic_store(&ptys.done, true);
+  pthread_join(drainer, NULL);
+
+  for (int i = 0; i < matches; i++)
+  {
+    close(ptys.fds[i]);
+  }
+  free(ttys);
+  free(names);
+  free(ptys.fds);
+}
+
+/**
+ * Print command line usage
+ * \param   prog    The name the program was run as
+ */
+void usage(const char *prog)
+{
+  fprintf(stderr,
+          "Usage: %s <benchmark> [args]\n"
+          "  flood [width height]   flood fill on a cell array vs. the occupancy bitboard\n"
+          "  search [threads]       alpha-beta search depth and nodes/s on the default board\n"
+          "  replay [file]          record an hour of play, then play it back from the file\n"
+          "  pacing [threads]       drift of a sleeping vs. a deadline-paced tick loop, with\n"
+          "                         threads spinning alongside (default: one per CPU)\n"
+          "  pinning [cpu]          tick jitter unpinned, pinned to a CPU (default 0), with that\n"
+          "                         CPU kept free of load, and at real-time priority\n"
+          "  tasks                  CPU time, context switches and jitter of the game's loops\n"
+          "                         as threads vs. as scheduler tasks on one thread\n"
+          "  render                 frames/s and bytes/frame of each renderer backend\n"
+          "  history [file]         write a million-match history, then time its statistics\n"
+          "                         from scratch vs. from a checkpoint, and a top-10 query\n"
+          "  host [matches]         CPU and memory per match of hosting bot matches (default\n"
+          "                         100), each on its own pty, from one thread\n",
+          prog);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // The same boards every run, so results are comparable
+  srand(1);
+
+  if (strcmp(argv[1], "flood") == 0)
+  {
+    if (argc == 4)
+    {
+      bench_flood(atoi(argv[2]), atoi(argv[3]), 10);
+      bench_flood(atoi(argv[2]), atoi(argv[3]), 35);
+    }
+    else
+    {
+      // The default board early and late in a round, then a much larger board
+      bench_flood(100, 31, 10);
+      bench_flood(100, 31, 35);
+      bench_flood(500, 500, 10);
+    }
+  }
+  else if (strcmp(argv[1], "search") == 0)
+  {
+    int threads = argc == 3 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    bench_search(DEFAULT_BOARD_WIDTH, DEFAULT_BOARD_HEIGHT, threads > 0 ? threads : 1);
+  }
+  else if (strcmp(argv[1], "replay") == 0)
+  {
+    bench_replay(argc == 3 ? argv[2] : "bench.replay");
+  }
+  else if (strcmp(argv[1], "pacing") == 0)
+  {
+    bench_pacing(argc == 3 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN));
+  }
+  else if (strcmp(argv[1], "pinning") == 0)
+  {
+    bench_pinning(argc == 3 ? atoi(argv[2]) : 0);
+  }
+  else if (strcmp(argv[1], "tasks") == 0)
+  {
+    bench_tasks();
+  }
+  else if (strcmp(argv[1], "render") == 0)
+  {
+    bench_render();
+  }
+  else if (strcmp(argv[1], "history") == 0)
+  {
+    bench_history(argc == 3 ? argv[2] : "bench.history");
+  }
+  else if (strcmp(argv[1], "host") == 0)
+  {
+    bench_host(argc == 3 ? atoi(argv[2]) : HOST_DEFAULT_MATCHES);
+  }
+  else
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  return 0;
+}
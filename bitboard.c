@@ -0,0 +1,589 @@
+#include "bitboard.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BITBOARD_X86 1
+#include <immintrin.h>
+#endif
+
+// Number of extra rows after the board used as scratch space by bitboard_grow
+#define SCRATCH_ROWS 2
+
+// Rows a flood fill with a deadline grows between readings of the clock
+#define FLOOD_CHECK_ROWS 32
+
+/**
+ * Update one row of a region. Each word becomes its neighbours in the row above and below plus
+ * its left and right neighbours, minus occupied cells. When fill is set, the result is also
+ * spread along runs of free cells within each word, so a flood fill needs far fewer passes.
+ * \return        true if any word in the row changed
+ */
+typedef bool (*row_kernel_t)(uint64_t *dst, const uint64_t *cur, const uint64_t *above,
+                             const uint64_t *below, const uint64_t *occ, int words, bool fill);
+
+// Count the set bits in words (or the clear bits if invert is set)
+typedef int (*count_kernel_t)(const uint64_t *words, int count, bool invert);
+
+typedef struct kernels
+{
+  bitboard_isa_t isa;
+  const char *name;
+  row_kernel_t grow_row;
+  count_kernel_t count;
+} kernels_t;
+
+/******************** Scalar kernels ********************/
+
+static bool scalar_grow_row(uint64_t *dst, const uint64_t *cur, const uint64_t *above,
+                            const uint64_t *below, const uint64_t *occ, int words, bool fill)
+{
+  uint64_t changed = 0;
+  for (int i = 0; i < words; i++)
+  {
+    uint64_t v = cur[i];
+    uint64_t free = ~occ[i];
+    uint64_t g = v | (v << 1) | (cur[i - 1] >> 63) | (v >> 1) | (cur[i + 1] << 63) | above[i] |
+                 below[i];
+    g &= free;
+
+    if (fill)
+    {
+      // Kogge-Stone occluded fill towards the high and low bits
+      uint64_t hi = g;
+      uint64_t lo = g;
+      uint64_t pro_hi = free;
+      uint64_t pro_lo = free;
+      for (int shift = 1; shift < 64; shift *= 2)
+      {
+        hi |= pro_hi & (hi << shift);
+        pro_hi &= pro_hi << shift;
+        lo |= pro_lo & (lo >> shift);
+        pro_lo &= pro_lo >> shift;
+      }
+      g = hi | lo;
+    }
+
+    changed |= g ^ dst[i];
+    dst[i] = g;
+  }
+  return changed != 0;
+}
+
+static int scalar_count(const uint64_t *words, int count, bool invert)
+{
+  uint64_t flip = invert ? ~(uint64_t)0 : 0;
+  int total = 0;
+  for (int i = 0; i < count; i++)
+  {
+    total += __builtin_popcountll(words[i] ^ flip);
+  }
+  return total;
+}
+
+/******************** SSE2 kernels ********************/
+
+#ifdef BITBOARD_X86
+
+#define SSE2_FILL_STEP(hi, lo, pro_hi, pro_lo, shift)                                              \
+  hi = _mm_or_si128(hi, _mm_and_si128(pro_hi, _mm_slli_epi64(hi, shift)));                          \
+  pro_hi = _mm_and_si128(pro_hi, _mm_slli_epi64(pro_hi, shift));                                    \
+  lo = _mm_or_si128(lo, _mm_and_si128(pro_lo, _mm_srli_epi64(lo, shift)));                          \
+  pro_lo = _mm_and_si128(pro_lo, _mm_srli_epi64(pro_lo, shift));
+
+__attribute__((target("sse2"))) static bool sse2_grow_row(uint64_t *dst, const uint64_t *cur,
+                                                          const uint64_t *above,
+                                                          const uint64_t *below,
+                                                          const uint64_t *occ, int words,
+                                                          bool fill)
+{
+  __m128i changed = _mm_setzero_si128();
+  for (int i = 0; i < words; i += 2)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)(cur + i));
+    __m128i left = _mm_loadu_si128((const __m128i *)(cur + i - 1));
+    __m128i right = _mm_loadu_si128((const __m128i *)(cur + i + 1));
+    __m128i o = _mm_loadu_si128((const __m128i *)(occ + i));
+
+    __m128i g = _mm_or_si128(v, _mm_loadu_si128((const __m128i *)(above + i)));
+    g = _mm_or_si128(g, _mm_loadu_si128((const __m128i *)(below + i)));
+    g = _mm_or_si128(g, _mm_or_si128(_mm_slli_epi64(v, 1), _mm_srli_epi64(left, 63)));
+    g = _mm_or_si128(g, _mm_or_si128(_mm_srli_epi64(v, 1), _mm_slli_epi64(right, 63)));
+    g = _mm_andnot_si128(o, g);
+
+    if (fill)
+    {
+      __m128i free = _mm_andnot_si128(o, _mm_set1_epi32(-1));
+      __m128i hi = g;
+      __m128i lo = g;
+      __m128i pro_hi = free;
+      __m128i pro_lo = free;
+      SSE2_FILL_STEP(hi, lo, pro_hi, pro_lo, 1);
+      SSE2_FILL_STEP(hi, lo, pro_hi, pro_lo, 2);
+      SSE2_FILL_STEP(hi, lo, pro_hi, pro_lo, 4);
+      SSE2_FILL_STEP(hi, lo, pro_hi, pro_lo, 8);
+      SSE2_FILL_STEP(hi, lo, pro_hi, pro_lo, 16);
+      SSE2_FILL_STEP(hi, lo, pro_hi, pro_lo, 32);
+      g = _mm_or_si128(hi, lo);
+    }
+
+    __m128i old = _mm_loadu_si128((const __m128i *)(dst + i));
+    changed = _mm_or_si128(changed, _mm_xor_si128(g, old));
+    _mm_storeu_si128((__m128i *)(dst + i), g);
+  }
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(changed, _mm_setzero_si128())) != 0xFFFF;
+}
+
+__attribute__((target("sse2"))) static int sse2_count(const uint64_t *words, int count,
+                                                      bool invert)
+{
+  const __m128i m1 = _mm_set1_epi8(0x55);
+  const __m128i m2 = _mm_set1_epi8(0x33);
+  const __m128i m4 = _mm_set1_epi8(0x0f);
+  __m128i flip = invert ? _mm_set1_epi32(-1) : _mm_setzero_si128();
+  __m128i total = _mm_setzero_si128();
+  for (int i = 0; i < count; i += 2)
+  {
+    // Bit-slice popcount of each byte, then sum the bytes of each half
+    __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(words + i)), flip);
+    x = _mm_sub_epi8(x, _mm_and_si128(_mm_srli_epi16(x, 1), m1));
+    x = _mm_add_epi8(_mm_and_si128(x, m2), _mm_and_si128(_mm_srli_epi16(x, 2), m2));
+    x = _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi16(x, 4)), m4);
+    total = _mm_add_epi64(total, _mm_sad_epu8(x, _mm_setzero_si128()));
+  }
+  uint64_t halves[2];
+  _mm_storeu_si128((__m128i *)halves, total);
+  return (int)(halves[0] + halves[1]);
+}
+
+/******************** AVX2 kernels ********************/
+
+#define AVX2_FILL_STEP(hi, lo, pro_hi, pro_lo, shift)                                              \
+  hi = _mm256_or_si256(hi, _mm256_and_si256(pro_hi, _mm256_slli_epi64(hi, shift)));                  \
+  pro_hi = _mm256_and_si256(pro_hi, _mm256_slli_epi64(pro_hi, shift));                              \
+  lo = _mm256_or_si256(lo, _mm256_and_si256(pro_lo, _mm256_srli_epi64(lo, shift)));                  \
+  pro_lo = _mm256_and_si256(pro_lo, _mm256_srli_epi64(pro_lo, shift));
+
+__attribute__((target("avx2"))) static bool avx2_grow_row(uint64_t *dst, const uint64_t *cur,
+                                                          const uint64_t *above,
+                                                          const uint64_t *below,
+                                                          const uint64_t *occ, int words,
+                                                          bool fill)
+{
+  __m256i changed = _mm256_setzero_si256();
+  for (int i = 0; i < words; i += 4)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(cur + i));
+    __m256i left = _mm256_loadu_si256((const __m256i *)(cur + i - 1));
+    __m256i right = _mm256_loadu_si256((const __m256i *)(cur + i + 1));
+    __m256i o = _mm256_loadu_si256((const __m256i *)(occ + i));
+
+    __m256i g = _mm256_or_si256(v, _mm256_loadu_si256((const __m256i *)(above + i)));
+    g = _mm256_or_si256(g, _mm256_loadu_si256((const __m256i *)(below + i)));
+    g = _mm256_or_si256(g, _mm256_or_si256(_mm256_slli_epi64(v, 1), _mm256_srli_epi64(left, 63)));
+    g = _mm256_or_si256(g,
+                        _mm256_or_si256(_mm256_srli_epi64(v, 1), _mm256_slli_epi64(right, 63)));
+    g = _mm256_andnot_si256(o, g);
+
+    if (fill)
+    {
+      __m256i free = _mm256_andnot_si256(o, _mm256_set1_epi32(-1));
+      __m256i hi = g;
+      __m256i lo = g;
+      __m256i pro_hi = free;
+      __m256i pro_lo = free;
+      AVX2_FILL_STEP(hi, lo, pro_hi, pro_lo, 1);
+      AVX2_FILL_STEP(hi, lo, pro_hi, pro_lo, 2);
+      AVX2_FILL_STEP(hi, lo, pro_hi, pro_lo, 4);
+      AVX2_FILL_STEP(hi, lo, pro_hi, pro_lo, 8);
+      AVX2_FILL_STEP(hi, lo, pro_hi, pro_lo, 16);
+      AVX2_FILL_STEP(hi, lo, pro_hi, pro_lo, 32);
+      g = _mm256_or_si256(hi, lo);
+    }
+
+    __m256i old = _mm256_loadu_si256((const __m256i *)(dst + i));
+    changed = _mm256_or_si256(changed, _mm256_xor_si256(g, old));
+    _mm256_storeu_si256((__m256i *)(dst + i), g);
+  }
+  return !_mm256_testz_si256(changed, changed);
+}
+
+__attribute__((target("avx2"))) static int avx2_count(const uint64_t *words, int count,
+                                                      bool invert)
+{
+  // Look up the popcount of each nibble with a byte shuffle
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1,
+                                          2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  __m256i flip = invert ? _mm256_set1_epi32(-1) : _mm256_setzero_si256();
+  __m256i total = _mm256_setzero_si256();
+  for (int i = 0; i < count; i += 4)
+  {
+    __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(words + i)), flip);
+    __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(x, low_mask));
+    __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask));
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(_mm256_add_epi8(lo, hi),
+                                                    _mm256_setzero_si256()));
+  }
+  uint64_t quarters[4];
+  _mm256_storeu_si256((__m256i *)quarters, total);
+  return (int)(quarters[0] + quarters[1] + quarters[2] + quarters[3]);
+}
+
+#endif
+
+/******************** Dispatch ********************/
+
+static const kernels_t scalar_kernels = {BITBOARD_SCALAR, "scalar", scalar_grow_row, scalar_count};
+#ifdef BITBOARD_X86
+static const kernels_t sse2_kernels = {BITBOARD_SSE2, "sse2", sse2_grow_row, sse2_count};
+static const kernels_t avx2_kernels = {BITBOARD_AVX2, "avx2", avx2_grow_row, avx2_count};
+#endif
+
+static const kernels_t *_Atomic kernels = NULL;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Find the kernels for an instruction set
+ * \return        NULL if the CPU (or this build) does not support isa
+ */
+static const kernels_t *find_kernels(bitboard_isa_t isa)
+{
+  switch (isa)
+  {
+  case BITBOARD_SCALAR:
+    return &scalar_kernels;
+#ifdef BITBOARD_X86
+  case BITBOARD_SSE2:
+    return __builtin_cpu_supports("sse2") ? &sse2_kernels : NULL;
+  case BITBOARD_AVX2:
+    return __builtin_cpu_supports("avx2") ? &avx2_kernels : NULL;
+#endif
+  default:
+    return NULL;
+  }
+}
+
+/**
+ * Pick the best kernels the CPU supports
+ */
+static void select_kernels()
+{
+  for (int isa = BITBOARD_AVX2; kernels == NULL; isa--)
+  {
+    kernels = find_kernels(isa);
+  }
+}
+
+static const kernels_t *get_kernels()
+{
+  pthread_once(&kernels_once, select_kernels);
+  return kernels;
+}
+
+/**
+ * Choose which instruction set the whole-board kernels use. By default the best one the CPU
+ * supports is picked.
+ * \return        false if the CPU (or this build) does not support isa
+ */
+bool bitboard_use_isa(bitboard_isa_t isa)
+{
+  pthread_once(&kernels_once, select_kernels);
+  const kernels_t *k = find_kernels(isa);
+  if (k != NULL)
+  {
+    kernels = k;
+  }
+  return k != NULL;
+}
+
+/**
+ * Get a printable name for the instruction set the whole-board kernels currently use
+ */
+const char *bitboard_isa_name()
+{
+  return get_kernels()->name;
+}
+
+/******************** Bitboards ********************/
+
+// Words each kernel processes per row: the row rounded up to a whole number of AVX2 vectors
+static int vector_words(const bitboard_t *bb)
+{
+  return bb->stride - 2;
+}
+
+/**
+ * Allocate a bitboard
+ * \param   bb      The bitboard to initialize
+ * \param   width   The board width in cells
+ * \param   height  The board height in cells
+ * \param   walls   true for an occupancy bitboard (bits outside the board set), false otherwise
+ */
+void bitboard_init(bitboard_t *bb, int width, int height, bool walls)
+{
+  bb->width = width;
+  bb->height = height;
+  bb->row_words = (width + 63) / 64;
+  bb->stride = (bb->row_words + 3) / 4 * 4 + 2;
+  bb->words = malloc(sizeof(uint64_t) * bb->stride * (height + 2 + SCRATCH_ROWS));
+  if (bb->words == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  bitboard_clear(bb, walls);
+}
+
+/**
+ * Release the memory owned by a bitboard
+ */
+void bitboard_free(bitboard_t *bb)
+{
+  free(bb->words);
+  bb->words = NULL;
+}
+
+/**
+ * Clear every cell on the board, leaving the walls of an occupancy bitboard in place
+ */
+void bitboard_clear(bitboard_t *bb, bool walls)
+{
+  size_t total = (size_t)bb->stride * (bb->height + 2);
+  if (!walls)
+  {
+    memset(bb->words, 0, sizeof(uint64_t) * total);
+    return;
+  }
+
+  memset(bb->words, 0xff, sizeof(uint64_t) * total);
+  for (int r = 0; r < bb->height; r++)
+  {
+    uint64_t *row = bitboard_row(bb, r);
+    memset(row, 0, sizeof(uint64_t) * (bb->width / 64));
+    if (bb->width % 64 != 0)
+    {
+      row[bb->width / 64] = ~(uint64_t)0 << (bb->width % 64);
+    }
+  }
+}
+
+/**
+ * Copy every cell of src into dst. Both bitboards must be the same size.
+ */
+void bitboard_copy(bitboard_t *dst, const bitboard_t *src)
+{
+  memcpy(dst->words, src->words, sizeof(uint64_t) * dst->stride * (dst->height + 2));
+}
+
+// The simple whole-board operations below are left to the compiler to vectorize. They only touch
+// the board rows, so padding keeps whatever each bitboard had (walls or nothing).
+
+/**
+ * Add every cell set in src to dst (dst |= src)
+ */
+void bitboard_or(bitboard_t *dst, const bitboard_t *src)
+{
+  for (int r = 0; r < dst->height; r++)
+  {
+    uint64_t *d = bitboard_row(dst, r);
+    const uint64_t *s = bitboard_row(src, r);
+    for (int i = 0; i < dst->row_words; i++)
+    {
+      d[i] |= s[i];
+    }
+  }
+}
+
+/**
+ * Remove every cell set in src from dst (dst &= ~src)
+ */
+void bitboard_andnot(bitboard_t *dst, const bitboard_t *src)
+{
+  for (int r = 0; r < dst->height; r++)
+  {
+    uint64_t *d = bitboard_row(dst, r);
+    const uint64_t *s = bitboard_row(src, r);
+    for (int i = 0; i < dst->row_words; i++)
+    {
+      d[i] &= ~s[i];
+    }
+  }
+}
+
+/**
+ * Keep only the cells of dst that are also set in src (dst &= src)
+ */
+void bitboard_and(bitboard_t *dst, const bitboard_t *src)
+{
+  for (int r = 0; r < dst->height; r++)
+  {
+    uint64_t *d = bitboard_row(dst, r);
+    const uint64_t *s = bitboard_row(src, r);
+    for (int i = 0; i < dst->row_words; i++)
+    {
+      d[i] &= s[i];
+    }
+  }
+}
+
+/**
+ * Check whether two bitboards with clear padding have any cell in common
+ */
+bool bitboard_intersects(const bitboard_t *a, const bitboard_t *b)
+{
+  uint64_t any = 0;
+  for (int r = 0; r < a->height; r++)
+  {
+    const uint64_t *x = bitboard_row(a, r);
+    const uint64_t *y = bitboard_row(b, r);
+    for (int i = 0; i < a->row_words; i++)
+    {
+      any |= x[i] & y[i];
+    }
+  }
+  return any != 0;
+}
+
+/**
+ * Count the set cells on a board with clear padding (e.g. a flood fill region)
+ */
+int bitboard_count(const bitboard_t *bb)
+{
+  const kernels_t *k = get_kernels();
+  int total = 0;
+  for (int r = 0; r < bb->height; r++)
+  {
+    total += k->count(bitboard_row(bb, r), vector_words(bb), false);
+  }
+  return total;
+}
+
+/**
+ * Count the empty cells on an occupancy bitboard
+ */
+int bitboard_count_free(const bitboard_t *occupied)
+{
+  const kernels_t *k = get_kernels();
+  int total = 0;
+  for (int r = 0; r < occupied->height; r++)
+  {
+    total += k->count(bitboard_row(occupied, r), vector_words(occupied), true);
+  }
+  return total;
+}
+
+/**
+ * Find every empty cell reachable from a starting cell without crossing an occupied one.
+ * \param   occupied  The occupancy bitboard to search
+ * \param   row       The board row of the starting cell
+ * \param   col       The board column of the starting cell
+ * \param   region    A bitboard of the same size that receives the reachable cells
+ * \return            The number of reachable cells, or 0 if the starting cell is occupied
+ */
+int bitboard_flood_fill(const bitboard_t *occupied, int row, int col, bitboard_t *region)
+{
+  return bitboard_flood_fill_until(occupied, row, col, region, UINT64_MAX, NULL);
+}
+
+/**
+ * Flood fill as bitboard_flood_fill does, but give up once time_ns passes a deadline. The clock is
+ * read every FLOOD_CHECK_ROWS rows grown, so the fill overruns the deadline by at most that many.
+ * \param   deadline  When to give up (UINT64_MAX never to)
+ * \param   finished  Set to false if the deadline cut the fill short, leaving only part of the
+ *                    reachable cells in region; otherwise left alone. May be NULL with no deadline.
+ * \return            The number of cells in region
+ */
+int bitboard_flood_fill_until(const bitboard_t *occupied, int row, int col, bitboard_t *region,
+                              uint64_t deadline, bool *finished)
+{
+  bitboard_clear(region, false);
+  if (bitboard_test(occupied, row, col))
+  {
+    return 0;
+  }
+  bitboard_set(region, row, col);
+
+  // Grow the region in place, sweeping down and then up the board until nothing changes. Updating
+  // in place lets a single sweep carry the region along a whole column. Only rows next to the
+  // region so far are visited, and a sweep keeps going as long as it is still finding new cells.
+  const kernels_t *k = get_kernels();
+  int words = vector_words(region);
+  int lo = row;
+  int hi = row;
+  bool changed = true;
+  int grown = 0; // rows grown, to read the clock every FLOOD_CHECK_ROWS
+  for (bool down = true; changed; down = !down)
+  {
+    changed = false;
+    int r = down ? (lo > 0 ? lo - 1 : 0) : (hi < region->height - 1 ? hi + 1 : hi);
+    int end = down ? hi + 1 : lo - 1;
+    int step = down ? 1 : -1;
+    for (; r != end + step && r >= 0 && r < region->height; r += step)
+    {
+      if (deadline != UINT64_MAX && ++grown % FLOOD_CHECK_ROWS == 0 && time_ns() > deadline)
+      {
+        *finished = false;
+        changed = false;
+        break;
+      }
+      uint64_t *cur = bitboard_row(region, r);
+      if (k->grow_row(cur, cur, bitboard_row(region, r - 1), bitboard_row(region, r + 1),
+                      bitboard_row(occupied, r), words, true))
+      {
+        changed = true;
+        lo = r < lo ? r : lo;
+        hi = r > hi ? r : hi;
+        if (r == end)
+        {
+          end += step;
+        }
+      }
+    }
+  }
+
+  int total = 0;
+  for (int r = lo; r <= hi; r++)
+  {
+    total += k->count(bitboard_row(region, r), words, false);
+  }
+  return total;
+}
+
+/**
+ * Grow a region by one step in every direction, then drop any occupied cells. This is one layer
+ * of a breadth-first search run on every frontier cell at once.
+ * \param   occupied  The occupancy bitboard
+ * \param   region    The region to grow, updated in place
+ * \return            true if the region gained any cells
+ */
+bool bitboard_grow(const bitboard_t *occupied, bitboard_t *region)
+{
+  const kernels_t *k = get_kernels();
+  int words = vector_words(region);
+
+  // Keep the previous contents of the row above and the current row in the scratch rows, so every
+  // row grows from the region as it was before this step
+  uint64_t *prev = bitboard_row(region, region->height + 1) - 1;
+  uint64_t *old = prev + region->stride;
+  memset(prev, 0, sizeof(uint64_t) * region->stride);
+
+  bool changed = false;
+  for (int r = 0; r < region->height; r++)
+  {
+    uint64_t *cur = bitboard_row(region, r);
+    memcpy(old, cur - 1, sizeof(uint64_t) * region->stride);
+    changed |= k->grow_row(cur, old + 1, prev + 1, bitboard_row(region, r + 1),
+                           bitboard_row(occupied, r), words, false);
+
+    uint64_t *tmp = prev;
+    prev = old;
+    old = tmp;
+  }
+  return changed;
+}
@@ -0,0 +1,165 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * One bit per board cell, packed into 64-bit words per row.
+ *
+ * Every row is surrounded by padding words, and there is a padding row above and below the board,
+ * so kernels can read the neighbours of any cell without bounds checks. An occupancy bitboard has
+ * every bit outside the board set (the walls), which makes "hit a wall" and "hit a trail" the same
+ * test. Other bitboards (e.g. flood fill regions) keep every bit outside the board clear.
+ */
+typedef struct bitboard
+{
+  int width;
+  int height;
+  int row_words; // words holding board cells in each row
+  int stride;    // words from one row to the next, including padding
+  uint64_t *words;
+} bitboard_t;
+
+// Instruction sets the whole-board kernels can be built for
+typedef enum bitboard_isa
+{
+  BITBOARD_SCALAR,
+  BITBOARD_SSE2,
+  BITBOARD_AVX2,
+} bitboard_isa_t;
+
+/**
+ * Allocate a bitboard
+ * \param   bb      The bitboard to initialize
+ * \param   width   The board width in cells
+ * \param   height  The board height in cells
+ * \param   walls   true for an occupancy bitboard (bits outside the board set), false otherwise
+ */
+void bitboard_init(bitboard_t *bb, int width, int height, bool walls);
+
+/**
+ * Release the memory owned by a bitboard
+ */
+void bitboard_free(bitboard_t *bb);
+
+/**
+ * Clear every cell on the board, leaving the walls of an occupancy bitboard in place
+ */
+void bitboard_clear(bitboard_t *bb, bool walls);
+
+/**
+ * Get a pointer to the first word of a row. Rows -1 and height are padding rows, and words -1
+ * and row_words of every row are padding words.
+ */
+static inline uint64_t *bitboard_row(const bitboard_t *bb, int row)
+{
+  return bb->words + (row + 1) * bb->stride + 1;
+}
+
+/**
+ * Check a single cell. Cells one step outside the board may be tested too: for an occupancy
+ * bitboard they read as occupied.
+ * \return        true if the bit for the cell is set
+ */
+static inline bool bitboard_test(const bitboard_t *bb, int row, int col)
+{
+  // Shift col up by 64 so col = -1 lands in the left padding word without a negative division
+  unsigned index = (unsigned)(col + 64);
+  return (bitboard_row(bb, row)[(int)(index / 64) - 1] >> (index % 64)) & 1;
+}
+
+/**
+ * Set the bit for a cell on the board
+ */
+static inline void bitboard_set(bitboard_t *bb, int row, int col)
+{
+  bitboard_row(bb, row)[col / 64] |= (uint64_t)1 << (col % 64);
+}
+
+/**
+ * Clear the bit for a cell on the board
+ */
+static inline void bitboard_reset(bitboard_t *bb, int row, int col)
+{
+  bitboard_row(bb, row)[col / 64] &= ~((uint64_t)1 << (col % 64));
+}
+
+/**
+ * Copy every cell of src into dst. Both bitboards must be the same size.
+ */
+void bitboard_copy(bitboard_t *dst, const bitboard_t *src);
+
+/**
+ * Add every cell set in src to dst (dst |= src)
+ */
+void bitboard_or(bitboard_t *dst, const bitboard_t *src);
+
+/**
+ * Remove every cell set in src from dst (dst &= ~src)
+ */
+void bitboard_andnot(bitboard_t *dst, const bitboard_t *src);
+
+/**
+ * Keep only the cells of dst that are also set in src (dst &= src)
+ */
+void bitboard_and(bitboard_t *dst, const bitboard_t *src);
+
+/**
+ * Check whether two bitboards with clear padding have any cell in common
+ */
+bool bitboard_intersects(const bitboard_t *a, const bitboard_t *b);
+
+/**
+ * Choose which instruction set the whole-board kernels use. By default the best one the CPU
+ * supports is picked.
+ * \return        false if the CPU (or this build) does not support isa
+ */
+bool bitboard_use_isa(bitboard_isa_t isa);
+
+/**
+ * Get a printable name for the instruction set the whole-board kernels currently use
+ */
+const char *bitboard_isa_name();
+
+/**
+ * Count the set cells on a board with clear padding (e.g. a flood fill region)
+ */
+int bitboard_count(const bitboard_t *bb);
+
+/**
+ * Count the empty cells on an occupancy bitboard
+ */
+int bitboard_count_free(const bitboard_t *occupied);
+
+/**
+ * Find every empty cell reachable from a starting cell without crossing an occupied one.
+ * \param   occupied  The occupancy bitboard to search
+ * \param   row       The board row of the starting cell
+ * \param   col       The board column of the starting cell
+ * \param   region    A bitboard of the same size that receives the reachable cells
+ * \return            The number of reachable cells, or 0 if the starting cell is occupied
+ */
+int bitboard_flood_fill(const bitboard_t *occupied, int row, int col, bitboard_t *region);
+
+/**
+ * Flood fill as bitboard_flood_fill does, but give up once time_ns passes a deadline. The clock is
+ * read every few dozen rows grown, so the fill overruns the deadline by at most that many rows.
+ * \param   deadline  When to give up (UINT64_MAX never to)
+ * \param   finished  Set to false if the deadline cut the fill short, leaving only part of the
+ *                    reachable cells in region; otherwise left alone. May be NULL with no deadline.
+ * \return            The number of cells in region
+ */
+int bitboard_flood_fill_until(const bitboard_t *occupied, int row, int col, bitboard_t *region,
+                              uint64_t deadline, bool *finished);
+
+/**
+ * Grow a region by one step in every direction, then drop any occupied cells. This is one layer
+ * of a breadth-first search run on every frontier cell at once.
+ * \param   occupied  The occupancy bitboard
+ * \param   region    The region to grow, updated in place
+ * \return            true if the region gained any cells
+ */
+bool bitboard_grow(const bitboard_t *occupied, bitboard_t *region);
+
+#endif
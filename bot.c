@@ -0,0 +1,553 @@
+#include "bot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+// Row and column offsets for each direction
+static const int dir_rows[4] = {-1, 0, 1, 0};
+static const int dir_cols[4] = {0, 1, 0, -1};
+
+// Work on a decision stops this fraction of the budget early, leaving time to finish up after the
+// deadline is noticed
+#define BOT_MARGIN_FRACTION 4
+
+/**
+ * Set up a bot for a player
+ * \param   bot     The bot to initialize
+ * \param   game    The game the bot plays in
+ * \param   player  The index of the player to steer
+ */
+void bot_init(bot_t *bot, const game_t *game, int player)
+{
+  memset(bot, 0, sizeof(bot_t));
+  bot->player = player;
+  bot->budget = BOT_BUDGET_NS;
+  for (int i = 0; i < 3; i++)
+  {
+    bitboard_init(&bot->region[i], game->width, game->height, false);
+  }
+  bitboard_init(&bot->reach, game->width, game->height, false);
+  bitboard_init(&bot->mine, game->width, game->height, false);
+  bitboard_init(&bot->theirs, game->width, game->height, false);
+  bitboard_init(&bot->blocked, game->width, game->height, true);
+  bitboard_init(&bot->frontier_mine, game->width, game->height, false);
+  bitboard_init(&bot->frontier_theirs, game->width, game->height, false);
+  bitboard_init(&bot->filled, game->width, game->height, false);
+  bitboard_init(&bot->known, game->width, game->height, false);
+  bot_reset(bot);
+}
+
+/**
+ * Make the bot choose its moves by alpha-beta search while it shares its area with the opponent.
+ * Only two-player games are searched; with more players the bot keeps its usual evaluation.
+ * \param   bot      The bot to update
+ * \param   game     The game the bot plays in
+ * \param   threads  The number of threads each search runs on
+ */
+void bot_use_search(bot_t *bot, const game_t *game, int threads)
+{
+  bot->search = malloc(sizeof(search_t));
+  if (bot->search == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  search_init(bot->search, game, threads);
+}
+
+/**
+ * Release the memory owned by a bot
+ */
+void bot_free(bot_t *bot)
+{
+  if (bot->search != NULL)
+  {
+    search_free(bot->search);
+    free(bot->search);
+    bot->search = NULL;
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    bitboard_free(&bot->region[i]);
+  }
+  bitboard_free(&bot->reach);
+  bitboard_free(&bot->mine);
+  bitboard_free(&bot->theirs);
+  bitboard_free(&bot->blocked);
+  bitboard_free(&bot->frontier_mine);
+  bitboard_free(&bot->frontier_theirs);
+  bitboard_free(&bot->filled);
+  bitboard_free(&bot->known);
+}
+
+/**
+ * Forget everything learned about the last round. Latency statistics are kept.
+ */
+void bot_reset(bot_t *bot)
+{
+  bot->separated = false;
+  bot->area = 0;
+  bot->have_known = false;
+}
+
+/**
+ * Check whether filling a cell could cut the empty cells around it into separate pieces. The
+ * eight surrounding cells are walked in a ring; if the empty ones form a single run they stay
+ * connected to each other without the middle cell. This only ever errs towards "could split".
+ */
+static bool may_split(const bitboard_t *occupied, int row, int col)
+{
+  static const int ring_rows[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+  static const int ring_cols[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+  int runs = 0;
+  bool prev_free = !bitboard_test(occupied, row + ring_rows[7], col + ring_cols[7]);
+  for (int i = 0; i < 8; i++)
+  {
+    bool free = !bitboard_test(occupied, row + ring_rows[i], col + ring_cols[i]);
+    if (free && !prev_free)
+    {
+      runs++;
+    }
+    prev_free = free;
+  }
+  return runs > 1;
+}
+
+/**
+ * Count the occupied cells next to a cell. Moves that stay close to walls and trails waste less
+ * space once a bot is filling in its own area.
+ */
+static int count_walls(const bitboard_t *occupied, int row, int col)
+{
+  int walls = 0;
+  for (int dir = 0; dir < 4; dir++)
+  {
+    walls += bitboard_test(occupied, row + dir_rows[dir], col + dir_cols[dir]);
+  }
+  return walls;
+}
+
+/**
+ * Find every cell a player other than the bot could move to next
+ */
+static void find_reach(bot_t *bot, const game_t *game)
+{
+  bitboard_clear(&bot->reach, false);
+  for (int i = 0; i < game->num_players; i++)
+  {
+    const player_t *other = &game->players[i];
+    if (i != bot->player && other->alive)
+    {
+      bitboard_set(&bot->reach, other->row, other->col);
+    }
+  }
+  bitboard_grow(&game->occupied, &bot->reach);
+}
+
+/**
+ * Count the cells a move would claim in a Voronoi partition of the board: the empty cells this
+ * bot can reach strictly before any other player. Territory is grown one layer at a time for the
+ * bot and for everyone else at once, and ties go to the other players.
+ * \param   row       The cell the bot would move to
+ * \param   col
+ * \param   deadline  Stop early once time_ns passes this
+ * \param   finished  Set to false if the deadline cut the partition short
+ */
+static int voronoi_territory(bot_t *bot, const game_t *game, int row, int col, uint64_t deadline,
+                             bool *finished)
+{
+  bitboard_clear(&bot->mine, false);
+  bitboard_set(&bot->mine, row, col);
+  bitboard_copy(&bot->theirs, &bot->reach);
+  bitboard_reset(&bot->theirs, row, col);
+
+  bitboard_copy(&bot->blocked, &game->occupied);
+  bitboard_or(&bot->blocked, &bot->mine);
+  bitboard_or(&bot->blocked, &bot->theirs);
+
+  int territory = 1;
+  for (;;)
+  {
+    if (time_ns() > deadline)
+    {
+      *finished = false;
+      return territory;
+    }
+
+    // Growing against the blocked cells leaves only the new layer
+    bitboard_copy(&bot->frontier_mine, &bot->mine);
+    bitboard_grow(&bot->blocked, &bot->frontier_mine);
+    bitboard_copy(&bot->frontier_theirs, &bot->theirs);
+    bitboard_grow(&bot->blocked, &bot->frontier_theirs);
+    bitboard_andnot(&bot->frontier_mine, &bot->frontier_theirs);
+
+    int gained = bitboard_count(&bot->frontier_mine);
+    if (gained == 0)
+    {
+      return territory;
+    }
+    territory += gained;
+
+    bitboard_or(&bot->mine, &bot->frontier_mine);
+    bitboard_or(&bot->theirs, &bot->frontier_theirs);
+    bitboard_or(&bot->blocked, &bot->frontier_mine);
+    bitboard_or(&bot->blocked, &bot->frontier_theirs);
+  }
+}
+
+/**
+ * Choose a move once no other player can reach the bot's area. Returns the chosen direction.
+ * \param   deadline  Stop measuring areas once time_ns passes this
+ * \param   finished  Set to false if the deadline cut a measurement short
+ */
+static int steer_separated(bot_t *bot, const game_t *game, const int *dirs, const int *rows,
+                           const int *cols, const bool *open, uint64_t deadline, bool *finished)
+{
+  const player_t *p = &game->players[bot->player];
+  int best = -1;
+  int best_area = -1;
+  int best_walls = -1;
+
+  if (!may_split(&game->occupied, p->row, p->col))
+  {
+    // Every open move leads to the same area, one cell smaller than before
+    for (int i = 0; i < 3; i++)
+    {
+      int walls = open[i] ? count_walls(&game->occupied, rows[i], cols[i]) : -1;
+      if (walls > best_walls)
+      {
+        best = i;
+        best_walls = walls;
+      }
+    }
+    bot->area--;
+  }
+  else
+  {
+    // The last move may have cut the area in pieces, so measure each one again. Out of time, a
+    // move is taken to keep the area the bot had.
+    for (int i = 0; i < 3; i++)
+    {
+      if (!open[i])
+      {
+        continue;
+      }
+      int area = bot->area;
+      if (*finished)
+      {
+        int filled = bitboard_flood_fill_until(&game->occupied, rows[i], cols[i], &bot->region[i],
+                                               deadline, finished);
+        area = *finished ? filled : area;
+      }
+      int walls = count_walls(&game->occupied, rows[i], cols[i]);
+      if (area > best_area || (area == best_area && walls > best_walls))
+      {
+        best = i;
+        best_area = area;
+        best_walls = walls;
+      }
+    }
+    bot->area = best_area;
+  }
+  return best >= 0 ? dirs[best] : dirs[0];
+}
+
+/**
+ * Bring the area the bot chose at its last decision up to date by taking out the cells filled
+ * since. Trails never go away, so nothing else can have changed.
+ * \return  true if none of the filled cells could have split the area, so it is still all one
+ *          piece and bot->known is exactly what a flood fill would find
+ */
+static bool update_known(bot_t *bot, const game_t *game)
+{
+  if (!bot->have_known)
+  {
+    return false;
+  }
+  bitboard_copy(&bot->filled, &bot->known);
+  bitboard_and(&bot->filled, &game->occupied);
+  bitboard_andnot(&bot->known, &game->occupied);
+  bot->known_area -= bitboard_count(&bot->filled);
+
+  // Fill the cells back in one at a time, each checked against the board as it was before it:
+  // a single cell that cannot split the area leaves it in one piece, so neither can all of them.
+  // Checking each against the final board instead would miss two cells cutting a corridor.
+  bitboard_copy(&bot->blocked, &game->occupied);
+  bitboard_andnot(&bot->blocked, &bot->filled);
+  const bitboard_t *filled = &bot->filled;
+  for (int r = 0; r < filled->height; r++)
+  {
+    const uint64_t *words = bitboard_row(filled, r);
+    for (int w = 0; w < filled->row_words; w++)
+    {
+      for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1)
+      {
+        int col = w * 64 + __builtin_ctzll(bits);
+        if (may_split(&bot->blocked, r, col))
+        {
+          return false;
+        }
+        bitboard_set(&bot->blocked, r, col);
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Choose a move while other players can still reach the bot's area. Returns the chosen direction.
+ * \param   deadline  Stop measuring areas and territory once time_ns passes this
+ * \param   finished  Set to false if the deadline cut a measurement short
+ */
+static int steer_contested(bot_t *bot, const game_t *game, const int *dirs, const int *rows,
+                           const int *cols, const bool *open, uint64_t deadline, bool *finished)
+{
+  find_reach(bot, game);
+
+  // Usually nothing filled since the last decision can have split the bot's area, and every move
+  // into it still reaches all of it. A move elsewhere (the bot may not have moved yet, having
+  // turned to a slower direction) is measured as usual. Areas only shrink if trails never fade.
+  bool lasting = game->trail_length == 0;
+  bool whole = lasting && update_known(bot, game);
+
+  int area[3] = {0, 0, 0};
+  bool separated[3] = {false, false, false};
+  bool exact[3] = {false, false, false}; // the area was measured in full
+  long best_score = -1;
+  int best = -1;
+  for (int i = 0; i < 3; i++)
+  {
+    if (!open[i])
+    {
+      continue;
+    }
+
+    // Moves that land in the same piece of the board reach the same area
+    int same = -1;
+    for (int j = 0; j < i; j++)
+    {
+      if (open[j] && bitboard_test(&bot->region[j], rows[i], cols[i]))
+      {
+        same = j;
+      }
+    }
+    if (same >= 0)
+    {
+      area[i] = area[same];
+      exact[i] = exact[same];
+      bitboard_copy(&bot->region[i], &bot->region[same]);
+    }
+    else if (whole && bitboard_test(&bot->known, rows[i], cols[i]))
+    {
+      area[i] = bot->known_area;
+      exact[i] = true;
+      bitboard_copy(&bot->region[i], &bot->known);
+    }
+    else if (*finished)
+    {
+      area[i] = bitboard_flood_fill_until(&game->occupied, rows[i], cols[i], &bot->region[i],
+                                          deadline, finished);
+      exact[i] = *finished;
+    }
+    if (!exact[i] && same < 0)
+    {
+      // Out of time: the move is worth the area the bot knew of, if it leads there
+      if (bot->have_known && bitboard_test(&bot->known, rows[i], cols[i]))
+      {
+        area[i] = bot->known_area;
+        bitboard_copy(&bot->region[i], &bot->known);
+      }
+      else
+      {
+        area[i] = 1;
+        bitboard_clear(&bot->region[i], false);
+        bitboard_set(&bot->region[i], rows[i], cols[i]);
+      }
+    }
+    separated[i] = lasting && exact[i] && !bitboard_intersects(&bot->region[i], &bot->reach);
+
+    // A move is worth its area, plus the part of it this bot gets to first. Out of time, fall back
+    // to the area alone.
+    int territory = area[i];
+    if (!separated[i] && *finished)
+    {
+      territory = voronoi_territory(bot, game, rows[i], cols[i], deadline, finished);
+    }
+    else if (!separated[i])
+    {
+      territory = 0;
+    }
+    long score = area[i] + 2L * territory;
+
+    // Someone else could move into the same cell, which kills both
+    if (bitboard_test(&bot->reach, rows[i], cols[i]))
+    {
+      score /= 2;
+    }
+
+    if (score > best_score)
+    {
+      best = i;
+      best_score = score;
+    }
+  }
+
+  if (best < 0)
+  {
+    return dirs[0];
+  }
+  if (separated[best])
+  {
+    bot->separated = true;
+    bot->area = area[best];
+  }
+
+  // Remember the chosen area for the next decision, if it is known in full
+  bot->have_known = exact[best];
+  if (exact[best])
+  {
+    bitboard_copy(&bot->known, &bot->region[best]);
+    bot->known_area = area[best];
+  }
+  return dirs[best];
+}
+
+/**
+ * Choose a move in a two-player game by searching ahead. Returns the chosen direction.
+ * \param   deadline  When the whole decision must be made by
+ * \param   finished  Set to false if the deadline cut the check for separation short
+ */
+static int steer_search(bot_t *bot, const game_t *game, const int *dirs, const int *rows,
+                        const int *cols, const bool *open, uint64_t deadline, bool *finished)
+{
+  // Once the opponent can no longer get into the bot's area there is nothing left to search for,
+  // unless fading trails open it up again. This is checked before searching so that a search
+  // overrunning the deadline cannot starve it.
+  find_reach(bot, game);
+  bool cut_off = false;
+  for (int i = 0; i < 3 && game->trail_length == 0; i++)
+  {
+    if (!open[i])
+    {
+      continue;
+    }
+    int area = bitboard_flood_fill_until(&game->occupied, rows[i], cols[i], &bot->region[i],
+                                         deadline, finished);
+    cut_off = *finished && !bitboard_intersects(&bot->region[i], &bot->reach);
+    if (!cut_off)
+    {
+      break;
+    }
+    bot->area = area;
+  }
+  if (cut_off)
+  {
+    bot->separated = true;
+    return steer_separated(bot, game, dirs, rows, cols, open, deadline, finished);
+  }
+
+  search_result_t result;
+  uint64_t now = time_ns();
+  uint64_t left = deadline > now ? deadline - now : 0;
+  search_run(bot->search, game, bot->player, left, &result);
+  bot->stats.searches++;
+  bot->stats.search_ns += result.elapsed_ns;
+  bot->stats.nodes += result.nodes;
+  bot->stats.depth_total += result.depth;
+  return result.dir;
+}
+
+/**
+ * Choose the bot's next direction and steer its player. Call this when game_move_due says the
+ * player is about to move.
+ */
+void bot_steer(bot_t *bot, game_t *game)
+{
+  uint64_t start = time_ns();
+  const player_t *p = &game->players[bot->player];
+
+  // The three directions that don't reverse: straight, right and left
+  int dirs[3] = {p->dir, (p->dir + 1) % 4, (p->dir + 3) % 4};
+  int rows[3];
+  int cols[3];
+  bool open[3];
+  for (int i = 0; i < 3; i++)
+  {
+    rows[i] = p->row + dir_rows[dirs[i]];
+    cols[i] = p->col + dir_cols[dirs[i]];
+    open[i] = !bitboard_test(&game->occupied, rows[i], cols[i]);
+  }
+
+  uint64_t deadline = start + bot->budget - bot->budget / BOT_MARGIN_FRACTION;
+  bool finished = true;
+  int dir;
+  if (bot->separated)
+  {
+    dir = steer_separated(bot, game, dirs, rows, cols, open, deadline, &finished);
+  }
+  else if (bot->search != NULL && game->num_players == 2)
+  {
+    dir = steer_search(bot, game, dirs, rows, cols, open, deadline, &finished);
+  }
+  else
+  {
+    dir = steer_contested(bot, game, dirs, rows, cols, open, deadline, &finished);
+  }
+  game_steer(game, bot->player, dir);
+
+  uint64_t elapsed = time_ns() - start;
+  bot->stats.decisions++;
+  bot->stats.total_ns += elapsed;
+  if (elapsed > bot->stats.max_ns)
+  {
+    bot->stats.max_ns = elapsed;
+  }
+  if (elapsed > bot->budget)
+  {
+    bot->stats.over_budget++;
+  }
+}
+
+/**
+ * Add one set of latency statistics to another
+ */
+void bot_add_stats(bot_stats_t *total, const bot_stats_t *stats)
+{
+  total->decisions += stats->decisions;
+  total->total_ns += stats->total_ns;
+  total->over_budget += stats->over_budget;
+  total->searches += stats->searches;
+  total->search_ns += stats->search_ns;
+  total->nodes += stats->nodes;
+  total->depth_total += stats->depth_total;
+  if (stats->max_ns > total->max_ns)
+  {
+    total->max_ns = stats->max_ns;
+  }
+}
+
+/**
+ * Print decision latency statistics
+ * \param   label   Which bot or bots the statistics are for
+ */
+void bot_report(const bot_stats_t *stats, const char *label, FILE *out)
+{
+  if (stats->decisions == 0)
+  {
+    return;
+  }
+  fprintf(out,
+          "%s: %llu decisions, mean %.1f us, max %.1f us, budget %.1f us, %llu over budget\n",
+          label, (unsigned long long)stats->decisions,
+          stats->total_ns / 1000.0 / stats->decisions, stats->max_ns / 1000.0,
+          BOT_BUDGET_NS / 1000.0, (unsigned long long)stats->over_budget);
+  if (stats->searches > 0)
+  {
+    fprintf(out, "%s: %llu searches, mean depth %.1f, %.0f nodes/s\n", label,
+            (unsigned long long)stats->searches, (double)stats->depth_total / stats->searches,
+            stats->nodes * 1e9 / stats->search_ns);
+  }
+}
@@ -0,0 +1,128 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bitboard.h"
+#include "game.h"
+#include "search.h"
+
+// Each decision must finish within this fraction of player_HORIZONTAL_INTERVAL
+#define BOT_BUDGET_FRACTION 50
+
+// Decision time allowed per move, in nanoseconds
+#define BOT_BUDGET_NS ((uint64_t)player_HORIZONTAL_INTERVAL * 1000000 / BOT_BUDGET_FRACTION)
+
+// Decision latency statistics
+typedef struct bot_stats
+{
+  uint64_t decisions;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t over_budget; // decisions that took longer than the budget
+
+  // Decisions made by alpha-beta search (see bot_use_search)
+  uint64_t searches;
+  uint64_t search_ns;
+  uint64_t nodes;
+  uint64_t depth_total;
+} bot_stats_t;
+
+/**
+ * A computer-controlled player.
+ *
+ * Before each move the bot scores going straight, left and right. A move is worth the empty area
+ * reachable from it (a flood fill) plus, while other players can still reach that area, the part
+ * of it the bot would get to first (a Voronoi partition grown one layer at a time from every head).
+ *
+ * The bot updates what it knew after its previous move instead of starting over. Unless trails
+ * fade, they never go away, so its area now is the area it chose last time less the cells filled
+ * since; unless one of those cells could have split it in two, that is all the flood fill would
+ * find. Once no other player can reach its area, that stays true for the rest of the round. From
+ * then on only the bot's own moves change its area, so it skips the Voronoi step and keeps the
+ * area size up to date. It only flood fills again when a move could split the area in two. With
+ * fading trails every decision measures the board afresh.
+ *
+ * Every flood fill and Voronoi partition gives up at the decision's deadline, which comes early
+ * enough to leave time to finish up. A move the bot ran out of time to measure is scored from the
+ * area it knew after its previous move.
+ *
+ * In a two-player game the bot can instead look ahead with an alpha-beta search (see search.h)
+ * until it is separated from its opponent.
+ */
+typedef struct bot
+{
+  int player;       // index of the player this bot steers
+  uint64_t budget;  // nanoseconds allowed per decision
+
+  bool separated;   // no other player can reach this bot's area any more
+  int area;         // empty cells reachable from the bike, once separated
+
+  // The area the bot chose at its last contested decision, as it was then, if it was measured in
+  // full
+  bitboard_t known;
+  int known_area;
+  bool have_known;
+
+  // Scratch space
+  bitboard_t region[3];       // area reachable from each candidate move
+  bitboard_t reach;           // cells other players can move to next
+  bitboard_t mine;            // Voronoi territory of this bot so far
+  bitboard_t theirs;          // Voronoi territory of everyone else so far
+  bitboard_t blocked;         // occupied or already claimed cells
+  bitboard_t frontier_mine;   // cells this bot claims in the current layer
+  bitboard_t frontier_theirs; // cells everyone else claims in the current layer
+  bitboard_t filled;          // cells of the known area filled since it was measured
+
+  search_t *search; // look-ahead search for two-player games, or NULL
+
+  bot_stats_t stats;
+} bot_t;
+
+/**
+ * Set up a bot for a player
+ * \param   bot     The bot to initialize
+ * \param   game    The game the bot plays in
+ * \param   player  The index of the player to steer
+ */
+void bot_init(bot_t *bot, const game_t *game, int player);
+
+/**
+ * Make the bot choose its moves by alpha-beta search while it shares its area with the opponent.
+ * Only two-player games are searched; with more players the bot keeps its usual evaluation.
+ * \param   bot      The bot to update
+ * \param   game     The game the bot plays in
+ * \param   threads  The number of threads each search runs on
+ */
+void bot_use_search(bot_t *bot, const game_t *game, int threads);
+
+/**
+ * Release the memory owned by a bot
+ */
+void bot_free(bot_t *bot);
+
+/**
+ * Forget everything learned about the last round. Latency statistics are kept.
+ */
+void bot_reset(bot_t *bot);
+
+/**
+ * Choose the bot's next direction and steer its player. Call this when game_move_due says the
+ * player is about to move.
+ */
+void bot_steer(bot_t *bot, game_t *game);
+
+/**
+ * Add one set of latency statistics to another
+ */
+void bot_add_stats(bot_stats_t *total, const bot_stats_t *stats);
+
+/**
+ * Print decision latency statistics
+ * \param   label   Which bot or bots the statistics are for
+ */
+void bot_report(const bot_stats_t *stats, const char *label, FILE *out);
+
+#endif
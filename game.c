@@ -0,0 +1,395 @@
+#include "game.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Check a configuration before starting a game with it
+ * \param   config  The configuration to check
+ * \return          NULL if the configuration is usable, otherwise a message explaining why not
+ */
+const char *game_config_error(const game_config_t *config)
+{
+  if (config->width > MAX_BOARD_SIDE || config->height > MAX_BOARD_SIDE)
+  {
+    return "the board can be at most 65535 cells on a side";
+  }
+  if ((int64_t)config->width * config->height > INT_MAX)
+  {
+    return "the board has too many cells";
+  }
+  return game_rules_error(config);
+}
+
+/**
+ * Check the parts of a configuration that do not depend on how the board is stored
+ * \param   config  The configuration to check
+ * \return          NULL if the configuration is usable, otherwise a message explaining why not
+ */
+const char *game_rules_error(const game_config_t *config)
+{
+  if (config->num_players < MIN_PLAYERS || config->num_players > MAX_PLAYERS)
+  {
+    return "the number of players must be between 2 and 64";
+  }
+  if (config->height < 5)
+  {
+    return "the board must be at least 5 rows tall";
+  }
+
+  // Players start in two rows, one on each edge, with at least one empty column between them
+  int per_row = (config->num_players + 1) / 2;
+  if (config->width < 2 * per_row + 1)
+  {
+    return "the board is too narrow for that many players";
+  }
+  if (config->trail_length != 0 && config->trail_length < MIN_TRAIL_TICKS)
+  {
+    return "trails must last at least as long as a bike takes to move";
+  }
+  return NULL;
+}
+
+/**
+ * Allocate the board for a new game and put the players at their starting positions
+ * \param   game    The game to initialize
+ * \param   config  A configuration accepted by game_config_error
+ */
+void game_init(game_t *game, const game_config_t *config)
+{
+  game->width = config->width;
+  game->height = config->height;
+  game->num_players = config->num_players;
+  game->cells = malloc((size_t)game->width * game->height);
+  game->trail_length = config->trail_length;
+  game->stamps = NULL;
+  game->writes = NULL;
+  game->write_capacity = 0;
+  if (game->trail_length > 0)
+  {
+    // Writes only expire once trail_length ticks have passed, and each tick writes at most two
+    // cells per player. A cell can't be written again until its trail fades, so no more than two
+    // writes per cell are waiting either.
+    size_t area = (size_t)game->width * game->height;
+    size_t lasting = 2 * (size_t)game->num_players * ((size_t)game->trail_length + 1);
+    game->write_capacity = lasting < 2 * area ? lasting : 2 * area;
+    game->stamps = malloc(sizeof(uint32_t) * area);
+    game->writes = malloc(sizeof(trail_write_t) * game->write_capacity);
+  }
+  if (game->cells == NULL ||
+      (game->trail_length > 0 && (game->stamps == NULL || game->writes == NULL)))
+  {
+    perror("malloc");
+    exit(2);
+  }
+  bitboard_init(&game->occupied, game->width, game->height, true);
+  game->snapshot = NULL;
+  game_reset(game);
+}
+
+/**
+ * Release the memory owned by a game (but not its snapshot)
+ */
+void game_free(game_t *game)
+{
+  free(game->cells);
+  free(game->stamps);
+  free(game->writes);
+  game->cells = NULL;
+  game->stamps = NULL;
+  game->writes = NULL;
+  bitboard_free(&game->occupied);
+}
+
+/**
+ * Copy the state of one game into another of the same size, e.g. to save it and restore it later.
+ * The copy's snapshot is left alone and every cell counts as changed.
+ * \param   dst     A game initialized with the same configuration as src
+ * \param   src     The game to copy
+ */
+void game_copy(game_t *dst, const game_t *src)
+{
+  memcpy(dst->cells, src->cells, (size_t)src->width * src->height);
+  if (src->stamps != NULL)
+  {
+    memcpy(dst->stamps, src->stamps, sizeof(uint32_t) * src->width * src->height);
+    for (size_t i = 0; i < src->num_writes; i++)
+    {
+      dst->writes[i] = src->writes[(src->first_write + i) % src->write_capacity];
+    }
+    dst->first_write = 0;
+    dst->num_writes = src->num_writes;
+  }
+  bitboard_copy(&dst->occupied, &src->occupied);
+  memcpy(dst->players, src->players, sizeof(player_t) * src->num_players);
+  dst->tick = src->tick;
+  dst->num_changed = 0;
+  dst->changed_all = true;
+}
+
+/**
+ * Remember a changed cell for the next game_publish call
+ */
+static void mark_changed(game_t *game, uint32_t index)
+{
+  if (game->num_changed < MAX_CHANGED_CELLS)
+  {
+    game->changed[game->num_changed++] = index;
+  }
+  else
+  {
+    game->changed_all = true;
+  }
+}
+
+/**
+ * Write a board cell and remember it for the next game_publish call
+ * \param   game    The game to update
+ * \param   row     The board row of the cell
+ * \param   col     The board column of the cell
+ * \param   value   The new contents of the cell
+ */
+static void set_cell(game_t *game, int row, int col, uint8_t value)
+{
+  uint32_t index = (uint32_t)row * game->width + col;
+  game->cells[index] = value;
+  if (game->stamps != NULL)
+  {
+    game->stamps[index] = game->tick;
+    size_t last = (game->first_write + game->num_writes++) % game->write_capacity;
+    game->writes[last] = (trail_write_t){index, game->tick};
+  }
+  if (value != CELL_EMPTY)
+  {
+    bitboard_set(&game->occupied, row, col);
+  }
+  mark_changed(game, index);
+}
+
+/**
+ * Clear the cells whose trails have faded by this tick. Writes expire in the order they were made,
+ * so only the front of the queue is looked at; a write to a cell written again since is dropped.
+ */
+static void fade_trails(game_t *game)
+{
+  while (game->num_writes > 0)
+  {
+    trail_write_t *write = &game->writes[game->first_write];
+    if ((uint32_t)game->tick - write->tick <= (uint32_t)game->trail_length)
+    {
+      break;
+    }
+    if (game->stamps[write->index] == write->tick)
+    {
+      game->cells[write->index] = CELL_EMPTY;
+      bitboard_reset(&game->occupied, write->index / game->width, write->index % game->width);
+      mark_changed(game, write->index);
+    }
+    game->first_write = (game->first_write + 1) % game->write_capacity;
+    game->num_writes--;
+  }
+}
+
+/**
+ * Clear the board and put every player back at its starting position for a new round
+ */
+void game_reset(game_t *game)
+{
+  memset(game->cells, CELL_EMPTY, (size_t)game->width * game->height);
+  bitboard_clear(&game->occupied, true);
+  game->num_changed = 0;
+  game->changed_all = true;
+  game->first_write = 0;
+  game->num_writes = 0;
+  game->tick = 0; // before the bikes are placed, so their cells are stamped with the new round
+
+  // Odd-numbered players start along the bottom heading north and even-numbered players along
+  // the top heading south, each group spread evenly across the board
+  int bottom_count = (game->num_players + 1) / 2;
+  int top_count = game->num_players / 2;
+  for (int i = 0; i < game->num_players; i++)
+  {
+    player_t *p = &game->players[i];
+    if (i % 2 == 0)
+    {
+      p->row = game->height - 2;
+      p->col = (i / 2 + 1) * game->width / (bottom_count + 1);
+      p->dir = DIR_NORTH;
+    }
+    else
+    {
+      p->row = 1 + (game->height > 5);
+      p->col = (i / 2 + 1) * game->width / (top_count + 1);
+      p->dir = DIR_SOUTH;
+    }
+    p->updated_dir = p->dir;
+    p->elapsed = 0;
+    p->alive = true;
+    p->death = DEATH_NONE;
+    p->died_tick = 0;
+    set_cell(game, p->row, p->col, (i + 1) | CELL_BIKE);
+  }
+}
+
+/**
+ * Request a new direction for a player. Reversing onto the player's own trail is ignored.
+ * \param   game    The game to update
+ * \param   player  The index of the player (0 for player 1)
+ * \param   dir     One of the DIR_ values
+ */
+void game_steer(game_t *game, int player, int dir)
+{
+  player_t *p = &game->players[player];
+  if (dir != (p->dir + 2) % 4)
+  {
+    p->updated_dir = dir;
+  }
+}
+
+/**
+ * Get how long a player waits between moves in a direction
+ * \param   dir     One of the DIR_ values
+ * \return          The interval in milliseconds
+ */
+int game_move_interval(int dir)
+{
+  return (dir == DIR_NORTH || dir == DIR_SOUTH) ? player_VERTICAL_INTERVAL
+                                                : player_HORIZONTAL_INTERVAL;
+}
+
+/**
+ * Check whether a player will move on the next tick (if it keeps its requested direction)
+ * \param   game    The game to check
+ * \param   player  The index of the player (0 for player 1)
+ */
+bool game_move_due(const game_t *game, int player)
+{
+  const player_t *p = &game->players[player];
+  return p->alive && p->elapsed + SIM_TICK_INTERVAL >= game_move_interval(p->updated_dir);
+}
+
+/**
+ * Advance the game by one fixed time step. Each player accumulates time and moves once it has
+ * waited long enough for its direction (vertical moves are slower to deal with rectangular
+ * cursors). Every move due this tick is planned against the board as it was at the start of the
+ * tick, and collisions are resolved only after all moves are known, so the outcome never depends
+ * on which player is processed first. The work done scales with the number of players, not the
+ * size of the board.
+ * \return        -1 if the round continues, 0 for a draw, or the number of the winning player
+ */
+int game_tick(game_t *game)
+{
+  int num_moving = 0;
+  int moving[MAX_PLAYERS];
+  int new_row[MAX_PLAYERS];
+  int new_col[MAX_PLAYERS];
+  bool crashed[MAX_PLAYERS];
+  game->tick++;
+  if (game->writes != NULL)
+  {
+    fade_trails(game);
+  }
+
+  // Work out where each player that is due to move will go
+  for (int i = 0; i < game->num_players; i++)
+  {
+    player_t *p = &game->players[i];
+    if (!p->alive)
+    {
+      continue;
+    }
+
+    int dir = p->updated_dir;
+    int interval = game_move_interval(dir);
+    p->elapsed += SIM_TICK_INTERVAL;
+    if (p->elapsed < interval)
+    {
+      continue;
+    }
+    p->elapsed -= interval;
+    p->dir = dir;
+
+    moving[num_moving] = i;
+    new_row[num_moving] = p->row + (dir == DIR_SOUTH) - (dir == DIR_NORTH);
+    new_col[num_moving] = p->col + (dir == DIR_EAST) - (dir == DIR_WEST);
+    num_moving++;
+  }
+
+  // Players die if they hit a wall, a trail or bike that was already on the board, or another
+  // player moving into the same cell this tick. The occupancy bitboard has the walls set, so one
+  // bit test covers the first two.
+  for (int m = 0; m < num_moving; m++)
+  {
+    int row = new_row[m];
+    int col = new_col[m];
+    crashed[m] = bitboard_test(&game->occupied, row, col);
+    for (int n = 0; n < num_moving && !crashed[m]; n++)
+    {
+      crashed[m] = n != m && new_row[n] == row && new_col[n] == col;
+    }
+  }
+
+  // Apply the surviving moves: the old bike position becomes trail
+  for (int m = 0; m < num_moving; m++)
+  {
+    int i = moving[m];
+    player_t *p = &game->players[i];
+    if (crashed[m])
+    {
+      p->alive = false;
+      p->died_tick = game->tick;
+      int row = new_row[m];
+      int col = new_col[m];
+      if (row < 0 || row >= game->height || col < 0 || col >= game->width)
+      {
+        p->death = DEATH_WALL;
+      }
+      else if (bitboard_test(&game->occupied, row, col))
+      {
+        p->death = CELL_OWNER(game_cell(game, row, col)) == i + 1 ? DEATH_OWN_TRAIL : DEATH_TRAIL;
+      }
+      else
+      {
+        p->death = DEATH_HEAD_ON;
+      }
+      continue;
+    }
+    set_cell(game, p->row, p->col, i + 1);
+    p->row = new_row[m];
+    p->col = new_col[m];
+    set_cell(game, p->row, p->col, (i + 1) | CELL_BIKE);
+  }
+
+  int survivors = 0;
+  int last_survivor = 0;
+  for (int i = 0; i < game->num_players; i++)
+  {
+    if (game->players[i].alive)
+    {
+      survivors++;
+      last_survivor = i + 1;
+    }
+  }
+
+  if (survivors > 1)
+  {
+    return -1;
+  }
+  return survivors == 1 ? last_survivor : 0;
+}
+
+/**
+ * Copy the cells changed since the last call into the game's snapshot, if it has one
+ */
+void game_publish(game_t *game)
+{
+  if (game->snapshot != NULL && (game->changed_all || game->num_changed > 0))
+  {
+    snapshot_publish(game->snapshot, game->cells, game->changed_all ? NULL : game->changed,
+                     game->num_changed);
+  }
+  game->num_changed = 0;
+  game->changed_all = false;
+}
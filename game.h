@@ -0,0 +1,211 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitboard.h"
+#include "snapshot.h"
+
+// Defines used to track the player direction
+#define DIR_NORTH 0
+#define DIR_EAST 1
+#define DIR_SOUTH 2
+#define DIR_WEST 3
+
+// Game parameters
+#define player_HORIZONTAL_INTERVAL 75 // 100
+#define player_VERTICAL_INTERVAL 110
+#define SIM_TICK_INTERVAL 5 // every player interval must be a multiple of this
+#define SIM_MAX_CATCH_UP 4   // most ticks a paced simulation runs back to back after falling behind
+
+// Limits and defaults for the runtime configuration
+#define MIN_PLAYERS 2
+#define MAX_PLAYERS 64
+#define DEFAULT_PLAYERS 2
+#define DEFAULT_BOARD_WIDTH 100
+#define DEFAULT_BOARD_HEIGHT 31
+
+// Largest board side (pipe bots are sent each side in 16 bits); the area must also fit an int
+#define MAX_BOARD_SIDE 65535
+
+// Shortest trail that can fade: a bike must move on before its own cell fades under it
+#define MIN_TRAIL_TICKS (player_VERTICAL_INTERVAL / SIM_TICK_INTERVAL)
+
+/**
+ * Board cells are one byte each. Zero represents an empty cell. Otherwise the low bits hold the
+ * number of the player (1 to MAX_PLAYERS) whose trail fills the cell, and CELL_BIKE is set on the
+ * cell holding that player's bike.
+ *
+ * With fading trails, a cell is cleared once more than trail_length ticks have passed since it was
+ * last written. Cells are written in tick order, so the game keeps its writes in a queue and each
+ * tick clears the ones that have expired from its front: the cost per tick is the number of cells
+ * fading, however long the trails are. A faded cell changes like any other, so the occupancy
+ * bitboard, the snapshot and pipe bots all see it go.
+ */
+#define CELL_EMPTY 0
+#define CELL_BIKE 0x80
+#define CELL_OWNER(cell) ((cell) & 0x7f)
+
+// How a player's round ended
+#define DEATH_NONE 0      // still alive
+#define DEATH_WALL 1      // drove off the board
+#define DEATH_OWN_TRAIL 2 // hit its own trail
+#define DEATH_TRAIL 3     // hit another player's trail or bike
+#define DEATH_HEAD_ON 4   // moved into the same cell as another player on the same tick
+
+// Most cells a tick can change (each moving player writes its old and new position, and with
+// fading trails as many cells again can fade)
+#define MAX_CHANGED_CELLS (4 * MAX_PLAYERS)
+
+// Game size chosen at runtime
+typedef struct game_config
+{
+  int width;
+  int height;
+  int num_players;
+  int trail_length; // ticks a trail cell lasts, or 0 for trails that never fade
+} game_config_t;
+
+// Per-player parameters
+typedef struct player
+{
+  int row;
+  int col;
+  int dir;         // the direction of the last move
+  int updated_dir; // the direction to take on the next move
+  int elapsed;     // milliseconds accumulated toward the next move
+  bool alive;
+  int death;       // a DEATH_ value
+  int died_tick;   // the round's tick count when the player died
+} player_t;
+
+// A cell written while trails fade, and the tick it was written on
+typedef struct trail_write
+{
+  uint32_t index;
+  uint32_t tick;
+} trail_write_t;
+
+// The state of one match
+typedef struct game
+{
+  int width;
+  int height;
+  int num_players;
+
+  // width * height cells in row-major order, encoded as described above
+  uint8_t *cells;
+
+  // With fading trails, the tick each cell was last written, and a ring of every write not yet
+  // expired, oldest first; otherwise NULL
+  int trail_length;
+  uint32_t *stamps;
+  trail_write_t *writes;
+  size_t write_capacity;
+  size_t first_write;
+  size_t num_writes;
+
+  // One bit per non-empty cell, with the walls around the board set, for whole-board queries
+  bitboard_t occupied;
+
+  player_t players[MAX_PLAYERS];
+  int tick; // ticks played this round
+
+  // Cells written since the last game_publish call
+  uint32_t changed[MAX_CHANGED_CELLS];
+  int num_changed;
+  bool changed_all;
+
+  // Where game_publish copies the board for a renderer, or NULL if nothing draws this game
+  snapshot_t *snapshot;
+} game_t;
+
+/**
+ * Check a configuration before starting a game with it
+ * \param   config  The configuration to check
+ * \return          NULL if the configuration is usable, otherwise a message explaining why not
+ */
+const char *game_config_error(const game_config_t *config);
+
+/**
+ * Check the parts of a configuration that do not depend on how the board is stored: the players,
+ * the smallest board they fit on and the trail length. game_config_error also checks the board
+ * fits in one array.
+ * \param   config  The configuration to check
+ * \return          NULL if the configuration is usable, otherwise a message explaining why not
+ */
+const char *game_rules_error(const game_config_t *config);
+
+/**
+ * Allocate the board for a new game and put the players at their starting positions
+ * \param   game    The game to initialize
+ * \param   config  A configuration accepted by game_config_error
+ */
+void game_init(game_t *game, const game_config_t *config);
+
+/**
+ * Release the memory owned by a game (but not its snapshot)
+ */
+void game_free(game_t *game);
+
+/**
+ * Copy the state of one game into another of the same size, e.g. to save it and restore it later.
+ * The copy's snapshot is left alone and every cell counts as changed.
+ * \param   dst     A game initialized with the same configuration as src
+ * \param   src     The game to copy
+ */
+void game_copy(game_t *dst, const game_t *src);
+
+/**
+ * Clear the board and put every player back at its starting position for a new round
+ */
+void game_reset(game_t *game);
+
+/**
+ * Request a new direction for a player. Reversing onto the player's own trail is ignored.
+ * \param   game    The game to update
+ * \param   player  The index of the player (0 for player 1)
+ * \param   dir     One of the DIR_ values
+ */
+void game_steer(game_t *game, int player, int dir);
+
+/**
+ * Get how long a player waits between moves in a direction
+ * \param   dir     One of the DIR_ values
+ * \return          The interval in milliseconds
+ */
+int game_move_interval(int dir);
+
+/**
+ * Check whether a player will move on the next tick (if it keeps its requested direction)
+ * \param   game    The game to check
+ * \param   player  The index of the player (0 for player 1)
+ */
+bool game_move_due(const game_t *game, int player);
+
+/**
+ * Advance the game by one SIM_TICK_INTERVAL time step
+ * \return        -1 if the round continues, 0 for a draw, or the number of the winning player
+ */
+int game_tick(game_t *game);
+
+/**
+ * Copy the cells changed since the last call into the game's snapshot, if it has one
+ */
+void game_publish(game_t *game);
+
+/**
+ * Get the contents of a board cell
+ * \param   game    The game to read
+ * \param   row     The board row of the cell
+ * \param   col     The board column of the cell
+ * \return          The encoded cell
+ */
+static inline uint8_t game_cell(const game_t *game, int row, int col)
+{
+  return game->cells[row * game->width + col];
+}
+
+#endif
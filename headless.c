@@ -0,0 +1,136 @@
+#include "headless.h"
+
+#include "util.h"
+
+// One in this many moves turns even when the way ahead is clear
+#define WANDER_TURN_CHANCE 16
+
+/**
+ * Pick a direction for a computer-controlled player: keep going straight, turning now and then,
+ * and turn away from anything directly ahead.
+ * \param   game    The game being played
+ * \param   player  The index of the player to steer
+ * \param   rng     Random generator state (see rng_next)
+ */
+void wander_steer(game_t *game, int player, uint64_t *rng)
+{
+  player_t *p = &game->players[player];
+  int options[3] = {p->dir, (p->dir + 1) % 4, (p->dir + 3) % 4};
+  bool open[3];
+  for (int i = 0; i < 3; i++)
+  {
+    int dir = options[i];
+    open[i] = !bitboard_test(&game->occupied, p->row + (dir == DIR_SOUTH) - (dir == DIR_NORTH),
+                             p->col + (dir == DIR_EAST) - (dir == DIR_WEST));
+  }
+
+  uint64_t r = rng_next(rng);
+  if (open[0] && r % WANDER_TURN_CHANCE != 0)
+  {
+    game_steer(game, player, options[0]);
+    return;
+  }
+
+  // Turn to a random open side, or keep going if there is none
+  int first = 1 + (int)((r >> 32) & 1);
+  int second = 3 - first;
+  if (open[first])
+  {
+    game_steer(game, player, options[first]);
+  }
+  else if (open[second])
+  {
+    game_steer(game, player, options[second]);
+  }
+  else
+  {
+    game_steer(game, player, options[0]);
+  }
+}
+
+/**
+ * Play one round from the starting positions as fast as possible. Nothing is drawn and nothing
+ * sleeps. With fading trails the round is a draw once it has lasted HEADLESS_FADING_ROUND_TRAILS
+ * trail lengths.
+ * \param   game    The game to play. It is reset first.
+ * \param   bots    The bot steering each player, or NULL for players steered by wander_steer
+ * \param   rng     Random generator state (see rng_next)
+ * \param   ticks   Incremented by the number of ticks the round lasted
+ * \param   replay  Records the round if not NULL
+ * \return          0 for a draw, otherwise the number of the winning player
+ */
+int headless_match(game_t *game, bot_t **bots, uint64_t *rng, uint64_t *ticks,
+                   replay_writer_t *replay)
+{
+  game_reset(game);
+  if (replay != NULL)
+  {
+    replay_start_round(replay, game);
+  }
+  for (int i = 0; i < game->num_players; i++)
+  {
+    if (bots[i] != NULL)
+    {
+      bot_reset(bots[i]);
+    }
+  }
+
+  int64_t max_ticks = game->trail_length > 0
+                        ? (int64_t)game->trail_length * HEADLESS_FADING_ROUND_TRAILS
+                        : INT64_MAX;
+  for (;;)
+  {
+    for (int i = 0; i < game->num_players; i++)
+    {
+      if (!game_move_due(game, i))
+      {
+        continue;
+      }
+      if (bots[i] != NULL)
+      {
+        bot_steer(bots[i], game);
+      }
+      else
+      {
+        wander_steer(game, i, rng);
+      }
+    }
+
+    if (replay != NULL)
+    {
+      replay_record_tick(replay, game);
+    }
+    int result = game_tick(game);
+    (*ticks)++;
+    if (result < 0 && game->tick >= max_ticks)
+    {
+      result = 0;
+    }
+    if (result >= 0)
+    {
+      if (replay != NULL)
+      {
+        replay_end_round(replay, result);
+      }
+      return result;
+    }
+  }
+}
+
+/**
+ * Print the totals of a batch of headless matches, including games per second
+ */
+void headless_report(const headless_stats_t *stats, int num_players, FILE *out)
+{
+  double seconds = stats->elapsed_ns / 1e9;
+  fprintf(out, "%d games, %llu ticks in %.3f s\n", stats->games,
+          (unsigned long long)stats->ticks, seconds);
+  fprintf(out, "%.0f games/s, %.0f ticks/s (%.0fx real time)\n", stats->games / seconds,
+          stats->ticks / seconds, stats->ticks * SIM_TICK_INTERVAL / 1000.0 / seconds);
+  bot_report(&stats->bots, "bot latency", out);
+  fprintf(out, "draws: %d\n", stats->wins[0]);
+  for (int i = 1; i <= num_players; i++)
+  {
+    fprintf(out, "player %d wins: %d\n", i, stats->wins[i]);
+  }
+}
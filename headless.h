@@ -0,0 +1,53 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bot.h"
+#include "game.h"
+#include "replay.h"
+
+// With fading trails the board never fills up, so a round that lasts this many trail lengths
+// ends in a draw
+#define HEADLESS_FADING_ROUND_TRAILS 64
+
+// Totals for a batch of headless matches
+typedef struct headless_stats
+{
+  int games;
+  uint64_t ticks;
+  int wins[MAX_PLAYERS + 1]; // wins[0] counts draws, wins[n] wins by player n
+  uint64_t elapsed_ns;
+  bot_stats_t bots; // decision latency of every bot
+} headless_stats_t;
+
+/**
+ * Pick a direction for a computer-controlled player: keep going straight, turning now and then,
+ * and turn away from anything directly ahead.
+ * \param   game    The game being played
+ * \param   player  The index of the player to steer
+ * \param   rng     Random generator state (see rng_next)
+ */
+void wander_steer(game_t *game, int player, uint64_t *rng);
+
+/**
+ * Play one round from the starting positions as fast as possible. Nothing is drawn and nothing
+ * sleeps. With fading trails the round is a draw once it has lasted HEADLESS_FADING_ROUND_TRAILS
+ * trail lengths.
+ * \param   game    The game to play. It is reset first.
+ * \param   bots    The bot steering each player, or NULL for players steered by wander_steer
+ * \param   rng     Random generator state (see rng_next)
+ * \param   ticks   Incremented by the number of ticks the round lasted
+ * \param   replay  Records the round if not NULL
+ * \return          0 for a draw, otherwise the number of the winning player
+ */
+int headless_match(game_t *game, bot_t **bots, uint64_t *rng, uint64_t *ticks,
+                   replay_writer_t *replay);
+
+/**
+ * Print the totals of a batch of headless matches, including games per second
+ */
+void headless_report(const headless_stats_t *stats, int num_players, FILE *out);
+
+#endif
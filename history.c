@@ -0,0 +1,909 @@
+#define _GNU_SOURCE
+
+#include "history.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BLOCK_MAGIC "TRONHB01"
+#define STATS_MAGIC "TRONHS01"
+#define MAGIC_SIZE 8
+#define BLOCK_HEADER_SIZE (MAGIC_SIZE + 16)
+#define STATS_HEADER_SIZE (MAGIC_SIZE + 48)
+
+// Players whose results against each other history_stats_report shows
+#define REPORT_HEAD_TO_HEAD 5
+
+// How history_stats_report describes each DEATH_ value
+static const char *const death_names[DEATH_HEAD_ON + 1] = {"survived", "into a wall",
+                                                           "on its own trail", "on a trail",
+                                                           "head-on"};
+
+/**
+ * Get the size of a block, padding included
+ */
+static size_t block_size(size_t matches, size_t slots, size_t names)
+{
+  size_t size = BLOCK_HEADER_SIZE + matches * (sizeof(uint32_t) + 2) +
+                slots * (sizeof(uint32_t) + sizeof(uint16_t) + 1) + names * (HISTORY_NAME_LEN + 1);
+  return (size + 7) & ~(size_t)7;
+}
+
+/**
+ * Copy a name into its fixed-size, NUL-padded form
+ */
+static void make_key(char key[HISTORY_NAME_LEN + 1], const char *name)
+{
+  memset(key, 0, HISTORY_NAME_LEN + 1);
+  for (int i = 0; i < HISTORY_NAME_LEN && name[i] != '\0'; i++)
+  {
+    key[i] = name[i];
+  }
+}
+
+/**
+ * Hash a name in its fixed-size form
+ */
+static uint32_t hash_key(const char key[HISTORY_NAME_LEN + 1])
+{
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < HISTORY_NAME_LEN + 1; i++)
+  {
+    hash = (hash ^ (uint8_t)key[i]) * 16777619u;
+  }
+  return hash ^ hash >> 16;
+}
+
+/**
+ * Allocate memory or exit
+ */
+static void *allocate(size_t size)
+{
+  void *memory = malloc(size);
+  if (memory == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  return memory;
+}
+
+/**
+ * Fill in a match record from a finished round
+ * \param   match   The record to fill in
+ * \param   game    The game, as game_tick left it at the end of the round
+ * \param   winner  The result game_tick returned
+ * \param   names   Each player's name
+ */
+void history_match_from_game(history_match_t *match, const game_t *game, int winner,
+                             const char *const *names)
+{
+  match->num_players = game->num_players;
+  match->winner = winner;
+  match->ticks = game->tick;
+  for (int i = 0; i < game->num_players; i++)
+  {
+    const player_t *p = &game->players[i];
+    match->names[i] = names[i];
+    // A player that crashed on a tick did not survive it; the survivors did
+    match->lasted[i] = p->alive ? game->tick : p->died_tick - 1;
+    match->deaths[i] = p->death;
+  }
+}
+
+/**
+ * Open a history file for appending, creating it if needed
+ * \return          false if it could not be opened (errno says why)
+ */
+bool history_writer_open(history_writer_t *writer, const char *path)
+{
+  writer->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (writer->fd < 0)
+  {
+    return false;
+  }
+  writer->matches = 0;
+  writer->slots = 0;
+  writer->ticks = allocate(HISTORY_BLOCK_MATCHES * sizeof(uint32_t));
+  writer->winners = allocate(HISTORY_BLOCK_MATCHES);
+  writer->counts = allocate(HISTORY_BLOCK_MATCHES);
+  writer->lasted = allocate(HISTORY_BLOCK_SLOTS * sizeof(uint32_t));
+  writer->players = allocate(HISTORY_BLOCK_SLOTS * sizeof(uint16_t));
+  writer->deaths = allocate(HISTORY_BLOCK_SLOTS);
+  writer->names = allocate(HISTORY_BLOCK_SLOTS * (HISTORY_NAME_LEN + 1));
+  writer->num_names = 0;
+  writer->name_slots = calloc(2 * HISTORY_BLOCK_SLOTS, sizeof(uint16_t));
+  writer->buffer = allocate(block_size(HISTORY_BLOCK_MATCHES, HISTORY_BLOCK_SLOTS,
+                                       HISTORY_BLOCK_SLOTS));
+  if (writer->name_slots == NULL)
+  {
+    perror("calloc");
+    exit(2);
+  }
+  return true;
+}
+
+/**
+ * Get a name's index in the block being collected, adding it if it is new
+ */
+static uint16_t block_name(history_writer_t *writer, const char *name)
+{
+  char key[HISTORY_NAME_LEN + 1];
+  make_key(key, name);
+  size_t mask = 2 * HISTORY_BLOCK_SLOTS - 1;
+  size_t slot = hash_key(key) & mask;
+  for (; writer->name_slots[slot] != 0; slot = (slot + 1) & mask)
+  {
+    uint16_t index = writer->name_slots[slot] - 1;
+    if (memcmp(writer->names[index], key, HISTORY_NAME_LEN + 1) == 0)
+    {
+      return index;
+    }
+  }
+  memcpy(writer->names[writer->num_names], key, HISTORY_NAME_LEN + 1);
+  writer->name_slots[slot] = ++writer->num_names;
+  return writer->num_names - 1;
+}
+
+/**
+ * Add a match to the block being collected, appending the block once it is full
+ * \return          false if a full block could not be written (errno says why)
+ */
+bool history_writer_add(history_writer_t *writer, const history_match_t *match)
+{
+  if (writer->slots + match->num_players > HISTORY_BLOCK_SLOTS && !history_writer_flush(writer))
+  {
+    return false;
+  }
+  int m = writer->matches++;
+  writer->ticks[m] = match->ticks;
+  writer->winners[m] = match->winner;
+  writer->counts[m] = match->num_players;
+  for (int i = 0; i < match->num_players; i++)
+  {
+    int s = writer->slots++;
+    writer->lasted[s] = match->lasted[i];
+    writer->players[s] = block_name(writer, match->names[i]);
+    writer->deaths[s] = match->deaths[i];
+  }
+  if (writer->matches == HISTORY_BLOCK_MATCHES)
+  {
+    return history_writer_flush(writer);
+  }
+  return true;
+}
+
+/**
+ * Append the matches collected so far
+ * \return          false if they could not be written (errno says why)
+ */
+bool history_writer_flush(history_writer_t *writer)
+{
+  if (writer->matches == 0)
+  {
+    return true;
+  }
+  size_t m = writer->matches;
+  size_t s = writer->slots;
+  size_t n = writer->num_names;
+  size_t size = block_size(m, s, n);
+
+  uint8_t *out = writer->buffer;
+  uint32_t counts[4] = {size, m, s, n};
+  memcpy(out, BLOCK_MAGIC, MAGIC_SIZE);
+  memcpy(out + MAGIC_SIZE, counts, sizeof(counts));
+  out += BLOCK_HEADER_SIZE;
+  memcpy(out, writer->ticks, m * sizeof(uint32_t));
+  out += m * sizeof(uint32_t);
+  memcpy(out, writer->lasted, s * sizeof(uint32_t));
+  out += s * sizeof(uint32_t);
+  memcpy(out, writer->players, s * sizeof(uint16_t));
+  out += s * sizeof(uint16_t);
+  memcpy(out, writer->winners, m);
+  out += m;
+  memcpy(out, writer->counts, m);
+  out += m;
+  memcpy(out, writer->deaths, s);
+  out += s;
+  memcpy(out, writer->names, n * (HISTORY_NAME_LEN + 1));
+  out += n * (HISTORY_NAME_LEN + 1);
+  memset(out, 0, writer->buffer + size - out);
+
+  writer->matches = 0;
+  writer->slots = 0;
+  writer->num_names = 0;
+  memset(writer->name_slots, 0, 2 * HISTORY_BLOCK_SLOTS * sizeof(uint16_t));
+
+  // One write, so blocks from concurrent writers never interleave
+  ssize_t written;
+  do
+  {
+    written = write(writer->fd, writer->buffer, size);
+  } while (written < 0 && errno == EINTR);
+  if (written >= 0 && (size_t)written != size)
+  {
+    errno = ENOSPC;
+    return false;
+  }
+  return written >= 0;
+}
+
+/**
+ * Append the matches collected so far and close the file
+ * \return          false if they could not be written (errno says why)
+ */
+bool history_writer_close(history_writer_t *writer)
+{
+  bool ok = history_writer_flush(writer);
+  ok = close(writer->fd) == 0 && ok;
+  free(writer->ticks);
+  free(writer->winners);
+  free(writer->counts);
+  free(writer->lasted);
+  free(writer->players);
+  free(writer->deaths);
+  free(writer->names);
+  free(writer->name_slots);
+  free(writer->buffer);
+  return ok;
+}
+
+/**
+ * Start with no matches
+ */
+void history_stats_init(history_stats_t *stats)
+{
+  memset(stats, 0, sizeof(history_stats_t));
+}
+
+/**
+ * Release the statistics' memory
+ */
+void history_stats_free(history_stats_t *stats)
+{
+  free(stats->players);
+  free(stats->player_slots);
+  free(stats->pairs);
+  free(stats->pair_slots);
+  history_stats_init(stats);
+}
+
+/**
+ * Find the hash table slot holding a player, or the free slot where it would go
+ */
+static size_t player_slot(const history_stats_t *stats, const char key[HISTORY_NAME_LEN + 1])
+{
+  size_t mask = stats->num_player_slots - 1;
+  for (size_t slot = hash_key(key) & mask;; slot = (slot + 1) & mask)
+  {
+    uint32_t index = stats->player_slots[slot];
+    if (index == 0 || memcmp(stats->players[index - 1].name, key, HISTORY_NAME_LEN + 1) == 0)
+    {
+      return slot;
+    }
+  }
+}
+
+/**
+ * Hash two player indices
+ */
+static uint32_t hash_pair(uint32_t a, uint32_t b)
+{
+  uint64_t key = ((uint64_t)a << 32 | b) * 0x9e3779b97f4a7c15ull;
+  return (uint32_t)(key >> 32);
+}
+
+/**
+ * Find the hash table slot holding a pair, or the free slot where it would go
+ */
+static size_t pair_slot(const history_stats_t *stats, uint32_t a, uint32_t b)
+{
+  size_t mask = stats->num_pair_slots - 1;
+  for (size_t slot = hash_pair(a, b) & mask;; slot = (slot + 1) & mask)
+  {
+    uint32_t index = stats->pair_slots[slot];
+    if (index == 0 || (stats->pairs[index - 1].a == a && stats->pairs[index - 1].b == b))
+    {
+      return slot;
+    }
+  }
+}
+
+/**
+ * (Re)build the player hash table with room for at least min_count players
+ */
+static void index_players(history_stats_t *stats, size_t min_count)
+{
+  size_t num_slots = 64;
+  while (num_slots < 2 * min_count)
+  {
+    num_slots *= 2;
+  }
+  free(stats->player_slots);
+  stats->player_slots = calloc(num_slots, sizeof(uint32_t));
+  if (stats->player_slots == NULL)
+  {
+    perror("calloc");
+    exit(2);
+  }
+  stats->num_player_slots = num_slots;
+  for (size_t i = 0; i < stats->num_players; i++)
+  {
+    stats->player_slots[player_slot(stats, stats->players[i].name)] = i + 1;
+  }
+}
+
+/**
+ * (Re)build the pair hash table with room for at least min_count pairs
+ */
+static void index_pairs(history_stats_t *stats, size_t min_count)
+{
+  size_t num_slots = 64;
+  while (num_slots < 2 * min_count)
+  {
+    num_slots *= 2;
+  }
+  free(stats->pair_slots);
+  stats->pair_slots = calloc(num_slots, sizeof(uint32_t));
+  if (stats->pair_slots == NULL)
+  {
+    perror("calloc");
+    exit(2);
+  }
+  stats->num_pair_slots = num_slots;
+  for (size_t i = 0; i < stats->num_pairs; i++)
+  {
+    stats->pair_slots[pair_slot(stats, stats->pairs[i].a, stats->pairs[i].b)] = i + 1;
+  }
+}
+
+/**
+ * Get a player's index, adding it if it is new
+ */
+static uint32_t add_player(history_stats_t *stats, const char key[HISTORY_NAME_LEN + 1])
+{
+  if (2 * (stats->num_players + 1) > stats->num_player_slots)
+  {
+    index_players(stats, 2 * (stats->num_players + 1));
+  }
+  size_t slot = player_slot(stats, key);
+  if (stats->player_slots[slot] != 0)
+  {
+    return stats->player_slots[slot] - 1;
+  }
+  if (stats->num_players == stats->player_capacity)
+  {
+    stats->player_capacity = stats->player_capacity > 0 ? 2 * stats->player_capacity : 64;
+    stats->players = realloc(stats->players, stats->player_capacity * sizeof(history_player_t));
+    if (stats->players == NULL)
+    {
+      perror("realloc");
+      exit(2);
+    }
+  }
+  history_player_t *player = &stats->players[stats->num_players];
+  memcpy(player->name, key, HISTORY_NAME_LEN + 1);
+  player->games = 0;
+  player->wins = 0;
+  player->draws = 0;
+  memset(player->deaths, 0, sizeof(player->deaths));
+  player->rating = HISTORY_INITIAL_RATING;
+  stats->player_slots[slot] = ++stats->num_players;
+  return stats->num_players - 1;
+}
+
+/**
+ * Get a pair's record, adding it if the players have not met before
+ */
+static history_pair_t *add_pair(history_stats_t *stats, uint32_t a, uint32_t b)
+{
+  if (2 * (stats->num_pairs + 1) > stats->num_pair_slots)
+  {
+    index_pairs(stats, 2 * (stats->num_pairs + 1));
+  }
+  size_t slot = pair_slot(stats, a, b);
+  if (stats->pair_slots[slot] != 0)
+  {
+    return &stats->pairs[stats->pair_slots[slot] - 1];
+  }
+  if (stats->num_pairs == stats->pair_capacity)
+  {
+    stats->pair_capacity = stats->pair_capacity > 0 ? 2 * stats->pair_capacity : 256;
+    stats->pairs = realloc(stats->pairs, stats->pair_capacity * sizeof(history_pair_t));
+    if (stats->pairs == NULL)
+    {
+      perror("realloc");
+      exit(2);
+    }
+  }
+  history_pair_t *pair = &stats->pairs[stats->num_pairs];
+  *pair = (history_pair_t){.a = a, .b = b};
+  stats->pair_slots[slot] = ++stats->num_pairs;
+  return pair;
+}
+
+/**
+ * Fold one match into the statistics
+ * \param   count   The number of players
+ * \param   winner  0 for a draw, otherwise the number of the winning player
+ * \param   ids     Each player's index
+ * \param   lasted  The ticks each player survived
+ * \param   deaths  How each player's round ended
+ */
+static void fold_match(history_stats_t *stats, int count, int winner, const uint32_t *ids,
+                       const uint32_t *lasted, const uint8_t *deaths)
+{
+  double surprise[MAX_PLAYERS] = {0};
+  for (int i = 0; i < count; i++)
+  {
+    history_player_t *p = &stats->players[ids[i]];
+    p->games++;
+    p->wins += winner == i + 1;
+    p->draws += winner == 0;
+    p->deaths[deaths[i] <= DEATH_HEAD_ON ? deaths[i] : DEATH_NONE]++;
+
+    // Every later player in the match is one result; ratings are as they were before the match
+    for (int j = i + 1; j < count; j++)
+    {
+      if (ids[i] == ids[j])
+      {
+        continue;
+      }
+      double score = lasted[i] > lasted[j] ? 1 : lasted[i] == lasted[j] ? 0.5 : 0;
+      double expected =
+          1 / (1 + pow(10, (stats->players[ids[j]].rating - p->rating) / 400));
+      surprise[i] += score - expected;
+      surprise[j] -= score - expected;
+
+      bool in_order = ids[i] < ids[j];
+      history_pair_t *pair = add_pair(stats, in_order ? ids[i] : ids[j], in_order ? ids[j] : ids[i]);
+      if (score == 0.5)
+      {
+        pair->draws++;
+      }
+      else if ((score == 1) == in_order)
+      {
+        pair->a_wins++;
+      }
+      else
+      {
+        pair->b_wins++;
+      }
+    }
+  }
+  for (int i = 0; count > 1 && i < count; i++)
+  {
+    stats->players[ids[i]].rating += HISTORY_ELO_K * surprise[i] / (count - 1);
+  }
+  stats->matches++;
+}
+
+/**
+ * Fold in one block's matches, using only the columns the statistics need
+ * \return          NULL on success, otherwise a message explaining what is wrong with the block
+ */
+static const char *fold_block(history_stats_t *stats, const uint8_t *block)
+{
+  uint32_t counts[4];
+  memcpy(counts, block + MAGIC_SIZE, sizeof(counts));
+  size_t m = counts[1];
+  size_t s = counts[2];
+  size_t n = counts[3];
+  const uint8_t *lasted_column = block + BLOCK_HEADER_SIZE + m * sizeof(uint32_t);
+  const uint16_t *players = (const uint16_t *)(lasted_column + s * sizeof(uint32_t));
+  const uint8_t *winners = (const uint8_t *)(players + s);
+  const uint8_t *player_counts = winners + m;
+  const uint8_t *deaths = player_counts + m;
+  const char(*names)[HISTORY_NAME_LEN + 1] = (const void *)(player_counts + m + s);
+
+  // Look each of the block's names up once
+  uint32_t *name_ids = allocate((n + 1) * sizeof(uint32_t));
+  for (size_t i = 0; i < n; i++)
+  {
+    char key[HISTORY_NAME_LEN + 1];
+    memcpy(key, names[i], HISTORY_NAME_LEN);
+    key[HISTORY_NAME_LEN] = '\0';
+    name_ids[i] = add_player(stats, key);
+  }
+
+  const char *error = NULL;
+  size_t slot = 0;
+  for (size_t i = 0; i < m && error == NULL; i++)
+  {
+    int count = player_counts[i];
+    if (count > MAX_PLAYERS || slot + count > s || winners[i] > count)
+    {
+      error = "a match has the wrong number of players";
+      break;
+    }
+    uint32_t ids[MAX_PLAYERS];
+    uint32_t lasted[MAX_PLAYERS];
+    memcpy(lasted, lasted_column + slot * sizeof(uint32_t), count * sizeof(uint32_t));
+    for (int j = 0; j < count; j++)
+    {
+      if (players[slot + j] >= n)
+      {
+        error = "a player's name is missing";
+        break;
+      }
+      ids[j] = name_ids[players[slot + j]];
+    }
+    if (error == NULL)
+    {
+      fold_match(stats, count, winners[i], ids, lasted, deaths + slot);
+    }
+    slot += count;
+  }
+  free(name_ids);
+  return error;
+}
+
+/**
+ * Fold in the matches added to a history since the statistics were last brought up to date
+ * \return          NULL on success, otherwise a message explaining what is wrong with the file
+ */
+const char *history_stats_update(history_stats_t *stats, const char *path)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return errno == ENOENT ? NULL : "the history could not be opened";
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return "the history could not be read";
+  }
+  size_t size = st.st_size;
+  if (size < stats->offset)
+  {
+    close(fd);
+    return "the history is shorter than the statistics saved for it";
+  }
+  if (size == stats->offset)
+  {
+    close(fd);
+    return NULL;
+  }
+  const uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    return "the history could not be mapped";
+  }
+  madvise((void *)map, size, MADV_SEQUENTIAL);
+
+  // Stop at a block still being written (or cut short by a crash); it is read next time
+  const char *error = NULL;
+  while (error == NULL && size - stats->offset >= BLOCK_HEADER_SIZE)
+  {
+    const uint8_t *block = map + stats->offset;
+    uint32_t counts[4];
+    memcpy(counts, block + MAGIC_SIZE, sizeof(counts));
+    if (memcmp(block, BLOCK_MAGIC, MAGIC_SIZE) != 0 ||
+        counts[0] != block_size(counts[1], counts[2], counts[3]))
+    {
+      error = "the history is not a match history";
+    }
+    else if (counts[0] > size - stats->offset)
+    {
+      break;
+    }
+    else
+    {
+      error = fold_block(stats, block);
+      stats->offset += counts[0];
+    }
+  }
+  munmap((void *)map, size);
+  return error;
+}
+
+/**
+ * Build the name of the file a history's statistics are saved in
+ * \return          false if the name does not fit
+ */
+static bool stats_file_name(char *buffer, size_t size, const char *path, const char *suffix)
+{
+  if (snprintf(buffer, size, "%s%s%s", path, HISTORY_STATS_SUFFIX, suffix) >= (int)size)
+  {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Check that a saved hash table's size could belong to a table of count entries: a power of two
+ * with room to spare, or no table for no entries
+ */
+static bool valid_table(uint64_t num_slots, uint64_t count)
+{
+  if (num_slots == 0)
+  {
+    return count == 0;
+  }
+  return (num_slots & (num_slots - 1)) == 0 && num_slots >= 2 * count && num_slots < 1ull << 32;
+}
+
+/**
+ * Load the statistics last saved for a history, if any, and fold in the matches added since
+ * \param   stats   Initialized statistics to replace
+ * \param   path    The history file
+ * \return          NULL on success, otherwise a message explaining what went wrong
+ */
+const char *history_stats_load(history_stats_t *stats, const char *path)
+{
+  history_stats_free(stats);
+  char name[4096];
+  if (!stats_file_name(name, sizeof(name), path, ""))
+  {
+    return "the statistics file's name is too long";
+  }
+  FILE *file = fopen(name, "rb");
+  if (file == NULL)
+  {
+    return history_stats_update(stats, path);
+  }
+
+  // The hash tables are saved too, so nothing has to be rehashed however many players there are
+  uint8_t header[STATS_HEADER_SIZE];
+  uint64_t fields[6];
+  bool ok = fread(header, 1, STATS_HEADER_SIZE, file) == STATS_HEADER_SIZE &&
+            memcmp(header, STATS_MAGIC, MAGIC_SIZE) == 0;
+  memcpy(fields, header + MAGIC_SIZE, sizeof(fields));
+  ok = ok && valid_table(fields[4], fields[2]) && valid_table(fields[5], fields[3]);
+  if (ok)
+  {
+    stats->matches = fields[0];
+    stats->offset = fields[1];
+    stats->num_players = stats->player_capacity = fields[2];
+    stats->num_pairs = stats->pair_capacity = fields[3];
+    stats->num_player_slots = fields[4];
+    stats->num_pair_slots = fields[5];
+    stats->players = allocate((fields[2] + 1) * sizeof(history_player_t));
+    stats->pairs = allocate((fields[3] + 1) * sizeof(history_pair_t));
+    stats->player_slots = allocate(fields[4] * sizeof(uint32_t));
+    stats->pair_slots = allocate(fields[5] * sizeof(uint32_t));
+    ok = fread(stats->players, sizeof(history_player_t), fields[2], file) == fields[2] &&
+         fread(stats->pairs, sizeof(history_pair_t), fields[3], file) == fields[3] &&
+         fread(stats->player_slots, sizeof(uint32_t), fields[4], file) == fields[4] &&
+         fread(stats->pair_slots, sizeof(uint32_t), fields[5], file) == fields[5];
+  }
+  fclose(file);
+
+  // Statistics that do not match the history are rebuilt from the start
+  struct stat st;
+  if (!ok || stat(path, &st) != 0 || (uint64_t)st.st_size < stats->offset)
+  {
+    history_stats_free(stats);
+  }
+  return history_stats_update(stats, path);
+}
+
+/**
+ * Save the statistics next to their history, replacing the last saved ones atomically
+ * \return          false if they could not be written (errno says why)
+ */
+bool history_stats_save(const history_stats_t *stats, const char *path)
+{
+  char name[4096];
+  char tmp[4096];
+  if (!stats_file_name(name, sizeof(name), path, "") ||
+      !stats_file_name(tmp, sizeof(tmp), path, ".tmp"))
+  {
+    return false;
+  }
+  FILE *file = fopen(tmp, "wb");
+  if (file == NULL)
+  {
+    return false;
+  }
+  uint8_t header[STATS_HEADER_SIZE];
+  uint64_t fields[6] = {stats->matches,     stats->offset,           stats->num_players,
+                        stats->num_pairs,   stats->num_player_slots, stats->num_pair_slots};
+  memcpy(header, STATS_MAGIC, MAGIC_SIZE);
+  memcpy(header + MAGIC_SIZE, fields, sizeof(fields));
+  bool ok = fwrite(header, 1, STATS_HEADER_SIZE, file) == STATS_HEADER_SIZE &&
+            fwrite(stats->players, sizeof(history_player_t), stats->num_players, file) ==
+                stats->num_players &&
+            fwrite(stats->pairs, sizeof(history_pair_t), stats->num_pairs, file) ==
+                stats->num_pairs &&
+            fwrite(stats->player_slots, sizeof(uint32_t), stats->num_player_slots, file) ==
+                stats->num_player_slots &&
+            fwrite(stats->pair_slots, sizeof(uint32_t), stats->num_pair_slots, file) ==
+                stats->num_pair_slots;
+
+  // The data has to be on disk before the rename replaces the old statistics
+  ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmp, name) != 0)
+  {
+    int error = errno;
+    unlink(tmp);
+    errno = error;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Find a player by name
+ * \return          The player's index, or -1 if it has played no matches
+ */
+long history_stats_find(const history_stats_t *stats, const char *name)
+{
+  if (stats->num_player_slots == 0)
+  {
+    return -1;
+  }
+  char key[HISTORY_NAME_LEN + 1];
+  make_key(key, name);
+  return (long)stats->player_slots[player_slot(stats, key)] - 1;
+}
+
+/**
+ * Get two players' results against each other
+ * \return          The pair, with a < b, or NULL if they have never met
+ */
+const history_pair_t *history_stats_pair(const history_stats_t *stats, uint32_t a, uint32_t b)
+{
+  if (stats->num_pair_slots == 0 || a == b)
+  {
+    return NULL;
+  }
+  uint32_t index = stats->pair_slots[pair_slot(stats, a < b ? a : b, a < b ? b : a)];
+  return index > 0 ? &stats->pairs[index - 1] : NULL;
+}
+
+/**
+ * Check whether one player ranks below another: a lower rating, or the same rating and a later
+ * first match
+ */
+static bool ranks_below(const history_stats_t *stats, uint32_t a, uint32_t b)
+{
+  double ra = stats->players[a].rating;
+  double rb = stats->players[b].rating;
+  return ra < rb || (ra == rb && a > b);
+}
+
+/**
+ * Move the heap entry at i down to its place, the lowest ranked player on top
+ */
+static void sift_down(const history_stats_t *stats, uint32_t *heap, size_t count, size_t i)
+{
+  for (;;)
+  {
+    size_t lowest = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    if (left < count && ranks_below(stats, heap[left], heap[lowest]))
+    {
+      lowest = left;
+    }
+    if (right < count && ranks_below(stats, heap[right], heap[lowest]))
+    {
+      lowest = right;
+    }
+    if (lowest == i)
+    {
+      return;
+    }
+    uint32_t swap = heap[i];
+    heap[i] = heap[lowest];
+    heap[lowest] = swap;
+    i = lowest;
+  }
+}
+
+/**
+ * Get the highest rated players
+ * \param   k       The most players wanted
+ * \param   top     Receives up to k player indices, best first
+ * \return          The number of players: k, or fewer if there are fewer
+ */
+size_t history_stats_top(const history_stats_t *stats, size_t k, uint32_t *top)
+{
+  // Keep the best k seen so far in a heap with the worst of them on top: O(n log k)
+  size_t count = 0;
+  for (uint32_t i = 0; i < stats->num_players && k > 0; i++)
+  {
+    if (count < k)
+    {
+      top[count++] = i;
+      if (count == k)
+      {
+        for (size_t j = k / 2; j-- > 0;)
+        {
+          sift_down(stats, top, count, j);
+        }
+      }
+    }
+    else if (ranks_below(stats, top[0], i))
+    {
+      top[0] = i;
+      sift_down(stats, top, count, 0);
+    }
+  }
+  if (count < k)
+  {
+    for (size_t j = count / 2; j-- > 0;)
+    {
+      sift_down(stats, top, count, j);
+    }
+  }
+
+  // Take the worst off the top one at a time, filling the list from the back
+  for (size_t n = count; n > 1; n--)
+  {
+    uint32_t worst = top[0];
+    top[0] = top[n - 1];
+    top[n - 1] = worst;
+    sift_down(stats, top, n - 1, 0);
+  }
+  return count;
+}
+
+/**
+ * Print the k highest rated players with their win rates, and how the best few fared against
+ * each other
+ */
+void history_stats_report(const history_stats_t *stats, size_t k, FILE *out)
+{
+  uint32_t *top = allocate((k + 1) * sizeof(uint32_t));
+  size_t count = history_stats_top(stats, k, top);
+  fprintf(out, "%llu matches, %zu players\n", (unsigned long long)stats->matches,
+          stats->num_players);
+  fprintf(out, "rank  %-*s  rating   games    wins  win rate  draws  usually dies\n",
+          HISTORY_NAME_LEN, "player");
+  for (size_t i = 0; i < count; i++)
+  {
+    const history_player_t *p = &stats->players[top[i]];
+    int usual = DEATH_WALL;
+    for (int d = DEATH_WALL; d <= DEATH_HEAD_ON; d++)
+    {
+      usual = p->deaths[d] > p->deaths[usual] ? d : usual;
+    }
+    fprintf(out, "%4zu  %-*s  %6.0f  %6u  %6u  %7.1f%%  %5u  %s\n", i + 1, HISTORY_NAME_LEN,
+            p->name, p->rating, p->games, p->wins, 100.0 * p->wins / p->games, p->draws,
+            p->deaths[usual] > 0 ? death_names[usual] : "-");
+  }
+
+  // Each row's wins-losses-draws against each column
+  size_t shown = count < REPORT_HEAD_TO_HEAD ? count : REPORT_HEAD_TO_HEAD;
+  if (shown > 1)
+  {
+    fprintf(out, "\nhead to head (row's wins-losses-draws against column)\n%-*s", HISTORY_NAME_LEN,
+            "");
+    for (size_t j = 0; j < shown; j++)
+    {
+      fprintf(out, "  %15.15s", stats->players[top[j]].name);
+    }
+    fputc('\n', out);
+    for (size_t i = 0; i < shown; i++)
+    {
+      fprintf(out, "%-*s", HISTORY_NAME_LEN, stats->players[top[i]].name);
+      for (size_t j = 0; j < shown; j++)
+      {
+        const history_pair_t *pair = history_stats_pair(stats, top[i], top[j]);
+        char cell[48] = "-";
+        if (pair != NULL)
+        {
+          bool first = pair->a == top[i];
+          snprintf(cell, sizeof(cell), "%u-%u-%u", first ? pair->a_wins : pair->b_wins,
+                   first ? pair->b_wins : pair->a_wins, pair->draws);
+        }
+        fprintf(out, "  %15s", cell);
+      }
+      fputc('\n', out);
+    }
+  }
+  free(top);
+}
@@ -0,0 +1,224 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "game.h"
+
+// Where the interactive game keeps its match history
+#define HISTORY_FILE "history.db"
+
+// Added to a history's path to name the file its statistics are saved in
+#define HISTORY_STATS_SUFFIX ".stats"
+
+// Longest player name, not counting the terminating NUL
+#define HISTORY_NAME_LEN 15
+
+// Most matches, and players over all of them, a writer collects before appending them as a block
+#define HISTORY_BLOCK_MATCHES 1024
+#define HISTORY_BLOCK_SLOTS 4096
+
+// Rating a new player starts with, and how far one match moves it
+#define HISTORY_INITIAL_RATING 1500.0
+#define HISTORY_ELO_K 32.0
+
+// One finished match, as handed to a writer
+typedef struct history_match
+{
+  int num_players;
+  int winner;     // 0 for a draw, otherwise the number of the winning player
+  uint32_t ticks; // how long the round lasted
+  const char *names[MAX_PLAYERS];
+  uint32_t lasted[MAX_PLAYERS]; // ticks each player survived
+  uint8_t deaths[MAX_PLAYERS];  // DEATH_ values
+} history_match_t;
+
+/**
+ * Collects matches and appends them to a history file a block at a time.
+ *
+ * The file is a series of self-contained blocks, stored by column so a reader only touches the
+ * columns it needs. A match has one player slot per player, and slots are in match order. The
+ * columns go from widest to narrowest, so each one stays aligned:
+ *
+ *   header    "TRONHB01", then as 4-byte counts: the block's size in bytes, its matches, its
+ *             player slots and the names it uses
+ *   ticks     each match's length in ticks, 4 bytes each
+ *   lasted    the ticks each slot's player survived, 4 bytes each
+ *   players   each slot's name as an index into the block's names, 2 bytes each
+ *   winners   each match's winner, 1 byte each (0 for a draw)
+ *   counts    each match's number of players, 1 byte each
+ *   deaths    how each slot's player died, a DEATH_ value, 1 byte each
+ *   names     HISTORY_NAME_LEN + 1 bytes each, padded with NULs
+ *
+ * followed by padding to a multiple of 8 bytes. Numbers are in native byte order.
+ *
+ * Each block goes to the file in one write() with O_APPEND, so any number of writers, in threads
+ * or processes, can share a file without locking. A block cut short by a crash is ignored.
+ */
+typedef struct history_writer
+{
+  int fd;
+
+  // The block being collected, a column at a time
+  int matches;
+  int slots;
+  uint32_t *ticks;
+  uint8_t *winners;
+  uint8_t *counts;
+  uint32_t *lasted;
+  uint16_t *players;
+  uint8_t *deaths;
+
+  // The block's names, with an open-addressed hash table of them (slot: index + 1, or 0 if free)
+  char (*names)[HISTORY_NAME_LEN + 1];
+  int num_names;
+  uint16_t *name_slots;
+
+  uint8_t *buffer; // the encoded block
+} history_writer_t;
+
+// A player's totals over every match folded into the statistics
+typedef struct history_player
+{
+  char name[HISTORY_NAME_LEN + 1];
+  uint32_t games;
+  uint32_t wins;
+  uint32_t draws;
+  uint32_t deaths[DEATH_HEAD_ON + 1]; // how its rounds ended, by DEATH_ value
+  double rating;                      // Elo
+} history_player_t;
+
+// Two players' results against each other; a is the lower player index
+typedef struct history_pair
+{
+  uint32_t a;
+  uint32_t b;
+  uint32_t a_wins; // matches where a outlasted b
+  uint32_t b_wins;
+  uint32_t draws;  // matches where they went out on the same tick
+} history_pair_t;
+
+/**
+ * Ratings, win rates and head-to-head records, kept up to date incrementally as matches are
+ * folded in one at a time.
+ *
+ * Every match counts as a result between each two of its players: whoever survived longer wins,
+ * and going out on the same tick is a draw. Each player's Elo rating moves by HISTORY_ELO_K
+ * times its total surprise over those results, divided by the number of opponents.
+ *
+ * The statistics can be saved along with how much of the history they include, so bringing them
+ * up to date only reads the blocks added since: querying them costs the same however long the
+ * history gets. Their hash tables are saved with them, so loading them never rehashes anything.
+ */
+typedef struct history_stats
+{
+  uint64_t matches;
+  uint64_t offset; // bytes of the history file folded in
+
+  history_player_t *players;
+  size_t num_players;
+  size_t player_capacity;
+  uint32_t *player_slots; // names to player indices: index + 1, or 0 if free
+  size_t num_player_slots;
+
+  history_pair_t *pairs;
+  size_t num_pairs;
+  size_t pair_capacity;
+  uint32_t *pair_slots; // (a, b) to pair indices: index + 1, or 0 if free
+  size_t num_pair_slots;
+} history_stats_t;
+
+/**
+ * Fill in a match record from a finished round
+ * \param   match   The record to fill in
+ * \param   game    The game, as game_tick left it at the end of the round
+ * \param   winner  The result game_tick returned
+ * \param   names   Each player's name
+ */
+void history_match_from_game(history_match_t *match, const game_t *game, int winner,
+                             const char *const *names);
+
+/**
+ * Open a history file for appending, creating it if needed
+ * \return          false if it could not be opened (errno says why)
+ */
+bool history_writer_open(history_writer_t *writer, const char *path);
+
+/**
+ * Add a match to the block being collected, appending the block once it is full
+ * \return          false if a full block could not be written (errno says why)
+ */
+bool history_writer_add(history_writer_t *writer, const history_match_t *match);
+
+/**
+ * Append the matches collected so far
+ * \return          false if they could not be written (errno says why)
+ */
+bool history_writer_flush(history_writer_t *writer);
+
+/**
+ * Append the matches collected so far and close the file
+ * \return          false if they could not be written (errno says why)
+ */
+bool history_writer_close(history_writer_t *writer);
+
+/**
+ * Start with no matches
+ */
+void history_stats_init(history_stats_t *stats);
+
+/**
+ * Release the statistics' memory
+ */
+void history_stats_free(history_stats_t *stats);
+
+/**
+ * Load the statistics last saved for a history, if any, and fold in the matches added since
+ * \param   stats   Initialized statistics to replace
+ * \param   path    The history file
+ * \return          NULL on success, otherwise a message explaining what went wrong
+ */
+const char *history_stats_load(history_stats_t *stats, const char *path);
+
+/**
+ * Fold in the matches added to a history since the statistics were last brought up to date
+ * \return          NULL on success, otherwise a message explaining what is wrong with the file
+ */
+const char *history_stats_update(history_stats_t *stats, const char *path);
+
+/**
+ * Save the statistics next to their history, replacing the last saved ones atomically
+ * \return          false if they could not be written (errno says why)
+ */
+bool history_stats_save(const history_stats_t *stats, const char *path);
+
+/**
+ * Find a player by name
+ * \return          The player's index, or -1 if it has played no matches
+ */
+long history_stats_find(const history_stats_t *stats, const char *name);
+
+/**
+ * Get two players' results against each other
+ * \return          The pair, with a < b, or NULL if they have never met
+ */
+const history_pair_t *history_stats_pair(const history_stats_t *stats, uint32_t a, uint32_t b);
+
+/**
+ * Get the highest rated players
+ * \param   k       The most players wanted
+ * \param   top     Receives up to k player indices, best first
+ * \return          The number of players: k, or fewer if there are fewer
+ */
+size_t history_stats_top(const history_stats_t *stats, size_t k, uint32_t *top);
+
+/**
+ * Print the k highest rated players with their win rates, and how the best few fared against
+ * each other
+ */
+void history_stats_report(const history_stats_t *stats, size_t k, FILE *out);
+
+#endif
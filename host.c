@@ -0,0 +1,621 @@
+#define _GNU_SOURCE
+
+#include "host.h"
+
+#include <curses.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "bot.h"
+#include "pacer.h"
+#include "render.h"
+#include "util.h"
+
+// Frames per second drawn on each terminal while a round is played
+#define HOST_FRAME_INTERVAL 33
+
+// Seconds counted down before each round, and how long a round's result is shown after it
+#define HOST_COUNTDOWN 3
+#define HOST_ROUND_PAUSE 3000
+
+// Where the board is drawn on each terminal
+#define BOARD_TOP 2
+#define BOARD_LEFT 2
+
+// Where a match is
+#define MATCH_COUNTDOWN 0
+#define MATCH_PLAYING 1
+#define MATCH_OVER 2   // showing the result of a round
+#define MATCH_CLOSED 3 // its terminal has quit or gone away
+
+// Set by SIGINT or SIGTERM
+static atomic_bool stopping;
+
+// One match and the terminal it is played on
+typedef struct host_match
+{
+  int number; // counting from 1, in the order the terminals were given
+  FILE *tty;
+  SCREEN *screen;
+
+  game_t game;
+  bot_t bots[MAX_PLAYERS];
+  int num_humans;                // players 1 to num_humans use the keyboard
+  int requested_dir[MAX_PLAYERS];
+  renderer_t *renderer;
+  pacer_t tick_pacer;
+  pacer_t frame_pacer;
+
+  int state;         // a MATCH_ value
+  int countdown;     // seconds left, while counting down
+  uint64_t state_ns; // when the countdown ticks or the result stops showing
+  int rounds;
+  int winner;        // result of the last round: 0 for a draw, otherwise the winning player
+  int wins[MAX_PLAYERS];
+
+  uint64_t wake_ns;  // the match's place in the timer queue
+} host_match_t;
+
+/**
+ * The matches' next deadlines: a binary min-heap on wake_ns. A match is popped when it is due and
+ * pushed back with its next deadline; closed matches are dropped when they come up.
+ */
+typedef struct host_queue
+{
+  host_match_t **items;
+  size_t count;
+} host_queue_t;
+
+/**
+ * Add a match to the timer queue, which has room for every match
+ */
+static void queue_push(host_queue_t *queue, host_match_t *match)
+{
+  size_t i = queue->count++;
+  while (i > 0 && queue->items[(i - 1) / 2]->wake_ns > match->wake_ns)
+  {
+    queue->items[i] = queue->items[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  queue->items[i] = match;
+}
+
+/**
+ * Take the match with the first deadline off the timer queue
+ */
+static host_match_t *queue_pop(host_queue_t *queue)
+{
+  host_match_t *first = queue->items[0];
+  host_match_t *last = queue->items[--queue->count];
+  size_t i = 0;
+  while (2 * i + 1 < queue->count)
+  {
+    size_t child = 2 * i + 1;
+    host_match_t **items = queue->items;
+    if (child + 1 < queue->count && items[child + 1]->wake_ns < items[child]->wake_ns)
+    {
+      child++;
+    }
+    if (queue->items[child]->wake_ns >= last->wake_ns)
+    {
+      break;
+    }
+    queue->items[i] = queue->items[child];
+    i = child;
+  }
+  queue->items[i] = last;
+  return first;
+}
+
+/**
+ * Stop the host after the current wake-up
+ */
+static void handle_stop(int sig)
+{
+  atomic_store(&stopping, true);
+}
+
+/**
+ * Move a pacer's next deadline onto a grid shared by every match, so matches whose rounds started
+ * at different times still tick and draw together and the host wakes once for all of them
+ * \param   origin  When the host started (time_ns)
+ */
+static void align_pacer(pacer_t *pacer, uint64_t origin)
+{
+  uint64_t periods = (pacer->deadline_ns - origin + pacer->period_ns - 1) / pacer->period_ns;
+  pacer->deadline_ns = origin + periods * pacer->period_ns;
+}
+
+/**
+ * Draw the title and the border around the board on a match's terminal
+ */
+static void draw_border(host_match_t *match)
+{
+  int width = match->game.width;
+  int height = match->game.height;
+  erase();
+  mvprintw(0, BOARD_LEFT + width / 2 - 7, "Tron! match %d", match->number);
+  mvaddch(BOARD_TOP - 1, BOARD_LEFT - 1, ACS_ULCORNER);
+  mvaddch(BOARD_TOP - 1, BOARD_LEFT + width, ACS_URCORNER);
+  mvaddch(BOARD_TOP + height, BOARD_LEFT - 1, ACS_LLCORNER);
+  mvaddch(BOARD_TOP + height, BOARD_LEFT + width, ACS_LRCORNER);
+  for (int col = 0; col < width; col++)
+  {
+    mvaddch(BOARD_TOP - 1, BOARD_LEFT + col, ACS_HLINE);
+    mvaddch(BOARD_TOP + height, BOARD_LEFT + col, ACS_HLINE);
+  }
+  for (int row = 0; row < height; row++)
+  {
+    mvaddch(BOARD_TOP + row, BOARD_LEFT - 1, ACS_VLINE);
+    mvaddch(BOARD_TOP + row, BOARD_LEFT + width, ACS_VLINE);
+  }
+
+  // On the terminal before the renderer draws inside it, so the erase cannot wipe its cells
+  refresh();
+}
+
+/**
+ * Draw the line under the board: the countdown or the last result, and the wins so far
+ */
+static void draw_status(host_match_t *match)
+{
+  char message[64];
+  if (match->state == MATCH_COUNTDOWN)
+  {
+    snprintf(message, sizeof(message), "Round %d starts in %d", match->rounds + 1,
+             match->countdown);
+  }
+  else if (match->state == MATCH_PLAYING)
+  {
+    snprintf(message, sizeof(message), "Round %d", match->rounds);
+  }
+  else if (match->winner > 0)
+  {
+    snprintf(message, sizeof(message), "Player %d wins round %d!", match->winner, match->rounds);
+  }
+  else
+  {
+    snprintf(message, sizeof(message), "Round %d is a draw!", match->rounds);
+  }
+
+  int row = BOARD_TOP + match->game.height + 1;
+  move(row, BOARD_LEFT);
+  clrtoeol();
+  printw("%s   wins:", message);
+  for (int i = 0; i < match->game.num_players; i++)
+  {
+    printw(" P%d %d", i + 1, match->wins[i]);
+  }
+  printw("   q quits");
+  refresh();
+}
+
+/**
+ * Give the renderer the cells changed since the last frame and put them on the terminal
+ */
+static void draw_frame(host_match_t *match)
+{
+  game_t *game = &match->game;
+  if (game->changed_all)
+  {
+    for (int row = 0; row < game->height; row++)
+    {
+      for (int col = 0; col < game->width; col++)
+      {
+        render_cell(match->renderer, row, col, game_cell(game, row, col));
+      }
+    }
+  }
+  else
+  {
+    for (int i = 0; i < game->num_changed; i++)
+    {
+      uint32_t cell = game->changed[i];
+      render_cell(match->renderer, cell / game->width, cell % game->width, game->cells[cell]);
+    }
+  }
+  game_publish(game); // clears the list of changed cells
+  render_flush(match->renderer);
+}
+
+/**
+ * Clear the board and start counting down to the next round
+ */
+static void start_countdown(host_match_t *match, uint64_t now)
+{
+  game_t *game = &match->game;
+  game_reset(game);
+  for (int i = match->num_humans; i < game->num_players; i++)
+  {
+    bot_reset(&match->bots[i]);
+  }
+  for (int i = 0; i < match->num_humans; i++)
+  {
+    match->requested_dir[i] = game->players[i].dir;
+  }
+  match->state = MATCH_COUNTDOWN;
+  match->countdown = HOST_COUNTDOWN;
+  match->state_ns = now + 1000000000ull;
+  draw_frame(match);
+  draw_status(match);
+}
+
+/**
+ * Play one tick of a match's round
+ * \return        -1 if the round continues, 0 for a draw, or the number of the winning player
+ */
+static int play_tick(host_match_t *match)
+{
+  game_t *game = &match->game;
+  for (int i = 0; i < match->num_humans; i++)
+  {
+    game_steer(game, i, match->requested_dir[i]);
+  }
+  for (int i = match->num_humans; i < game->num_players; i++)
+  {
+    if (game_move_due(game, i))
+    {
+      bot_steer(&match->bots[i], game);
+    }
+  }
+  return game_tick(game);
+}
+
+/**
+ * Do whatever a match has due: count down, play ticks and draw a frame, or start the next round
+ * \param   origin  When the host started, for aligning the match's pacers
+ */
+static void run_match(host_match_t *match, uint64_t origin)
+{
+  set_term(match->screen);
+  uint64_t now = time_ns();
+  if (match->state == MATCH_COUNTDOWN && now >= match->state_ns)
+  {
+    match->state_ns += 1000000000ull;
+    if (--match->countdown == 0)
+    {
+      match->state = MATCH_PLAYING;
+      match->rounds++;
+      pacer_start(&match->tick_pacer);
+      pacer_start(&match->frame_pacer);
+      align_pacer(&match->tick_pacer, origin);
+      align_pacer(&match->frame_pacer, origin);
+    }
+    draw_status(match);
+  }
+  else if (match->state == MATCH_PLAYING)
+  {
+    int due = pacer_due(&match->tick_pacer, now);
+    int result = -1;
+    for (int i = 0; i < due && result < 0; i++)
+    {
+      result = play_tick(match);
+    }
+    if (result >= 0)
+    {
+      match->state = MATCH_OVER;
+      match->state_ns = now + HOST_ROUND_PAUSE * 1000000ull;
+      match->winner = result;
+      if (result > 0)
+      {
+        match->wins[result - 1]++;
+      }
+      draw_frame(match);
+      draw_status(match);
+    }
+    else if (pacer_due(&match->frame_pacer, now) > 0)
+    {
+      draw_frame(match);
+    }
+  }
+  else if (match->state == MATCH_OVER && now >= match->state_ns)
+  {
+    start_countdown(match, now);
+  }
+
+  // A round wakes the match for every tick and frame; otherwise only the clock on the screen does
+  if (match->state == MATCH_PLAYING)
+  {
+    match->wake_ns = match->tick_pacer.deadline_ns < match->frame_pacer.deadline_ns
+                         ? match->tick_pacer.deadline_ns
+                         : match->frame_pacer.deadline_ns;
+  }
+  else
+  {
+    match->wake_ns = match->state_ns;
+  }
+}
+
+/**
+ * Take a match's terminal for a new match: a curses screen of its own, a board, bots and a
+ * renderer
+ * \return        false if the terminal cannot be used (a message has been printed)
+ */
+static bool open_match(host_match_t *match, const host_options_t *options, int number,
+                       const char *path)
+{
+  memset(match, 0, sizeof(host_match_t));
+  match->number = number;
+  match->tty = fopen(path, "r+");
+  if (match->tty == NULL)
+  {
+    fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  match->screen = newterm(NULL, match->tty, match->tty);
+  if (match->screen == NULL)
+  {
+    fprintf(stderr, "Cannot start curses on %s.\n", path);
+    fclose(match->tty);
+    return false;
+  }
+  set_term(match->screen);
+  cbreak();
+  noecho();
+  keypad(stdscr, true);
+  nodelay(stdscr, true);
+  curs_set(0);
+
+  const game_config_t *config = &options->config;
+  if (BOARD_TOP + config->height + 1 >= LINES || BOARD_LEFT + config->width >= COLS)
+  {
+    endwin();
+    delscreen(match->screen);
+    fclose(match->tty);
+    match->screen = NULL;
+    fprintf(stderr, "The terminal on %s is too small: a %dx%d board needs at least %dx%d.\n",
+            path, config->width, config->height, BOARD_LEFT + config->width + 1,
+            BOARD_TOP + config->height + 2);
+    return false;
+  }
+
+  game_init(&match->game, config);
+  match->num_humans = config->num_players - options->bots;
+  for (int i = match->num_humans; i < config->num_players; i++)
+  {
+    bot_init(&match->bots[i], &match->game, i);
+  }
+  match->renderer = render_create(options->render != NULL ? options->render : "ansi",
+                                  config->width, config->height, BOARD_TOP, BOARD_LEFT,
+                                  fileno(match->tty));
+  pacer_init(&match->tick_pacer, SIM_TICK_INTERVAL * 1000000ull, SIM_MAX_CATCH_UP);
+  pacer_init(&match->frame_pacer, HOST_FRAME_INTERVAL * 1000000ull, 1);
+  draw_border(match);
+  start_countdown(match, time_ns());
+  match->wake_ns = match->state_ns;
+  return true;
+}
+
+/**
+ * Give a match's terminal back and release the match. Its curses screen stays until the host
+ * exits: deleting one screen stops ncurses reading keys on the others.
+ */
+static void close_match(host_match_t *match)
+{
+  set_term(match->screen);
+  endwin();
+  render_free(match->renderer);
+  for (int i = match->num_humans; i < match->game.num_players; i++)
+  {
+    bot_free(&match->bots[i]);
+  }
+  game_free(&match->game);
+  match->state = MATCH_CLOSED;
+}
+
+/**
+ * Read every key waiting on a match's terminal
+ * \return        false if the terminal has quit
+ */
+static bool read_keys(host_match_t *match, const host_options_t *options)
+{
+  set_term(match->screen);
+  int key;
+  while ((key = getch()) != ERR)
+  {
+    if (key == 'q')
+    {
+      return false;
+    }
+    if (key == KEY_RESIZE)
+    {
+      draw_border(match);
+      render_invalidate(match->renderer);
+      match->game.changed_all = true;
+      draw_frame(match);
+      draw_status(match);
+      continue;
+    }
+    for (int i = 0; i < match->num_humans && i < options->num_keys; i++)
+    {
+      for (int dir = DIR_NORTH; dir <= DIR_WEST; dir++)
+      {
+        if (key == options->keys[i][dir])
+        {
+          match->requested_dir[i] = dir;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Get the process's resident set size in KiB
+ */
+static long resident_kib(void)
+{
+  long size = 0;
+  long resident = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm != NULL)
+  {
+    if (fscanf(statm, "%ld %ld", &size, &resident) != 2)
+    {
+      resident = 0;
+    }
+    fclose(statm);
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Get the CPU time the process has used, in seconds
+ */
+static double cpu_seconds(void)
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec +
+         usage.ru_stime.tv_usec / 1e6;
+}
+
+/**
+ * Run many independent matches in one process, each on its own terminal: a pty someone has open,
+ * given by its device path. Each terminal gets its own curses screen (newterm), board, bots and
+ * renderer, and plays round after round until q is pressed on it.
+ *
+ * One thread runs every match. The matches' next deadlines (tick, frame or the end of a countdown)
+ * are kept in one timer queue, and the thread sleeps in poll() on every terminal until the first
+ * of them is due or a key arrives, so an idle match costs nothing and none has a thread of its own.
+ * \param   options  What to play
+ * \param   ttys     The terminals' device paths
+ * \param   count    The number of terminals, at most HOST_MAX_MATCHES
+ * \return           The exit status for the program
+ */
+int host_run(const host_options_t *options, const char *const *ttys, int count)
+{
+  long kib_before = resident_kib();
+  host_match_t *matches = malloc(sizeof(host_match_t) * count);
+  struct pollfd *fds = malloc(sizeof(struct pollfd) * count);
+  host_queue_t queue = {.items = malloc(sizeof(host_match_t *) * count), .count = 0};
+  if (matches == NULL || fds == NULL || queue.items == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+
+  int open = 0;
+  for (int i = 0; i < count; i++)
+  {
+    fds[i] = (struct pollfd){.fd = -1, .events = POLLIN};
+    if (open_match(&matches[i], options, i + 1, ttys[i]))
+    {
+      fds[i].fd = fileno(matches[i].tty);
+      queue_push(&queue, &matches[i]);
+      open++;
+    }
+    else
+    {
+      matches[i].state = MATCH_CLOSED;
+    }
+  }
+  long kib_open = resident_kib();
+  if (open == 0)
+  {
+    free(matches);
+    free(fds);
+    free(queue.items);
+    return 1;
+  }
+  printf("hosting %d matches; press q on a match's terminal to end it\n", open);
+  fflush(stdout);
+
+  struct sigaction action = {.sa_handler = handle_stop};
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  uint64_t origin = time_ns();
+  uint64_t end = options->seconds > 0 ? origin + options->seconds * 1000000000ull : UINT64_MAX;
+  double cpu_start = cpu_seconds();
+  uint64_t wakes = 0;
+  while (open > 0 && !atomic_load(&stopping))
+  {
+    // Sleep until the first deadline, or a key on any terminal
+    uint64_t now = time_ns();
+    uint64_t wake = queue.count > 0 ? queue.items[0]->wake_ns : UINT64_MAX;
+    wake = wake < end ? wake : end;
+    if (now >= end)
+    {
+      break;
+    }
+    uint64_t wait = wake > now ? wake - now : 0;
+    struct timespec timeout = {.tv_sec = wait / 1000000000, .tv_nsec = wait % 1000000000};
+    if (ppoll(fds, count, &timeout, NULL) > 0)
+    {
+      for (int i = 0; i < count; i++)
+      {
+        if (fds[i].fd >= 0 && fds[i].revents != 0 &&
+            ((fds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) != 0 ||
+             !read_keys(&matches[i], options)))
+        {
+          close_match(&matches[i]);
+          fds[i].fd = -1;
+          open--;
+        }
+      }
+    }
+    wakes++;
+
+    // Every match due gets its turn, then goes back in the queue
+    now = time_ns();
+    while (queue.count > 0 && queue.items[0]->wake_ns <= now)
+    {
+      host_match_t *match = queue_pop(&queue);
+      if (match->state != MATCH_CLOSED)
+      {
+        run_match(match, origin);
+        queue_push(&queue, match);
+      }
+    }
+  }
+  double elapsed = (time_ns() - origin) / 1e9;
+  double cpu = cpu_seconds() - cpu_start;
+
+  // Report before closing, while every match's figures are still there
+  int hosted = 0;
+  uint64_t rounds = 0;
+  uint64_t ticks = 0;
+  pacer_stats_t tick_stats = {0};
+  pacer_stats_t frame_stats = {0};
+  for (int i = 0; i < count; i++)
+  {
+    if (matches[i].screen == NULL)
+    {
+      continue; // never opened
+    }
+    hosted++;
+    rounds += matches[i].rounds;
+    ticks += matches[i].tick_pacer.stats.periods;
+    pacer_add_stats(&tick_stats, &matches[i].tick_pacer.stats);
+    pacer_add_stats(&frame_stats, &matches[i].frame_pacer.stats);
+    if (matches[i].state != MATCH_CLOSED)
+    {
+      close_match(&matches[i]);
+    }
+    delscreen(matches[i].screen);
+    fclose(matches[i].tty);
+  }
+  printf("%d matches on one thread: %llu rounds, %llu ticks in %.1f s, %llu wake-ups\n", hosted,
+         (unsigned long long)rounds, (unsigned long long)ticks, elapsed,
+         (unsigned long long)wakes);
+  printf("cpu: %.2f s (%.1f%% of one CPU), %.3f%% per match\n", cpu, cpu / elapsed * 100,
+         cpu / elapsed * 100 / hosted);
+  printf("memory: %ld KiB resident with every match open, %ld KiB per match\n", kib_open,
+         (kib_open - kib_before) / hosted);
+  pacer_report(&tick_stats, "tick pacing", stdout);
+  pacer_report(&frame_stats, "frame pacing", stdout);
+
+  free(matches);
+  free(fds);
+  free(queue.items);
+  return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include "game.h"
+
+// Most matches one host runs
+#define HOST_MAX_MATCHES 1024
+
+// What every match on a host plays
+typedef struct host_options
+{
+  game_config_t config;
+  int bots;              // players steered by bots (the last ones); the rest use the keyboard
+  const char *render;    // renderer backend for every terminal, or NULL for ansi
+  const int (*keys)[4];  // keys for each keyboard player, indexed by direction
+  int num_keys;
+  int seconds;           // how long to run, or 0 to run until interrupted
+} host_options_t;
+
+/**
+ * Run many independent matches in one process, each on its own terminal: a pty someone has open,
+ * given by its device path. Each terminal gets its own curses screen (newterm), board, bots and
+ * renderer, and plays round after round until q is pressed on it.
+ *
+ * One thread runs every match. The matches' next deadlines (tick, frame or the end of a countdown)
+ * are kept in one timer queue, and the thread sleeps in poll() on every terminal until the first
+ * of them is due or a key arrives, so an idle match costs nothing and none has a thread of its own.
+ * \param   options  What to play
+ * \param   ttys     The terminals' device paths
+ * \param   count    The number of terminals, at most HOST_MAX_MATCHES
+ * \return           The exit status for the program
+ */
+int host_run(const host_options_t *options, const char *const *ttys, int count);
+
+#endif
@@ -0,0 +1,723 @@
+#define _GNU_SOURCE
+
+#include "leaderboard.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAGIC "TRONLBD2"
+#define MAGIC_SIZE 8
+#define HEADER_SIZE (MAGIC_SIZE + 16)
+
+// The journal space given back is rounded down to a multiple of this
+#define HOLE_ALIGN 4096
+
+/**
+ * Copy a name into an entry's fixed-size, NUL-padded form
+ */
+static void make_key(char key[LEADERBOARD_NAME_LEN + 1], const char *name)
+{
+  memset(key, 0, LEADERBOARD_NAME_LEN + 1);
+  for (int i = 0; i < LEADERBOARD_NAME_LEN && name[i] != '\0'; i++)
+  {
+    key[i] = name[i];
+  }
+}
+
+/**
+ * Order entries by name
+ */
+static int compare_names(const void *a, const void *b)
+{
+  return memcmp(((const leaderboard_entry_t *)a)->name, ((const leaderboard_entry_t *)b)->name,
+                LEADERBOARD_NAME_LEN + 1);
+}
+
+/**
+ * Allocate working memory from the leaderboard's arena, or the heap if it has none
+ */
+static void *scratch_alloc(leaderboard_t *board, size_t size)
+{
+  if (board->scratch != NULL)
+  {
+    return arena_alloc(board->scratch, size);
+  }
+  void *memory = malloc(size);
+  if (memory == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  return memory;
+}
+
+/**
+ * Release working memory from scratch_alloc; the arena's is released when it is reset
+ */
+static void scratch_free(leaderboard_t *board, void *memory)
+{
+  if (board->scratch == NULL)
+  {
+    free(memory);
+  }
+}
+
+/**
+ * Build the name of one of a leaderboard's other files
+ * \return          false if the name does not fit
+ */
+static bool file_name(char *buffer, size_t size, const char *path, const char *suffix)
+{
+  if (snprintf(buffer, size, "%s%s", path, suffix) >= (int)size)
+  {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Find the hash table slot holding a name, or the free slot where it would go
+ */
+static size_t find_slot(const leaderboard_t *board, const char key[LEADERBOARD_NAME_LEN + 1])
+{
+  uint32_t bits;
+  memcpy(&bits, key, sizeof(bits));
+  uint32_t hash = bits * 2654435761u;
+  size_t mask = board->num_slots - 1;
+  for (size_t slot = (hash ^ hash >> 16) & mask;; slot = (slot + 1) & mask)
+  {
+    uint32_t rank = board->slots[slot];
+    if (rank == 0 || memcmp(board->entries[rank - 1].name, key, LEADERBOARD_NAME_LEN + 1) == 0)
+    {
+      return slot;
+    }
+  }
+}
+
+/**
+ * (Re)build the hash table with room for at least min_count players
+ */
+static void build_index(leaderboard_t *board, size_t min_count)
+{
+  size_t num_slots = 64;
+  while (num_slots < 2 * min_count)
+  {
+    num_slots *= 2;
+  }
+  free(board->slots);
+  board->slots = calloc(num_slots, sizeof(uint32_t));
+  if (board->slots == NULL)
+  {
+    perror("calloc");
+    exit(2);
+  }
+  board->num_slots = num_slots;
+  for (size_t i = 0; i < board->count; i++)
+  {
+    board->slots[find_slot(board, board->entries[i].name)] = i + 1;
+  }
+}
+
+/**
+ * Make sure the hash table can take one more player
+ */
+static void reserve_index(leaderboard_t *board)
+{
+  if (board->slots == NULL || 2 * (board->count + 1) > board->num_slots)
+  {
+    build_index(board, board->count + 1);
+  }
+}
+
+/**
+ * Make sure the entries are in memory with room for one more player
+ */
+static void reserve_entries(leaderboard_t *board)
+{
+  if (board->capacity > board->count)
+  {
+    return;
+  }
+  size_t capacity = board->count < 32 ? 64 : 2 * board->count;
+  leaderboard_entry_t *entries;
+  if (board->capacity == 0)
+  {
+    // Leave the mapping for memory of our own
+    entries = malloc(capacity * sizeof(leaderboard_entry_t));
+    if (entries != NULL && board->count > 0)
+    {
+      memcpy(entries, board->entries, board->count * sizeof(leaderboard_entry_t));
+    }
+  }
+  else
+  {
+    entries = realloc(board->entries, capacity * sizeof(leaderboard_entry_t));
+  }
+  if (entries == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  if (board->map != NULL)
+  {
+    munmap(board->map, board->map_size);
+    board->map = NULL;
+    board->by_name = NULL;
+  }
+  board->entries = entries;
+  board->capacity = capacity;
+}
+
+/**
+ * Find a player among the entries
+ * \return          The player's rank counting from 0, or -1 if it has no entry
+ */
+static long find_rank(leaderboard_t *board, const char key[LEADERBOARD_NAME_LEN + 1])
+{
+  if (board->count == 0)
+  {
+    return -1;
+  }
+
+  // A snapshot that has not changed is searched in place, so a reader never looks at every entry
+  if (board->by_name != NULL && board->slots == NULL)
+  {
+    size_t low = 0;
+    size_t high = board->count;
+    while (low < high)
+    {
+      size_t mid = low + (high - low) / 2;
+      uint32_t rank = board->by_name[mid];
+      int order = memcmp(board->entries[rank].name, key, LEADERBOARD_NAME_LEN + 1);
+      if (order == 0)
+      {
+        return rank;
+      }
+      if (order < 0)
+      {
+        low = mid + 1;
+      }
+      else
+      {
+        high = mid;
+      }
+    }
+    return -1;
+  }
+
+  if (board->slots == NULL)
+  {
+    build_index(board, board->count);
+  }
+  return (long)board->slots[find_slot(board, key)] - 1;
+}
+
+/**
+ * Get a player's wins since the snapshot
+ */
+static uint32_t tail_score(const leaderboard_t *board, const char key[LEADERBOARD_NAME_LEN + 1])
+{
+  leaderboard_entry_t probe;
+  memcpy(probe.name, key, sizeof(probe.name));
+  const leaderboard_entry_t *found =
+      bsearch(&probe, board->tail, board->tail_count, sizeof(leaderboard_entry_t), compare_names);
+  return found != NULL ? found->score : 0;
+}
+
+/**
+ * Read the journal records written since the snapshot and total them by player
+ * \return          NULL on success, otherwise a message explaining what went wrong
+ */
+static const char *read_journal(leaderboard_t *board, const char *path)
+{
+  char journal[4096];
+  if (!file_name(journal, sizeof(journal), path, LEADERBOARD_JOURNAL_SUFFIX))
+  {
+    return "the journal's name is too long";
+  }
+  int fd = open(journal, O_RDONLY);
+  if (fd < 0)
+  {
+    return errno == ENOENT ? NULL : "the journal could not be opened";
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return "the journal could not be read";
+  }
+
+  // Only whole records count; one being appended right now is picked up next time. A journal
+  // shorter than the snapshot says was replaced, so all of it is new.
+  uint64_t end = st.st_size - st.st_size % sizeof(leaderboard_entry_t);
+  uint64_t start = board->journal_offset <= end ? board->journal_offset : 0;
+  size_t records = (end - start) / sizeof(leaderboard_entry_t);
+  leaderboard_entry_t *tail = scratch_alloc(board, (records + 1) * sizeof(leaderboard_entry_t));
+  size_t done = 0;
+  while (done < end - start)
+  {
+    ssize_t n = pread(fd, (uint8_t *)tail + done, end - start - done, start + done);
+    if (n <= 0 && errno != EINTR)
+    {
+      scratch_free(board, tail);
+      close(fd);
+      return "the journal could not be read";
+    }
+    done += n > 0 ? n : 0;
+  }
+  close(fd);
+
+  // Total each player's wins. Records of zeros are space the compactor gave back, or a write a
+  // crash cut short.
+  qsort(tail, records, sizeof(leaderboard_entry_t), compare_names);
+  size_t count = 0;
+  for (size_t i = 0; i < records; i++)
+  {
+    if (tail[i].name[0] == '\0' || tail[i].score == 0)
+    {
+      continue;
+    }
+    if (count > 0 && compare_names(&tail[count - 1], &tail[i]) == 0)
+    {
+      tail[count - 1].score += tail[i].score;
+    }
+    else
+    {
+      tail[count++] = tail[i];
+    }
+  }
+  board->tail = tail;
+  board->tail_count = count;
+  board->tail_records = records;
+  board->journal_end = end;
+  return NULL;
+}
+
+/**
+ * Map a leaderboard's snapshot and read its journal. A missing file is an empty leaderboard.
+ * \param   board   Receives the leaderboard
+ * \param   path    The snapshot's file
+ * \param   scratch An arena for the memory a reader needs, which must outlive the leaderboard,
+ *                  or NULL to use the heap
+ * \return          NULL on success, otherwise a message explaining what is wrong with the files
+ */
+const char *leaderboard_open(leaderboard_t *board, const char *path, arena_t *scratch)
+{
+  memset(board, 0, sizeof(leaderboard_t));
+  board->scratch = scratch;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return errno == ENOENT ? read_journal(board, path) : "the file could not be opened";
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < HEADER_SIZE)
+  {
+    close(fd);
+    return "the file is too short to be a leaderboard";
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    return "the file could not be mapped";
+  }
+
+  uint64_t header[2];
+  memcpy(header, (uint8_t *)data + MAGIC_SIZE, sizeof(header));
+  uint64_t count = header[0];
+  if (memcmp(data, MAGIC, MAGIC_SIZE) != 0 ||
+      (size_t)st.st_size != HEADER_SIZE + count * (sizeof(leaderboard_entry_t) + sizeof(uint32_t)))
+  {
+    munmap(data, st.st_size);
+    return "the file is not a leaderboard";
+  }
+  board->map = data;
+  board->map_size = st.st_size;
+  board->entries = (leaderboard_entry_t *)((uint8_t *)data + HEADER_SIZE);
+  board->by_name = (const uint32_t *)(board->entries + count);
+  board->count = count;
+  board->journal_offset = header[1];
+  return read_journal(board, path);
+}
+
+/**
+ * Release a leaderboard (without saving it)
+ */
+void leaderboard_close(leaderboard_t *board)
+{
+  if (board->map != NULL)
+  {
+    munmap(board->map, board->map_size);
+  }
+  else
+  {
+    free(board->entries);
+  }
+  free(board->slots);
+  scratch_free(board, board->tail);
+  memset(board, 0, sizeof(leaderboard_t));
+}
+
+/**
+ * Order entries by score, best first, then by name
+ */
+static int compare_scores(const void *a, const void *b)
+{
+  const leaderboard_entry_t *x = a;
+  const leaderboard_entry_t *y = b;
+  if (x->score != y->score)
+  {
+    return x->score > y->score ? -1 : 1;
+  }
+  return compare_names(x, y);
+}
+
+/**
+ * Add entries for the players in a scoresheet written by an earlier version of the game: lines
+ * of a name and a score. Players already on the leaderboard keep their scores.
+ * \return          false if the file could not be read
+ */
+bool leaderboard_import_csv(leaderboard_t *board, const char *path)
+{
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+  {
+    return false;
+  }
+  char line[256];
+  char name[LEADERBOARD_NAME_LEN + 1];
+  unsigned score;
+  bool added = false;
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    char key[LEADERBOARD_NAME_LEN + 1];
+    if (sscanf(line, "%3s %u", name, &score) != 2)
+    {
+      continue;
+    }
+    make_key(key, name);
+    if (find_rank(board, key) >= 0)
+    {
+      continue;
+    }
+    reserve_entries(board);
+    reserve_index(board);
+    leaderboard_entry_t *entry = &board->entries[board->count];
+    memcpy(entry->name, key, sizeof(key));
+    entry->score = score;
+    board->slots[find_slot(board, entry->name)] = ++board->count;
+    added = true;
+  }
+  fclose(file);
+
+  // Imports are rare, so simply sort everything again
+  if (added)
+  {
+    qsort(board->entries, board->count, sizeof(leaderboard_entry_t), compare_scores);
+    build_index(board, board->count);
+  }
+  return true;
+}
+
+/**
+ * Give a player a win, adding it to the leaderboard if it is new
+ * \param   name    The player's name; characters past LEADERBOARD_NAME_LEN are ignored
+ * \return          The player's new rank, counting from 0
+ */
+size_t leaderboard_add_win(leaderboard_t *board, const char *name)
+{
+  char key[LEADERBOARD_NAME_LEN + 1];
+  make_key(key, name);
+  reserve_entries(board);
+  reserve_index(board);
+
+  // A new player joins at the bottom with no wins
+  size_t slot = find_slot(board, key);
+  if (board->slots[slot] == 0)
+  {
+    memcpy(board->entries[board->count].name, key, sizeof(key));
+    board->entries[board->count].score = 0;
+    board->slots[slot] = ++board->count;
+  }
+  size_t rank = board->slots[slot] - 1;
+  uint32_t score = board->entries[rank].score;
+  if (score == UINT32_MAX)
+  {
+    return rank;
+  }
+
+  // Find the first player with the same score: scores only go down towards the player's rank
+  size_t low = 0;
+  size_t high = rank;
+  while (low < high)
+  {
+    size_t mid = low + (high - low) / 2;
+    if (board->entries[mid].score > score)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+
+  // Swap places with that player; with one more point the player then ranks just below everyone
+  // who already has that many
+  if (low != rank)
+  {
+    leaderboard_entry_t first = board->entries[low];
+    board->slots[find_slot(board, first.name)] = rank + 1;
+    board->slots[slot] = low + 1;
+    board->entries[low] = board->entries[rank];
+    board->entries[rank] = first;
+  }
+  board->entries[low].score++;
+  return low;
+}
+
+/**
+ * Get a player's wins, counting the journal
+ */
+uint32_t leaderboard_score(leaderboard_t *board, const char *name)
+{
+  char key[LEADERBOARD_NAME_LEN + 1];
+  make_key(key, name);
+  long rank = find_rank(board, key);
+  return (rank >= 0 ? board->entries[rank].score : 0) + tail_score(board, key);
+}
+
+/**
+ * Get the best players, counting the journal
+ * \param   k       The most entries wanted
+ * \param   top     Receives up to k entries in rank order
+ * \return          The number of entries: k, or fewer if there are fewer players
+ */
+size_t leaderboard_top(leaderboard_t *board, size_t k, leaderboard_entry_t *top)
+{
+  // Players with newer wins are ranked by their totals...
+  size_t num_moved = board->tail_count;
+  leaderboard_entry_t *moved = scratch_alloc(board, (num_moved + 1) * sizeof(leaderboard_entry_t));
+  for (size_t i = 0; i < num_moved; i++)
+  {
+    moved[i] = board->tail[i];
+    long rank = find_rank(board, moved[i].name);
+    moved[i].score += rank >= 0 ? board->entries[rank].score : 0;
+  }
+  qsort(moved, num_moved, sizeof(leaderboard_entry_t), compare_scores);
+
+  // ...and merged with everyone else, who keeps their place in the snapshot
+  size_t n = 0;
+  size_t i = 0;
+  size_t j = 0;
+  while (n < k)
+  {
+    while (i < board->count && tail_score(board, board->entries[i].name) > 0)
+    {
+      i++;
+    }
+    if (i < board->count && (j == num_moved || board->entries[i].score >= moved[j].score))
+    {
+      top[n++] = board->entries[i++];
+    }
+    else if (j < num_moved)
+    {
+      top[n++] = moved[j++];
+    }
+    else
+    {
+      break;
+    }
+  }
+  scratch_free(board, moved);
+  return n;
+}
+
+/**
+ * Order ranks by the names of the entries they point to
+ */
+static int compare_ranks(const void *a, const void *b, void *entries)
+{
+  const leaderboard_entry_t *e = entries;
+  return compare_names(&e[*(const uint32_t *)a], &e[*(const uint32_t *)b]);
+}
+
+/**
+ * Write the entries to a snapshot file, replacing it atomically
+ * \return          false if it could not be written (errno says why)
+ */
+bool leaderboard_save(const leaderboard_t *board, const char *path)
+{
+  char tmp[4096];
+  if (!file_name(tmp, sizeof(tmp), path, ".tmp"))
+  {
+    return false;
+  }
+
+  // The name index lets readers look players up without reading every entry
+  uint32_t *by_name = malloc((board->count + 1) * sizeof(uint32_t));
+  if (by_name == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  for (size_t i = 0; i < board->count; i++)
+  {
+    by_name[i] = i;
+  }
+  qsort_r(by_name, board->count, sizeof(uint32_t), compare_ranks, board->entries);
+
+  FILE *file = fopen(tmp, "wb");
+  if (file == NULL)
+  {
+    free(by_name);
+    return false;
+  }
+  uint8_t header[HEADER_SIZE];
+  uint64_t fields[2] = {board->count, board->journal_offset};
+  memcpy(header, MAGIC, MAGIC_SIZE);
+  memcpy(header + MAGIC_SIZE, fields, sizeof(fields));
+  size_t count = board->count;
+  bool ok = fwrite(header, 1, HEADER_SIZE, file) == HEADER_SIZE &&
+            fwrite(board->entries, sizeof(leaderboard_entry_t), count, file) == count &&
+            fwrite(by_name, sizeof(uint32_t), count, file) == count;
+  free(by_name);
+
+  // The data has to be on disk before the rename makes it the snapshot
+  ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmp, path) != 0)
+  {
+    int error = errno;
+    unlink(tmp);
+    errno = error;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Give a player a win by appending it to a leaderboard's journal. Never waits for other writers
+ * or the compactor.
+ * \param   path    The leaderboard's snapshot file
+ * \param   name    The player's name; characters past LEADERBOARD_NAME_LEN are ignored
+ * \return          false if the journal could not be written (errno says why)
+ */
+bool leaderboard_record_win(const char *path, const char *name)
+{
+  char journal[4096];
+  if (!file_name(journal, sizeof(journal), path, LEADERBOARD_JOURNAL_SUFFIX))
+  {
+    return false;
+  }
+  leaderboard_entry_t record;
+  make_key(record.name, name);
+  record.score = 1;
+  if (record.name[0] == '\0')
+  {
+    errno = EINVAL;
+    return false;
+  }
+
+  // A write this small to a file opened for appending lands whole at the end, whoever else is
+  // appending at the same time
+  int fd = open(journal, O_WRONLY | O_APPEND | O_CREAT, 0644);
+  if (fd < 0)
+  {
+    return false;
+  }
+  ssize_t n = write(fd, &record, sizeof(record));
+  int error = errno;
+  close(fd);
+  if (n != sizeof(record))
+  {
+    errno = n < 0 ? error : EIO;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Fold a leaderboard's journal into its snapshot, unless another process is already doing so.
+ * The first compaction also imports LEADERBOARD_LEGACY_FILE.
+ * \param   path        The leaderboard's snapshot file
+ * \param   min_records Only compact once the journal has this many records past the snapshot
+ * \return              NULL on success, otherwise a message explaining what went wrong
+ */
+const char *leaderboard_compact(const char *path, size_t min_records)
+{
+  char name[4096];
+  if (!file_name(name, sizeof(name), path, LEADERBOARD_LOCK_SUFFIX))
+  {
+    return "the leaderboard's name is too long";
+  }
+
+  // Only one compactor at a time; the others have nothing to do. Writers never take the lock.
+  int lock = open(name, O_RDWR | O_CREAT, 0644);
+  if (lock < 0)
+  {
+    return "the lock could not be opened";
+  }
+  if (flock(lock, LOCK_EX | LOCK_NB) != 0)
+  {
+    close(lock);
+    return errno == EWOULDBLOCK ? NULL : "the lock could not be taken";
+  }
+
+  bool exists = access(path, F_OK) == 0;
+  leaderboard_t board;
+  const char *error = leaderboard_open(&board, path, NULL);
+  if (error != NULL || (exists && board.tail_records < min_records))
+  {
+    if (error == NULL)
+    {
+      leaderboard_close(&board);
+    }
+    close(lock);
+    return error;
+  }
+
+  if (!exists)
+  {
+    leaderboard_import_csv(&board, LEADERBOARD_LEGACY_FILE);
+  }
+  for (size_t i = 0; i < board.tail_count; i++)
+  {
+    for (uint32_t w = 0; w < board.tail[i].score; w++)
+    {
+      leaderboard_add_win(&board, board.tail[i].name);
+    }
+  }
+  uint64_t folded = board.journal_offset;
+  board.journal_offset = board.journal_end;
+  if (!leaderboard_save(&board, path))
+  {
+    error = "the snapshot could not be written";
+  }
+  leaderboard_close(&board);
+
+  // Give back the journal space the previous snapshot had already folded. Readers that still
+  // have that snapshot open read from its offset on, so they never see the hole.
+  folded -= folded % HOLE_ALIGN;
+  if (error == NULL && folded > 0 &&
+      file_name(name, sizeof(name), path, LEADERBOARD_JOURNAL_SUFFIX))
+  {
+    int fd = open(name, O_WRONLY);
+    if (fd >= 0)
+    {
+      fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, folded);
+      close(fd);
+    }
+  }
+  close(lock);
+  return error;
+}
@@ -0,0 +1,145 @@
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+// Where the interactive game keeps its leaderboard
+#define LEADERBOARD_FILE "leaderboard.db"
+
+// Added to the leaderboard's path to name its journal and the lock its compactor takes
+#define LEADERBOARD_JOURNAL_SUFFIX ".journal"
+#define LEADERBOARD_LOCK_SUFFIX ".lock"
+
+// The scoresheet earlier versions kept, imported the first time the leaderboard is compacted
+#define LEADERBOARD_LEGACY_FILE "scoresheet.csv"
+
+// Longest player name, not counting the terminating NUL
+#define LEADERBOARD_NAME_LEN 3
+
+// Journal records worth folding into the snapshot
+#define LEADERBOARD_COMPACT_RECORDS 64
+
+// One player's line on the leaderboard, or a journal record. The name is padded with NULs.
+typedef struct leaderboard_entry
+{
+  char name[LEADERBOARD_NAME_LEN + 1];
+  uint32_t score; // wins, or in a journal record the wins to add
+} leaderboard_entry_t;
+
+/**
+ * Every player's win count, ranked, shared by any number of tron processes.
+ *
+ * Wins are appended to a journal, one 8-byte entry per win written with O_APPEND, so concurrent
+ * writers never lock or block each other and no update is lost. A compactor, run by whichever
+ * process gets the lock first, folds the journal into a snapshot every so often; readers merge the
+ * snapshot with the journal records written since. The journal is never truncated, since a writer
+ * may be appending; the folded part is punched out of it to give the space back.
+ *
+ * The snapshot is "TRONLBD2", the number of entries and the journal offset it includes (8 bytes
+ * each), the entries in rank order, then each entry's rank as 4 bytes in name order, all in native
+ * byte order. A reader maps it and reads the top k entries straight from it, looking up the few
+ * players with newer journal records by binary search on the name index.
+ *
+ * Changing the entries in memory (as the compactor does) copies them out of the mapping and builds
+ * a hash table from names to ranks. Players with the same score sit next to each other, so a win
+ * moves a player to the front of its score's run (found by binary search) before adding the
+ * point: the ranking stays sorted after O(log n) work. Ties go to whoever reached the score first.
+ *
+ * leaderboard_save writes a temporary file and renames it over the old snapshot, so a crash leaves
+ * either the old one or the new one.
+ */
+typedef struct leaderboard
+{
+  leaderboard_entry_t *entries; // in rank order: mapped from the snapshot until the first change
+  size_t count;
+  size_t capacity;          // 0 while the entries are still mapped
+  const uint32_t *by_name;  // the snapshot's ranks in name order, or NULL once the entries change
+  uint64_t journal_offset;  // journal bytes included in the entries
+
+  void *map; // the mapped snapshot, or NULL
+  size_t map_size;
+
+  // Open-addressed hash table of names: each slot holds a rank + 1, or 0 if free
+  uint32_t *slots;
+  size_t num_slots;
+
+  // Wins in the journal since the snapshot, one entry per player in name order
+  leaderboard_entry_t *tail;
+  size_t tail_count;
+  size_t tail_records; // journal records they came from
+  uint64_t journal_end;
+
+  arena_t *scratch; // where the tail and leaderboard_top's working space come from, or NULL
+} leaderboard_t;
+
+/**
+ * Map a leaderboard's snapshot and read its journal. A missing file is an empty leaderboard.
+ * \param   board   Receives the leaderboard
+ * \param   path    The snapshot's file
+ * \param   scratch An arena for the memory a reader needs, which must outlive the leaderboard,
+ *                  or NULL to use the heap
+ * \return          NULL on success, otherwise a message explaining what is wrong with the files
+ */
+const char *leaderboard_open(leaderboard_t *board, const char *path, arena_t *scratch);
+
+/**
+ * Release a leaderboard (without saving it)
+ */
+void leaderboard_close(leaderboard_t *board);
+
+/**
+ * Give a player a win by appending it to a leaderboard's journal. Never waits for other writers
+ * or the compactor.
+ * \param   path    The leaderboard's snapshot file
+ * \param   name    The player's name; characters past LEADERBOARD_NAME_LEN are ignored
+ * \return          false if the journal could not be written (errno says why)
+ */
+bool leaderboard_record_win(const char *path, const char *name);
+
+/**
+ * Fold a leaderboard's journal into its snapshot, unless another process is already doing so.
+ * The first compaction also imports LEADERBOARD_LEGACY_FILE.
+ * \param   path        The leaderboard's snapshot file
+ * \param   min_records Only compact once the journal has this many records past the snapshot
+ * \return              NULL on success, otherwise a message explaining what went wrong
+ */
+const char *leaderboard_compact(const char *path, size_t min_records);
+
+/**
+ * Add entries for the players in a scoresheet written by an earlier version of the game: lines
+ * of a name and a score. Players already on the leaderboard keep their scores.
+ * \return          false if the file could not be read
+ */
+bool leaderboard_import_csv(leaderboard_t *board, const char *path);
+
+/**
+ * Give a player a win in memory, adding it to the entries if it is new
+ * \param   name    The player's name; characters past LEADERBOARD_NAME_LEN are ignored
+ * \return          The player's new rank among the entries, counting from 0
+ */
+size_t leaderboard_add_win(leaderboard_t *board, const char *name);
+
+/**
+ * Get a player's wins, counting the journal
+ */
+uint32_t leaderboard_score(leaderboard_t *board, const char *name);
+
+/**
+ * Get the best players, counting the journal
+ * \param   k       The most entries wanted
+ * \param   top     Receives up to k entries in rank order
+ * \return          The number of entries: k, or fewer if there are fewer players
+ */
+size_t leaderboard_top(leaderboard_t *board, size_t k, leaderboard_entry_t *top);
+
+/**
+ * Write the entries to a snapshot file, replacing it atomically
+ * \return          false if it could not be written (errno says why)
+ */
+bool leaderboard_save(const leaderboard_t *board, const char *path);
+
+#endif
@@ -0,0 +1,155 @@
+#define _GNU_SOURCE
+
+#include "pacer.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "util.h"
+
+static const uint64_t bucket_limits[PACER_BUCKETS - 1] = PACER_BUCKET_LIMITS;
+
+/**
+ * Set up a pacer with empty statistics
+ * \param   pacer         The pacer to initialize
+ * \param   period_ns     The loop's period
+ * \param   max_catch_up  Most periods to run at once after an overrun (at least 1)
+ */
+void pacer_init(pacer_t *pacer, uint64_t period_ns, int max_catch_up)
+{
+  memset(pacer, 0, sizeof(pacer_t));
+  pacer->period_ns = period_ns;
+  pacer->max_catch_up = max_catch_up > 1 ? max_catch_up : 1;
+  pacer_start(pacer);
+}
+
+/**
+ * Start a new run of the loop: the first deadline is one period from now. Statistics carry on.
+ */
+void pacer_start(pacer_t *pacer)
+{
+  pacer->deadline_ns = time_ns() + pacer->period_ns;
+}
+
+/**
+ * Sleep until the next deadline
+ * \return          The number of periods to run now: 1, or more to catch up after an overrun
+ */
+int pacer_wait(pacer_t *pacer)
+{
+  uint64_t now = time_ns();
+  if (now < pacer->deadline_ns && pacer->sleep_until != NULL)
+  {
+    pacer->sleep_until(pacer->deadline_ns);
+    now = time_ns();
+  }
+  else if (now < pacer->deadline_ns)
+  {
+    // time_ns reads the same clock, so the deadline can be handed straight to the kernel
+    struct timespec deadline = {.tv_sec = pacer->deadline_ns / 1000000000,
+                                .tv_nsec = pacer->deadline_ns % 1000000000};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+    {
+    }
+    now = time_ns();
+  }
+  else
+  {
+    pacer->stats.overruns++;
+  }
+  return pacer_due(pacer, now > pacer->deadline_ns ? now : pacer->deadline_ns);
+}
+
+/**
+ * Count the periods due at a time, for a loop that does its own waiting (an event loop serving
+ * many pacers, say). A call at or after the deadline counts as a wake-up.
+ * \param   now     The current time (time_ns)
+ * \return          The number of periods to run now: 0 before the deadline, 1, or more to catch
+ *                  up after an overrun
+ */
+int pacer_due(pacer_t *pacer, uint64_t now)
+{
+  if (now < pacer->deadline_ns)
+  {
+    return 0;
+  }
+  pacer_stats_t *stats = &pacer->stats;
+  uint64_t late = now - pacer->deadline_ns;
+  stats->wakes++;
+  stats->late_total_ns += late;
+  stats->late_max_ns = late > stats->late_max_ns ? late : stats->late_max_ns;
+  int bucket = 0;
+  while (bucket < PACER_BUCKETS - 1 && late >= bucket_limits[bucket] * 1000)
+  {
+    bucket++;
+  }
+  stats->histogram[bucket]++;
+
+  // Every period whose deadline has passed is due; the next deadline stays on the same phase
+  uint64_t due = 1 + late / pacer->period_ns;
+  pacer->deadline_ns += due * pacer->period_ns;
+  if (due > (uint64_t)pacer->max_catch_up)
+  {
+    stats->dropped += due - pacer->max_catch_up;
+    due = pacer->max_catch_up;
+  }
+  stats->periods += due;
+  return (int)due;
+}
+
+/**
+ * Add one pacer's statistics to a total
+ */
+void pacer_add_stats(pacer_stats_t *total, const pacer_stats_t *stats)
+{
+  total->wakes += stats->wakes;
+  total->periods += stats->periods;
+  total->overruns += stats->overruns;
+  total->dropped += stats->dropped;
+  total->late_total_ns += stats->late_total_ns;
+  total->late_max_ns =
+      stats->late_max_ns > total->late_max_ns ? stats->late_max_ns : total->late_max_ns;
+  for (int i = 0; i < PACER_BUCKETS; i++)
+  {
+    total->histogram[i] += stats->histogram[i];
+  }
+}
+
+/**
+ * Print how late a loop woke up and how often it fell behind
+ * \param   stats   The statistics to print
+ * \param   label   Names the loop
+ * \param   out     Where to print
+ */
+void pacer_report(const pacer_stats_t *stats, const char *label, FILE *out)
+{
+  if (stats->wakes == 0)
+  {
+    return;
+  }
+
+  // The smallest bucket limit that 99% of wake-ups came in under
+  uint64_t seen = 0;
+  int p99 = 0;
+  while (p99 < PACER_BUCKETS - 1 && (seen += stats->histogram[p99]) * 100 < stats->wakes * 99)
+  {
+    p99++;
+  }
+  char limit[32];
+  if (p99 < PACER_BUCKETS - 1)
+  {
+    snprintf(limit, sizeof(limit), "%llu us", (unsigned long long)bucket_limits[p99]);
+  }
+  else
+  {
+    snprintf(limit, sizeof(limit), "over %llu us",
+             (unsigned long long)bucket_limits[PACER_BUCKETS - 2]);
+  }
+  fprintf(out,
+          "%s: %llu periods, woke late by mean %.1f us, max %.1f us, 99%% within %s; "
+          "%llu overruns, %llu periods dropped\n",
+          label, (unsigned long long)stats->periods, stats->late_total_ns / 1000.0 / stats->wakes,
+          stats->late_max_ns / 1000.0, limit, (unsigned long long)stats->overruns,
+          (unsigned long long)stats->dropped);
+}
@@ -0,0 +1,86 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Wake-up lateness histogram buckets, in microseconds (the last bucket holds everything later)
+#define PACER_BUCKETS 8
+#define PACER_BUCKET_LIMITS {50, 100, 250, 500, 1000, 2000, 5000}
+
+// How well a loop kept to its period
+typedef struct pacer_stats
+{
+  uint64_t wakes;
+  uint64_t periods;  // periods run, counting ones run back to back to catch up
+  uint64_t overruns; // wake-ups that found the deadline already passed
+  uint64_t dropped;  // periods given up on rather than run late
+  uint64_t late_total_ns;
+  uint64_t late_max_ns;
+  uint64_t histogram[PACER_BUCKETS]; // wake-ups by lateness
+} pacer_stats_t;
+
+/**
+ * Paces a loop against absolute deadlines on the monotonic clock: the nth period starts at
+ * start + n * period however long the work or the sleeps take, so errors never add up over a
+ * match.
+ *
+ * When the work overruns, the periods whose deadlines have passed are run back to back to catch
+ * up, up to max_catch_up of them; the rest are dropped and the loop carries on at its usual phase.
+ * A simulation catches up so game time keeps pace with real time; a renderer uses a max_catch_up
+ * of 1, since only the latest frame is worth drawing.
+ */
+typedef struct pacer
+{
+  uint64_t period_ns;
+  int max_catch_up;
+  uint64_t deadline_ns; // start of the next period
+  pacer_stats_t stats;
+
+  // Sleeps until a time on the monotonic clock, for a loop that must not block its thread (a
+  // scheduler task, say); NULL to sleep the calling thread
+  void (*sleep_until)(uint64_t deadline_ns);
+} pacer_t;
+
+/**
+ * Set up a pacer with empty statistics
+ * \param   pacer         The pacer to initialize
+ * \param   period_ns     The loop's period
+ * \param   max_catch_up  Most periods to run at once after an overrun (at least 1)
+ */
+void pacer_init(pacer_t *pacer, uint64_t period_ns, int max_catch_up);
+
+/**
+ * Start a new run of the loop: the first deadline is one period from now. Statistics carry on.
+ */
+void pacer_start(pacer_t *pacer);
+
+/**
+ * Sleep until the next deadline
+ * \return          The number of periods to run now: 1, or more to catch up after an overrun
+ */
+int pacer_wait(pacer_t *pacer);
+
+/**
+ * Count the periods due at a time, for a loop that does its own waiting (an event loop serving
+ * many pacers, say). A call at or after the deadline counts as a wake-up.
+ * \param   now     The current time (time_ns)
+ * \return          The number of periods to run now: 0 before the deadline, 1, or more to catch
+ *                  up after an overrun
+ */
+int pacer_due(pacer_t *pacer, uint64_t now);
+
+/**
+ * Add one pacer's statistics to a total
+ */
+void pacer_add_stats(pacer_stats_t *total, const pacer_stats_t *stats);
+
+/**
+ * Print how late a loop woke up and how often it fell behind
+ * \param   stats   The statistics to print
+ * \param   label   Names the loop
+ * \param   out     Where to print
+ */
+void pacer_report(const pacer_stats_t *stats, const char *label, FILE *out);
+
+#endif
@@ -0,0 +1,366 @@
+#define _GNU_SOURCE
+
+#include "pipebot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "util.h"
+
+/**
+ * Write a number as little-endian bytes
+ */
+static uint8_t *put_le(uint8_t *out, uint32_t value, int bytes)
+{
+  for (int i = 0; i < bytes; i++)
+  {
+    *out++ = (uint8_t)(value >> (8 * i));
+  }
+  return out;
+}
+
+/**
+ * Run in a thread to time the bot's answers as they arrive
+ */
+static void *pipebot_reader(void *arg)
+{
+  pipebot_t *bot = arg;
+  int answered = 0; // a bot that sends extra bytes only gets its first answer counted
+  uint8_t buffer[64];
+  ssize_t n;
+  while ((n = read(bot->from_bot, buffer, sizeof(buffer))) != 0)
+  {
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      break;
+    }
+    uint64_t now = time_ns();
+    int request = atomic_load_explicit(&bot->asked, memory_order_acquire);
+    if (request == 0 || request == answered)
+    {
+      continue;
+    }
+    uint64_t latency = now - atomic_load_explicit(&bot->asked_ns, memory_order_relaxed);
+    bot->stats.decisions++;
+    bot->stats.total_ns += latency;
+    bot->stats.max_ns = latency > bot->stats.max_ns ? latency : bot->stats.max_ns;
+
+    // Anything but a direction keeps the player going the way it was
+    atomic_store_explicit(&bot->answer_dir, buffer[0] <= DIR_WEST ? buffer[0] : -1,
+                          memory_order_relaxed);
+    atomic_store_explicit(&bot->answered, request, memory_order_release);
+    answered = request;
+  }
+  atomic_store(&bot->gone, true);
+  return NULL;
+}
+
+/**
+ * Start a bot program with its standard input and output connected to the game
+ * \param   bot     The bot to initialize
+ * \param   game    The game the bot plays in
+ * \param   player  The index of the player to steer
+ * \param   command A shell command that runs the bot
+ * \return          false if the program could not be started (errno says why)
+ */
+bool pipebot_init(pipebot_t *bot, const game_t *game, int player, const char *command)
+{
+  memset(bot, 0, sizeof(pipebot_t));
+  bot->player = player;
+  bot->width = game->width;
+  bot->height = game->height;
+  atomic_init(&bot->asked, 0);
+  atomic_init(&bot->answered, 0);
+  atomic_init(&bot->answer_dir, -1);
+  atomic_init(&bot->gone, false);
+
+  int to_bot[2];
+  int from_bot[2];
+  if (pipe2(to_bot, O_CLOEXEC) != 0)
+  {
+    return false;
+  }
+  if (pipe2(from_bot, O_CLOEXEC) != 0)
+  {
+    close(to_bot[0]);
+    close(to_bot[1]);
+    return false;
+  }
+  bot->pid = fork();
+  if (bot->pid == 0)
+  {
+    // The bot's diagnostics would scribble over the game's screen
+    int null = open("/dev/null", O_WRONLY);
+    dup2(to_bot[0], STDIN_FILENO);
+    dup2(from_bot[1], STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+    _exit(127);
+  }
+  int saved = errno;
+  close(to_bot[0]);
+  close(from_bot[1]);
+  if (bot->pid < 0)
+  {
+    close(to_bot[1]);
+    close(from_bot[0]);
+    errno = saved;
+    return false;
+  }
+  bot->to_bot = to_bot[1];
+  bot->from_bot = from_bot[0];
+
+  // Writes must never block the simulation; a dead bot is noticed through EPIPE
+  fcntl(bot->to_bot, F_SETFL, O_NONBLOCK);
+  signal(SIGPIPE, SIG_IGN);
+
+  size_t cells = (size_t)game->width * game->height;
+  bot->seen = calloc(cells, 1);
+  bot->capacity = 9 + cells * 6; // every cell changed, with the longest possible gaps
+  bot->message = malloc(bot->capacity);
+  if (bot->seen == NULL || bot->message == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  if (pthread_create(&bot->reader, NULL, pipebot_reader, bot) != 0)
+  {
+    perror("pthread_create");
+    exit(2);
+  }
+  return true;
+}
+
+/**
+ * Stop a bot program and release everything it owns
+ */
+void pipebot_free(pipebot_t *bot)
+{
+  // Closing its input is the polite way to ask a bot to exit
+  close(bot->to_bot);
+  kill(bot->pid, SIGTERM);
+  waitpid(bot->pid, NULL, 0);
+  pthread_join(bot->reader, NULL);
+  close(bot->from_bot);
+  free(bot->seen);
+  free(bot->message);
+}
+
+/**
+ * Write a whole message without waiting. A bot that cannot take a message whole is stopped: it
+ * has either exited or stopped reading its input, and a partial message would corrupt the stream.
+ * \return        true if the message was written
+ */
+static bool pipebot_write(pipebot_t *bot, const uint8_t *message, size_t size)
+{
+  if (atomic_load(&bot->gone))
+  {
+    return false;
+  }
+  ssize_t n = write(bot->to_bot, message, size);
+  if (n == (ssize_t)size)
+  {
+    return true;
+  }
+  if (n < 0 && errno == EAGAIN)
+  {
+    return false;
+  }
+  atomic_store(&bot->gone, true);
+  kill(bot->pid, SIGTERM);
+  return false;
+}
+
+/**
+ * Tell the bot a new round has started. Call this right after game_reset.
+ */
+void pipebot_start_round(pipebot_t *bot, const game_t *game)
+{
+  // An answer still outstanding belongs to the last round
+  bot->late = atomic_load(&bot->asked) != 0;
+  memset(bot->seen, CELL_EMPTY, (size_t)bot->width * bot->height);
+  bot->num_pending = 0;
+  bot->compare_all = true; // the starting bikes were placed before the round was announced
+
+  uint8_t message[7] = {PIPEBOT_MSG_ROUND};
+  uint8_t *out = put_le(message + 1, game->width, 2);
+  out = put_le(out, game->height, 2);
+  *out++ = (uint8_t)game->num_players;
+  *out++ = (uint8_t)bot->player;
+  pipebot_write(bot, message, sizeof(message));
+}
+
+/**
+ * Steer the bot's player with its answer, if one arrived in time. Never waits. Call this every
+ * tick, before game_tick.
+ */
+void pipebot_steer(pipebot_t *bot, game_t *game)
+{
+  int request = atomic_load_explicit(&bot->asked, memory_order_relaxed);
+  if (request == 0)
+  {
+    return;
+  }
+  if (atomic_load_explicit(&bot->answered, memory_order_acquire) != request)
+  {
+    // No answer yet: the deadline has passed, so whatever the bot says will be too late
+    if (!bot->late)
+    {
+      bot->late = true;
+      bot->stats.over_budget++;
+    }
+    return;
+  }
+  int dir = atomic_load_explicit(&bot->answer_dir, memory_order_relaxed);
+  if (dir >= 0 && !bot->late && game->players[bot->player].alive)
+  {
+    game_steer(game, bot->player, dir);
+  }
+  bot->late = false;
+  atomic_store_explicit(&bot->asked, 0, memory_order_relaxed);
+}
+
+/**
+ * Append a cell's index and new value to a TICK message
+ * \param   previous    The index of the last cell in the message, updated to this one
+ */
+static uint8_t *put_change(uint8_t *out, size_t index, uint8_t cell, size_t *previous)
+{
+  for (uint64_t gap = index - *previous - 1; ; gap >>= 7)
+  {
+    *out++ = (uint8_t)(gap & 0x7f) | (gap >= 0x80 ? 0x80 : 0);
+    if (gap < 0x80)
+    {
+      break;
+    }
+  }
+  *out++ = cell;
+  *previous = index;
+  return out;
+}
+
+/**
+ * Order cell indices for qsort
+ */
+static int compare_index(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Send the bot the cells that changed since it last saw the board, unless it has yet to answer
+ * the previous message. Never waits. Call this every tick, after game_tick and before
+ * game_publish, which clears the game's list of the cells written.
+ * \param   tick    The number of the tick just played, counting from 0 at the start of the round
+ */
+void pipebot_send(pipebot_t *bot, const game_t *game, int tick)
+{
+  if (atomic_load(&bot->gone))
+  {
+    return;
+  }
+
+  // Note this tick's writes even while an answer is outstanding, so they go out with the next
+  // message
+  if (game->changed_all || bot->num_pending + game->num_changed > PIPEBOT_MAX_PENDING)
+  {
+    bot->compare_all = true;
+  }
+  else
+  {
+    memcpy(bot->pending + bot->num_pending, game->changed, sizeof(uint32_t) * game->num_changed);
+    bot->num_pending += game->num_changed;
+  }
+  if (atomic_load_explicit(&bot->asked, memory_order_relaxed) != 0)
+  {
+    return;
+  }
+
+  uint8_t *out = bot->message + 9;
+  uint32_t count = 0;
+  size_t previous = (size_t)-1;
+  size_t cells = (size_t)bot->width * bot->height;
+  if (bot->compare_all)
+  {
+    // Compare a word at a time; most of the board is the same as last time
+    for (size_t i = 0; i < cells; i++)
+    {
+      if (i + 8 <= cells && memcmp(game->cells + i, bot->seen + i, 8) == 0)
+      {
+        i += 7;
+        continue;
+      }
+      if (game->cells[i] != bot->seen[i])
+      {
+        out = put_change(out, i, game->cells[i], &previous);
+        count++;
+      }
+    }
+  }
+  else
+  {
+    // Only the cells written since the last message can differ. A cell written twice, or back to
+    // what the bot saw, is sent at most once.
+    qsort(bot->pending, bot->num_pending, sizeof(uint32_t), compare_index);
+    for (int i = 0; i < bot->num_pending; i++)
+    {
+      uint32_t index = bot->pending[i];
+      if (index != previous && game->cells[index] != bot->seen[index])
+      {
+        out = put_change(out, index, game->cells[index], &previous);
+        count++;
+      }
+    }
+  }
+  bot->message[0] = PIPEBOT_MSG_TICK;
+  put_le(put_le(bot->message + 1, (uint32_t)tick, 4), count, 4);
+
+  // The bot may answer before write returns, so the request is in flight from before then
+  atomic_store_explicit(&bot->asked_ns, time_ns(), memory_order_relaxed);
+  bot->requests = bot->requests == INT_MAX ? 1 : bot->requests + 1;
+  atomic_store_explicit(&bot->asked, bot->requests, memory_order_release);
+  if (!pipebot_write(bot, bot->message, out - bot->message))
+  {
+    atomic_store_explicit(&bot->asked, 0, memory_order_relaxed);
+    return; // the changes stay unseen and go out with the next message
+  }
+
+  if (bot->compare_all)
+  {
+    memcpy(bot->seen, game->cells, cells);
+  }
+  for (int i = 0; i < bot->num_pending; i++)
+  {
+    bot->seen[bot->pending[i]] = game->cells[bot->pending[i]];
+  }
+  bot->num_pending = 0;
+  bot->compare_all = false;
+}
+
+/**
+ * Print a bot's answer latency and missed deadlines
+ */
+void pipebot_report(const pipebot_t *bot, FILE *out)
+{
+  if (bot->stats.decisions == 0)
+  {
+    fprintf(out, "external bot %d: no answers\n", bot->player + 1);
+    return;
+  }
+  fprintf(out, "external bot %d: %llu answers, mean %.1f us, max %.1f us, %llu missed deadlines\n",
+          bot->player + 1, (unsigned long long)bot->stats.decisions,
+          bot->stats.total_ns / 1000.0 / bot->stats.decisions, bot->stats.max_ns / 1000.0,
+          (unsigned long long)bot->stats.over_budget);
+}
@@ -0,0 +1,117 @@
+#ifndef PIPEBOT_H
+#define PIPEBOT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "bot.h"
+#include "game.h"
+
+// Messages to an external bot, on its standard input. Numbers are little-endian.
+#define PIPEBOT_MSG_ROUND 'R' // width (2 bytes), height (2 bytes), players (1), the bot's player (1)
+#define PIPEBOT_MSG_TICK 'T'  // tick (4 bytes), number of changed cells (4), then the changes
+
+// Most cell writes a bot's next message can list before the whole board is compared instead
+#define PIPEBOT_MAX_PENDING 1024
+
+/**
+ * A player steered by another program, written in any language, that talks to the game over
+ * pipes.
+ *
+ * At the start of each round the bot gets a ROUND message; its copy of the board starts out empty.
+ * After every tick the game sends a TICK message with the cells that changed since the last one
+ * the bot saw, each as the gap from the previous changed cell's index (a variable-length integer
+ * of 7 bits per byte, low bits first, counting from index -1) followed by the cell's new value as
+ * described in game.h. Indices count row by row from the top left. With fading trails, a cell that
+ * fades is sent as changing to empty.
+ *
+ * The bot answers every TICK with one byte: a DIR_ value to steer, or anything else to keep its
+ * direction. The answer must arrive before the next tick (SIM_TICK_INTERVAL milliseconds); a late
+ * answer is ignored and the player keeps its direction. The game never waits for a bot: while an
+ * answer is outstanding the bot is sent nothing, and the changes it has not seen are batched into
+ * the next message.
+ *
+ * A thread per bot reads its answers as they arrive, to time them.
+ */
+typedef struct pipebot
+{
+  int player; // index of the player this bot steers
+  int width;
+  int height;
+
+  pid_t pid;
+  int to_bot;   // the bot's standard input
+  int from_bot; // the bot's standard output
+  pthread_t reader;
+
+  uint8_t *seen;    // the board as the bot last saw it
+  uint8_t *message; // scratch space for building a message
+  size_t capacity;
+
+  // Cells written since the bot's last message, in the order written and possibly repeated. When
+  // too many pile up, or the game lost track of its changes, the whole board is compared instead.
+  uint32_t pending[PIPEBOT_MAX_PENDING];
+  int num_pending;
+  bool compare_all;
+
+  // The request in flight: its number (or 0) and when it was sent. Set by the simulation thread.
+  int requests; // requests sent so far, to number them
+  atomic_int asked;
+  _Atomic uint64_t asked_ns;
+  bool late; // the request missed its deadline, so its answer will be ignored
+
+  // The latest answer: the request it answers (or 0) and its direction (or -1 to keep going).
+  // Set by the reader thread.
+  atomic_int answered;
+  atomic_int answer_dir;
+  atomic_bool gone; // the bot has exited or closed its pipes
+
+  // decisions, total_ns and max_ns time every answer (written by the reader thread);
+  // over_budget counts missed deadlines (written by the simulation thread)
+  bot_stats_t stats;
+} pipebot_t;
+
+/**
+ * Start a bot program with its standard input and output connected to the game
+ * \param   bot     The bot to initialize
+ * \param   game    The game the bot plays in
+ * \param   player  The index of the player to steer
+ * \param   command A shell command that runs the bot
+ * \return          false if the program could not be started (errno says why)
+ */
+bool pipebot_init(pipebot_t *bot, const game_t *game, int player, const char *command);
+
+/**
+ * Stop a bot program and release everything it owns
+ */
+void pipebot_free(pipebot_t *bot);
+
+/**
+ * Tell the bot a new round has started. Call this right after game_reset.
+ */
+void pipebot_start_round(pipebot_t *bot, const game_t *game);
+
+/**
+ * Steer the bot's player with its answer, if one arrived in time. Never waits. Call this every
+ * tick, before game_tick.
+ */
+void pipebot_steer(pipebot_t *bot, game_t *game);
+
+/**
+ * Send the bot the cells that changed since it last saw the board, unless it has yet to answer
+ * the previous message. Never waits. Call this every tick, after game_tick and before
+ * game_publish, which clears the game's list of the cells written.
+ * \param   tick    The number of the tick just played, counting from 0 at the start of the round
+ */
+void pipebot_send(pipebot_t *bot, const game_t *game, int tick);
+
+/**
+ * Print a bot's answer latency and missed deadlines
+ */
+void pipebot_report(const pipebot_t *bot, FILE *out);
+
+#endif
@@ -0,0 +1,370 @@
+#include "render.h"
+
+#include <curses.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "game.h"
+
+// Color pair used for player bikes (trails use pairs 1 to RENDER_TRAIL_COLORS)
+#define BIKE_COLOR_PAIR (RENDER_TRAIL_COLORS + 1)
+
+// Background of each trail color and of bikes, as curses colors (also the ANSI color numbers)
+static const int trail_colors[RENDER_TRAIL_COLORS] = {COLOR_YELLOW, COLOR_CYAN, COLOR_MAGENTA,
+                                                      COLOR_GREEN,  COLOR_RED,  COLOR_BLUE};
+#define BIKE_COLOR COLOR_WHITE
+
+// Shown by the ansi backend for cells whose contents on the terminal are unknown
+#define CELL_UNKNOWN 0xff
+
+// Shortest run of cells the ansi backend empties with one erase rather than spaces
+#define ERASE_RUN 8
+
+/**
+ * Get the color pair a cell is drawn in: 0 for an empty cell
+ */
+static int cell_pair(uint8_t cell)
+{
+  if (cell == CELL_EMPTY)
+  {
+    return 0;
+  }
+  if (cell & CELL_BIKE)
+  {
+    return BIKE_COLOR_PAIR;
+  }
+  return 1 + (CELL_OWNER(cell) - 1) % RENDER_TRAIL_COLORS;
+}
+
+/**
+ * Get the background a cell is drawn with, as an ANSI color number (9 is the default)
+ */
+static int cell_background(uint8_t cell)
+{
+  int pair = cell_pair(cell);
+  if (pair == 0)
+  {
+    return 9;
+  }
+  return pair == BIKE_COLOR_PAIR ? BIKE_COLOR : trail_colors[pair - 1];
+}
+
+/**
+ * Define the color pairs for the bikes and trails
+ */
+static void init_colors(void)
+{
+  use_default_colors();
+  start_color();
+  for (int i = 0; i < RENDER_TRAIL_COLORS; i++)
+  {
+    init_pair(1 + i, -1, trail_colors[i]);
+  }
+  init_pair(BIKE_COLOR_PAIR, -1, BIKE_COLOR);
+}
+
+/**
+ * Draw a single board cell with curses
+ */
+static void curses_cell(renderer_t *renderer, int row, int col, uint8_t cell)
+{
+  mvaddch(renderer->top + row, renderer->left + col, ' ' | COLOR_PAIR(cell_pair(cell)));
+}
+
+static void curses_flush(renderer_t *renderer)
+{
+  refresh();
+}
+
+static void curses_nothing(renderer_t *renderer)
+{
+  // curses keeps track of the screen itself
+}
+
+static void curses_destroy(renderer_t *renderer)
+{
+  free(renderer);
+}
+
+static const render_backend_t curses_backend = {
+    .name = "curses",
+    .cell = curses_cell,
+    .flush = curses_flush,
+    .invalidate = curses_nothing,
+    .sync = curses_nothing,
+    .destroy = curses_destroy,
+};
+
+// The ansi backend's state
+typedef struct ansi_renderer
+{
+  renderer_t base;
+  int fd;
+  uint8_t *shown; // what the terminal shows, or CELL_UNKNOWN
+  uint8_t *next;  // what the next frame should show
+  char *buffer;   // the frame being built, big enough for every cell to change
+  size_t capacity;
+} ansi_renderer_t;
+
+static void ansi_cell(renderer_t *renderer, int row, int col, uint8_t cell)
+{
+  ansi_renderer_t *ansi = (ansi_renderer_t *)renderer;
+  ansi->next[row * renderer->width + col] = cell;
+}
+
+/**
+ * Write a number in decimal
+ * \return        The position after it
+ */
+static char *put_number(char *out, int n)
+{
+  char digits[12];
+  int len = 0;
+  do
+  {
+    digits[len++] = '0' + n % 10;
+    n /= 10;
+  } while (n > 0);
+  while (len > 0)
+  {
+    *out++ = digits[--len];
+  }
+  return out;
+}
+
+static void ansi_flush(renderer_t *renderer)
+{
+  ansi_renderer_t *ansi = (ansi_renderer_t *)renderer;
+  char *out = ansi->buffer;
+  int width = renderer->width;
+
+  // Save the cursor and attributes ncurses left
+  memcpy(out, "\0337", 2);
+  out += 2;
+
+  int cursor_row = -1; // where the terminal's cursor is, in board cells (-1: unknown)
+  int cursor_col = -1;
+  int color = -1;      // the current background: a curses color, 9 for the default, -1 unknown
+  bool changed = false;
+  for (int r = 0; r < renderer->height; r++)
+  {
+    const uint8_t *next = ansi->next + r * width;
+    uint8_t *shown = ansi->shown + r * width;
+    if (memcmp(next, shown, width) == 0)
+    {
+      continue;
+    }
+    for (int c = 0; c < width; c++)
+    {
+      if (next[c] == shown[c])
+      {
+        continue;
+      }
+      changed = true;
+      int background = cell_background(next[c]);
+
+      // Move to the cell. A short gap of unchanged cells in the current color is cheaper to draw
+      // over again than to step across; otherwise step forward within a row, or move there.
+      int gap = r == cursor_row ? c - cursor_col : -1;
+      bool redraw = gap > 0 && gap <= 3;
+      for (int g = cursor_col; redraw && g < c; g++)
+      {
+        redraw = shown[g] != CELL_UNKNOWN && cell_background(shown[g]) == color;
+      }
+      if (redraw)
+      {
+        memset(out, ' ', gap);
+        out += gap;
+      }
+      else if (gap > 0)
+      {
+        memcpy(out, "\033[", 2);
+        out = put_number(out + 2, gap);
+        *out++ = 'C';
+      }
+      else if (r != cursor_row || c != cursor_col)
+      {
+        memcpy(out, "\033[", 2);
+        out = put_number(out + 2, renderer->top + r + 1);
+        *out++ = ';';
+        out = put_number(out, renderer->left + c + 1);
+        *out++ = 'H';
+      }
+
+      if (background != color)
+      {
+        memcpy(out, "\033[4", 3);
+        out[3] = '0' + background;
+        out[4] = 'm';
+        out += 5;
+        color = background;
+      }
+
+      // A long run of cells to empty is erased in place, leaving the cursor where it is
+      int run = 1;
+      while (background == 9 && c + run < width && next[c + run] == CELL_EMPTY &&
+             shown[c + run] != CELL_EMPTY)
+      {
+        run++;
+      }
+      cursor_row = r;
+      if (run >= ERASE_RUN)
+      {
+        memcpy(out, "\033[", 2);
+        out = put_number(out + 2, run);
+        *out++ = 'X';
+        memset(shown + c, CELL_EMPTY, run);
+        cursor_col = c;
+        c += run - 1;
+        continue;
+      }
+      *out++ = ' ';
+      shown[c] = next[c];
+      cursor_col = c + 1;
+    }
+  }
+  if (!changed)
+  {
+    return;
+  }
+
+  // Put back what ncurses expects
+  memcpy(out, "\0338", 2);
+  out += 2;
+
+  // One write per frame; a terminal that takes only part of it gets the rest straight after
+  const char *data = ansi->buffer;
+  size_t size = out - ansi->buffer;
+  renderer->bytes += size;
+  while (size > 0)
+  {
+    ssize_t n = write(ansi->fd, data, size);
+    if (n < 0 && errno != EINTR)
+    {
+      break;
+    }
+    if (n > 0)
+    {
+      data += n;
+      size -= n;
+    }
+  }
+}
+
+static void ansi_invalidate(renderer_t *renderer)
+{
+  ansi_renderer_t *ansi = (ansi_renderer_t *)renderer;
+  memset(ansi->shown, CELL_UNKNOWN, (size_t)renderer->width * renderer->height);
+}
+
+static void ansi_sync(renderer_t *renderer)
+{
+  ansi_renderer_t *ansi = (ansi_renderer_t *)renderer;
+  for (int r = 0; r < renderer->height; r++)
+  {
+    for (int c = 0; c < renderer->width; c++)
+    {
+      uint8_t cell = ansi->shown[r * renderer->width + c];
+      if (cell != CELL_UNKNOWN)
+      {
+        curses_cell(renderer, r, c, cell);
+      }
+    }
+  }
+}
+
+static void ansi_destroy(renderer_t *renderer)
+{
+  ansi_renderer_t *ansi = (ansi_renderer_t *)renderer;
+  free(ansi->shown);
+  free(ansi->next);
+  free(ansi->buffer);
+  free(ansi);
+}
+
+static const render_backend_t ansi_backend = {
+    .name = "ansi",
+    .cell = ansi_cell,
+    .flush = ansi_flush,
+    .invalidate = ansi_invalidate,
+    .sync = ansi_sync,
+    .destroy = ansi_destroy,
+};
+
+/**
+ * Create a renderer. ncurses must already be initialized.
+ * \param   name    "ansi" or "curses"
+ * \param   width   The board width in cells
+ * \param   height  The board height in cells
+ * \param   top     The screen row of the board's first row
+ * \param   left    The screen column of the board's first column
+ * \param   fd      Where the ansi backend writes, normally the terminal on standard output
+ * \return          The renderer, or NULL if there is no backend of that name
+ */
+renderer_t *render_create(const char *name, int width, int height, int top, int left, int fd)
+{
+  renderer_t *renderer;
+  if (strcmp(name, "curses") == 0)
+  {
+    renderer = malloc(sizeof(renderer_t));
+    if (renderer == NULL)
+    {
+      perror("malloc");
+      exit(2);
+    }
+    renderer->backend = &curses_backend;
+  }
+  else if (strcmp(name, "ansi") == 0)
+  {
+    ansi_renderer_t *ansi = malloc(sizeof(ansi_renderer_t));
+    if (ansi == NULL)
+    {
+      perror("malloc");
+      exit(2);
+    }
+    size_t cells = (size_t)width * height;
+    // Worst case per cell: an absolute move, a color change and the space itself
+    ansi->capacity = 4 + cells * (sizeof("\033[65535;65535H") + sizeof("\033[49m"));
+    ansi->fd = fd;
+    ansi->shown = malloc(cells);
+    ansi->next = malloc(cells);
+    ansi->buffer = malloc(ansi->capacity);
+    if (ansi->shown == NULL || ansi->next == NULL || ansi->buffer == NULL)
+    {
+      perror("malloc");
+      exit(2);
+    }
+    memset(ansi->shown, CELL_UNKNOWN, cells);
+    memset(ansi->next, CELL_EMPTY, cells);
+    renderer = &ansi->base;
+    renderer->backend = &ansi_backend;
+  }
+  else
+  {
+    return NULL;
+  }
+
+  renderer->width = width;
+  renderer->height = height;
+  renderer->top = top;
+  renderer->left = left;
+  renderer->frames = 0;
+  renderer->bytes = 0;
+  init_colors();
+  return renderer;
+}
+
+/**
+ * Pick the backend to use when none is asked for: ansi on a terminal that understands it,
+ * otherwise curses
+ */
+const char *render_default_backend(void)
+{
+  const char *term = getenv("TERM");
+  bool ansi = isatty(STDOUT_FILENO) && term != NULL && strcmp(term, "dumb") != 0 &&
+              strncmp(term, "vt52", 4) != 0 && has_colors();
+  return ansi ? "ansi" : "curses";
+}
@@ -0,0 +1,111 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Number of colors used to tell player trails apart
+#define RENDER_TRAIL_COLORS 6
+
+typedef struct renderer renderer_t;
+
+// The operations every rendering backend provides
+typedef struct render_backend
+{
+  const char *name;
+  void (*cell)(renderer_t *renderer, int row, int col, uint8_t cell);
+  void (*flush)(renderer_t *renderer);
+  void (*invalidate)(renderer_t *renderer);
+  void (*sync)(renderer_t *renderer);
+  void (*destroy)(renderer_t *renderer);
+} render_backend_t;
+
+/**
+ * Draws board cells on the terminal. Every other part of the screen (the border, messages and
+ * menus) is left to ncurses.
+ *
+ * Two backends are available:
+ *   curses  each cell goes through mvaddch and each frame through refresh
+ *   ansi    cells are collected and, at the end of the frame, the ones that differ from what the
+ *           terminal shows are written as ANSI escapes into a preallocated buffer with a single
+ *           write(). Cursor moves are only emitted where a run of changed cells is broken, and
+ *           colors only where they change. The cursor and attributes ncurses left are saved and
+ *           restored around the frame, so ncurses never notices.
+ */
+struct renderer
+{
+  const render_backend_t *backend;
+  int width;  // board size in cells
+  int height;
+  int top;    // screen row of the board's first row, counting from 0
+  int left;   // screen column of the board's first column
+
+  // Frames flushed and bytes written to the terminal so far (bytes only for the ansi backend)
+  uint64_t frames;
+  uint64_t bytes;
+};
+
+/**
+ * Create a renderer. ncurses must already be initialized.
+ * \param   name    "ansi" or "curses"
+ * \param   width   The board width in cells
+ * \param   height  The board height in cells
+ * \param   top     The screen row of the board's first row
+ * \param   left    The screen column of the board's first column
+ * \param   fd      Where the ansi backend writes, normally the terminal on standard output
+ * \return          The renderer, or NULL if there is no backend of that name
+ */
+renderer_t *render_create(const char *name, int width, int height, int top, int left, int fd);
+
+/**
+ * Pick the backend to use when none is asked for: ansi on a terminal that understands it,
+ * otherwise curses
+ */
+const char *render_default_backend(void);
+
+/**
+ * Set a board cell for the next frame
+ * \param   row     The board row of the cell
+ * \param   col     The board column of the cell
+ * \param   cell    The encoded contents of the cell (see game.h)
+ */
+static inline void render_cell(renderer_t *renderer, int row, int col, uint8_t cell)
+{
+  renderer->backend->cell(renderer, row, col, cell);
+}
+
+/**
+ * Put the cells set since the last flush on the screen
+ */
+static inline void render_flush(renderer_t *renderer)
+{
+  renderer->backend->flush(renderer);
+  renderer->frames++;
+}
+
+/**
+ * Forget what the screen shows, e.g. after it was cleared, so the next frame draws every cell
+ * set again
+ */
+static inline void render_invalidate(renderer_t *renderer)
+{
+  renderer->backend->invalidate(renderer);
+}
+
+/**
+ * Bring ncurses' idea of the board up to date, before drawing something over it with ncurses
+ */
+static inline void render_sync(renderer_t *renderer)
+{
+  renderer->backend->sync(renderer);
+}
+
+/**
+ * Release a renderer
+ */
+static inline void render_free(renderer_t *renderer)
+{
+  renderer->backend->destroy(renderer);
+}
+
+#endif
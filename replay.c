@@ -0,0 +1,615 @@
+#include "replay.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util.h"
+
+// Record kinds, stored in the low two bits of each tag
+#define REC_STEER 0
+#define REC_KEYFRAME 1
+#define REC_END 2
+#define REC_ROUND 3
+
+#define HEADER_MAGIC "TRONREP2"
+#define FOOTER_MAGIC "TRONIDX1"
+#define MAGIC_SIZE 8
+#define FOOTER_SIZE (8 + MAGIC_SIZE)
+
+// A position in a mapped replay
+typedef struct reader
+{
+  const uint8_t *pos;
+  const uint8_t *end;
+} reader_t;
+
+/**
+ * Append bytes to a growable buffer
+ */
+static void put_bytes(uint8_t **data, size_t *size, size_t *capacity, const void *bytes, size_t n)
+{
+  if (*size + n > *capacity)
+  {
+    size_t grown = *capacity > 0 ? *capacity * 2 : 4096;
+    while (grown < *size + n)
+    {
+      grown *= 2;
+    }
+    *data = realloc(*data, grown);
+    if (*data == NULL)
+    {
+      perror("realloc");
+      exit(2);
+    }
+    *capacity = grown;
+  }
+  memcpy(*data + *size, bytes, n);
+  *size += n;
+}
+
+/**
+ * Append an unsigned integer to a growable buffer, seven bits per byte with the high bit set on
+ * every byte but the last
+ */
+static void put_varint(uint8_t **data, size_t *size, size_t *capacity, uint64_t value)
+{
+  uint8_t bytes[10];
+  size_t n = 0;
+  while (value >= 0x80)
+  {
+    bytes[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  bytes[n++] = (uint8_t)value;
+  put_bytes(data, size, capacity, bytes, n);
+}
+
+/**
+ * Read an integer written by put_varint
+ * \return        false if the integer runs past the end of the data
+ */
+static bool get_varint(reader_t *r, uint64_t *value)
+{
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && r->pos < r->end; shift += 7)
+  {
+    uint8_t byte = *r->pos++;
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+    {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Read an integer that must be below a limit
+ */
+static bool get_int(reader_t *r, uint64_t limit, int *value)
+{
+  uint64_t v;
+  if (!get_varint(r, &v) || v >= limit)
+  {
+    return false;
+  }
+  *value = (int)v;
+  return true;
+}
+
+/**
+ * Start recording a session
+ * \param   writer  The writer to initialize
+ * \param   config  The game configuration
+ * \param   seed    The random seed of the session
+ */
+void replay_writer_init(replay_writer_t *writer, const game_config_t *config, uint64_t seed)
+{
+  memset(writer, 0, sizeof(replay_writer_t));
+  writer->config = *config;
+  writer->seed = seed;
+
+  put_bytes(&writer->data, &writer->size, &writer->capacity, HEADER_MAGIC, MAGIC_SIZE);
+  put_varint(&writer->data, &writer->size, &writer->capacity, seed);
+  put_varint(&writer->data, &writer->size, &writer->capacity, config->width);
+  put_varint(&writer->data, &writer->size, &writer->capacity, config->height);
+  put_varint(&writer->data, &writer->size, &writer->capacity, config->num_players);
+  put_varint(&writer->data, &writer->size, &writer->capacity, REPLAY_KEYFRAME_INTERVAL);
+}
+
+/**
+ * Release the memory owned by a writer
+ */
+void replay_writer_free(replay_writer_t *writer)
+{
+  free(writer->data);
+  free(writer->index);
+  writer->data = NULL;
+  writer->index = NULL;
+}
+
+/**
+ * Start a record in the current round and note where it is in the index if asked to
+ */
+static void put_tag(replay_writer_t *writer, int kind, bool indexed)
+{
+  if (indexed)
+  {
+    put_varint(&writer->index, &writer->index_size, &writer->index_capacity, writer->round);
+    put_varint(&writer->index, &writer->index_size, &writer->index_capacity, writer->tick);
+    put_varint(&writer->index, &writer->index_size, &writer->index_capacity, writer->size);
+  }
+  uint64_t delta = (uint64_t)(writer->tick - writer->last_tick);
+  put_varint(&writer->data, &writer->size, &writer->capacity, delta << 2 | kind);
+  writer->last_tick = writer->tick;
+}
+
+/**
+ * Record the start of a round. Call this right after game_reset.
+ */
+void replay_start_round(replay_writer_t *writer, const game_t *game)
+{
+  writer->round++;
+  writer->tick = 0;
+  writer->last_tick = 0;
+  put_tag(writer, REC_ROUND, true);
+  for (int i = 0; i < game->num_players; i++)
+  {
+    writer->dirs[i] = game->players[i].updated_dir;
+  }
+}
+
+/**
+ * Record the state of every player and the whole board
+ */
+static void put_keyframe(replay_writer_t *writer, const game_t *game)
+{
+  put_tag(writer, REC_KEYFRAME, true);
+  for (int i = 0; i < game->num_players; i++)
+  {
+    const player_t *p = &game->players[i];
+    int fields[8] = {p->row, p->col, p->dir, p->updated_dir, p->elapsed, p->alive, p->death,
+                     p->died_tick};
+    for (int f = 0; f < 8; f++)
+    {
+      put_varint(&writer->data, &writer->size, &writer->capacity, fields[f]);
+    }
+  }
+
+  // Runs of identical cells: most of the board is empty or long straight trails
+  int cells = game->width * game->height;
+  for (int start = 0; start < cells;)
+  {
+    int end = start + 1;
+    while (end < cells && game->cells[end] == game->cells[start])
+    {
+      end++;
+    }
+    put_varint(&writer->data, &writer->size, &writer->capacity, end - start);
+    put_bytes(&writer->data, &writer->size, &writer->capacity, &game->cells[start], 1);
+    start = end;
+  }
+}
+
+/**
+ * Record the players' direction changes for one tick. Call this once per tick, after every
+ * player has steered and just before game_tick.
+ */
+void replay_record_tick(replay_writer_t *writer, const game_t *game)
+{
+  for (int i = 0; i < game->num_players; i++)
+  {
+    int dir = game->players[i].updated_dir;
+    if (game->players[i].alive && dir != writer->dirs[i])
+    {
+      put_tag(writer, REC_STEER, false);
+      put_varint(&writer->data, &writer->size, &writer->capacity, i * 4 + dir);
+      writer->dirs[i] = dir;
+    }
+  }
+  if (writer->tick > 0 && writer->tick % REPLAY_KEYFRAME_INTERVAL == 0)
+  {
+    put_keyframe(writer, game);
+  }
+  writer->tick++;
+}
+
+/**
+ * Record the end of a round, after the game_tick that ended it
+ * \param   winner  The result returned by game_tick
+ */
+void replay_end_round(replay_writer_t *writer, int winner)
+{
+  put_tag(writer, REC_END, false);
+  put_varint(&writer->data, &writer->size, &writer->capacity, winner);
+}
+
+/**
+ * Write everything recorded so far to a file. The file is written under a temporary name and
+ * renamed over the old one, so a crash never leaves a half-written replay.
+ * \return          false if the file could not be written (errno says why)
+ */
+bool replay_save(const replay_writer_t *writer, const char *path)
+{
+  char tmp[4096];
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+  {
+    return false;
+  }
+  FILE *file = fopen(tmp, "wb");
+  if (file == NULL)
+  {
+    return false;
+  }
+
+  uint8_t footer[FOOTER_SIZE];
+  for (int i = 0; i < 8; i++)
+  {
+    footer[i] = (uint8_t)(writer->size >> (8 * i));
+  }
+  memcpy(footer + 8, FOOTER_MAGIC, MAGIC_SIZE);
+
+  bool ok = fwrite(writer->data, 1, writer->size, file) == writer->size &&
+            fwrite(writer->index, 1, writer->index_size, file) == writer->index_size &&
+            fwrite(footer, 1, FOOTER_SIZE, file) == FOOTER_SIZE;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmp, path) != 0)
+  {
+    unlink(tmp);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Map a replay file into memory
+ * \param   replay  Receives the mapped file
+ * \param   path    The file to open
+ * \return          NULL on success, otherwise a message explaining what is wrong with the file
+ */
+const char *replay_open(replay_t *replay, const char *path)
+{
+  memset(replay, 0, sizeof(replay_t));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return "the file could not be opened";
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < MAGIC_SIZE + FOOTER_SIZE)
+  {
+    close(fd);
+    return "the file is too short to be a replay";
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    return "the file could not be mapped";
+  }
+  replay->data = data;
+  replay->size = st.st_size;
+
+  const uint8_t *footer = replay->data + replay->size - FOOTER_SIZE;
+  if (memcmp(replay->data, HEADER_MAGIC, MAGIC_SIZE) != 0 ||
+      memcmp(footer + 8, FOOTER_MAGIC, MAGIC_SIZE) != 0)
+  {
+    replay_close(replay);
+    return "the file is not a replay";
+  }
+  for (int i = 0; i < 8; i++)
+  {
+    replay->index |= (size_t)footer[i] << (8 * i);
+  }
+
+  reader_t r = {replay->data + MAGIC_SIZE, replay->data + replay->size - FOOTER_SIZE};
+  if (replay->index < MAGIC_SIZE || replay->index > replay->size - FOOTER_SIZE ||
+      !get_varint(&r, &replay->seed) || !get_int(&r, 1 << 16, &replay->config.width) ||
+      !get_int(&r, 1 << 16, &replay->config.height) ||
+      !get_int(&r, MAX_PLAYERS + 1, &replay->config.num_players) ||
+      !get_int(&r, 1 << 30, &replay->keyframe_interval) ||
+      game_config_error(&replay->config) != NULL)
+  {
+    replay_close(replay);
+    return "the replay header is corrupt";
+  }
+  replay->body = r.pos - replay->data;
+
+  // Round starts are the index entries at tick 0; the rest are keyframes
+  r.pos = replay->data + replay->index;
+  while (r.pos < r.end)
+  {
+    uint64_t round, tick, offset;
+    if (!get_varint(&r, &round) || !get_varint(&r, &tick) || !get_varint(&r, &offset) ||
+        offset < replay->body || offset >= replay->index)
+    {
+      replay_close(replay);
+      return "the replay index is corrupt";
+    }
+    if (tick == 0)
+    {
+      replay->rounds++;
+    }
+    else
+    {
+      replay->keyframes++;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Unmap a replay file
+ */
+void replay_close(replay_t *replay)
+{
+  if (replay->data != NULL)
+  {
+    munmap((void *)replay->data, replay->size);
+    replay->data = NULL;
+  }
+}
+
+/**
+ * Read a keyframe into a game, or compare it with the game
+ * \param   load    true to overwrite the game with the keyframe, false to compare
+ * \param   match   If comparing, set to false when the game differs from the keyframe
+ * \return          false if the keyframe is corrupt
+ */
+static bool read_keyframe(reader_t *r, game_t *game, bool load, bool *match)
+{
+  for (int i = 0; i < game->num_players; i++)
+  {
+    player_t *p = &game->players[i];
+    int fields[8];
+    int limits[8] = {game->height, game->width, 4, 4, 1 << 16, 2, DEATH_HEAD_ON + 1, 1 << 30};
+    for (int f = 0; f < 8; f++)
+    {
+      if (!get_int(r, limits[f], &fields[f]))
+      {
+        return false;
+      }
+    }
+    player_t state = {fields[0], fields[1], fields[2], fields[3], fields[4], fields[5], fields[6],
+                      fields[7]};
+    if (load)
+    {
+      *p = state;
+    }
+    else if (p->row != state.row || p->col != state.col || p->dir != state.dir ||
+             p->updated_dir != state.updated_dir || p->elapsed != state.elapsed ||
+             p->alive != state.alive || p->death != state.death ||
+             p->died_tick != state.died_tick)
+    {
+      *match = false;
+    }
+  }
+
+  int cells = game->width * game->height;
+  if (load)
+  {
+    bitboard_clear(&game->occupied, true);
+  }
+  for (int start = 0; start < cells;)
+  {
+    int run;
+    if (!get_int(r, cells - start + 1, &run) || run == 0 || r->pos >= r->end)
+    {
+      return false;
+    }
+    uint8_t value = *r->pos++;
+    for (int i = start; i < start + run; i++)
+    {
+      if (load)
+      {
+        game->cells[i] = value;
+        if (value != CELL_EMPTY)
+        {
+          bitboard_set(&game->occupied, i / game->width, i % game->width);
+        }
+      }
+      else if (game->cells[i] != value)
+      {
+        *match = false;
+      }
+    }
+    start += run;
+  }
+  if (load)
+  {
+    game->num_changed = 0;
+    game->changed_all = true;
+  }
+  return true;
+}
+
+/**
+ * Play the records of one round from the reader's position, starting with the game as it is at
+ * tick *tick. Stops after the round's end record, or before the first record past stop_tick.
+ * \param   stop_tick  The tick to stop at, or -1 to play the whole round
+ * \param   stats      Keyframe and result checks are counted here, or NULL to skip them
+ * \return             false if the replay is corrupt
+ */
+static bool play_round(reader_t *r, game_t *game, int *tick, int stop_tick, replay_stats_t *stats)
+{
+  int last = *tick;
+  for (;;)
+  {
+    const uint8_t *record = r->pos;
+    uint64_t tag;
+    if (!get_varint(r, &tag) || (tag & 3) == REC_ROUND)
+    {
+      return false;
+    }
+    int target = last + (int)(tag >> 2);
+    if (target < last)
+    {
+      return false;
+    }
+    last = target;
+    if (stop_tick >= 0 && target > stop_tick)
+    {
+      target = stop_tick;
+      r->pos = record;
+    }
+
+    // Nothing happens between records but the ticks themselves
+    while (*tick < target)
+    {
+      int result = game_tick(game);
+      (*tick)++;
+      if (result >= 0 && *tick < last)
+      {
+        return false;
+      }
+    }
+    if (r->pos == record)
+    {
+      return true;
+    }
+
+    int value;
+    bool match = true;
+    switch (tag & 3)
+    {
+    case REC_STEER:
+      if (!get_int(r, game->num_players * 4, &value))
+      {
+        return false;
+      }
+      game_steer(game, value / 4, value % 4);
+      break;
+    case REC_KEYFRAME:
+      if (!read_keyframe(r, game, false, &match))
+      {
+        return false;
+      }
+      if (stats != NULL)
+      {
+        stats->keyframes++;
+        stats->mismatches += !match;
+      }
+      break;
+    case REC_END:
+      if (!get_int(r, MAX_PLAYERS + 1, &value))
+      {
+        return false;
+      }
+      if (stats != NULL)
+      {
+        // The round must have ended on exactly this tick, with this winner
+        int survivors = 0;
+        int survivor = 0;
+        for (int i = 0; i < game->num_players; i++)
+        {
+          if (game->players[i].alive)
+          {
+            survivors++;
+            survivor = i + 1;
+          }
+        }
+        stats->mismatches += survivors > 1 || (survivors == 1 ? survivor : 0) != value;
+        stats->rounds++;
+        stats->ticks += *tick;
+      }
+      return true;
+    }
+  }
+}
+
+/**
+ * Play every round of a replay as fast as possible, checking the board against each keyframe and
+ * the result of each round against the recorded winner
+ * \param   replay  The replay to play
+ * \param   game    A game initialized with the replay's configuration
+ * \param   stats   Receives the totals
+ * \return          false if the replay is corrupt
+ */
+bool replay_play(const replay_t *replay, game_t *game, replay_stats_t *stats)
+{
+  memset(stats, 0, sizeof(replay_stats_t));
+  uint64_t start = time_ns();
+
+  reader_t r = {replay->data + replay->body, replay->data + replay->index};
+  while (r.pos < r.end)
+  {
+    uint64_t tag;
+    if (!get_varint(&r, &tag) || tag != REC_ROUND)
+    {
+      return false;
+    }
+    game_reset(game);
+    int tick = 0;
+    if (!play_round(&r, game, &tick, -1, stats))
+    {
+      return false;
+    }
+  }
+
+  stats->elapsed_ns = time_ns() - start;
+  return true;
+}
+
+/**
+ * Put a game in the state it was in at a given tick of a given round, starting from the nearest
+ * keyframe before it
+ * \param   replay  The replay to seek in
+ * \param   game    A game initialized with the replay's configuration
+ * \param   round   The round, counting from 1
+ * \param   tick    The tick within the round. Seeking past the end stops at the end.
+ * \return          false if the round does not exist or the replay is corrupt
+ */
+bool replay_seek(const replay_t *replay, game_t *game, int round, int tick)
+{
+  // Find the last round start or keyframe at or before the tick
+  reader_t index = {replay->data + replay->index, replay->data + replay->size - FOOTER_SIZE};
+  uint64_t best_tick = 0;
+  uint64_t best_offset = 0;
+  bool found = false;
+  while (index.pos < index.end)
+  {
+    uint64_t entry_round, entry_tick, offset;
+    if (!get_varint(&index, &entry_round) || !get_varint(&index, &entry_tick) ||
+        !get_varint(&index, &offset))
+    {
+      return false;
+    }
+    if (entry_round == (uint64_t)round && entry_tick <= (uint64_t)tick)
+    {
+      best_tick = entry_tick;
+      best_offset = offset;
+      found = true;
+    }
+  }
+  if (!found)
+  {
+    return false;
+  }
+
+  reader_t r = {replay->data + best_offset, replay->data + replay->index};
+  uint64_t tag;
+  if (!get_varint(&r, &tag))
+  {
+    return false;
+  }
+  if (best_tick == 0)
+  {
+    game_reset(game);
+  }
+  else if ((tag & 3) != REC_KEYFRAME || !read_keyframe(&r, game, true, NULL))
+  {
+    return false;
+  }
+  else
+  {
+    game->tick = (int)best_tick;
+  }
+  int now = (int)best_tick;
+  return play_round(&r, game, &now, tick, NULL);
+}
@@ -0,0 +1,149 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// Ticks between board keyframes (ten seconds of play)
+#define REPLAY_KEYFRAME_INTERVAL 2000
+
+/**
+ * A session of rounds recorded as it is played.
+ *
+ * The simulation is deterministic, so a replay only needs the configuration and the direction
+ * changes each player made, tick by tick. Everything is stored as variable-length integers:
+ *
+ *   header     "TRONREP2", then seed, width, height, players and the keyframe interval
+ *   rounds     for each round, a list of records that each start with a tag: the number of ticks
+ *              since the previous record, shifted left two bits, plus the record kind
+ *                steer     player * 4 + direction
+ *                keyframe  the players' state and the board (run-length encoded) before the tick
+ *                end       the winner; the tag's tick count reaches the tick that ended the round
+ *                round     starts the next round (the tick count is always 0)
+ *   index      where every keyframe is (round, tick, offset), so a reader can seek
+ *   footer     the offset of the index as 8 little-endian bytes, then "TRONIDX1"
+ *
+ * The whole file is kept in memory and rewritten after every round.
+ */
+typedef struct replay_writer
+{
+  game_config_t config;
+  uint64_t seed;
+
+  uint8_t *data; // header and rounds recorded so far
+  size_t size;
+  size_t capacity;
+
+  uint8_t *index; // encoded keyframe index
+  size_t index_size;
+  size_t index_capacity;
+
+  int round;     // rounds started so far
+  int tick;      // ticks played in the current round
+  int last_tick; // tick of the last record in the current round
+  int dirs[MAX_PLAYERS];
+} replay_writer_t;
+
+/**
+ * A replay file mapped into memory for reading
+ */
+typedef struct replay
+{
+  const uint8_t *data;
+  size_t size;
+
+  game_config_t config;
+  uint64_t seed;
+  int keyframe_interval;
+
+  size_t body;      // offset of the first round
+  size_t index;     // offset of the keyframe index
+  int rounds;
+  int keyframes;
+} replay_t;
+
+// Totals from playing back a replay
+typedef struct replay_stats
+{
+  int rounds;
+  uint64_t ticks;
+  int keyframes;  // keyframes checked against the board
+  int mismatches; // keyframes or winners that did not match the recording
+  uint64_t elapsed_ns;
+} replay_stats_t;
+
+/**
+ * Start recording a session
+ * \param   writer  The writer to initialize
+ * \param   config  The game configuration
+ * \param   seed    The random seed of the session
+ */
+void replay_writer_init(replay_writer_t *writer, const game_config_t *config, uint64_t seed);
+
+/**
+ * Release the memory owned by a writer
+ */
+void replay_writer_free(replay_writer_t *writer);
+
+/**
+ * Record the start of a round. Call this right after game_reset.
+ */
+void replay_start_round(replay_writer_t *writer, const game_t *game);
+
+/**
+ * Record the players' direction changes for one tick. Call this once per tick, after every
+ * player has steered and just before game_tick.
+ */
+void replay_record_tick(replay_writer_t *writer, const game_t *game);
+
+/**
+ * Record the end of a round, after the game_tick that ended it
+ * \param   winner  The result returned by game_tick
+ */
+void replay_end_round(replay_writer_t *writer, int winner);
+
+/**
+ * Write everything recorded so far to a file. The file is written under a temporary name and
+ * renamed over the old one, so a crash never leaves a half-written replay.
+ * \return          false if the file could not be written (errno says why)
+ */
+bool replay_save(const replay_writer_t *writer, const char *path);
+
+/**
+ * Map a replay file into memory
+ * \param   replay  Receives the mapped file
+ * \param   path    The file to open
+ * \return          NULL on success, otherwise a message explaining what is wrong with the file
+ */
+const char *replay_open(replay_t *replay, const char *path);
+
+/**
+ * Unmap a replay file
+ */
+void replay_close(replay_t *replay);
+
+/**
+ * Play every round of a replay as fast as possible, checking the board against each keyframe and
+ * the result of each round against the recorded winner
+ * \param   replay  The replay to play
+ * \param   game    A game initialized with the replay's configuration
+ * \param   stats   Receives the totals
+ * \return          false if the replay is corrupt
+ */
+bool replay_play(const replay_t *replay, game_t *game, replay_stats_t *stats);
+
+/**
+ * Put a game in the state it was in at a given tick of a given round, starting from the nearest
+ * keyframe before it
+ * \param   replay  The replay to seek in
+ * \param   game    A game initialized with the replay's configuration
+ * \param   round   The round, counting from 1
+ * \param   tick    The tick within the round. Seeking past the end stops at the end.
+ * \return          false if the round does not exist or the replay is corrupt
+ */
+bool replay_seek(const replay_t *replay, game_t *game, int round, int tick);
+
+#endif
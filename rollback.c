@@ -0,0 +1,183 @@
+#include "rollback.h"
+
+#include <string.h>
+
+#include "util.h"
+
+/**
+ * Set up a prediction
+ * \param   rb      The prediction to initialize
+ * \param   config  The server's game configuration
+ * \param   local   The index of the player this client steers
+ */
+void rollback_init(rollback_t *rb, const game_config_t *config, int local)
+{
+  memset(rb, 0, sizeof(rollback_t));
+  game_init(&rb->game, config);
+  for (int i = 0; i < ROLLBACK_WINDOW; i++)
+  {
+    game_init(&rb->history[i], config);
+  }
+  rb->local = local;
+  rollback_reset(rb);
+}
+
+/**
+ * Release the memory owned by a prediction
+ */
+void rollback_free(rollback_t *rb)
+{
+  game_free(&rb->game);
+  for (int i = 0; i < ROLLBACK_WINDOW; i++)
+  {
+    game_free(&rb->history[i]);
+  }
+}
+
+/**
+ * Start predicting a new round from tick 0
+ */
+void rollback_reset(rollback_t *rb)
+{
+  game_reset(&rb->game);
+  rb->tick = 0;
+  rb->confirmed = 0;
+  rb->redo = -1;
+  rb->result = -1;
+  for (int i = 0; i < rb->game.num_players; i++)
+  {
+    rb->confirmed_dir[i] = rb->game.players[i].dir;
+  }
+  rb->local_dir = rb->confirmed_dir[rb->local];
+}
+
+/**
+ * Steer this client's player from the next tick simulated on
+ * \param   dir     One of the DIR_ values
+ */
+void rollback_steer(rollback_t *rb, int dir)
+{
+  rb->local_dir = dir;
+}
+
+/**
+ * Save the board, steer every player as recorded for the current tick and simulate it. The
+ * directions actually taken replace the recorded ones, so a key that game_steer ignores is not
+ * later mistaken for a misprediction.
+ */
+static void step(rollback_t *rb)
+{
+  game_t *game = &rb->game;
+  int8_t *dirs = rb->dirs[rb->tick % ROLLBACK_WINDOW];
+  game_copy(&rb->history[rb->tick % ROLLBACK_WINDOW], game);
+  for (int i = 0; i < game->num_players; i++)
+  {
+    if (game->players[i].alive)
+    {
+      game_steer(game, i, dirs[i]);
+      dirs[i] = game->players[i].updated_dir;
+    }
+  }
+  rb->result = game_tick(game);
+  rb->tick++;
+}
+
+/**
+ * Take the directions the server steered every player on one tick. Ticks must be confirmed in
+ * order. If the prediction is behind the server it is first simulated up to that tick; if it is
+ * ahead and predicted something else, the next rollback_advance goes back and fixes it.
+ * \param   tick    The tick, counting from 0 at the start of the round
+ * \param   dirs    One direction per player
+ */
+void rollback_confirm(rollback_t *rb, int tick, const int *dirs)
+{
+  while (rb->tick < tick && rollback_advance(rb))
+  {
+  }
+  int num_players = rb->game.num_players;
+  memcpy(rb->confirmed_dir, dirs, sizeof(int) * num_players);
+  rb->confirmed = tick + 1;
+  if (rb->tick < tick)
+  {
+    return; // the prediction ended early; an earlier confirmation will already have fixed it
+  }
+
+  int8_t *slot = rb->dirs[tick % ROLLBACK_WINDOW];
+  if (tick == rb->tick)
+  {
+    // Not simulated yet: the next rollback_advance uses the server's directions
+    for (int i = 0; i < num_players; i++)
+    {
+      slot[i] = dirs[i];
+    }
+    return;
+  }
+
+  // Only the players still riding at the start of a tick can have been mispredicted on it
+  const player_t *players = rb->history[tick % ROLLBACK_WINDOW].players;
+  for (int i = 0; i < num_players; i++)
+  {
+    if (slot[i] != dirs[i] && players[i].alive)
+    {
+      rb->redo = rb->redo < 0 || tick < rb->redo ? tick : rb->redo;
+    }
+    slot[i] = dirs[i];
+  }
+
+  // The other players are now predicted to keep their newly confirmed directions
+  for (int t = tick + 1; t < rb->tick; t++)
+  {
+    int8_t *later = rb->dirs[t % ROLLBACK_WINDOW];
+    players = rb->history[t % ROLLBACK_WINDOW].players;
+    for (int i = 0; i < num_players; i++)
+    {
+      if (i != rb->local && later[i] != dirs[i] && players[i].alive)
+      {
+        later[i] = dirs[i];
+        rb->redo = rb->redo < 0 || t < rb->redo ? t : rb->redo;
+      }
+    }
+  }
+}
+
+/**
+ * Correct any wrong prediction, then simulate one more tick
+ * \return        false if the round is over, or the prediction is already ROLLBACK_WINDOW - 1
+ *                ticks ahead of what the server has confirmed
+ */
+bool rollback_advance(rollback_t *rb)
+{
+  if (rb->redo >= 0)
+  {
+    uint64_t start = time_ns();
+    int present = rb->tick;
+    rb->tick = rb->redo;
+    game_copy(&rb->game, &rb->history[rb->tick % ROLLBACK_WINDOW]);
+    rb->result = -1;
+    while (rb->tick < present && rb->result < 0)
+    {
+      step(rb);
+    }
+    rb->rollbacks++;
+    rb->resimulated += rb->tick - rb->redo;
+    rb->max_depth = present - rb->redo > rb->max_depth ? present - rb->redo : rb->max_depth;
+    rb->rollback_ns += time_ns() - start;
+    rb->redo = -1;
+  }
+
+  if (rb->result >= 0 || rb->tick - rb->confirmed >= ROLLBACK_WINDOW - 1)
+  {
+    return false;
+  }
+  if (rb->tick >= rb->confirmed)
+  {
+    // Predict: the other players keep going as last confirmed, this one as last asked
+    int8_t *slot = rb->dirs[rb->tick % ROLLBACK_WINDOW];
+    for (int i = 0; i < rb->game.num_players; i++)
+    {
+      slot[i] = i == rb->local ? rb->local_dir : rb->confirmed_dir[i];
+    }
+  }
+  step(rb);
+  return true;
+}
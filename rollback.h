@@ -0,0 +1,89 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// Ticks of history kept for rolling back (320ms of play). A client never runs further than this
+// ahead of the last tick the server has confirmed.
+#define ROLLBACK_WINDOW 64
+
+/**
+ * A client's prediction of a game the server is playing.
+ *
+ * The client runs the simulation itself, ahead of the server, so its own player turns the moment
+ * a key is pressed instead of a round trip later. The other players are predicted to keep the
+ * direction the server last confirmed for them. Every tick the server confirms the direction each
+ * player actually steered; when that differs from what the client predicted, the client restores
+ * its copy of the board from the start of that tick and simulates forward again to the present.
+ *
+ * The simulation is deterministic, so once every tick up to the present has been confirmed the
+ * prediction is exactly the server's board.
+ */
+typedef struct rollback
+{
+  game_t game; // the predicted present
+
+  // The board at the start of each recent tick, and the direction each player steered on it
+  game_t history[ROLLBACK_WINDOW];
+  int8_t dirs[ROLLBACK_WINDOW][MAX_PLAYERS];
+
+  int tick;      // ticks simulated so far this round
+  int confirmed; // ticks whose directions the server has confirmed
+  int redo;      // earliest tick simulated with a wrong prediction, or -1
+  int result;    // what game_tick returned for the last tick simulated
+
+  int local;     // the player this client steers
+  int local_dir; // the direction this client asked for most recently
+  int confirmed_dir[MAX_PLAYERS]; // each player's direction on the last confirmed tick
+
+  // Totals since rollback_init
+  uint64_t rollbacks;     // times a prediction turned out wrong
+  uint64_t resimulated;   // ticks simulated again after a wrong prediction
+  int max_depth;          // most ticks rolled back at once
+  uint64_t rollback_ns;   // time spent restoring and simulating again
+} rollback_t;
+
+/**
+ * Set up a prediction
+ * \param   rb      The prediction to initialize
+ * \param   config  The server's game configuration
+ * \param   local   The index of the player this client steers
+ */
+void rollback_init(rollback_t *rb, const game_config_t *config, int local);
+
+/**
+ * Release the memory owned by a prediction
+ */
+void rollback_free(rollback_t *rb);
+
+/**
+ * Start predicting a new round from tick 0
+ */
+void rollback_reset(rollback_t *rb);
+
+/**
+ * Steer this client's player from the next tick simulated on
+ * \param   dir     One of the DIR_ values
+ */
+void rollback_steer(rollback_t *rb, int dir);
+
+/**
+ * Take the directions the server steered every player on one tick. Ticks must be confirmed in
+ * order. If the prediction is behind the server it is first simulated up to that tick; if it is
+ * ahead and predicted something else, the next rollback_advance goes back and fixes it.
+ * \param   tick    The tick, counting from 0 at the start of the round
+ * \param   dirs    One direction per player
+ */
+void rollback_confirm(rollback_t *rb, int tick, const int *dirs);
+
+/**
+ * Correct any wrong prediction, then simulate one more tick
+ * \return        false if the round is over, or the prediction is already ROLLBACK_WINDOW - 1
+ *                ticks ahead of what the server has confirmed
+ */
+bool rollback_advance(rollback_t *rb);
+
+#endif
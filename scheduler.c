@@ -1,10 +1,13 @@
-#define _XOPEN_SOURCE
+#define _GNU_SOURCE
 #define _XOPEN_SOURCE_EXTENDED
 
 #include "scheduler.h"
 
 #include <assert.h>
 #include <curses.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <ucontext.h>
 #include <time.h>
@@ -16,8 +19,8 @@
 // This is an upper limit on the number of tasks we can create.
 #define MAX_TASKS 128
 
-// This is the size of each task's stack memory
-#define STACK_SIZE 65536
+// This is the size of each task's stack memory: room for tron's bots and curses, not just worm
+#define STACK_SIZE 262144
 // size_t current_time_ms() {
 //   struct timespec ts;
 //   clock_gettime(CLOCK_REALTIME, &ts);
@@ -47,8 +50,8 @@ typedef struct task_info {
   // 0 is inactive, 1 is active
   enum code process;
 
-  //   b. If the task is sleeping, when should it wake up?
-  size_t wakeuptime;
+  //   b. If the task is sleeping, when should it wake up? (time_ns)
+  uint64_t wakeup_ns;
   //   c. If the task is waiting for another task, which task is it waiting for?
   int pre;
   //   d. Was the task blocked waiting for user input? Once you successfully
@@ -135,64 +138,80 @@ void task_create(task_t* handle, task_fn_t fn) {
 }
 
 /**
- * Wait for a task to finish. If the task has not yet finished, the scheduler should
- * suspend this task and wake it up later when the task specified by handle has exited.
- *
- * \param handle  This is the handle produced by task_create
+ * Check whether a task can run now. A task blocked on input reads it here, if there is any.
+ */
+static bool task_ready(int index) {
+  switch(tasks[index].process) {
+  case inactive:
+    return true;
+  case waiting:
+    return tasks[tasks[index].pre].process == done;
+  case sleeping:
+    return tasks[index].wakeup_ns <= time_ns();
+  case blocked:
+    return (tasks[index].input = getch()) != ERR;
+  default:
+    return false;
+  }
+}
+
+/**
+ * Nothing can run: sleep until the first sleeping task is due or, if a task is waiting for input,
+ * a key arrives. The scheduler would otherwise spin a whole CPU between ticks.
  */
+static void task_idle() {
+  uint64_t wakeup_ns = UINT64_MAX;
+  bool reading = false;
+  for(int i = 0; i < num_tasks; i++) {
+    if(tasks[i].process == sleeping && tasks[i].wakeup_ns < wakeup_ns) {
+      wakeup_ns = tasks[i].wakeup_ns;
+    }
+    reading |= tasks[i].process == blocked;
+  }
+  assert((wakeup_ns != UINT64_MAX || reading) && "every task is waiting for another");
 
+  struct timespec timeout;
+  uint64_t now = time_ns();
+  if(wakeup_ns != UINT64_MAX) {
+    if(wakeup_ns <= now) {
+      return;
+    }
+    timeout.tv_sec = (wakeup_ns - now) / 1000000000;
+    timeout.tv_nsec = (wakeup_ns - now) % 1000000000;
+  }
+  struct pollfd input = {.fd = STDIN_FILENO, .events = POLLIN};
+  ppoll(&input, reading ? 1 : 0, wakeup_ns != UINT64_MAX ? &timeout : NULL, NULL);
+}
+
+/**
+ * Switch to the next task that can run, taking turns from the one after the current task. If no
+ * task can run, wait until one can.
+ */
 int task_swap() {
-  int index = (current_task + 1) % num_tasks;
   int last_task = current_task;
 
   while(true) {
-    if(tasks[index].process == inactive) {
-      current_task = index;
-      swapcontext(&tasks[last_task].context, &tasks[current_task].context);
-      return 0;
-
-    } else if(tasks[index].process == waiting) {
-      if(tasks[tasks[index].pre].process == done) {
+    for(int step = 1; step <= num_tasks; step++) {
+      int index = (last_task + step) % num_tasks;
+      if(task_ready(index)) {
         tasks[index].process = inactive;
         current_task = index;
-        swapcontext(&tasks[last_task].context, &tasks[current_task].context);
+        if(index != last_task) {
+          swapcontext(&tasks[last_task].context, &tasks[current_task].context);
+        }
         return 0;
-      } else {
-        current_task = index;
-        index = (index + 1) % num_tasks;
       }
-
-    } else if(tasks[index].process == sleeping) {
-      if(tasks[index].wakeuptime < time_ms()) {
-        tasks[index].process = inactive;
-        current_task = index;
-        swapcontext(&tasks[last_task].context, &tasks[current_task].context);
-        return 0;
-      } else {
-        current_task = index;
-        index = (index + 1) % num_tasks;
-      }
-
-    } else if(tasks[index].process == blocked) {
-      int ch;
-      if((ch = getch()) != ERR) {
-        tasks[index].process = inactive;
-        current_task = index;
-        tasks[index].input = ch;
-        swapcontext(&tasks[last_task].context, &tasks[current_task].context);
-        return 0;
-      } else {
-        current_task = index;
-        index = (index + 1) % num_tasks;
-      }
-
-    } else if(tasks[index].process == done) {
-      current_task = index;
-      index = (index + 1) % num_tasks;
     }
+    task_idle();
   }
 }
 
+/**
+ * Wait for a task to finish. If the task has not yet finished, the scheduler should
+ * suspend this task and wake it up later when the task specified by handle has exited.
+ *
+ * \param handle  This is the handle produced by task_create
+ */
 void task_wait(task_t handle) {
     tasks[current_task].process = waiting;  
     tasks[current_task].pre = handle;
@@ -232,16 +251,19 @@ void task_wait(task_t handle) {
  * \param ms  The number of milliseconds the task should sleep.
  */
 void task_sleep(size_t ms) {
-  size_t wakeup_time = time_ms() + ms;
+  task_sleep_until(time_ns() + ms * 1000000ull);
+}
 
-  tasks[current_task].wakeuptime = wakeup_time;
+/**
+ * The currently-executing task should sleep until a time on the monotonic clock (see time_ns),
+ * running other tasks meanwhile. A time already past just gives the other tasks a turn.
+ *
+ * \param deadline_ns  When the task should wake up.
+ */
+void task_sleep_until(uint64_t deadline_ns) {
+  tasks[current_task].wakeup_ns = deadline_ns;
   tasks[current_task].process = sleeping;
   task_swap();
-  // TODO: Block this task until the requested time has elapsed.
-  // Hint: Record the time the task should wake up instead of the time left for it to sleep. The
-  // bookkeeping is easier this way.
-  // pthread_t thread;
-  // pthread_create(&thread, NULL, timer_thread, &
 }
 
 /**
@@ -252,11 +274,11 @@ void task_sleep(size_t ms) {
  * \returns The read character code
  */
 int task_readchar() {
-  tasks[current_task].process = blocked;
   int inp;
   if((inp = getch()) != ERR) {
     return inp;
   }
-  inp = task_swap();
+  tasks[current_task].process = blocked;
+  task_swap();
   return tasks[current_task].input;
 }
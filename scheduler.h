@@ -2,6 +2,7 @@
 #define SCHEDULER_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 /// This is the type of a function run in a scheduler task
 typedef void (*task_fn_t)();
@@ -41,6 +42,14 @@ void task_wait(task_t handle);
  */
 void task_sleep(size_t ms);
 
+/**
+ * The currently-executing task should sleep until a time on the monotonic clock (see time_ns),
+ * running other tasks meanwhile. A time already past just gives the other tasks a turn.
+ *
+ * \param deadline_ns  When the task should wake up.
+ */
+void task_sleep_until(uint64_t deadline_ns);
+
 /**
  * Read a character from user input. If no input is available, the task should
  * block until input becomes available. The scheduler should run a different
@@ -0,0 +1,669 @@
+#include "search.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+// How often (in nodes) each thread checks the clock
+#define SEARCH_CHECK_INTERVAL 4
+
+// Larger than any score
+#define SEARCH_INFINITY (SEARCH_WIN + 1)
+
+// Scores beyond this are wins or losses a known number of plies away
+#define SEARCH_DECIDED (SEARCH_WIN - SEARCH_MAX_DEPTH - 1)
+
+// How a stored score relates to the true score of the position
+#define BOUND_EXACT 0
+#define BOUND_LOWER 1 // the true score is at least this (the search failed high)
+#define BOUND_UPPER 2 // the true score is at most this (the search failed low)
+
+// Stored in place of a best move when there is none
+#define NO_MOVE 3
+
+// Row and column offsets for each direction
+static const int dir_rows[4] = {-1, 0, 1, 0};
+static const int dir_cols[4] = {0, 1, 0, -1};
+
+// Each thread's private state, kept on its own cache lines
+typedef struct search_worker
+{
+  _Alignas(64) search_t *search;
+  int id;
+  pthread_t thread;
+  unsigned generation; // helpers only: the last search this thread ran
+
+  // The position being searched. Player 0 is the one searching, player 1 the opponent.
+  player_t players[2];
+  bitboard_t occupied;
+  uint64_t hash; // Zobrist hash of the occupied cells
+
+  // Scratch space for the Voronoi evaluation
+  bitboard_t blocked;
+  bitboard_t frontier_mine;
+  bitboard_t frontier_theirs;
+  bitboard_t tie;
+
+  uint64_t nodes;
+  bool stopped;
+
+  // Result of the deepest iteration this thread finished
+  int depth;
+  int score;
+  int dir;
+} search_worker_t;
+
+static void *search_helper(void *arg);
+
+/**
+ * Set up a search for games of a given size and start its helper threads
+ * \param   search   The search to initialize
+ * \param   game     A game of the size to search
+ * \param   threads  The number of threads each search runs on
+ */
+void search_init(search_t *search, const game_t *game, int threads)
+{
+  memset(search, 0, sizeof(search_t));
+  search->width = game->width;
+  search->height = game->height;
+  search->threads = threads;
+
+  int cells = game->width * game->height;
+  size_t entries = (size_t)1 << SEARCH_TT_BITS;
+  search->zobrist_cells = malloc(sizeof(uint64_t) * cells);
+  search->zobrist_heads[0] = malloc(sizeof(uint64_t) * cells);
+  search->zobrist_heads[1] = malloc(sizeof(uint64_t) * cells);
+  search->table = aligned_alloc(64, sizeof(search_entry_t) * entries);
+  search->workers = aligned_alloc(64, sizeof(search_worker_t) * threads);
+  if (search->zobrist_cells == NULL || search->zobrist_heads[0] == NULL ||
+      search->zobrist_heads[1] == NULL || search->table == NULL || search->workers == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+
+  // Fixed keys, so hashes are the same every run
+  uint64_t rng = 0x7472306e;
+  for (int i = 0; i < cells; i++)
+  {
+    search->zobrist_cells[i] = rng_next(&rng);
+    search->zobrist_heads[0][i] = rng_next(&rng);
+    search->zobrist_heads[1][i] = rng_next(&rng);
+  }
+  for (int p = 0; p < 2; p++)
+  {
+    for (int dirs = 0; dirs < 16; dirs++)
+    {
+      for (int e = 0; e < 24; e++)
+      {
+        search->zobrist_timing[p][dirs][e] = rng_next(&rng);
+      }
+    }
+  }
+
+  search->table_mask = entries - 1;
+  for (size_t i = 0; i < entries; i++)
+  {
+    atomic_init(&search->table[i].check, 0);
+    atomic_init(&search->table[i].data, 0);
+  }
+  atomic_init(&search->stop, false);
+
+  memset(search->workers, 0, sizeof(search_worker_t) * threads);
+  for (int i = 0; i < threads; i++)
+  {
+    search_worker_t *w = &search->workers[i];
+    w->search = search;
+    w->id = i;
+    bitboard_init(&w->occupied, game->width, game->height, true);
+    bitboard_init(&w->blocked, game->width, game->height, true);
+    bitboard_init(&w->frontier_mine, game->width, game->height, false);
+    bitboard_init(&w->frontier_theirs, game->width, game->height, false);
+    bitboard_init(&w->tie, game->width, game->height, false);
+  }
+
+  // The calling thread is the main thread of every search; the helpers wait for one to start
+  pthread_mutex_init(&search->lock, NULL);
+  pthread_cond_init(&search->started, NULL);
+  pthread_cond_init(&search->finished, NULL);
+  for (int i = 1; i < threads; i++)
+  {
+    if (pthread_create(&search->workers[i].thread, NULL, search_helper, &search->workers[i]) != 0)
+    {
+      perror("pthread_create");
+      exit(2);
+    }
+  }
+}
+
+/**
+ * Stop a search's helper threads and release the memory it owns
+ */
+void search_free(search_t *search)
+{
+  pthread_mutex_lock(&search->lock);
+  search->quit = true;
+  pthread_cond_broadcast(&search->started);
+  pthread_mutex_unlock(&search->lock);
+  for (int i = 1; i < search->threads; i++)
+  {
+    pthread_join(search->workers[i].thread, NULL);
+  }
+  pthread_mutex_destroy(&search->lock);
+  pthread_cond_destroy(&search->started);
+  pthread_cond_destroy(&search->finished);
+
+  for (int i = 0; i < search->threads; i++)
+  {
+    search_worker_t *w = &search->workers[i];
+    bitboard_free(&w->occupied);
+    bitboard_free(&w->blocked);
+    bitboard_free(&w->frontier_mine);
+    bitboard_free(&w->frontier_theirs);
+    bitboard_free(&w->tie);
+  }
+  free(search->workers);
+  free(search->table);
+  free(search->zobrist_cells);
+  free(search->zobrist_heads[0]);
+  free(search->zobrist_heads[1]);
+  search->workers = NULL;
+  search->table = NULL;
+}
+
+/**
+ * Hash the parts of a position that are not occupied cells: where the heads are, which way they
+ * are going and how long until they move
+ */
+static uint64_t head_hash(const search_t *s, const player_t *players)
+{
+  uint64_t hash = 0;
+  for (int i = 0; i < 2; i++)
+  {
+    const player_t *p = &players[i];
+    hash ^= s->zobrist_heads[i][p->row * s->width + p->col];
+    hash ^= s->zobrist_timing[i][p->dir * 4 + p->updated_dir][p->elapsed / SIM_TICK_INTERVAL];
+  }
+  return hash;
+}
+
+/**
+ * Look a position up in the transposition table
+ * \return        true if the table holds an entry for this key, unpacked into the out parameters
+ */
+static bool table_probe(const search_t *s, uint64_t key, int *score, int *depth, int *bound,
+                        int *move)
+{
+  search_entry_t *entry = &s->table[key & s->table_mask];
+  uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+  uint64_t check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+  if ((check ^ data) != key)
+  {
+    return false;
+  }
+  *score = (int32_t)(uint32_t)data;
+  *depth = (data >> 32) & 0xff;
+  *bound = (data >> 40) & 3;
+  *move = (data >> 42) & 3;
+  return true;
+}
+
+/**
+ * Store a search result in the transposition table, unless the slot holds a deeper result for the
+ * same position
+ */
+static void table_store(search_t *s, uint64_t key, int score, int depth, int bound, int move)
+{
+  search_entry_t *entry = &s->table[key & s->table_mask];
+  uint64_t old = atomic_load_explicit(&entry->data, memory_order_relaxed);
+  uint64_t old_check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+  if ((old_check ^ old) == key && (int)((old >> 32) & 0xff) > depth)
+  {
+    return;
+  }
+  uint64_t data = (uint32_t)score | (uint64_t)depth << 32 | (uint64_t)bound << 40 |
+                  (uint64_t)move << 42;
+  atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+  atomic_store_explicit(&entry->check, key ^ data, memory_order_relaxed);
+}
+
+/**
+ * Wins and losses are scored by distance from the root. The table stores them by distance from
+ * the position instead, so they stay right when the position is reached by another path.
+ */
+static int score_to_table(int score, int ply)
+{
+  return score > SEARCH_DECIDED ? score + ply : score < -SEARCH_DECIDED ? score - ply : score;
+}
+
+static int score_from_table(int score, int ply)
+{
+  return score > SEARCH_DECIDED ? score - ply : score < -SEARCH_DECIDED ? score + ply : score;
+}
+
+/**
+ * Get the number of ticks until a player moves if it keeps its requested direction (at least 1)
+ */
+static int ticks_until_move(const player_t *p)
+{
+  int ticks = (game_move_interval(p->updated_dir) - p->elapsed + SIM_TICK_INTERVAL - 1) /
+              SIM_TICK_INTERVAL;
+  return ticks > 1 ? ticks : 1;
+}
+
+/**
+ * Score a position for the searching player: the cells it reaches strictly before the opponent,
+ * minus the cells the opponent reaches first. Both territories grow one layer at a time from the
+ * heads, and cells reached by both in the same layer go to neither.
+ */
+static int evaluate(search_worker_t *w)
+{
+  bitboard_copy(&w->blocked, &w->occupied);
+  bitboard_clear(&w->frontier_mine, false);
+  bitboard_clear(&w->frontier_theirs, false);
+  bitboard_set(&w->frontier_mine, w->players[0].row, w->players[0].col);
+  bitboard_set(&w->frontier_theirs, w->players[1].row, w->players[1].col);
+
+  int score = 0;
+  for (;;)
+  {
+    // Everything behind the frontiers is blocked, so growing them leaves only the next layer
+    bitboard_grow(&w->blocked, &w->frontier_mine);
+    bitboard_grow(&w->blocked, &w->frontier_theirs);
+    bitboard_copy(&w->tie, &w->frontier_mine);
+    bitboard_and(&w->tie, &w->frontier_theirs);
+    bitboard_andnot(&w->frontier_mine, &w->tie);
+    bitboard_andnot(&w->frontier_theirs, &w->tie);
+
+    int mine = bitboard_count(&w->frontier_mine);
+    int theirs = bitboard_count(&w->frontier_theirs);
+    if (mine == 0 && theirs == 0)
+    {
+      return score;
+    }
+    score += mine - theirs;
+
+    bitboard_or(&w->blocked, &w->frontier_mine);
+    bitboard_or(&w->blocked, &w->frontier_theirs);
+    bitboard_or(&w->blocked, &w->tie);
+  }
+}
+
+static int search_tick(search_worker_t *w, int depth, int ply, int alpha, int beta, int *best_dir);
+
+/**
+ * Play one tick with the directions both players have chosen, the way game_tick does, and search
+ * the position it leads to
+ */
+static int resolve(search_worker_t *w, int depth, int ply, int alpha, int beta)
+{
+  search_t *s = w->search;
+  player_t saved[2];
+  memcpy(saved, w->players, sizeof(saved));
+
+  bool moving[2];
+  int rows[2];
+  int cols[2];
+  for (int i = 0; i < 2; i++)
+  {
+    player_t *p = &w->players[i];
+    int interval = game_move_interval(p->updated_dir);
+    p->elapsed += SIM_TICK_INTERVAL;
+    moving[i] = p->elapsed >= interval;
+    if (moving[i])
+    {
+      p->elapsed -= interval;
+      p->dir = p->updated_dir;
+      rows[i] = p->row + dir_rows[p->dir];
+      cols[i] = p->col + dir_cols[p->dir];
+    }
+  }
+
+  bool crashed[2];
+  for (int i = 0; i < 2; i++)
+  {
+    crashed[i] = moving[i] && (bitboard_test(&w->occupied, rows[i], cols[i]) ||
+                               (moving[1 - i] && rows[i] == rows[1 - i] && cols[i] == cols[1 - i]));
+  }
+  if (crashed[0] || crashed[1])
+  {
+    memcpy(w->players, saved, sizeof(saved));
+    if (crashed[0] && crashed[1])
+    {
+      return 0;
+    }
+    return crashed[0] ? -(SEARCH_WIN - ply) : SEARCH_WIN - ply;
+  }
+
+  for (int i = 0; i < 2; i++)
+  {
+    if (moving[i])
+    {
+      w->players[i].row = rows[i];
+      w->players[i].col = cols[i];
+      bitboard_set(&w->occupied, rows[i], cols[i]);
+      w->hash ^= s->zobrist_cells[rows[i] * s->width + cols[i]];
+    }
+  }
+
+  int score = search_tick(w, depth - 1, ply + 1, alpha, beta, NULL);
+
+  for (int i = 0; i < 2; i++)
+  {
+    if (moving[i])
+    {
+      bitboard_reset(&w->occupied, rows[i], cols[i]);
+      w->hash ^= s->zobrist_cells[rows[i] * s->width + cols[i]];
+    }
+  }
+  memcpy(w->players, saved, sizeof(saved));
+  return score;
+}
+
+/**
+ * Let the opponent answer a direction the searching player chose for a tick where both move
+ */
+static int answer(search_worker_t *w, int depth, int ply, int alpha, int beta)
+{
+  player_t *p = &w->players[1];
+  int saved_dir = p->updated_dir;
+  int best = SEARCH_INFINITY;
+  for (int i = 0; i < 3 && alpha < beta; i++)
+  {
+    // Straight first: it is the most common choice and the cheapest to refute
+    p->updated_dir = (p->dir + (i == 0 ? 0 : i == 1 ? 1 : 3)) % 4;
+    int score = resolve(w, depth, ply, alpha, beta);
+    if (w->stopped)
+    {
+      break;
+    }
+    if (score < best)
+    {
+      best = score;
+    }
+    if (score < beta)
+    {
+      beta = score;
+    }
+  }
+  p->updated_dir = saved_dir;
+  return best;
+}
+
+/**
+ * Check whether this thread should give up on its current iteration
+ */
+static bool should_stop(search_worker_t *w)
+{
+  search_t *s = w->search;
+
+  // The main thread always finishes its first iteration, so there is always a move to play
+  if (w->id == 0 && w->depth == 0)
+  {
+    return false;
+  }
+  if (atomic_load_explicit(&s->stop, memory_order_relaxed))
+  {
+    return true;
+  }
+  if (time_ns() > s->deadline)
+  {
+    atomic_store_explicit(&s->stop, true, memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Search the position at the start of a tick: skip ahead to the next tick where someone moves,
+ * let the players due to move choose their directions and play it out.
+ * \param   depth     Ticks with moves left to search
+ * \param   ply       Ticks with moves since the root
+ * \param   alpha     The score the searching player is already sure of
+ * \param   beta      The score the opponent is already sure of
+ * \param   best_dir  If not NULL, receives the searching player's best direction
+ * \return            The score of the position for the searching player
+ */
+static int search_tick(search_worker_t *w, int depth, int ply, int alpha, int beta, int *best_dir)
+{
+  search_t *s = w->search;
+  if (++w->nodes % SEARCH_CHECK_INTERVAL == 0 && !w->stopped)
+  {
+    w->stopped = should_stop(w);
+  }
+  if (w->stopped)
+  {
+    return 0;
+  }
+
+  // Nothing changes in the ticks where nobody moves except the time both players have waited
+  player_t saved[2];
+  memcpy(saved, w->players, sizeof(saved));
+  int wait[2] = {ticks_until_move(&w->players[0]), ticks_until_move(&w->players[1])};
+  int skip = (wait[0] < wait[1] ? wait[0] : wait[1]) - 1;
+  w->players[0].elapsed += skip * SIM_TICK_INTERVAL;
+  w->players[1].elapsed += skip * SIM_TICK_INTERVAL;
+  bool due[2] = {wait[0] == skip + 1, wait[1] == skip + 1};
+
+  if (depth == 0)
+  {
+    int score = evaluate(w);
+    memcpy(w->players, saved, sizeof(saved));
+    return score;
+  }
+
+  uint64_t key = w->hash ^ head_hash(s, w->players);
+  int table_move = NO_MOVE;
+  int table_score, table_depth, bound;
+  if (table_probe(s, key, &table_score, &table_depth, &bound, &table_move) && best_dir == NULL &&
+      table_depth >= depth)
+  {
+    table_score = score_from_table(table_score, ply);
+    if (bound == BOUND_EXACT || (bound == BOUND_LOWER && table_score >= beta) ||
+        (bound == BOUND_UPPER && table_score <= alpha))
+    {
+      memcpy(w->players, saved, sizeof(saved));
+      return table_score;
+    }
+  }
+
+  // The searching player chooses first; the opponent only chooses here if it moves alone
+  int mover = due[0] ? 0 : 1;
+  player_t *p = &w->players[mover];
+  int turns[3] = {0, 1, 3}; // straight, right, left
+  if (table_move != NO_MOVE)
+  {
+    int tmp = turns[0];
+    turns[0] = turns[table_move];
+    turns[table_move] = tmp;
+  }
+
+  int alpha0 = alpha;
+  int beta0 = beta;
+  int best = mover == 0 ? -SEARCH_INFINITY : SEARCH_INFINITY;
+  int best_turn = NO_MOVE;
+  for (int i = 0; i < 3 && alpha < beta; i++)
+  {
+    p->updated_dir = (p->dir + turns[i]) % 4;
+    int score;
+    if (mover == 0 && due[1])
+    {
+      score = answer(w, depth, ply, alpha, beta);
+    }
+    else
+    {
+      score = resolve(w, depth, ply, alpha, beta);
+    }
+    if (w->stopped)
+    {
+      break;
+    }
+
+    if (mover == 0 ? score > best : score < best)
+    {
+      best = score;
+      best_turn = turns[i] == 3 ? 2 : turns[i];
+    }
+    if (mover == 0 && score > alpha)
+    {
+      alpha = score;
+    }
+    if (mover == 1 && score < beta)
+    {
+      beta = score;
+    }
+  }
+
+  if (best_dir != NULL && mover == 0 && best_turn != NO_MOVE)
+  {
+    *best_dir = (saved[0].dir + (best_turn == 2 ? 3 : best_turn)) % 4;
+  }
+  memcpy(w->players, saved, sizeof(saved));
+  if (w->stopped)
+  {
+    return 0;
+  }
+
+  bound = best <= alpha0 ? BOUND_UPPER : best >= beta0 ? BOUND_LOWER : BOUND_EXACT;
+  table_store(s, key, score_to_table(best, ply), depth, bound, best_turn);
+  return best;
+}
+
+/**
+ * Run in each thread: search the root one iteration deeper at a time until the deadline
+ */
+static void *search_thread(void *arg)
+{
+  search_worker_t *w = arg;
+
+  // Half the helpers work one iteration ahead, filling the table for the others
+  for (int depth = 1 + (w->id % 2); depth <= SEARCH_MAX_DEPTH; depth++)
+  {
+    int dir = w->players[0].updated_dir;
+    int score = search_tick(w, depth, 0, -SEARCH_INFINITY, SEARCH_INFINITY, &dir);
+    if (w->stopped)
+    {
+      break;
+    }
+    w->depth = depth;
+    w->score = score;
+    w->dir = dir;
+
+    // Searching deeper cannot change a forced win or loss
+    if (score > SEARCH_DECIDED || score < -SEARCH_DECIDED)
+    {
+      break;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Run in each helper thread for the life of the search: take part in every search as it starts
+ */
+static void *search_helper(void *arg)
+{
+  search_worker_t *w = arg;
+  search_t *s = w->search;
+  pthread_mutex_lock(&s->lock);
+  for (;;)
+  {
+    while (w->generation == s->generation && !s->quit)
+    {
+      pthread_cond_wait(&s->started, &s->lock);
+    }
+    if (s->quit)
+    {
+      break;
+    }
+    w->generation = s->generation;
+    pthread_mutex_unlock(&s->lock);
+
+    search_thread(w);
+
+    pthread_mutex_lock(&s->lock);
+    if (--s->running == 0)
+    {
+      pthread_cond_signal(&s->finished);
+    }
+  }
+  pthread_mutex_unlock(&s->lock);
+  return NULL;
+}
+
+/**
+ * Search a two-player game for the best direction for one player
+ * \param   search   The search to run
+ * \param   game     The game, with the player about to move (see game_move_due)
+ * \param   player   The index of the player to search for
+ * \param   budget   Nanoseconds to search for. The first iteration always finishes.
+ * \param   result   Receives the best direction and search statistics
+ */
+void search_run(search_t *search, const game_t *game, int player, uint64_t budget,
+                search_result_t *result)
+{
+  uint64_t start = time_ns();
+  search->deadline = start + budget;
+  atomic_store(&search->stop, false);
+
+  uint64_t hash = 0;
+  for (int row = 0; row < game->height; row++)
+  {
+    for (int col = 0; col < game->width; col++)
+    {
+      if (game_cell(game, row, col) != CELL_EMPTY)
+      {
+        hash ^= search->zobrist_cells[row * game->width + col];
+      }
+    }
+  }
+
+  for (int i = 0; i < search->threads; i++)
+  {
+    search_worker_t *w = &search->workers[i];
+    w->players[0] = game->players[player];
+    w->players[1] = game->players[1 - player];
+    bitboard_copy(&w->occupied, &game->occupied);
+    w->hash = hash;
+    w->nodes = 0;
+    w->stopped = false;
+    w->depth = 0;
+    w->score = 0;
+    w->dir = w->players[0].updated_dir;
+  }
+
+  // The calling thread is the main thread; the helpers only share what they find through the
+  // table. Once the main thread stops, the others stop at their next check of the clock.
+  pthread_mutex_lock(&search->lock);
+  search->running = search->threads - 1;
+  search->generation++;
+  pthread_cond_broadcast(&search->started);
+  pthread_mutex_unlock(&search->lock);
+  search_thread(&search->workers[0]);
+  atomic_store(&search->stop, true);
+  pthread_mutex_lock(&search->lock);
+  while (search->running > 0)
+  {
+    pthread_cond_wait(&search->finished, &search->lock);
+  }
+  pthread_mutex_unlock(&search->lock);
+
+  // Play the move from the deepest finished iteration, preferring the main thread's
+  const search_worker_t *best = &search->workers[0];
+  result->nodes = best->nodes;
+  for (int i = 1; i < search->threads; i++)
+  {
+    const search_worker_t *w = &search->workers[i];
+    result->nodes += w->nodes;
+    if (w->depth > best->depth)
+    {
+      best = w;
+    }
+  }
+  result->dir = best->dir;
+  result->depth = best->depth;
+  result->score = best->score;
+  result->elapsed_ns = time_ns() - start;
+}
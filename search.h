@@ -0,0 +1,110 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bitboard.h"
+#include "game.h"
+
+// Deepest search, in ticks where someone moves
+#define SEARCH_MAX_DEPTH 64
+
+// Transposition table entries, as a power of two (16 bytes each)
+#define SEARCH_TT_BITS 18
+
+// Score of a won position; wins found sooner score higher
+#define SEARCH_WIN 1000000
+
+// One slot of the transposition table. The key is stored XORed with the data, so an entry torn by
+// two threads writing at once fails the key check instead of returning mixed-up data.
+typedef struct search_entry
+{
+  _Atomic uint64_t check; // key ^ data
+  _Atomic uint64_t data;  // score, depth, bound and best move, packed
+} search_entry_t;
+
+// The outcome of one search
+typedef struct search_result
+{
+  int dir;             // the best direction found
+  int depth;           // the deepest iteration that finished
+  int score;           // its score for the searching player
+  uint64_t nodes;      // positions visited by every thread
+  uint64_t elapsed_ns; // wall time of the search
+} search_result_t;
+
+/**
+ * A parallel alpha-beta search for two-player games.
+ *
+ * The search plays the rules of game_tick: both players accumulate time each tick and move once
+ * their interval has passed, moves are planned against the board at the start of the tick, and
+ * players that hit something or each other die together. Ticks where nobody moves are skipped, so
+ * a ply is a tick where at least one player chooses a direction. When both move in the same tick
+ * the searching player chooses first and the opponent answers knowing the choice, which gives a
+ * safe (pessimistic) value for simultaneous moves. Leaves are scored by Voronoi territory: the
+ * cells each player reaches strictly before the other.
+ *
+ * Positions are identified by a Zobrist hash of the occupied cells, the heads and their timing,
+ * and shared between threads through a lock-free transposition table. Each thread runs its own
+ * iterative deepening from the same root (lazy SMP); helpers start one iteration deeper every
+ * other thread so they fill the table ahead of the main thread. The helpers are started once, by
+ * search_init, so a search creates no threads and allocates nothing.
+ */
+typedef struct search
+{
+  int width;
+  int height;
+  int threads;
+
+  // Random keys: one per cell, one per player per head cell, one per player per timing state
+  uint64_t *zobrist_cells;
+  uint64_t *zobrist_heads[2];
+  uint64_t zobrist_timing[2][16][24];
+
+  search_entry_t *table;
+  uint64_t table_mask;
+
+  // Set by the first thread to notice the deadline
+  atomic_bool stop;
+  uint64_t deadline;
+
+  struct search_worker *workers;
+
+  // The helper threads live as long as the search, parked between searches: each search bumps
+  // generation to start them and waits until none is running. Protected by lock.
+  pthread_mutex_t lock;
+  pthread_cond_t started;
+  pthread_cond_t finished;
+  unsigned generation;
+  int running;
+  bool quit;
+} search_t;
+
+/**
+ * Set up a search for games of a given size and start its helper threads
+ * \param   search   The search to initialize
+ * \param   game     A game of the size to search
+ * \param   threads  The number of threads each search runs on
+ */
+void search_init(search_t *search, const game_t *game, int threads);
+
+/**
+ * Stop a search's helper threads and release the memory it owns
+ */
+void search_free(search_t *search);
+
+/**
+ * Search a two-player game for the best direction for one player
+ * \param   search   The search to run
+ * \param   game     The game, with the player about to move (see game_move_due)
+ * \param   player   The index of the player to search for
+ * \param   budget   Nanoseconds to search for. The first iteration always finishes.
+ * \param   result   Receives the best direction and search statistics
+ */
+void search_run(search_t *search, const game_t *game, int player, uint64_t budget,
+                search_result_t *result);
+
+#endif
@@ -0,0 +1,789 @@
+#define _GNU_SOURCE
+
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bot.h"
+#include "pacer.h"
+#include "util.h"
+
+#define SHARED_MAGIC 0x54524f4e // "TRON"
+
+// Failed attempts at a consistent read before a client checks the server is still alive, and how
+// long it then waits before trying again
+#define SHARED_READ_SPINS 1000
+#define SHARED_READ_BACKOFF_NS 1000000
+
+// How long the server waits between checks while idle, and between rounds
+#define SERVER_POLL_INTERVAL 100
+#define SERVER_ROUND_PAUSE 3000
+
+// Inputs a client can have waiting for their tick
+#define SERVER_INPUT_QUEUE 16
+
+// Set by SIGINT or SIGTERM
+static atomic_bool stopping;
+
+// An input waiting for the tick a client sent it for
+typedef struct server_input
+{
+  int dir;
+  int tick;
+} server_input_t;
+
+// Everything the server owns
+typedef struct server
+{
+  game_t game;
+  bot_t bots[MAX_PLAYERS];
+  int seats; // players 1 to seats are steered by clients
+  pacer_t pacer;
+
+  shared_board_t board;
+  server_status_t status;
+
+  int listen_fd;
+  int client_fd[MAX_PLAYERS]; // the socket steering each seat, or -1 for a free seat
+
+  // Directions requested by clients, protected by input_lock along with client_fd and seated.
+  // Sends to clients also happen under the lock.
+  pthread_mutex_t input_lock;
+  int requested_dir[MAX_PLAYERS];
+  server_input_t inputs[MAX_PLAYERS][SERVER_INPUT_QUEUE]; // in the order they arrived
+  int num_inputs[MAX_PLAYERS];
+} server_t;
+
+/**
+ * Write a number as little-endian bytes
+ */
+static void put_le(uint8_t *out, uint64_t value, int bytes)
+{
+  for (int i = 0; i < bytes; i++)
+  {
+    out[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+/**
+ * Read a number written by put_le
+ */
+static uint64_t get_le(const uint8_t *in, int bytes)
+{
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; i++)
+  {
+    value |= (uint64_t)in[i] << (8 * i);
+  }
+  return value;
+}
+
+/**
+ * Build the names of a server's shared-memory segment and socket
+ */
+static void server_paths(const char *name, char *shm, char *sock, size_t size)
+{
+  snprintf(shm, size, "/tron-%s", name);
+  snprintf(sock, size, "/tmp/tron-%s.sock", name);
+}
+
+/**
+ * Get the size of the shared-memory segment for a board
+ */
+static size_t shared_size(int width, int height)
+{
+  return sizeof(shared_header_t) + sizeof(atomic_uint) * height + (size_t)width * height;
+}
+
+/**
+ * Point a board's fields into a mapped segment
+ */
+static void shared_map(shared_board_t *board, void *segment, int height)
+{
+  board->header = segment;
+  board->row_seq = (atomic_uint *)(board->header + 1);
+  board->cells = (uint8_t *)(board->row_seq + height);
+}
+
+/**
+ * Publish the server's status and, if cells is not NULL, board contents
+ * \param   cells        The simulation's board, or NULL to publish only the status
+ * \param   changed      Indices of the cells that changed, or NULL if the whole board changed
+ * \param   num_changed  The number of entries in changed
+ */
+static void shared_board_publish(server_t *server, const uint8_t *cells, const uint32_t *changed,
+                                 int num_changed)
+{
+  shared_board_t *board = &server->board;
+  shared_header_t *header = board->header;
+  unsigned seq = atomic_load_explicit(&header->seq, memory_order_relaxed);
+  atomic_store_explicit(&header->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  header->status = server->status;
+  if (cells != NULL && changed == NULL)
+  {
+    memcpy(board->cells, cells, (size_t)header->width * header->height);
+    for (int r = 0; r < header->height; r++)
+    {
+      atomic_store_explicit(&board->row_seq[r], seq + 2, memory_order_relaxed);
+    }
+  }
+  else if (cells != NULL)
+  {
+    for (int i = 0; i < num_changed; i++)
+    {
+      board->cells[changed[i]] = cells[changed[i]];
+      atomic_store_explicit(&board->row_seq[changed[i] / header->width], seq + 2,
+                            memory_order_relaxed);
+    }
+  }
+
+  atomic_store_explicit(&header->seq, seq + 2, memory_order_release);
+}
+
+/**
+ * Map a server's board for reading
+ * \param   board   Receives the mapped board
+ * \param   name    The name the server was started with
+ * \return          NULL on success, otherwise a message explaining why not
+ */
+const char *shared_board_attach(shared_board_t *board, const char *name)
+{
+  char shm[256];
+  char sock[256];
+  server_paths(name, shm, sock, sizeof(shm));
+  memset(board, 0, sizeof(shared_board_t));
+
+  int fd = shm_open(shm, O_RDONLY, 0);
+  if (fd < 0)
+  {
+    return "no server is running with that name";
+  }
+  shared_header_t header;
+  if (read(fd, &header, sizeof(header)) != sizeof(header) || header.magic != SHARED_MAGIC)
+  {
+    close(fd);
+    return "the server's shared memory is not a tron board";
+  }
+  board->size = shared_size(header.width, header.height);
+  void *segment = mmap(NULL, board->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED)
+  {
+    return "the server's shared memory could not be mapped";
+  }
+  shared_map(board, segment, header.height);
+
+  // Nothing has been drawn yet, so every row counts as changed on the first read
+  board->seen = malloc(sizeof(uint32_t) * header.height);
+  board->pending = malloc(sizeof(uint32_t) * header.height);
+  if (board->seen == NULL || board->pending == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  memset(board->seen, 0xff, sizeof(uint32_t) * header.height);
+  return NULL;
+}
+
+/**
+ * Unmap a board mapped with shared_board_attach
+ */
+void shared_board_detach(shared_board_t *board)
+{
+  munmap(board->header, board->size);
+  free(board->seen);
+  free(board->pending);
+  board->header = NULL;
+}
+
+/**
+ * Copy the rows that changed since the last call into a private frame, without taking any lock
+ * \param   board   The board to read
+ * \param   frame   Receives the changed rows, width * height cells in row-major order
+ * \param   rows    Receives the numbers of the changed rows (at most height entries)
+ * \param   status  Receives the server's status, consistent with the rows
+ * \return          The number of rows written to rows, or -1 if the server died while writing
+ */
+int shared_board_read(shared_board_t *board, uint8_t *frame, int *rows, server_status_t *status)
+{
+  shared_header_t *header = board->header;
+  int width = header->width;
+  unsigned start;
+  unsigned end;
+  int nrows;
+  int attempts = 0;
+  do
+  {
+    // A server killed mid-write leaves seq odd for good, so a long run of failed reads stops to
+    // check the server is still there before retrying
+    if (++attempts > SHARED_READ_SPINS)
+    {
+      if (kill(header->pid, 0) != 0 && errno == ESRCH)
+      {
+        return -1;
+      }
+      struct timespec backoff = {0, SHARED_READ_BACKOFF_NS};
+      nanosleep(&backoff, NULL);
+      attempts = 0;
+    }
+    start = atomic_load_explicit(&header->seq, memory_order_acquire);
+    nrows = 0;
+    for (int r = 0; r < header->height; r++)
+    {
+      unsigned version = atomic_load_explicit(&board->row_seq[r], memory_order_relaxed);
+      if (version != board->seen[r])
+      {
+        memcpy(frame + r * width, board->cells + r * width, width);
+        board->pending[nrows] = version;
+        rows[nrows++] = r;
+      }
+    }
+    *status = header->status;
+    atomic_thread_fence(memory_order_acquire);
+    end = atomic_load_explicit(&header->seq, memory_order_relaxed);
+  } while ((start & 1) || start != end);
+
+  // Only remember what was drawn once the copy is known to be consistent
+  for (int i = 0; i < nrows; i++)
+  {
+    board->seen[rows[i]] = board->pending[i];
+  }
+  return nrows;
+}
+
+/**
+ * Connect to a server's input socket and take a seat
+ * \param   name    The name the server was started with
+ * \param   seat    Receives the index of the player this client steers
+ * \return          The connected socket, or -1 (with errno set, or seat set to SERVER_FULL)
+ */
+int server_connect(const char *name, int *seat)
+{
+  char shm[256];
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  server_paths(name, shm, addr.sun_path, sizeof(addr.sun_path));
+  *seat = -1;
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  uint8_t reply;
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      recv(fd, &reply, 1, 0) != 1)
+  {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  if (reply == SERVER_FULL)
+  {
+    *seat = SERVER_FULL;
+    close(fd);
+    return -1;
+  }
+  *seat = reply;
+  return fd;
+}
+
+/**
+ * Ask the server to steer this client's player
+ * \param   fd      A socket returned by server_connect
+ * \param   dir     One of the DIR_ values
+ * \param   tick    The tick of the round to turn on; 0 for as soon as possible
+ * \return          false if the server has gone away
+ */
+bool server_send_input(int fd, int dir, int tick)
+{
+  uint8_t message[6] = {SERVER_MSG_INPUT, (uint8_t)dir};
+  put_le(message + 2, (uint32_t)tick, 4);
+  return send(fd, message, sizeof(message), MSG_NOSIGNAL) == sizeof(message);
+}
+
+/**
+ * Ask the server to echo a time stamp, to measure the round trip
+ * \return          false if the server has gone away
+ */
+bool server_send_ping(int fd, uint64_t stamp)
+{
+  uint8_t message[9] = {SERVER_MSG_PING};
+  put_le(message + 1, stamp, 8);
+  return send(fd, message, sizeof(message), MSG_NOSIGNAL) == sizeof(message);
+}
+
+/**
+ * Take the next message the server has sent, without waiting
+ * \param   fd          A socket returned by server_connect
+ * \param   message     Receives the message
+ * \param   num_players The number of players in the server's game
+ * \return              1 if a message was received, 0 if none is waiting, -1 if the server has
+ *                      gone away
+ */
+int server_receive(int fd, server_message_t *message, int num_players)
+{
+  uint8_t data[SERVER_MSG_MAX];
+  for (;;)
+  {
+    ssize_t n = recv(fd, data, sizeof(data), MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      return 0;
+    }
+    if (n <= 0)
+    {
+      return -1;
+    }
+
+    // Anything malformed is skipped
+    message->type = data[0];
+    if (data[0] == SERVER_MSG_ROUND && n == 1)
+    {
+      return 1;
+    }
+    if (data[0] == SERVER_MSG_TICK && n == 5 + num_players)
+    {
+      message->tick = (int)get_le(data + 1, 4);
+      for (int i = 0; i < num_players; i++)
+      {
+        message->dirs[i] = data[5 + i] & 3;
+      }
+      return 1;
+    }
+    if (data[0] == SERVER_MSG_PONG && n == 9)
+    {
+      message->stamp = get_le(data + 1, 8);
+      return 1;
+    }
+  }
+}
+
+/**
+ * Send a message to every seated client. A client that has let its socket fill up is too far
+ * behind to catch up, so it is shut down; the input thread then frees its seat. Call this with
+ * input_lock held.
+ */
+static void broadcast(server_t *server, const uint8_t *message, size_t size)
+{
+  for (int i = 0; i < server->seats; i++)
+  {
+    int fd = server->client_fd[i];
+    if (fd >= 0 && send(fd, message, size, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)size &&
+        (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      shutdown(fd, SHUT_RDWR);
+    }
+  }
+}
+
+/**
+ * Stop the server at the end of the current tick
+ */
+static void handle_stop(int sig)
+{
+  atomic_store(&stopping, true);
+}
+
+/**
+ * Sleep for a while, waking early if the server is stopping
+ */
+static void pause_ms(int ms)
+{
+  for (int slept = 0; slept < ms && !atomic_load(&stopping); slept += SERVER_POLL_INTERVAL)
+  {
+    sleep_ms(ms - slept < SERVER_POLL_INTERVAL ? ms - slept : SERVER_POLL_INTERVAL);
+  }
+}
+
+/**
+ * Run in a thread to seat new clients and read their inputs
+ */
+static void *server_inputs(void *arg)
+{
+  server_t *server = arg;
+  struct pollfd fds[MAX_PLAYERS + 1];
+
+  while (!atomic_load(&stopping))
+  {
+    // Only this thread changes client_fd, so it can read it without the lock
+    int nfds = 0;
+    int seat_of[MAX_PLAYERS + 1];
+    fds[nfds].fd = server->listen_fd;
+    fds[nfds].events = POLLIN;
+    seat_of[nfds++] = -1;
+    for (int i = 0; i < server->seats; i++)
+    {
+      if (server->client_fd[i] >= 0)
+      {
+        fds[nfds].fd = server->client_fd[i];
+        fds[nfds].events = POLLIN;
+        seat_of[nfds++] = i;
+      }
+    }
+    if (poll(fds, nfds, SERVER_POLL_INTERVAL) <= 0)
+    {
+      continue;
+    }
+
+    if (fds[0].revents & POLLIN)
+    {
+      int fd = accept(server->listen_fd, NULL, NULL);
+      if (fd >= 0)
+      {
+        int seat = -1;
+        for (int i = 0; i < server->seats && seat < 0; i++)
+        {
+          seat = server->client_fd[i] < 0 ? i : -1;
+        }
+        uint8_t reply = seat >= 0 ? seat : SERVER_FULL;
+        send(fd, &reply, 1, MSG_NOSIGNAL);
+        if (seat < 0)
+        {
+          close(fd);
+        }
+        else
+        {
+          pthread_mutex_lock(&server->input_lock);
+          server->client_fd[seat] = fd;
+          server->status.seated++;
+          pthread_mutex_unlock(&server->input_lock);
+          printf("player %d joined\n", seat + 1);
+        }
+      }
+    }
+
+    for (int i = 1; i < nfds; i++)
+    {
+      if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+      {
+        continue;
+      }
+      int seat = seat_of[i];
+      uint8_t message[SERVER_MSG_MAX];
+      ssize_t n = recv(fds[i].fd, message, sizeof(message), MSG_DONTWAIT);
+      pthread_mutex_lock(&server->input_lock);
+      if (n <= 0 && !(n < 0 && errno == EAGAIN))
+      {
+        // The client has gone; its player keeps going straight until someone takes the seat
+        close(fds[i].fd);
+        server->client_fd[seat] = -1;
+        server->num_inputs[seat] = 0;
+        server->status.seated--;
+        printf("player %d left\n", seat + 1);
+      }
+      else if (n == 6 && message[0] == SERVER_MSG_INPUT && message[1] <= DIR_WEST)
+      {
+        // A full queue means the client is sending faster than it plays; make room by applying
+        // the oldest input now
+        server_input_t *queue = server->inputs[seat];
+        if (server->num_inputs[seat] == SERVER_INPUT_QUEUE)
+        {
+          server->requested_dir[seat] = queue[0].dir;
+          memmove(queue, queue + 1, sizeof(server_input_t) * (SERVER_INPUT_QUEUE - 1));
+          server->num_inputs[seat]--;
+        }
+        queue[server->num_inputs[seat]++] =
+            (server_input_t){.dir = message[1], .tick = (int)get_le(message + 2, 4)};
+      }
+      else if (n == 9 && message[0] == SERVER_MSG_PING)
+      {
+        message[0] = SERVER_MSG_PONG;
+        send(fds[i].fd, message, 9, MSG_DONTWAIT | MSG_NOSIGNAL);
+      }
+      pthread_mutex_unlock(&server->input_lock);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Publish a new status without changing the board
+ * \return        true if every seat is taken
+ */
+static bool set_state(server_t *server, int state)
+{
+  pthread_mutex_lock(&server->input_lock);
+  server->status.state = state;
+  shared_board_publish(server, NULL, NULL, 0);
+  bool full = server->status.seated == server->seats;
+  pthread_mutex_unlock(&server->input_lock);
+  return full;
+}
+
+/**
+ * Play one round at the usual speed, publishing every tick
+ * \return        0 for a draw, otherwise the number of the winning player
+ */
+static int server_round(server_t *server)
+{
+  game_t *game = &server->game;
+  game_reset(game);
+  for (int i = server->seats; i < game->num_players; i++)
+  {
+    bot_reset(&server->bots[i]);
+  }
+
+  pthread_mutex_lock(&server->input_lock);
+  for (int i = 0; i < server->seats; i++)
+  {
+    server->requested_dir[i] = game->players[i].dir;
+    server->num_inputs[i] = 0;
+  }
+  server->status.state = SERVER_PLAYING;
+  server->status.round++;
+  shared_board_publish(server, game->cells, NULL, 0);
+  uint8_t round_message = SERVER_MSG_ROUND;
+  broadcast(server, &round_message, 1);
+  pthread_mutex_unlock(&server->input_lock);
+  game_publish(game);
+
+  uint8_t tick_message[SERVER_MSG_MAX] = {SERVER_MSG_TICK};
+  int due = 1; // ticks to run before waiting for the next deadline
+  pacer_start(&server->pacer);
+  for (int tick = 0;; tick++)
+  {
+    pthread_mutex_lock(&server->input_lock);
+    for (int i = 0; i < server->seats; i++)
+    {
+      // Take every input meant for this tick or earlier
+      server_input_t *queue = server->inputs[i];
+      int taken = 0;
+      while (taken < server->num_inputs[i] && queue[taken].tick <= tick)
+      {
+        server->requested_dir[i] = queue[taken++].dir;
+      }
+      server->num_inputs[i] -= taken;
+      memmove(queue, queue + taken, sizeof(server_input_t) * server->num_inputs[i]);
+      game_steer(game, i, server->requested_dir[i]);
+    }
+    pthread_mutex_unlock(&server->input_lock);
+
+    for (int i = server->seats; i < game->num_players; i++)
+    {
+      if (game_move_due(game, i))
+      {
+        bot_steer(&server->bots[i], game);
+      }
+    }
+
+    // Tell the clients how every player steered, so their predictions can catch up
+    put_le(tick_message + 1, (uint32_t)tick, 4);
+    for (int i = 0; i < game->num_players; i++)
+    {
+      tick_message[5 + i] = (uint8_t)game->players[i].updated_dir;
+    }
+    pthread_mutex_lock(&server->input_lock);
+    broadcast(server, tick_message, 5 + game->num_players);
+    pthread_mutex_unlock(&server->input_lock);
+
+    int result = game_tick(game);
+    pthread_mutex_lock(&server->input_lock);
+    if (result >= 0)
+    {
+      server->status.state = SERVER_OVER;
+      server->status.winner = result;
+    }
+    shared_board_publish(server, game->cells, game->changed_all ? NULL : game->changed,
+                         game->num_changed);
+    pthread_mutex_unlock(&server->input_lock);
+    game_publish(game); // clears the list of changed cells
+
+    if (result >= 0 || atomic_load(&stopping))
+    {
+      return result;
+    }
+    if (--due == 0)
+    {
+      due = pacer_wait(&server->pacer);
+    }
+  }
+}
+
+/**
+ * Check whether the server that created a shared-memory segment is still running
+ * \param   shm     The segment's name
+ */
+static bool server_alive(const char *shm)
+{
+  int fd = shm_open(shm, O_RDONLY, 0);
+  if (fd < 0)
+  {
+    return false;
+  }
+  shared_header_t header;
+  bool alive = read(fd, &header, sizeof(header)) == sizeof(header) &&
+               header.magic == SHARED_MAGIC && header.pid > 0 &&
+               (kill(header.pid, 0) == 0 || errno == EPERM);
+  close(fd);
+  return alive;
+}
+
+/**
+ * Run a server: own the simulation, publish the board in shared memory and take each player's
+ * input from a client connected over a Unix domain socket. Runs until interrupted.
+ * \param   name     Names the shared-memory segment (/tron-NAME) and the socket
+ *                   (/tmp/tron-NAME.sock)
+ * \param   config   The game configuration
+ * \param   bots     The number of players steered by bots (the last ones); the rest are seats
+ *                   for clients
+ * \param   search   Threads per bot for alpha-beta search in two-player games, 0 to not search
+ * \return           The exit status for the program
+ */
+int server_run(const char *name, const game_config_t *config, int bots, int search)
+{
+  static server_t server;
+  char shm[256];
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  server_paths(name, shm, addr.sun_path, sizeof(addr.sun_path));
+
+  // The board lives in a shared-memory segment every client maps read-only. One left behind by a
+  // server that died is replaced, but a running server keeps its name, segment and socket.
+  server.board.size = shared_size(config->width, config->height);
+  int fd = shm_open(shm, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0 && errno == EEXIST)
+  {
+    if (server_alive(shm))
+    {
+      fprintf(stderr, "A server named \"%s\" is already running.\n", name);
+      return 1;
+    }
+    shm_unlink(shm);
+    fd = shm_open(shm, O_CREAT | O_EXCL | O_RDWR, 0644);
+  }
+  if (fd < 0 || ftruncate(fd, server.board.size) != 0)
+  {
+    perror(shm);
+    return 1;
+  }
+  void *segment = mmap(NULL, server.board.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED)
+  {
+    perror("mmap");
+    shm_unlink(shm);
+    return 1;
+  }
+  shared_map(&server.board, segment, config->height);
+  server.board.header->magic = SHARED_MAGIC;
+  server.board.header->width = config->width;
+  server.board.header->height = config->height;
+  server.board.header->num_players = config->num_players;
+  server.board.header->pid = getpid();
+  atomic_init(&server.board.header->seq, 0);
+
+  // Inputs and the ticks' directions are exchanged as messages on a socket next to it
+  server.listen_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  unlink(addr.sun_path);
+  if (server.listen_fd < 0 || bind(server.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(server.listen_fd, MAX_PLAYERS) != 0)
+  {
+    perror(addr.sun_path);
+    munmap(segment, server.board.size);
+    shm_unlink(shm);
+    return 1;
+  }
+
+  game_init(&server.game, config);
+  server.seats = config->num_players - bots;
+  for (int i = 0; i < config->num_players; i++)
+  {
+    server.client_fd[i] = -1;
+    if (i >= server.seats)
+    {
+      bot_init(&server.bots[i], &server.game, i);
+      if (search > 0)
+      {
+        bot_use_search(&server.bots[i], &server.game, search);
+      }
+    }
+  }
+  server.status = (server_status_t){.state = SERVER_WAITING, .seats = server.seats};
+  pthread_mutex_init(&server.input_lock, NULL);
+  pacer_init(&server.pacer, SIM_TICK_INTERVAL * 1000000ull, SIM_MAX_CATCH_UP);
+  shared_board_publish(&server, server.game.cells, NULL, 0);
+  game_publish(&server.game);
+
+  struct sigaction action = {.sa_handler = handle_stop};
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  pthread_t input_thread;
+  if (pthread_create(&input_thread, NULL, server_inputs, &server) != 0)
+  {
+    perror("pthread_create");
+    exit(2);
+  }
+  printf("serving \"%s\" with %d seats; join with: tron --join %s (or --watch %s)\n", name,
+         server.seats, name, name);
+  fflush(stdout);
+
+  while (!atomic_load(&stopping))
+  {
+    // Wait for a full table, then count down so everyone is ready
+    while (!set_state(&server, SERVER_WAITING) && !atomic_load(&stopping))
+    {
+      pause_ms(SERVER_POLL_INTERVAL);
+    }
+    for (int i = 3; i > 0 && !atomic_load(&stopping); i--)
+    {
+      server.status.countdown = i;
+      set_state(&server, SERVER_COUNTDOWN);
+      pause_ms(1000);
+    }
+    if (atomic_load(&stopping))
+    {
+      break;
+    }
+
+    int winner = server_round(&server);
+    if (winner > 0)
+    {
+      printf("round %d: player %d wins\n", server.status.round, winner);
+    }
+    else if (winner == 0)
+    {
+      printf("round %d: draw\n", server.status.round);
+    }
+    fflush(stdout);
+    pause_ms(SERVER_ROUND_PAUSE);
+  }
+
+  // Tell attached clients, then clean up; clients keep their mappings until they detach
+  set_state(&server, SERVER_STOPPED);
+  pthread_join(input_thread, NULL);
+  for (int i = 0; i < server.seats; i++)
+  {
+    if (server.client_fd[i] >= 0)
+    {
+      close(server.client_fd[i]);
+    }
+  }
+  close(server.listen_fd);
+  unlink(addr.sun_path);
+  munmap(segment, server.board.size);
+  shm_unlink(shm);
+  for (int i = server.seats; i < config->num_players; i++)
+  {
+    bot_free(&server.bots[i]);
+  }
+  game_free(&server.game);
+  pacer_report(&server.pacer.stats, "tick pacing", stdout);
+  printf("server stopped\n");
+  return 0;
+}
@@ -0,0 +1,161 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// What the server is doing, as published to clients
+#define SERVER_WAITING 0   // waiting for every seat to be taken
+#define SERVER_COUNTDOWN 1 // a round is about to start
+#define SERVER_PLAYING 2
+#define SERVER_OVER 3      // the round is over; the next one starts shortly
+#define SERVER_STOPPED 4   // the server has shut down
+
+// Sent to a client instead of a seat number when every seat is taken
+#define SERVER_FULL 0xff
+
+/**
+ * Messages on a client's socket, after the one byte the server sends on connecting (the client's
+ * seat, or SERVER_FULL). Each starts with its type byte; numbers are little-endian.
+ *
+ * The server tells every seated client which direction each player steered on every tick, so a
+ * client can run the simulation itself ahead of the server (see rollback_t). A client tags each
+ * input with the tick it wants it applied on; the server applies it then, or as soon as it
+ * arrives if that tick has already been played.
+ */
+#define SERVER_MSG_INPUT 1 // client: direction (1 byte), then the tick to apply it on (4 bytes)
+#define SERVER_MSG_PING 2  // client: 8 bytes for the server to send back in a PONG
+#define SERVER_MSG_ROUND 3 // server: a round starts now, with tick 0
+#define SERVER_MSG_TICK 4  // server: the tick (4 bytes), then each player's direction (1 byte each)
+#define SERVER_MSG_PONG 5  // server: the 8 bytes from a PING
+
+// Largest message on the socket
+#define SERVER_MSG_MAX (5 + MAX_PLAYERS)
+
+// A message from the server, decoded
+typedef struct server_message
+{
+  int type;  // one of the SERVER_MSG_ values sent by the server
+  int tick;  // TICK only
+  int dirs[MAX_PLAYERS]; // TICK only
+  uint64_t stamp; // PONG only
+} server_message_t;
+
+// Everything a client shows besides the board
+typedef struct server_status
+{
+  int state;     // one of the SERVER_ values
+  int round;     // rounds started so far
+  int countdown; // seconds until the round starts, while counting down
+  int winner;    // result of the last round: 0 for a draw, otherwise the winning player
+  int seated;    // seats taken by clients
+  int seats;     // seats for clients (the other players are bots)
+} server_status_t;
+
+/**
+ * The start of the shared-memory segment a server publishes its board in. It is followed by one
+ * version number per row and then the cells.
+ *
+ * The server is the only writer and uses the same seqlock as snapshot_t: seq is odd while it
+ * writes. Each row's version is set to the seq value that last changed it, so a client that
+ * remembers which versions it has drawn copies only the rows that changed, straight out of the
+ * segment. The server writes each change once however many clients are attached.
+ */
+typedef struct shared_header
+{
+  uint32_t magic;
+  int32_t width;
+  int32_t height;
+  int32_t num_players;
+  int32_t pid; // the server's process, so a client can tell it has died
+  atomic_uint seq;
+  server_status_t status;
+} shared_header_t;
+
+// A mapped shared-memory board, on the server or a client
+typedef struct shared_board
+{
+  shared_header_t *header;
+  atomic_uint *row_seq;
+  uint8_t *cells;
+  size_t size;
+
+  // Client only: the version of each row in the client's frame
+  uint32_t *seen;
+  uint32_t *pending;
+} shared_board_t;
+
+/**
+ * Run a server: own the simulation, publish the board in shared memory and take each player's
+ * input from a client connected over a Unix domain socket. Runs until interrupted.
+ * \param   name     Names the shared-memory segment (/tron-NAME) and the socket
+ *                   (/tmp/tron-NAME.sock)
+ * \param   config   The game configuration
+ * \param   bots     The number of players steered by bots (the last ones); the rest are seats
+ *                   for clients
+ * \param   search   Threads per bot for alpha-beta search in two-player games, 0 to not search
+ * \return           The exit status for the program
+ */
+int server_run(const char *name, const game_config_t *config, int bots, int search);
+
+/**
+ * Map a server's board for reading
+ * \param   board   Receives the mapped board
+ * \param   name    The name the server was started with
+ * \return          NULL on success, otherwise a message explaining why not
+ */
+const char *shared_board_attach(shared_board_t *board, const char *name);
+
+/**
+ * Unmap a board mapped with shared_board_attach
+ */
+void shared_board_detach(shared_board_t *board);
+
+/**
+ * Copy the rows that changed since the last call into a private frame, without taking any lock
+ * \param   board   The board to read
+ * \param   frame   Receives the changed rows, width * height cells in row-major order
+ * \param   rows    Receives the numbers of the changed rows (at most height entries)
+ * \param   status  Receives the server's status, consistent with the rows
+ * \return          The number of rows written to rows, or -1 if the server died while writing
+ */
+int shared_board_read(shared_board_t *board, uint8_t *frame, int *rows, server_status_t *status);
+
+/**
+ * Connect to a server's input socket and take a seat
+ * \param   name    The name the server was started with
+ * \param   seat    Receives the index of the player this client steers
+ * \return          The connected socket, or -1 (with errno set, or seat set to SERVER_FULL)
+ */
+int server_connect(const char *name, int *seat);
+
+/**
+ * Ask the server to steer this client's player
+ * \param   fd      A socket returned by server_connect
+ * \param   dir     One of the DIR_ values
+ * \param   tick    The tick of the round to turn on; 0 for as soon as possible
+ * \return          false if the server has gone away
+ */
+bool server_send_input(int fd, int dir, int tick);
+
+/**
+ * Ask the server to echo a time stamp, to measure the round trip
+ * \return          false if the server has gone away
+ */
+bool server_send_ping(int fd, uint64_t stamp);
+
+/**
+ * Take the next message the server has sent, without waiting
+ * \param   fd          A socket returned by server_connect
+ * \param   message     Receives the message
+ * \param   num_players The number of players in the server's game
+ * \return              1 if a message was received, 0 if none is waiting, -1 if the server has
+ *                      gone away
+ */
+int server_receive(int fd, server_message_t *message, int num_players);
+
+#endif
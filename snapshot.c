@@ -0,0 +1,184 @@
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Allocate an empty snapshot for a board of the given size
+ * \param   width   The board width in cells
+ * \param   height  The board height in cells
+ * \return          The new snapshot. Release it with snapshot_free.
+ */
+snapshot_t *snapshot_create(int width, int height)
+{
+  snapshot_t *snap = malloc(sizeof(snapshot_t));
+  if (snap == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+
+  snap->width = width;
+  snap->height = height;
+  snap->row_words = (width + 63) / 64;
+  atomic_init(&snap->seq, 0);
+  atomic_init(&snap->repaint, true);
+  snap->cells = calloc((size_t)width * height, sizeof(uint8_t));
+  snap->dirty = calloc((size_t)height * snap->row_words, sizeof(atomic_uint_least64_t));
+  snap->dirty_rows = calloc((height + 63) / 64, sizeof(atomic_uint_least64_t));
+  if (snap->cells == NULL || snap->dirty == NULL || snap->dirty_rows == NULL)
+  {
+    perror("calloc");
+    exit(2);
+  }
+  return snap;
+}
+
+/**
+ * Release a snapshot created with snapshot_create
+ */
+void snapshot_free(snapshot_t *snap)
+{
+  if (snap == NULL)
+  {
+    return;
+  }
+  free(snap->cells);
+  free(snap->dirty);
+  free(snap->dirty_rows);
+  free(snap);
+}
+
+/**
+ * Publish new board contents. Only one thread may publish to a snapshot at a time.
+ * \param   snap         The snapshot to update
+ * \param   cells        The simulation's board, width * height cells in row-major order
+ * \param   changed      Indices of the cells that changed since the last publish, or NULL if the
+ *                       whole board changed
+ * \param   num_changed  The number of entries in changed
+ */
+void snapshot_publish(snapshot_t *snap, const uint8_t *cells, const uint32_t *changed,
+                      int num_changed)
+{
+  unsigned seq = atomic_load_explicit(&snap->seq, memory_order_relaxed);
+  atomic_store_explicit(&snap->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  if (changed == NULL)
+  {
+    memcpy(snap->cells, cells, (size_t)snap->width * snap->height);
+  }
+  else
+  {
+    for (int i = 0; i < num_changed; i++)
+    {
+      snap->cells[changed[i]] = cells[changed[i]];
+    }
+  }
+  atomic_store_explicit(&snap->seq, seq + 2, memory_order_release);
+
+  // Only mark cells dirty once their new values are visible, and a row only after its cells
+  if (changed == NULL)
+  {
+    atomic_store(&snap->repaint, true);
+    return;
+  }
+  for (int i = 0; i < num_changed; i++)
+  {
+    int r = changed[i] / snap->width;
+    int c = changed[i] % snap->width;
+    atomic_fetch_or(&snap->dirty[r * snap->row_words + c / 64], (uint64_t)1 << (c % 64));
+    atomic_fetch_or(&snap->dirty_rows[r / 64], (uint64_t)1 << (r % 64));
+  }
+}
+
+/**
+ * Ask the renderer to redraw every cell, e.g. because the terminal was resized
+ */
+void snapshot_request_repaint(snapshot_t *snap)
+{
+  atomic_store(&snap->repaint, true);
+}
+
+/**
+ * Claim the pending repaint request, if any
+ * \return        true if the renderer should redraw every cell
+ */
+bool snapshot_take_repaint(snapshot_t *snap)
+{
+  return atomic_exchange(&snap->repaint, false);
+}
+
+/**
+ * Claim the dirty bits of every changed cell, clearing them in the snapshot.
+ * \param   snap    The snapshot to read from
+ * \param   rows    Receives the numbers of the rows with dirty cells (at most height entries)
+ * \param   mask    Receives row_words bitmap words for each row listed in rows. Words for other
+ *                  rows are left untouched.
+ * \return          The number of rows written to rows
+ */
+int snapshot_take_dirty(snapshot_t *snap, int *rows, uint64_t *mask)
+{
+  int nrows = 0;
+  for (int w = 0; w < (snap->height + 63) / 64; w++)
+  {
+    uint64_t row_bits = atomic_exchange(&snap->dirty_rows[w], 0);
+    for (; row_bits != 0; row_bits &= row_bits - 1)
+    {
+      int r = w * 64 + __builtin_ctzll(row_bits);
+      bool any = false;
+      for (int i = 0; i < snap->row_words; i++)
+      {
+        int index = r * snap->row_words + i;
+        mask[index] = atomic_exchange(&snap->dirty[index], 0);
+        any |= mask[index] != 0;
+      }
+      // A row bit can outlive its cell bits if the renderer claimed them a frame early
+      if (any)
+      {
+        rows[nrows++] = r;
+      }
+    }
+  }
+  return nrows;
+}
+
+/**
+ * Copy published cells into a private frame without taking any lock.
+ * \param   snap    The snapshot to read from
+ * \param   frame   Destination, width * height cells in row-major order
+ * \param   rows    Rows to copy as returned by snapshot_take_dirty, or NULL to copy everything
+ * \param   nrows   The number of entries in rows
+ * \param   mask    The cells to copy within those rows
+ */
+void snapshot_read(snapshot_t *snap, uint8_t *frame, const int *rows, int nrows,
+                   const uint64_t *mask)
+{
+  unsigned start;
+  unsigned end;
+  do
+  {
+    start = atomic_load_explicit(&snap->seq, memory_order_acquire);
+    if (rows == NULL)
+    {
+      memcpy(frame, snap->cells, (size_t)snap->width * snap->height);
+    }
+    else
+    {
+      for (int i = 0; i < nrows; i++)
+      {
+        int r = rows[i];
+        for (int w = 0; w < snap->row_words; w++)
+        {
+          for (uint64_t bits = mask[r * snap->row_words + w]; bits != 0; bits &= bits - 1)
+          {
+            int index = r * snap->width + w * 64 + __builtin_ctzll(bits);
+            frame[index] = snap->cells[index];
+          }
+        }
+      }
+    }
+    atomic_thread_fence(memory_order_acquire);
+    end = atomic_load_explicit(&snap->seq, memory_order_relaxed);
+  } while ((start & 1) || start != end);
+}
@@ -0,0 +1,89 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Read-only copy of a game board published for a renderer.
+ *
+ * The simulation is the only writer. Each publish copies just the cells that changed, bumping seq
+ * to an odd value while it writes. Readers never lock: they copy cells out and retry if seq was
+ * odd or changed while they were copying.
+ *
+ * dirty has one bit per cell that changed since the renderer last drew it, and dirty_rows has one
+ * bit per row with any dirty cells, so a renderer only visits rows that changed. The writer sets
+ * bits after the new values are published and the renderer clears them before reading, so a change
+ * is never lost. repaint asks the renderer to redraw every cell.
+ */
+typedef struct snapshot
+{
+  int width;
+  int height;
+  int row_words; // 64-bit words per row of the dirty bitmap
+
+  atomic_uint seq;
+  uint8_t *cells;
+  atomic_uint_least64_t *dirty;
+  atomic_uint_least64_t *dirty_rows;
+  atomic_bool repaint;
+} snapshot_t;
+
+/**
+ * Allocate an empty snapshot for a board of the given size
+ * \param   width   The board width in cells
+ * \param   height  The board height in cells
+ * \return          The new snapshot. Release it with snapshot_free.
+ */
+snapshot_t *snapshot_create(int width, int height);
+
+/**
+ * Release a snapshot created with snapshot_create
+ */
+void snapshot_free(snapshot_t *snap);
+
+/**
+ * Publish new board contents. Only one thread may publish to a snapshot at a time.
+ * \param   snap         The snapshot to update
+ * \param   cells        The simulation's board, width * height cells in row-major order
+ * \param   changed      Indices of the cells that changed since the last publish, or NULL if the
+ *                       whole board changed
+ * \param   num_changed  The number of entries in changed
+ */
+void snapshot_publish(snapshot_t *snap, const uint8_t *cells, const uint32_t *changed,
+                      int num_changed);
+
+/**
+ * Ask the renderer to redraw every cell, e.g. because the terminal was resized
+ */
+void snapshot_request_repaint(snapshot_t *snap);
+
+/**
+ * Claim the pending repaint request, if any
+ * \return        true if the renderer should redraw every cell
+ */
+bool snapshot_take_repaint(snapshot_t *snap);
+
+/**
+ * Claim the dirty bits of every changed cell, clearing them in the snapshot.
+ * \param   snap    The snapshot to read from
+ * \param   rows    Receives the numbers of the rows with dirty cells (at most height entries)
+ * \param   mask    Receives row_words bitmap words for each row listed in rows. Words for other
+ *                  rows are left untouched.
+ * \return          The number of rows written to rows
+ */
+int snapshot_take_dirty(snapshot_t *snap, int *rows, uint64_t *mask);
+
+/**
+ * Copy published cells into a private frame without taking any lock.
+ * \param   snap    The snapshot to read from
+ * \param   frame   Destination, width * height cells in row-major order
+ * \param   rows    Rows to copy as returned by snapshot_take_dirty, or NULL to copy everything
+ * \param   nrows   The number of entries in rows
+ * \param   mask    The cells to copy within those rows
+ */
+void snapshot_read(snapshot_t *snap, uint8_t *frame, const int *rows, int nrows,
+                   const uint64_t *mask);
+
+#endif
@@ -0,0 +1,223 @@
+// Plays rounds with fading trails. A bike circling a loop shorter than its trail must crash into
+// its own tail, and one circling a longer loop must drive through its faded tail forever; trails
+// that outlast the round must play exactly like trails that never fade. Each tick, the occupancy
+// bitboard and the board a renderer keeps up to date from the snapshot's dirty cells must both
+// match game_cell cell for cell. Headless rounds between bots, which can dodge fading trails
+// forever, must end in a draw at the round limit.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+#include "headless.h"
+#include "snapshot.h"
+#include "util.h"
+
+#define LOOP_TICKS 20000
+#define ROUNDS 30
+#define BOT_ROUNDS 5
+
+// Cells on each side of the square player 1 drives around
+#define LOOP_SIDE 4
+
+/**
+ * Drive player 1 around a square with LOOP_SIDE cells on each side, turning clockwise, while
+ * player 2 stays where it started
+ * \param   trail_length    Ticks a trail lasts
+ * \return                  The tick player 1 died on, or 0 if it survived LOOP_TICKS
+ */
+static int drive_loop(int trail_length)
+{
+  game_config_t config = {.width = 40, .height = 20, .num_players = 2,
+                          .trail_length = trail_length};
+  game_t game;
+  game_init(&game, &config);
+  int moved = 0;
+  int last_row = game.players[0].row;
+  int last_col = game.players[0].col;
+  int died = 0;
+  for (int t = 0; t < LOOP_TICKS && died == 0; t++)
+  {
+    // Turn right after every LOOP_SIDE - 1 moves
+    player_t *p = &game.players[0];
+    if (p->row != last_row || p->col != last_col)
+    {
+      moved++;
+      last_row = p->row;
+      last_col = p->col;
+    }
+    game_steer(&game, 0, (moved / (LOOP_SIDE - 1)) % 4);
+
+    // Player 2 never moves: its time toward a move is taken back every tick
+    game.players[1].elapsed = 0;
+    game_tick(&game);
+    died = game.players[0].alive ? 0 : game.tick;
+  }
+  game_free(&game);
+  return died;
+}
+
+/**
+ * Play wandering rounds with and without fading, publishing every tick, and compare
+ * \return          The number of problems found
+ */
+static int compare_rounds(int trail_length, bool same_as_lasting)
+{
+  game_config_t lasting_config = {.width = DEFAULT_BOARD_WIDTH,
+                                  .height = DEFAULT_BOARD_HEIGHT,
+                                  .num_players = 4};
+  game_config_t fading_config = lasting_config;
+  fading_config.trail_length = trail_length;
+  game_t lasting;
+  game_t fading;
+  game_init(&lasting, &lasting_config);
+  game_init(&fading, &fading_config);
+  fading.snapshot = snapshot_create(fading.width, fading.height);
+  size_t cells = (size_t)fading.width * fading.height;
+  uint8_t *frame = calloc(cells, 1);
+  int *rows = malloc(sizeof(int) * fading.height);
+  uint64_t *mask = malloc(sizeof(uint64_t) * fading.height * fading.snapshot->row_words);
+  if (frame == NULL || rows == NULL || mask == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+
+  int problems = 0;
+  uint64_t ticks = 0;
+  int differed = 0;
+  for (int round = 0; round < ROUNDS; round++)
+  {
+    uint64_t lasting_rng = round + 1;
+    uint64_t fading_rng = round + 1;
+    int lasting_result = -1;
+    int fading_result = -1;
+    while (fading_result < 0)
+    {
+      for (int i = 0; i < fading.num_players; i++)
+      {
+        if (lasting_result < 0 && game_move_due(&lasting, i))
+        {
+          wander_steer(&lasting, i, &lasting_rng);
+        }
+        if (game_move_due(&fading, i))
+        {
+          wander_steer(&fading, i, &fading_rng);
+        }
+      }
+      lasting_result = lasting_result < 0 ? game_tick(&lasting) : lasting_result;
+      fading_result = game_tick(&fading);
+      ticks++;
+
+      // What the renderer would draw, reading only the cells marked dirty
+      game_publish(&fading);
+      bool repaint = snapshot_take_repaint(fading.snapshot);
+      int nrows = snapshot_take_dirty(fading.snapshot, rows, mask);
+      snapshot_read(fading.snapshot, frame, repaint ? NULL : rows, nrows, mask);
+      for (size_t i = 0; i < cells; i++)
+      {
+        int row = i / fading.width;
+        int col = i % fading.width;
+        uint8_t cell = game_cell(&fading, row, col);
+        problems += frame[i] != cell;
+        problems += bitboard_test(&fading.occupied, row, col) != (cell != CELL_EMPTY);
+      }
+    }
+    if (lasting_result != fading_result || lasting.tick != fading.tick)
+    {
+      differed++;
+    }
+    game_reset(&lasting);
+    game_reset(&fading);
+  }
+  if (same_as_lasting)
+  {
+    problems += differed;
+  }
+  printf("trails of %d ticks: %d rounds, %llu ticks, %d rounds unlike lasting trails: "
+         "%d problems\n",
+         trail_length, ROUNDS, (unsigned long long)ticks, differed, problems);
+  free(frame);
+  free(rows);
+  free(mask);
+  snapshot_free(fading.snapshot);
+  game_free(&lasting);
+  game_free(&fading);
+  return problems;
+}
+
+/**
+ * Play headless rounds between bots and check none outlasts the limit on rounds with fading
+ * trails, and that a round stopped by the limit is a draw
+ * \return          The number of problems found
+ */
+static int bot_rounds(int trail_length)
+{
+  game_config_t config = {.width = DEFAULT_BOARD_WIDTH,
+                          .height = DEFAULT_BOARD_HEIGHT,
+                          .num_players = 2,
+                          .trail_length = trail_length};
+  game_t game;
+  game_init(&game, &config);
+  bot_t bots[2];
+  bot_t *player_bots[2] = {&bots[0], &bots[1]};
+  bot_init(&bots[0], &game, 0);
+  bot_init(&bots[1], &game, 1);
+
+  int problems = 0;
+  int limited = 0;
+  uint64_t rng = 1;
+  int max_ticks = trail_length * HEADLESS_FADING_ROUND_TRAILS;
+  for (int round = 0; round < BOT_ROUNDS; round++)
+  {
+    uint64_t ticks = 0;
+    int winner = headless_match(&game, player_bots, &rng, &ticks, NULL);
+    bool survivors = game.players[0].alive || game.players[1].alive;
+    problems += ticks > (uint64_t)max_ticks;
+    if (ticks == (uint64_t)max_ticks && survivors)
+    {
+      limited++;
+      problems += winner != 0;
+    }
+  }
+  printf("bots with trails of %d ticks: %d of %d rounds stopped at %d ticks\n", trail_length,
+         limited, BOT_ROUNDS, max_ticks);
+  problems += limited == 0;
+  bot_free(&bots[0]);
+  bot_free(&bots[1]);
+  game_free(&game);
+  return problems;
+}
+
+int main()
+{
+  int problems = 0;
+
+  // A lap takes 4 * (LOOP_SIDE - 1) moves, half of them vertical. The bike comes back to a cell a
+  // lap after it entered it, so the cell has been trail for a lap less the time the bike spent on
+  // it, at most one vertical move.
+  int lap = 2 * (LOOP_SIDE - 1) * (player_HORIZONTAL_INTERVAL + player_VERTICAL_INTERVAL) /
+            SIM_TICK_INTERVAL;
+  int dwell = player_VERTICAL_INTERVAL / SIM_TICK_INTERVAL;
+  int long_trail = drive_loop(2 * lap);
+  int short_trail = drive_loop(lap - 2 * dwell);
+  int lasting = drive_loop(0);
+  printf("looping: crashed on tick %d with trails that never fade, %d with trails longer than a "
+         "lap, %d with shorter ones\n",
+         lasting, long_trail, short_trail);
+  problems += lasting == 0 || long_trail == 0 || short_trail != 0;
+
+  problems += compare_rounds(1 << 30, true);
+  problems += compare_rounds(MIN_TRAIL_TICKS * 4, false);
+  problems += bot_rounds(MIN_TRAIL_TICKS * 4);
+
+  if (problems > 0)
+  {
+    printf("%d problems\n", problems);
+    return 1;
+  }
+  printf("All done!\n");
+  return 0;
+}
@@ -0,0 +1,224 @@
+// Plays rounds between a stand-in server and a predicting client that only hear from each other
+// through queues with an artificial delay, and checks that the client always ends up with the
+// server's board once the server has confirmed a tick.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+#include "headless.h"
+#include "rollback.h"
+#include "util.h"
+
+#define MAX_TICKS 20000
+#define QUEUE_SIZE 4096
+
+// A message in flight: sent at one tick, arriving at a later one
+typedef struct message
+{
+  int arrive;
+  int tick;
+  int dirs[MAX_PLAYERS];
+} message_t;
+
+typedef struct queue
+{
+  message_t messages[QUEUE_SIZE];
+  int head;
+  int tail;
+  int last_arrival; // messages arrive in the order they were sent
+} queue_t;
+
+static void queue_send(queue_t *queue, int now, int delay, int jitter, uint64_t *rng,
+                       int tick, const int *dirs, int num_dirs)
+{
+  message_t *m = &queue->messages[queue->tail++ % QUEUE_SIZE];
+  m->arrive = now + delay + (jitter > 0 ? (int)(rng_next(rng) % (jitter + 1)) : 0);
+  m->arrive = m->arrive < queue->last_arrival ? queue->last_arrival : m->arrive;
+  queue->last_arrival = m->arrive;
+  m->tick = tick;
+  memcpy(m->dirs, dirs, sizeof(int) * num_dirs);
+}
+
+static message_t *queue_receive(queue_t *queue, int now)
+{
+  if (queue->head == queue->tail || queue->messages[queue->head % QUEUE_SIZE].arrive > now)
+  {
+    return NULL;
+  }
+  return &queue->messages[queue->head++ % QUEUE_SIZE];
+}
+
+// Hash everything game_tick depends on (nothing about a dead player but that it is dead)
+static uint64_t hash_game(const game_t *game)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for (int i = 0; i < game->width * game->height; i++)
+  {
+    hash = (hash ^ game->cells[i]) * 1099511628211ull;
+  }
+  for (int i = 0; i < game->num_players; i++)
+  {
+    const player_t *p = &game->players[i];
+    int fields[] = {p->row, p->col, p->dir, p->alive ? p->updated_dir : 0, p->elapsed, p->alive};
+    for (int f = 0; f < 6; f++)
+    {
+      hash = (hash ^ (uint32_t)fields[f]) * 1099511628211ull;
+    }
+  }
+  return hash;
+}
+
+/**
+ * Play rounds with a given one-way delay (plus up to jitter more ticks) and client lead
+ * \return        The number of ticks where the client disagreed with the server
+ */
+static int run(int num_players, int delay, int jitter, int lead, int rounds, uint64_t seed)
+{
+  game_config_t config = {DEFAULT_BOARD_WIDTH, DEFAULT_BOARD_HEIGHT, num_players};
+  static game_t server;
+  static rollback_t client;
+  static queue_t to_client;
+  static queue_t to_server;
+  static uint64_t hashes[MAX_TICKS];
+  game_init(&server, &config);
+  rollback_init(&client, &config, 0);
+  uint64_t rng = seed;
+  int mismatches = 0;
+  uint64_t ticks = 0;
+
+  for (int round = 0; round < rounds; round++)
+  {
+    game_reset(&server);
+    rollback_reset(&client);
+    memset(&to_client, 0, sizeof(queue_t));
+    memset(&to_server, 0, sizeof(queue_t));
+    int requested = server.players[0].dir;
+    int pending_dir = -1;
+    int pending_tick = 0;
+    int result = -1;
+    int end = MAX_TICKS;
+    int checked = 0;
+
+    for (int now = 0; client.confirmed < end; now++)
+    {
+      // The server applies the client's inputs at the tick they were meant for, or as soon as
+      // they arrive if that is already past
+      if (now < end)
+      {
+        message_t *m;
+        while ((m = queue_receive(&to_server, now)) != NULL)
+        {
+          pending_dir = m->dirs[0];
+          pending_tick = m->tick;
+        }
+        if (pending_dir >= 0 && pending_tick <= now)
+        {
+          requested = pending_dir;
+          pending_dir = -1;
+        }
+
+        hashes[now] = hash_game(&server);
+        game_steer(&server, 0, requested);
+        for (int i = 1; i < num_players; i++)
+        {
+          if (game_move_due(&server, i))
+          {
+            wander_steer(&server, i, &rng);
+          }
+        }
+        int dirs[MAX_PLAYERS];
+        for (int i = 0; i < num_players; i++)
+        {
+          dirs[i] = server.players[i].updated_dir;
+        }
+        queue_send(&to_client, now, delay, jitter, &rng, now, dirs, num_players);
+        result = game_tick(&server);
+        if (result >= 0 || now + 1 == MAX_TICKS)
+        {
+          end = now + 1;
+        }
+      }
+
+      // The client takes every confirmation that has arrived, steers its own player on its
+      // prediction, and runs ahead of what it has heard by the lead
+      message_t *m;
+      while ((m = queue_receive(&to_client, now)) != NULL)
+      {
+        rollback_confirm(&client, m->tick, m->dirs);
+      }
+      player_t *me = &client.game.players[0];
+      if (client.result < 0 && me->alive && game_move_due(&client.game, 0))
+      {
+        int before = me->updated_dir;
+        wander_steer(&client.game, 0, &rng);
+        if (me->updated_dir != client.local_dir)
+        {
+          rollback_steer(&client, me->updated_dir);
+          int dir = me->updated_dir;
+          queue_send(&to_server, now, delay, jitter, &rng, client.tick, &dir, 1);
+        }
+        me->updated_dir = before;
+      }
+      while (client.tick < now - delay + lead && rollback_advance(&client))
+      {
+      }
+      if (client.redo >= 0)
+      {
+        rollback_advance(&client);
+      }
+
+      // Every confirmed tick still in the history must match the server exactly
+      int first = client.tick - ROLLBACK_WINDOW + 1;
+      for (int t = checked > first ? checked : first; t < client.confirmed && t < client.tick; t++)
+      {
+        if (hash_game(&client.history[t % ROLLBACK_WINDOW]) != hashes[t])
+        {
+          printf("round %d: tick %d differs from the server\n", round + 1, t);
+          mismatches++;
+        }
+      }
+      checked = client.confirmed;
+    }
+
+    // With every tick confirmed the prediction is the server's final board
+    rollback_advance(&client);
+    if (client.tick != end || client.result != result || hash_game(&client.game) != hash_game(&server))
+    {
+      printf("round %d: final board differs from the server\n", round + 1);
+      mismatches++;
+    }
+    ticks += end;
+  }
+
+  printf("%d players, delay %2d+%d ticks, lead %2d: %d rounds, %6" PRIu64 " ticks, "
+         "%5" PRIu64 " rollbacks, %.1f ticks resimulated per tick, deepest %2d, %.1f us each\n",
+         num_players, delay, jitter, lead, rounds, ticks, client.rollbacks,
+         (double)client.resimulated / ticks, client.max_depth,
+         client.rollbacks ? client.rollback_ns / 1e3 / client.rollbacks : 0.0);
+  rollback_free(&client);
+  game_free(&server);
+  return mismatches;
+}
+
+int main()
+{
+  int mismatches = 0;
+  mismatches += run(2, 0, 0, 1, 20, 1);
+  mismatches += run(2, 4, 0, 9, 20, 2);
+  mismatches += run(2, 4, 3, 9, 20, 3);
+  mismatches += run(2, 12, 4, 25, 20, 4);
+  mismatches += run(4, 8, 2, 17, 20, 5);
+  mismatches += run(2, 8, 0, 0, 20, 6); // too little lead: the server moves the client late
+
+  if (mismatches > 0)
+  {
+    printf("%d mismatches\n", mismatches);
+    return 1;
+  }
+  printf("All done!\n");
+  return 0;
+}
@@ -0,0 +1,292 @@
+// Gives random players wins on a leaderboard and checks it against plain counts: ranks stay
+// sorted, every player's score is right, and the leaderboard survives being saved and reopened.
+// Then has several processes append wins to the journal at once while another compacts it, and
+// times wins on a leaderboard of a million players.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "leaderboard.h"
+#include "util.h"
+
+#define TEST_FILE "test6.db"
+#define TEST_CSV "test6.csv"
+#define WRITERS 8
+#define WRITER_WINS 3000
+#define WRITER_PLAYERS 500
+
+// Make up the name of player n: three bytes, none of them NUL
+static void player_name(uint32_t n, char name[LEADERBOARD_NAME_LEN + 1])
+{
+  for (int i = 0; i < LEADERBOARD_NAME_LEN; i++)
+  {
+    name[i] = (char)(1 + n % 255);
+    n /= 255;
+  }
+  name[LEADERBOARD_NAME_LEN] = '\0';
+}
+
+// Check the ranking and every score; returns the number of problems found
+static int check(leaderboard_t *board, const uint32_t *wins, int players)
+{
+  int problems = 0;
+  leaderboard_entry_t *top = malloc((players + 1) * sizeof(leaderboard_entry_t));
+  size_t count = leaderboard_top(board, players + 1, top);
+  for (size_t i = 1; i < count; i++)
+  {
+    if (top[i].score > top[i - 1].score)
+    {
+      printf("rank %zu has more wins than rank %zu\n", i, i - 1);
+      problems++;
+    }
+  }
+  for (size_t i = 0; i < count; i++)
+  {
+    if (leaderboard_score(board, top[i].name) != top[i].score)
+    {
+      printf("rank %zu does not have its player's score\n", i);
+      problems++;
+    }
+  }
+  free(top);
+
+  size_t listed = 0;
+  for (int n = 0; n < players; n++)
+  {
+    char name[LEADERBOARD_NAME_LEN + 1];
+    player_name(n, name);
+    listed += wins[n] > 0;
+    if (leaderboard_score(board, name) != wins[n])
+    {
+      printf("player %d should have %u wins\n", n, wins[n]);
+      problems++;
+    }
+  }
+  if (listed != count)
+  {
+    printf("%zu players listed instead of %zu\n", count, listed);
+    problems++;
+  }
+  return problems;
+}
+
+// Remove a leaderboard's files
+static void remove_files(const char *path)
+{
+  char name[256];
+  unlink(path);
+  snprintf(name, sizeof(name), "%s%s", path, LEADERBOARD_JOURNAL_SUFFIX);
+  unlink(name);
+  snprintf(name, sizeof(name), "%s%s", path, LEADERBOARD_LOCK_SUFFIX);
+  unlink(name);
+}
+
+// The player a writer gives its nth win
+static int writer_player(int writer, int n)
+{
+  uint64_t rng = 1 + writer * 1000003ull + n;
+  return (int)(rng_next(&rng) % WRITER_PLAYERS);
+}
+
+// Append wins from several processes at once while compacting; returns the number of problems
+static int concurrent(void)
+{
+  remove_files(TEST_FILE);
+  pid_t writers[WRITERS];
+  for (int w = 0; w < WRITERS; w++)
+  {
+    writers[w] = fork();
+    if (writers[w] == 0)
+    {
+      for (int n = 0; n < WRITER_WINS; n++)
+      {
+        char name[LEADERBOARD_NAME_LEN + 1];
+        player_name(writer_player(w, n), name);
+        if (!leaderboard_record_win(TEST_FILE, name))
+        {
+          _exit(1);
+        }
+        if (n % 100 == 99)
+        {
+          usleep(1000); // spread the wins over several compactions
+        }
+      }
+      _exit(0);
+    }
+  }
+
+  // Compact over and over while they write, as every finished game does
+  int problems = 0;
+  int compactions = 0;
+  int running = WRITERS;
+  while (running > 0)
+  {
+    const char *error = leaderboard_compact(TEST_FILE, 16);
+    if (error != NULL)
+    {
+      printf("compaction failed: %s\n", error);
+      problems++;
+    }
+    compactions++;
+    int status;
+    while (running > 0 && waitpid(-1, &status, WNOHANG) > 0)
+    {
+      running--;
+      problems += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+  }
+
+  uint32_t wins[WRITER_PLAYERS] = {0};
+  for (int w = 0; w < WRITERS; w++)
+  {
+    for (int n = 0; n < WRITER_WINS; n++)
+    {
+      wins[writer_player(w, n)]++;
+    }
+  }
+
+  // Readers see every win whether or not it has been folded yet
+  leaderboard_t board;
+  problems += leaderboard_open(&board, TEST_FILE, NULL) != NULL;
+  size_t pending = board.tail_records;
+  problems += check(&board, wins, WRITER_PLAYERS);
+  leaderboard_close(&board);
+  problems += leaderboard_compact(TEST_FILE, 0) != NULL;
+  problems += leaderboard_open(&board, TEST_FILE, NULL) != NULL;
+  problems += board.tail_records != 0;
+  problems += check(&board, wins, WRITER_PLAYERS);
+  leaderboard_close(&board);
+
+  remove_files(TEST_FILE);
+  printf("%d writers, %d wins each, %d compactions (%zu wins left in the journal): %d problems\n",
+         WRITERS, WRITER_WINS, compactions, pending, problems);
+  return problems;
+}
+
+static int run(int players, int games, uint64_t seed)
+{
+  uint32_t *wins = calloc(players, sizeof(uint32_t));
+  uint64_t rng = seed;
+  leaderboard_t board;
+  unlink(TEST_FILE);
+  int problems = leaderboard_open(&board, TEST_FILE, NULL) != NULL;
+
+  for (int g = 0; g < games; g++)
+  {
+    // Skewed, so some players win a lot and many tie
+    int n = (int)(rng_next(&rng) % players);
+    n = n % (1 + (int)(rng_next(&rng) % players));
+    char name[LEADERBOARD_NAME_LEN + 1];
+    player_name(n, name);
+    size_t rank = leaderboard_add_win(&board, name);
+    wins[n]++;
+    if (board.entries[rank].score != wins[n] ||
+        (rank > 0 && board.entries[rank - 1].score < wins[n]))
+    {
+      printf("game %d: player %d ranked %zu with %u wins\n", g, n, rank,
+             board.entries[rank].score);
+      problems++;
+    }
+  }
+  problems += check(&board, wins, players);
+
+  if (!leaderboard_save(&board, TEST_FILE))
+  {
+    perror(TEST_FILE);
+    problems++;
+  }
+  leaderboard_close(&board);
+  if (leaderboard_open(&board, TEST_FILE, NULL) != NULL)
+  {
+    printf("could not reopen the leaderboard\n");
+    problems++;
+  }
+  problems += check(&board, wins, players);
+  leaderboard_close(&board);
+  unlink(TEST_FILE);
+  free(wins);
+  printf("%d players, %d games: %d problems\n", players, games, problems);
+  return problems;
+}
+
+// Import a scoresheet written by the old game
+static int import(void)
+{
+  FILE *csv = fopen(TEST_CSV, "w");
+  fputs("ABC  3  \nXYZ  12 \nQQQ  1  \n", csv);
+  fclose(csv);
+
+  leaderboard_t board;
+  leaderboard_open(&board, TEST_FILE, NULL);
+  leaderboard_add_win(&board, "QQQ");
+  int problems = !leaderboard_import_csv(&board, TEST_CSV);
+  leaderboard_entry_t top[10];
+  size_t count = leaderboard_top(&board, 10, top);
+  problems += count != 3 || strcmp(top[0].name, "XYZ") != 0 || top[0].score != 12 ||
+              strcmp(top[1].name, "ABC") != 0 || strcmp(top[2].name, "QQQ") != 0 ||
+              top[2].score != 1;
+  leaderboard_close(&board);
+  unlink(TEST_CSV);
+  printf("import: %d problems\n", problems);
+  return problems;
+}
+
+// Time wins among a million players, then reading the top ten from the saved file
+static void timing(void)
+{
+  int players = 1000000;
+  leaderboard_t board;
+  unlink(TEST_FILE);
+  leaderboard_open(&board, TEST_FILE, NULL);
+  uint64_t rng = 1;
+  uint64_t start = time_ns();
+  for (int g = 0; g < 4 * players; g++)
+  {
+    char name[LEADERBOARD_NAME_LEN + 1];
+    player_name(rng_next(&rng) % players, name);
+    leaderboard_add_win(&board, name);
+  }
+  uint64_t elapsed = time_ns() - start;
+  leaderboard_save(&board, TEST_FILE);
+  leaderboard_close(&board);
+
+  // Add a few journal records, as a reader usually finds
+  for (int n = 0; n < LEADERBOARD_COMPACT_RECORDS; n++)
+  {
+    char name[LEADERBOARD_NAME_LEN + 1];
+    player_name(rng_next(&rng) % players, name);
+    leaderboard_record_win(TEST_FILE, name);
+  }
+  start = time_ns();
+  leaderboard_open(&board, TEST_FILE, NULL);
+  leaderboard_entry_t top[10];
+  leaderboard_top(&board, 10, top);
+  leaderboard_close(&board);
+  printf("%d wins among %zu players: %.0f ns each; top ten from the files in %.1f us\n",
+         4 * players, (size_t)players, elapsed / (4.0 * players), (time_ns() - start) / 1e3);
+  remove_files(TEST_FILE);
+}
+
+int main()
+{
+  int problems = 0;
+  problems += run(1, 100, 1);
+  problems += run(10, 1000, 2);
+  problems += run(1000, 100000, 3);
+  problems += run(100000, 300000, 4);
+  problems += import();
+  problems += concurrent();
+  timing();
+
+  if (problems > 0)
+  {
+    printf("%d problems\n", problems);
+    return 1;
+  }
+  printf("All done!\n");
+  return 0;
+}
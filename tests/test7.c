@@ -0,0 +1,316 @@
+// Writes random matches to a match history and checks the statistics read back against plain
+// counts: games, wins, draws, deaths and head-to-head records. Checks that saved statistics brought
+// up to date with newer matches come out exactly as if the whole history were read from scratch,
+// that a block cut short is skipped until it is complete, and that several processes can append
+// to one history at once.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "util.h"
+
+#define TEST_FILE "test7.db"
+#define PLAYERS 50
+#define MATCHES 20000
+#define WRITERS 4
+#define WRITER_MATCHES 2000
+
+// Plain totals to check the statistics against
+typedef struct expected
+{
+  uint32_t games[PLAYERS];
+  uint32_t wins[PLAYERS];
+  uint32_t draws[PLAYERS];
+  uint32_t deaths[PLAYERS][DEATH_HEAD_ON + 1];
+  uint32_t beat[PLAYERS][PLAYERS]; // beat[a][b]: matches where a outlasted b
+  uint32_t tied[PLAYERS][PLAYERS];
+} expected_t;
+
+/**
+ * Make up a random match between distinct players, with ties for survival now and then
+ */
+static void make_match(history_match_t *match, char names[][HISTORY_NAME_LEN + 1], int *ids,
+                       uint64_t *rng)
+{
+  match->num_players = 2 + rng_next(rng) % 5;
+  uint32_t best = 0;
+  int winners = 0;
+  for (int i = 0; i < match->num_players; i++)
+  {
+    bool taken;
+    do
+    {
+      ids[i] = rng_next(rng) % PLAYERS;
+      taken = false;
+      for (int j = 0; j < i; j++)
+      {
+        taken |= ids[j] == ids[i];
+      }
+    } while (taken);
+    snprintf(names[i], HISTORY_NAME_LEN + 1, "p%d", ids[i]);
+    match->names[i] = names[i];
+    match->lasted[i] = rng_next(rng) % 20 + ids[i] / 5;
+    match->deaths[i] = DEATH_WALL + rng_next(rng) % 4;
+    if (match->lasted[i] > best)
+    {
+      best = match->lasted[i];
+      winners = 0;
+    }
+    winners += match->lasted[i] == best;
+  }
+  match->ticks = best;
+  match->winner = 0;
+  for (int i = 0; i < match->num_players; i++)
+  {
+    if (match->lasted[i] == best && winners == 1)
+    {
+      match->winner = i + 1;
+      match->deaths[i] = DEATH_NONE;
+    }
+  }
+}
+
+/**
+ * Add a match to the plain totals
+ */
+static void count_match(expected_t *expected, const history_match_t *match, const int *ids)
+{
+  for (int i = 0; i < match->num_players; i++)
+  {
+    int a = ids[i];
+    expected->games[a]++;
+    expected->wins[a] += match->winner == i + 1;
+    expected->draws[a] += match->winner == 0;
+    expected->deaths[a][match->deaths[i]]++;
+    for (int j = 0; j < match->num_players; j++)
+    {
+      int b = ids[j];
+      expected->beat[a][b] += match->lasted[i] > match->lasted[j];
+      expected->tied[a][b] += i != j && match->lasted[i] == match->lasted[j];
+    }
+  }
+}
+
+/**
+ * Write random matches, flushing now and then so they span many blocks
+ */
+static void write_matches(history_writer_t *writer, expected_t *expected, int matches,
+                          uint64_t *rng)
+{
+  for (int m = 0; m < matches; m++)
+  {
+    history_match_t match;
+    char names[MAX_PLAYERS][HISTORY_NAME_LEN + 1];
+    int ids[MAX_PLAYERS];
+    make_match(&match, names, ids, rng);
+    if (expected != NULL)
+    {
+      count_match(expected, &match, ids);
+    }
+    history_writer_add(writer, &match);
+    if (rng_next(rng) % 500 == 0)
+    {
+      history_writer_flush(writer);
+    }
+  }
+}
+
+// Check the statistics against the plain totals; returns the number of problems found
+static int check(const history_stats_t *stats, const expected_t *expected, uint64_t matches)
+{
+  int problems = stats->matches != matches;
+  for (int a = 0; a < PLAYERS; a++)
+  {
+    char name[HISTORY_NAME_LEN + 1];
+    snprintf(name, sizeof(name), "p%d", a);
+    long id = history_stats_find(stats, name);
+    if (id < 0)
+    {
+      printf("player %d is missing\n", a);
+      problems++;
+      continue;
+    }
+    const history_player_t *p = &stats->players[id];
+    if (p->games != expected->games[a] || p->wins != expected->wins[a] ||
+        p->draws != expected->draws[a] ||
+        memcmp(p->deaths, expected->deaths[a], sizeof(p->deaths)) != 0)
+    {
+      printf("player %d has the wrong totals\n", a);
+      problems++;
+    }
+    for (int b = 0; b < PLAYERS; b++)
+    {
+      char other[HISTORY_NAME_LEN + 1];
+      snprintf(other, sizeof(other), "p%d", b);
+      long other_id = history_stats_find(stats, other);
+      const history_pair_t *pair = other_id >= 0 ? history_stats_pair(stats, id, other_id) : NULL;
+      uint32_t wins = 0;
+      uint32_t draws = 0;
+      if (pair != NULL)
+      {
+        wins = pair->a == id ? pair->a_wins : pair->b_wins;
+        draws = pair->draws;
+      }
+      if (wins != expected->beat[a][b] || draws != expected->tied[a][b])
+      {
+        printf("players %d and %d have the wrong head-to-head record\n", a, b);
+        problems++;
+      }
+    }
+  }
+
+  // The top ten are the ten best ratings, best first
+  uint32_t top[10];
+  size_t count = history_stats_top(stats, 10, top);
+  for (size_t i = 0; i < count; i++)
+  {
+    size_t better = 0;
+    for (size_t j = 0; j < stats->num_players; j++)
+    {
+      better += stats->players[j].rating > stats->players[top[i]].rating;
+    }
+    if (better > i || (i > 0 && stats->players[top[i]].rating > stats->players[top[i - 1]].rating))
+    {
+      printf("rank %zu is out of order\n", i + 1);
+      problems++;
+    }
+  }
+  return problems + (count != (stats->num_players < 10 ? stats->num_players : 10));
+}
+
+// Compare two sets of statistics player by player; returns the number of differences
+static int compare(const history_stats_t *a, const history_stats_t *b)
+{
+  int problems = a->matches != b->matches || a->num_players != b->num_players;
+  for (size_t i = 0; i < a->num_players && i < b->num_players; i++)
+  {
+    long j = history_stats_find(b, a->players[i].name);
+    if (j < 0 || memcmp(&a->players[i], &b->players[j], sizeof(history_player_t)) != 0)
+    {
+      printf("%s differs\n", a->players[i].name);
+      problems++;
+    }
+  }
+  return problems;
+}
+
+static int run(void)
+{
+  unlink(TEST_FILE);
+  char stats_file[256];
+  snprintf(stats_file, sizeof(stats_file), "%s%s", TEST_FILE, HISTORY_STATS_SUFFIX);
+  unlink(stats_file);
+
+  expected_t *expected = calloc(1, sizeof(expected_t));
+  uint64_t rng = 1;
+  history_writer_t writer;
+  int problems = !history_writer_open(&writer, TEST_FILE);
+
+  // Save statistics halfway through, then add the rest
+  write_matches(&writer, expected, MATCHES / 2, &rng);
+  history_writer_flush(&writer);
+  history_stats_t saved;
+  history_stats_init(&saved);
+  problems += history_stats_load(&saved, TEST_FILE) != NULL;
+  problems += check(&saved, expected, MATCHES / 2);
+  problems += !history_stats_save(&saved, TEST_FILE);
+  history_stats_free(&saved);
+  write_matches(&writer, expected, MATCHES / 2, &rng);
+  problems += !history_writer_close(&writer);
+
+  history_stats_t incremental;
+  history_stats_t scratch;
+  history_stats_init(&incremental);
+  history_stats_init(&scratch);
+  problems += history_stats_load(&incremental, TEST_FILE) != NULL;
+  problems += history_stats_update(&scratch, TEST_FILE) != NULL;
+  problems += check(&incremental, expected, MATCHES);
+  problems += check(&scratch, expected, MATCHES);
+  problems += compare(&incremental, &scratch);
+
+  // Half a block is left for later; the whole block counts once it is there
+  history_writer_t late;
+  history_writer_open(&late, TEST_FILE ".late");
+  write_matches(&late, NULL, 10, &rng);
+  history_writer_close(&late);
+  FILE *block = fopen(TEST_FILE ".late", "rb");
+  char bytes[4096];
+  size_t size = fread(bytes, 1, sizeof(bytes), block);
+  fclose(block);
+  unlink(TEST_FILE ".late");
+  FILE *file = fopen(TEST_FILE, "ab");
+  fwrite(bytes, 1, size / 2, file);
+  fclose(file);
+  uint64_t offset = scratch.offset;
+  problems += history_stats_update(&scratch, TEST_FILE) != NULL;
+  problems += scratch.matches != MATCHES || scratch.offset != offset;
+  file = fopen(TEST_FILE, "ab");
+  fwrite(bytes + size / 2, 1, size - size / 2, file);
+  fclose(file);
+  problems += history_stats_update(&scratch, TEST_FILE) != NULL;
+  problems += scratch.matches != MATCHES + 10;
+
+  history_stats_free(&incremental);
+  history_stats_free(&scratch);
+  free(expected);
+  unlink(TEST_FILE);
+  unlink(stats_file);
+  printf("%d matches, %d players: %d problems\n", MATCHES, PLAYERS, problems);
+  return problems;
+}
+
+// Append matches from several processes at once; returns the number of problems
+static int concurrent(void)
+{
+  unlink(TEST_FILE);
+  for (int w = 0; w < WRITERS; w++)
+  {
+    if (fork() == 0)
+    {
+      history_writer_t writer;
+      uint64_t rng = 100 + w;
+      if (!history_writer_open(&writer, TEST_FILE))
+      {
+        _exit(1);
+      }
+      write_matches(&writer, NULL, WRITER_MATCHES, &rng);
+      _exit(history_writer_close(&writer) ? 0 : 1);
+    }
+  }
+  int problems = 0;
+  for (int w = 0; w < WRITERS; w++)
+  {
+    int status;
+    wait(&status);
+    problems += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+
+  history_stats_t stats;
+  history_stats_init(&stats);
+  problems += history_stats_update(&stats, TEST_FILE) != NULL;
+  problems += stats.matches != WRITERS * WRITER_MATCHES;
+  history_stats_free(&stats);
+  unlink(TEST_FILE);
+  printf("%d writers, %d matches each: %d problems\n", WRITERS, WRITER_MATCHES, problems);
+  return problems;
+}
+
+int main()
+{
+  int problems = 0;
+  problems += run();
+  problems += concurrent();
+
+  if (problems > 0)
+  {
+    printf("%d problems\n", problems);
+    return 1;
+  }
+  printf("All done!\n");
+  return 0;
+}
@@ -0,0 +1,261 @@
+// Plays a 1000-round headless session the way the game does between rounds: each round is played,
+// recorded in a match history, given to the winner on a leaderboard and followed by reading the
+// top ten with scratch memory from a per-round arena. Every heap allocation made by the game's
+// code is counted (the test is linked with malloc and friends wrapped). Once warmed up, the tick
+// loop must never allocate, the rest of a round must only allocate while compacting the
+// leaderboard (and free it all again), and the resident set size must not grow. Then two bots
+// that search with helper threads play a shorter session, which must neither allocate nor create
+// a thread in the tick loop.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "bot.h"
+#include "headless.h"
+#include "history.h"
+#include "leaderboard.h"
+#include "util.h"
+
+#define TEST_HISTORY "test8.db"
+#define TEST_LEADERBOARD "test8.lb"
+#define ROUNDS 1000
+#define SEARCH_ROUNDS 5
+#define SEARCH_THREADS 2
+
+// Rounds played before anything is measured: enough to compact the leaderboard a couple of times
+// and let the arena settle at its working size
+#define WARM_UP_ROUNDS (3 * LEADERBOARD_COMPACT_RECORDS)
+
+// Pages the resident set may gain over the whole session regardless, as the kernel and the C
+// library touch a page now and then (the mapped leaderboard, the top of malloc's heap after
+// compacting). Small leaks are caught by counting live blocks; this catches memory that grows
+// with the rounds played.
+#define RESIDENT_SLACK_PAGES 64
+
+// Allocation and thread counts, kept by the wrappers below
+static uint64_t allocations;
+static int64_t live;
+static uint64_t threads_created;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *memory, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+void __real_free(void *memory);
+int __real_pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                          void *(*start)(void *), void *arg);
+
+void *__wrap_malloc(size_t size)
+{
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&live, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&live, 1, __ATOMIC_RELAXED);
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *memory, size_t size)
+{
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&live, memory == NULL, __ATOMIC_RELAXED);
+  return __real_realloc(memory, size);
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size)
+{
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&live, 1, __ATOMIC_RELAXED);
+  return __real_aligned_alloc(alignment, size);
+}
+
+void __wrap_free(void *memory)
+{
+  __atomic_sub_fetch(&live, memory != NULL, __ATOMIC_RELAXED);
+  __real_free(memory);
+}
+
+int __wrap_pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                          void *(*start)(void *), void *arg)
+{
+  __atomic_add_fetch(&threads_created, 1, __ATOMIC_RELAXED);
+  return __real_pthread_create(thread, attr, start, arg);
+}
+
+// Get the resident set size in pages
+static long resident_pages(void)
+{
+  long size = 0;
+  long resident = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm != NULL)
+  {
+    if (fscanf(statm, "%ld %ld", &size, &resident) != 2)
+    {
+      resident = 0;
+    }
+    fclose(statm);
+  }
+  return resident;
+}
+
+/**
+ * Play two-player rounds between bots that search on SEARCH_THREADS threads each
+ * \return          The number of problems found
+ */
+static int search_session(void)
+{
+  game_config_t config = {.width = DEFAULT_BOARD_WIDTH,
+                          .height = DEFAULT_BOARD_HEIGHT,
+                          .num_players = 2};
+  game_t game;
+  game_init(&game, &config);
+  bot_t bots[2];
+  bot_t *player_bots[2] = {&bots[0], &bots[1]};
+  for (int i = 0; i < 2; i++)
+  {
+    bot_init(&bots[i], &game, i);
+    bot_use_search(&bots[i], &game, SEARCH_THREADS);
+  }
+
+  uint64_t rng = 1;
+  uint64_t ticks = 0;
+  uint64_t allocated = allocations;
+  uint64_t created = threads_created;
+  for (int round = 0; round < SEARCH_ROUNDS; round++)
+  {
+    headless_match(&game, player_bots, &rng, &ticks, NULL);
+  }
+  allocated = allocations - allocated;
+  created = threads_created - created;
+  uint64_t searches = bots[0].stats.searches + bots[1].stats.searches;
+  printf("%d rounds with searching bots, %llu ticks, %llu searches: %llu allocations, %llu threads "
+         "created\n",
+         SEARCH_ROUNDS, (unsigned long long)ticks, (unsigned long long)searches,
+         (unsigned long long)allocated, (unsigned long long)created);
+  for (int i = 0; i < 2; i++)
+  {
+    bot_free(&bots[i]);
+  }
+  game_free(&game);
+  return (searches == 0) + (allocated != 0) + (created != 0);
+}
+
+int main()
+{
+  unlink(TEST_HISTORY);
+  unlink(TEST_LEADERBOARD);
+  unlink(TEST_LEADERBOARD LEADERBOARD_JOURNAL_SUFFIX);
+
+  game_config_t config = {.width = DEFAULT_BOARD_WIDTH,
+                          .height = DEFAULT_BOARD_HEIGHT,
+                          .num_players = 4};
+  game_t game;
+  game_init(&game, &config);
+
+  // Two players wander and two are steered by bots, as in a game with two people at the keyboard
+  bot_t bots[4];
+  bot_t *player_bots[4] = {NULL, NULL, &bots[2], &bots[3]};
+  bot_init(&bots[2], &game, 2);
+  bot_init(&bots[3], &game, 3);
+  const char *names[4] = {"P1", "P2", "BOT3", "BOT4"};
+
+  history_writer_t history;
+  arena_t arena;
+  arena_init(&arena, 1024);
+  int problems = !history_writer_open(&history, TEST_HISTORY);
+
+  uint64_t rng = 1;
+  uint64_t ticks = 0;
+  uint64_t tick_allocations = 0;
+  uint64_t round_allocations = 0;
+  uint64_t compactions = 0;
+  uint64_t overflows = 0;
+  int64_t live_before = 0;
+  long pages_before = 0;
+  for (int round = 0; round < WARM_UP_ROUNDS + ROUNDS; round++)
+  {
+    if (round == WARM_UP_ROUNDS)
+    {
+      tick_allocations = 0;
+      round_allocations = 0;
+      overflows = arena.overflow_count;
+      live_before = live;
+      pages_before = resident_pages();
+    }
+    arena_reset(&arena);
+
+    uint64_t before = allocations;
+    int winner = headless_match(&game, player_bots, &rng, &ticks, NULL);
+    tick_allocations += allocations - before;
+
+    // Everything the game over screen does
+    before = allocations;
+    history_match_t match;
+    history_match_from_game(&match, &game, winner, names);
+    problems += !history_writer_add(&history, &match);
+    if (winner > 0)
+    {
+      problems += !leaderboard_record_win(TEST_LEADERBOARD, names[winner - 1]);
+    }
+    leaderboard_t board;
+    leaderboard_entry_t top[10];
+    problems += leaderboard_open(&board, TEST_LEADERBOARD, &arena) != NULL;
+    size_t count = leaderboard_top(&board, 10, top);
+    size_t pending = board.tail_records;
+    leaderboard_close(&board);
+    problems += count == 0 && winner > 0;
+    round_allocations += allocations - before;
+
+    // The game compacts in the background, on the heap; it only has to give it all back
+    if (pending >= LEADERBOARD_COMPACT_RECORDS)
+    {
+      problems += leaderboard_compact(TEST_LEADERBOARD, LEADERBOARD_COMPACT_RECORDS) != NULL;
+      compactions++;
+    }
+  }
+  long pages_after = resident_pages();
+
+  printf("%d rounds, %llu ticks, %llu compactions\n", ROUNDS, (unsigned long long)ticks,
+         (unsigned long long)compactions);
+  printf("allocations: %llu in the tick loop, %llu elsewhere outside compaction, %llu arena "
+         "overflows; %lld more blocks live than after warming up\n",
+         (unsigned long long)tick_allocations, (unsigned long long)round_allocations,
+         (unsigned long long)(arena.overflow_count - overflows), (long long)(live - live_before));
+  printf("resident set: %ld pages after warming up, %ld after %d more rounds\n", pages_before,
+         pages_after, ROUNDS);
+  problems += tick_allocations != 0;
+  problems += round_allocations != 0;
+  problems += arena.overflow_count != overflows;
+  problems += live != live_before;
+  problems += pages_after > pages_before + RESIDENT_SLACK_PAGES;
+
+  problems += !history_writer_close(&history);
+  arena_free(&arena);
+  bot_free(&bots[2]);
+  bot_free(&bots[3]);
+  game_free(&game);
+  unlink(TEST_HISTORY);
+  unlink(TEST_LEADERBOARD);
+  unlink(TEST_LEADERBOARD LEADERBOARD_JOURNAL_SUFFIX);
+  unlink(TEST_LEADERBOARD LEADERBOARD_LOCK_SUFFIX);
+
+  problems += search_session();
+
+  if (problems > 0)
+  {
+    printf("%d problems\n", problems);
+    return 1;
+  }
+  printf("All done!\n");
+  return 0;
+}
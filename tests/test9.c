@@ -0,0 +1,194 @@
+// Plays the same rounds on a board and on a world of the same size and checks every cell and
+// result agrees, then plays wandering rounds on a 10000x10000 world: cells read back by row and
+// by cell must match, the view must keep player 1 in sight, and the memory held must follow the
+// trails (chunks are reused from round to round, never more than the longest round needed).
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+#include "headless.h"
+#include "util.h"
+#include "world.h"
+
+#define SMALL_ROUNDS 50
+#define LARGE_SIDE 10000
+#define LARGE_ROUNDS 20
+#define LARGE_MAX_TICKS 50000
+#define VIEW_HEIGHT 40
+#define VIEW_WIDTH 120
+
+/**
+ * Play rounds on a default board and on a world of the same size, steering both the same way
+ * \return          The number of problems found
+ */
+static int same_as_board(void)
+{
+  game_config_t config = {.width = DEFAULT_BOARD_WIDTH,
+                          .height = DEFAULT_BOARD_HEIGHT,
+                          .num_players = 4};
+  game_t game;
+  world_t world;
+  game_init(&game, &config);
+  world_init(&world, &config);
+  int problems = 0;
+  uint64_t ticks = 0;
+  for (int round = 0; round < SMALL_ROUNDS && problems == 0; round++)
+  {
+    uint64_t game_rng = round + 1;
+    uint64_t world_rng = round + 1;
+    int result = -1;
+    while (result < 0 && problems == 0)
+    {
+      for (int i = 0; i < config.num_players; i++)
+      {
+        if (game_move_due(&game, i))
+        {
+          wander_steer(&game, i, &game_rng);
+        }
+        if (world_move_due(&world, i))
+        {
+          world_wander(&world, i, &world_rng);
+        }
+      }
+      result = game_tick(&game);
+      if (world_tick(&world) != result)
+      {
+        printf("round %d, tick %d: the results differ\n", round, game.tick);
+        problems++;
+      }
+      for (int r = 0; r < game.height; r++)
+      {
+        for (int c = 0; c < game.width; c++)
+        {
+          problems += world_cell(&world, r, c) != game_cell(&game, r, c);
+        }
+      }
+      for (int i = 0; i < config.num_players; i++)
+      {
+        problems += world.players[i].death != game.players[i].death;
+      }
+      ticks++;
+    }
+    game_reset(&game);
+    world_reset(&world);
+  }
+  printf("%d rounds, %llu ticks on a %dx%d board and world: %d problems\n", SMALL_ROUNDS,
+         (unsigned long long)ticks, config.width, config.height, problems);
+  game_free(&game);
+  world_free(&world);
+  return problems;
+}
+
+/**
+ * Check a sample of rows read a run at a time against single cells, including runs across chunks
+ * and rows nothing has been written to
+ */
+static int check_rows(const world_t *world, uint64_t *rng)
+{
+  int problems = 0;
+  uint8_t run[VIEW_WIDTH];
+  for (int i = 0; i < 50; i++)
+  {
+    // Half the rows are taken from around the players, the rest from anywhere
+    const player_t *p = &world->players[i % world->num_players];
+    int row = i % 2 ? (int)(rng_next(rng) % world->height) : p->row;
+    int col = (int)(rng_next(rng) % (world->width - VIEW_WIDTH));
+    col = i % 2 ? col : (p->col > VIEW_WIDTH / 2 ? p->col - VIEW_WIDTH / 2 : 0);
+    world_read_row(world, row, col, VIEW_WIDTH, run);
+    for (int c = 0; c < VIEW_WIDTH; c++)
+    {
+      problems += run[c] != world_cell(world, row, col + c);
+    }
+  }
+  return problems;
+}
+
+/**
+ * Play wandering rounds on a large world
+ * \return          The number of problems found
+ */
+static int large_world(void)
+{
+  game_config_t config = {.width = LARGE_SIDE, .height = LARGE_SIDE, .num_players = 4};
+  world_t world;
+  world_init(&world, &config);
+  uint64_t rng = 1;
+  int problems = 0;
+  size_t most_chunks = 0;
+  uint64_t longest = 0;
+  for (int round = 0; round < LARGE_ROUNDS; round++)
+  {
+    int top = -WORLD_MAX_SIDE;
+    int left = -WORLD_MAX_SIDE;
+    uint64_t trail = config.num_players; // cells written: every bike and the trail behind it
+    int result = -1;
+    while (result < 0 && world.tick < LARGE_MAX_TICKS)
+    {
+      for (int i = 0; i < config.num_players; i++)
+      {
+        if (world_move_due(&world, i))
+        {
+          world_wander(&world, i, &rng);
+          trail++;
+        }
+      }
+      result = world_tick(&world);
+
+      // The view stays in the world with player 1 inside it
+      world_follow(&world, 0, VIEW_HEIGHT, VIEW_WIDTH, &top, &left);
+      const player_t *p = &world.players[0];
+      if (top < 0 || top + VIEW_HEIGHT > world.height || left < 0 ||
+          left + VIEW_WIDTH > world.width || (p->alive && (p->row < top ||
+          p->row >= top + VIEW_HEIGHT || p->col < left || p->col >= left + VIEW_WIDTH)))
+      {
+        problems++;
+      }
+    }
+    problems += check_rows(&world, &rng);
+
+    // A chunk holds at least one written cell
+    if (world.num_chunks > trail)
+    {
+      printf("round %d: %zu chunks for %llu cells\n", round, world.num_chunks,
+             (unsigned long long)trail);
+      problems++;
+    }
+    most_chunks = world.num_chunks > most_chunks ? world.num_chunks : most_chunks;
+    longest = (uint64_t)world.tick > longest ? (uint64_t)world.tick : longest;
+    world_reset(&world);
+
+    // Every chunk is kept for reuse, and no more were allocated than one round needed
+    if (world.num_chunks + world.num_spare != most_chunks)
+    {
+      printf("round %d: %zu chunks, but at most %zu were in use\n", round,
+             world.num_chunks + world.num_spare, most_chunks);
+      problems++;
+    }
+  }
+  size_t memory = world_memory(&world);
+  printf("%d rounds on a %dx%d world, up to %llu ticks: at most %zu chunks, %zu KiB (%.0f KiB as "
+         "one array): %d problems\n",
+         LARGE_ROUNDS, config.width, config.height, (unsigned long long)longest, most_chunks,
+         memory / 1024, (double)config.width * config.height / 1024, problems);
+  problems += memory > (size_t)config.width * config.height / 100;
+  world_free(&world);
+  return problems;
+}
+
+int main()
+{
+  int problems = 0;
+  problems += same_as_board();
+  problems += large_world();
+
+  if (problems > 0)
+  {
+    printf("%d problems\n", problems);
+    return 1;
+  }
+  printf("All done!\n");
+  return 0;
+}
@@ -0,0 +1,184 @@
+#include "tournament.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "util.h"
+
+// Number of matches a worker claims at a time
+#define TOURNAMENT_BATCH 16
+
+// State shared by every worker in a tournament
+typedef struct tournament
+{
+  const game_config_t *config;
+  int games;
+  int bots;
+  int search;
+  uint64_t seed;
+  const char *history; // the match history file, or NULL
+  atomic_int next_game;
+} tournament_t;
+
+// Each worker's private state, kept on its own cache lines
+typedef struct worker
+{
+  _Alignas(64) tournament_t *tournament;
+  pthread_t thread;
+  headless_stats_t stats;
+  bool history_failed;
+} worker_t;
+
+/**
+ * Run in a worker thread to play matches until the tournament is finished
+ */
+static void *tournament_worker(void *arg)
+{
+  worker_t *worker = arg;
+  tournament_t *t = worker->tournament;
+
+  game_t game;
+  game_init(&game, t->config);
+
+  bot_t bots[MAX_PLAYERS];
+  bot_t *player_bots[MAX_PLAYERS];
+  char seat_names[MAX_PLAYERS][HISTORY_NAME_LEN + 1];
+  const char *names[MAX_PLAYERS];
+  for (int i = 0; i < game.num_players; i++)
+  {
+    // Name each seat after what steers it, so the history rates the bots against each other
+    const char *kind = "wander";
+    player_bots[i] = NULL;
+    if (i >= game.num_players - t->bots)
+    {
+      kind = t->search > 0 ? "search" : "bot";
+      bot_init(&bots[i], &game, i);
+      if (t->search > 0)
+      {
+        bot_use_search(&bots[i], &game, t->search);
+      }
+      player_bots[i] = &bots[i];
+    }
+    snprintf(seat_names[i], sizeof(seat_names[i]), "%s%d", kind, i + 1);
+    names[i] = seat_names[i];
+  }
+
+  history_writer_t history;
+  bool recording = t->history != NULL && history_writer_open(&history, t->history);
+  worker->history_failed = t->history != NULL && !recording;
+
+  for (;;)
+  {
+    int first = atomic_fetch_add(&t->next_game, TOURNAMENT_BATCH);
+    if (first >= t->games)
+    {
+      break;
+    }
+    int last = first + TOURNAMENT_BATCH < t->games ? first + TOURNAMENT_BATCH : t->games;
+    for (int i = first; i < last; i++)
+    {
+      // Derive an independent generator for this match from its number
+      uint64_t mix = (uint64_t)i;
+      uint64_t rng = t->seed ^ rng_next(&mix);
+      int winner = headless_match(&game, player_bots, &rng, &worker->stats.ticks, NULL);
+      worker->stats.wins[winner]++;
+      worker->stats.games++;
+      if (recording)
+      {
+        history_match_t match;
+        history_match_from_game(&match, &game, winner, names);
+        worker->history_failed |= !history_writer_add(&history, &match);
+      }
+    }
+  }
+  if (recording)
+  {
+    worker->history_failed |= !history_writer_close(&history);
+  }
+
+  for (int i = 0; i < game.num_players; i++)
+  {
+    if (player_bots[i] != NULL)
+    {
+      bot_add_stats(&worker->stats.bots, &bots[i].stats);
+      bot_free(&bots[i]);
+    }
+  }
+  game_free(&game);
+  return NULL;
+}
+
+/**
+ * Play a batch of headless matches on a pool of worker threads.
+ * \param   config   The game configuration
+ * \param   games    The number of matches to play
+ * \param   threads  The number of worker threads
+ * \param   bots     The number of players steered by bots (the last ones); the rest wander
+ * \param   search   Threads per bot for alpha-beta search in two-player games, 0 to not search
+ * \param   seed     The tournament seed
+ * \param   history  A match history file every match is appended to, or NULL
+ * \param   stats    Receives the combined totals
+ */
+void tournament_run(const game_config_t *config, int games, int threads, int bots, int search,
+                    uint64_t seed, const char *history, headless_stats_t *stats)
+{
+  tournament_t t = {.config = config, .games = games, .bots = bots, .search = search,
+                     .seed = seed, .history = history};
+  atomic_init(&t.next_game, 0);
+
+  worker_t *workers = aligned_alloc(64, sizeof(worker_t) * threads);
+  if (workers == NULL)
+  {
+    perror("aligned_alloc");
+    exit(2);
+  }
+  memset(workers, 0, sizeof(worker_t) * threads);
+
+  uint64_t start = time_ns();
+  for (int i = 0; i < threads; i++)
+  {
+    workers[i].tournament = &t;
+    if (pthread_create(&workers[i].thread, NULL, tournament_worker, &workers[i]) != 0)
+    {
+      perror("pthread_create");
+      exit(2);
+    }
+  }
+
+  // Add up the results once everyone is done
+  memset(stats, 0, sizeof(headless_stats_t));
+  bool history_failed = false;
+  for (int i = 0; i < threads; i++)
+  {
+    pthread_join(workers[i].thread, NULL);
+    history_failed |= workers[i].history_failed;
+    stats->games += workers[i].stats.games;
+    stats->ticks += workers[i].stats.ticks;
+    for (int j = 0; j <= MAX_PLAYERS; j++)
+    {
+      stats->wins[j] += workers[i].stats.wins[j];
+    }
+    bot_add_stats(&stats->bots, &workers[i].stats.bots);
+  }
+  stats->elapsed_ns = time_ns() - start;
+  if (history_failed)
+  {
+    fprintf(stderr, "Could not record every match in %s.\n", history);
+  }
+
+  free(workers);
+}
+
+/**
+ * Get the number of CPUs available, as a default thread count
+ */
+int tournament_default_threads()
+{
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return cpus > 0 ? (int)cpus : 1;
+}
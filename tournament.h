@@ -0,0 +1,36 @@
+#ifndef TOURNAMENT_H
+#define TOURNAMENT_H
+
+#include <stdint.h>
+
+#include "game.h"
+#include "headless.h"
+
+/**
+ * Play a batch of headless matches on a pool of worker threads.
+ *
+ * Workers claim matches in small batches from a shared counter. Each has its own board and keeps
+ * its own totals, which are only added up after every worker has finished, so workers never
+ * contend on anything while playing. With a history file, each worker collects its matches into
+ * its own blocks and appends a block at a time, so recording never makes workers wait for each
+ * other either. Every match seeds its random generator from the tournament seed and the match
+ * number, so results do not depend on the number of threads.
+ *
+ * \param   config   The game configuration
+ * \param   games    The number of matches to play
+ * \param   threads  The number of worker threads
+ * \param   bots     The number of players steered by bots (the last ones); the rest wander
+ * \param   search   Threads per bot for alpha-beta search in two-player games, 0 to not search
+ * \param   seed     The tournament seed
+ * \param   history  A match history file every match is appended to, or NULL
+ * \param   stats    Receives the combined totals
+ */
+void tournament_run(const game_config_t *config, int games, int threads, int bots, int search,
+                    uint64_t seed, const char *history, headless_stats_t *stats);
+
+/**
+ * Get the number of CPUs available, as a default thread count
+ */
+int tournament_default_threads();
+
+#endif
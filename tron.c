@@ -2,60 +2,180 @@
 #define _GNU_SOURCE
 
 #include <curses.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
 #include <ctype.h>
+#include "affinity.h"
+#include "arena.h"
+#include "bot.h"
+#include "game.h"
+#include "headless.h"
+#include "history.h"
+#include "host.h"
+#include "leaderboard.h"
+#include "pacer.h"
+#include "pipebot.h"
+#include "render.h"
+#include "replay.h"
+#include "rollback.h"
 #include "scheduler.h"
+#include "server.h"
+#include "snapshot.h"
+#include "tournament.h"
 #include "util.h"
+#include "world.h"
 
+#include <getopt.h>
 #include <pthread.h>
 #include <semaphore.h>
-
-// Defines used to track the player direction
-#define DIR_NORTH 0
-#define DIR_EAST 1
-#define DIR_SOUTH 2
-#define DIR_WEST 3
+#include <stdatomic.h>
 
 // Game parameters
-#define INIT_player_LENGTH 4
-#define player_HORIZONTAL_INTERVAL 75 // 100
-#define player_VERTICAL_INTERVAL 110
 #define DRAW_BOARD_INTERVAL 33
 #define READ_INPUT_INTERVAL 150
-#define BOARD_WIDTH 100
-#define BOARD_HEIGHT 31
+
+// Number of players that can steer from the keyboard
+#define NUM_KEYBOARD_PLAYERS 4
+
+// Worker threads that play each round: the simulation, the renderer and keyboard input
+#define NUM_WORKERS 3
 
 // Locks for concurrency control
 pthread_mutex_t board_lock = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t input_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /**
- * In-memory representation of the game board
- * Zero represents an empty cell
- * Positive numbers represent player cells (which count up at each time step until they reach
- * player_length) Negative numbers represent apple cells (which count up at each time step)
+ * The game being played. Its board is only touched by the simulation thread (with board_lock
+ * held); the renderer draws from game.snapshot instead.
  */
-int board[BOARD_HEIGHT][BOARD_WIDTH];
+game_t game;
+
+// Keys for each keyboard player, indexed by direction (north, east, south, west)
+const int player_keys[NUM_KEYBOARD_PLAYERS][4] = {
+    {KEY_UP, KEY_RIGHT, KEY_DOWN, KEY_LEFT},
+    {'w', 'd', 's', 'a'},
+    {'i', 'l', 'k', 'j'},
+    {'8', '6', '5', '4'},
+};
+
+// Directions requested from the keyboard, protected by input_lock
+int requested_dir[NUM_KEYBOARD_PLAYERS];
+
+// Players 1 to num_humans use the keyboard; the rest are bots. Bots from first_pipebot on are
+// other programs (see pipebot_t).
+int num_humans;
+int first_pipebot;
+bot_t bots[MAX_PLAYERS];
+pipebot_t pipebots[MAX_PLAYERS];
+
+// Ticks played in the current round
+int round_tick;
+
+// Pace the simulation, the renderer and keyboard polling
+pacer_t tick_pacer;
+pacer_t frame_pacer;
+pacer_t input_pacer;
+
+// Draws the board cells
+renderer_t *renderer;
+
+// Scratch memory for the game over screen, released when the next round starts
+#define ROUND_ARENA_SIZE 16384
+arena_t round_arena;
+
+// Where each worker runs: the simulation, the renderer and keyboard input, in that order
+thread_placement_t placements[NUM_WORKERS] = {
+    {.label = "simulation", .cpu = AFFINITY_ANY_CPU},
+    {.label = "render", .cpu = AFFINITY_ANY_CPU},
+    {.label = "input", .cpu = AFFINITY_ANY_CPU},
+};
+
+// Records every round of the session, or NULL if it is not being recorded
+replay_writer_t *recording = NULL;
+
+// Where the session is. The lobby comes first; then each round counts down, is played and ends
+// with its game over screen, until the players quit.
+typedef enum session_state
+{
+  STATE_LOBBY,
+  STATE_COUNTDOWN,
+  STATE_PLAYING,
+  STATE_GAME_OVER,
+  STATE_QUIT,
+} session_state_t;
 
-// player 1 parameters
-int player_dir = DIR_NORTH;
-int updated_player_dir = DIR_NORTH;
+/**
+ * The session's state. The workers are created once and wait between rounds; the main thread
+ * runs every other state itself, so the game over screen and its file I/O never hold the board
+ * lock or contend with a worker. Only changed with state_lock held, and state_changed is
+ * broadcast each time; the workers' loops read it without the lock.
+ */
+atomic_int session_state = STATE_LOBBY;
+pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t state_changed = PTHREAD_COND_INITIALIZER;
+int parked_workers = 0; // workers waiting for the next round, protected by state_lock
 
-// player 2 parameters
-int player_dir_2 = DIR_SOUTH;
-int updated_player_dir_2 = DIR_SOUTH;
+/**
+ * Whether the workers run as tasks on the main thread's scheduler (see scheduler.h) instead of
+ * threads of their own. Tasks only switch when one sleeps, so the locks are never contended and
+ * the kernel only sees one thread wake up; the waits between rounds poll the state instead of
+ * blocking on state_changed, which would stop every task.
+ */
+bool green = false;
 
-// Is the game running?
-bool running = true;
+// Set on the game over screen to play another round
 bool play_again = false;
 
+// Folds the leaderboard's journal while the game goes on. It lives for the whole session, waiting
+// on compact_wanted until update_score asks for a compaction or the session ends.
+pthread_t compactor;
+pthread_mutex_t compact_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t compact_wanted = PTHREAD_COND_INITIALIZER;
+bool compact_requested = false; // protected by compact_lock
+bool compactor_stopping = false;
+
+// Outcome of the last round: 0 for a draw, otherwise the number of the winning player
+int winner = 0;
+
+// Command line options
+typedef struct options
+{
+  game_config_t config;
+  bool headless; // play without a terminal as fast as possible
+  int games;     // number of headless games
+  int threads;   // worker threads for headless games
+  int bots;      // number of players steered by bots, or -1 for every player without keys
+  int search;    // threads per bot for alpha-beta search in two-player games, 0 to not search
+  uint64_t seed; // seed for headless games
+  const char *record; // file to record the session's replay in, or NULL
+  const char *replay; // replay file to play back instead of playing, or NULL
+  int seek_round;     // with replay, show the board at this round and tick instead (round 0: no)
+  int seek_tick;
+  const char *serve;  // run a server with this name instead of playing, or NULL
+  const char *join;   // join the server with this name as a player, or NULL
+  const char *watch;  // watch the server with this name, or NULL
+  const char *bot_cmds[MAX_PLAYERS]; // commands running external bots for the last players
+  int num_bot_cmds;
+  const char *render; // renderer backend, or NULL to pick one for the terminal
+  const char *history; // match history to record games in, or NULL for the default
+  const char *stats;   // match history to report statistics on instead of playing, or NULL
+  int pin[NUM_WORKERS]; // CPU for each worker (simulation, render, input) or AFFINITY_ANY_CPU
+  bool realtime;        // run the simulation thread at a SCHED_FIFO priority if permitted
+  bool green;           // run the workers as scheduler tasks on one thread
+  const char *hosts[HOST_MAX_MATCHES]; // terminals to host a match on each of, instead of playing
+  int num_hosts;
+  bool world; // play on a sparse world of config's size, seen through a viewport
+} options_t;
+
 /**
  * Convert a board row number to a screen position
  * \param   row   The board row number to convert
@@ -82,7 +202,7 @@ int screen_col(int col)
 void init_display()
 {
   // Print Title Line
-  move(screen_row(-2), screen_col(BOARD_WIDTH / 2 - 5));
+  move(screen_row(-2), screen_col(game.width / 2 - 5));
   addch(ACS_DIAMOND);
   addch(ACS_DIAMOND);
   printw(" Tron! ");
@@ -91,22 +211,22 @@ void init_display()
 
   // Print corners
   mvaddch(screen_row(-1), screen_col(-1), ACS_ULCORNER);
-  mvaddch(screen_row(-1), screen_col(BOARD_WIDTH), ACS_URCORNER);
-  mvaddch(screen_row(BOARD_HEIGHT), screen_col(-1), ACS_LLCORNER);
-  mvaddch(screen_row(BOARD_HEIGHT), screen_col(BOARD_WIDTH), ACS_LRCORNER);
+  mvaddch(screen_row(-1), screen_col(game.width), ACS_URCORNER);
+  mvaddch(screen_row(game.height), screen_col(-1), ACS_LLCORNER);
+  mvaddch(screen_row(game.height), screen_col(game.width), ACS_LRCORNER);
 
   // Print top and bottom edges
-  for (int col = 0; col < BOARD_WIDTH; col++)
+  for (int col = 0; col < game.width; col++)
   {
     mvaddch(screen_row(-1), screen_col(col), ACS_HLINE);
-    mvaddch(screen_row(BOARD_HEIGHT), screen_col(col), ACS_HLINE);
+    mvaddch(screen_row(game.height), screen_col(col), ACS_HLINE);
   }
 
   // Print left and right edges
-  for (int row = 0; row < BOARD_HEIGHT; row++)
+  for (int row = 0; row < game.height; row++)
   {
     mvaddch(screen_row(row), screen_col(-1), ACS_VLINE);
-    mvaddch(screen_row(row), screen_col(BOARD_WIDTH), ACS_VLINE);
+    mvaddch(screen_row(row), screen_col(game.width), ACS_VLINE);
   }
 
   // Refresh the display
@@ -115,11 +235,11 @@ void init_display()
 
 void game_countdown()
 {
-  int row = (BOARD_HEIGHT / 2);
-  int col = (BOARD_WIDTH / 2);
+  int row = (game.height / 2);
+  int col = (game.width / 2);
   for (int i = 3; i >= 0; i--)
   {
-    mvprintw(screen_row(row) + 6, screen_col(BOARD_WIDTH / 2) - 12,
+    mvprintw(screen_row(row) + 6, screen_col(game.width / 2) - 12,
              "     Starting in %d.     ", i);
     refresh();
     sleep(1);
@@ -137,8 +257,8 @@ void game_countdown()
  */
 void start_game()
 {
-  int row = (BOARD_HEIGHT / 2);
-  int col = (BOARD_WIDTH / 2);
+  int row = (game.height / 2);
+  int col = (game.width / 2);
   mvprintw(screen_row(row) - 5, screen_col(col) - 6, "            ");
   mvprintw(screen_row(row) - 4, screen_col(col) - 9, " Welcome to Tron! ");
   mvprintw(screen_row(row) - 3, screen_col(col) - 6, "            ");
@@ -149,7 +269,14 @@ void start_game()
   mvprintw(screen_row(row) + 2, screen_col(col) - 6, "            ");
   mvprintw(screen_row(row) + 3, screen_col(col) - 11, " Player 1: Arrow Keys ");
   mvprintw(screen_row(row) + 4, screen_col(col) - 10, " Player 2: WASD Keys ");
-  mvprintw(screen_row(row) + 5, screen_col(col) - 6, "            ");
+  if (game.num_players > 2)
+  {
+    mvprintw(screen_row(row) + 5, screen_col(col) - 13, " Players 3, 4: IJKL, 8456 ");
+  }
+  else
+  {
+    mvprintw(screen_row(row) + 5, screen_col(col) - 6, "            ");
+  }
   refresh();
 
   // wait for user input
@@ -162,21 +289,24 @@ void start_game()
   }
   // ungetch otherwise it breaks
   ungetch(0);
-
-  game_countdown();
 }
 
+/**
+ * Show the ten best players and wait for a key press. 'p' plays again.
+ */
 void displayScores()
 {
-  int row = (BOARD_HEIGHT / 2);
-  int col = (BOARD_WIDTH / 2);
-
-  // Try to open the file
-  FILE *scores = fopen("scoresheet.csv", "r+");
-  if (scores == NULL)
+  int row = (game.height / 2);
+  int col = (game.width / 2);
+
+  leaderboard_t board;
+  leaderboard_entry_t top[10];
+  size_t count = 0;
+  const char *error = leaderboard_open(&board, LEADERBOARD_FILE, &round_arena);
+  if (error == NULL)
   {
-    perror("Unable to open score file");
-    exit(1);
+    count = leaderboard_top(&board, 10, top);
+    leaderboard_close(&board);
   }
 
   int rowstart = screen_row(row) - 8;
@@ -184,48 +314,28 @@ void displayScores()
   mvprintw(rowstart++, screen_col(col) - 11, "|   LEADERBOARD     |");
   mvprintw(rowstart++, screen_col(col) - 11, "|rank, player, score|");
   mvprintw(rowstart++, screen_col(col) - 11, "|                   |");
-
-  char *line = malloc(sizeof(char) * 10); // the line to read in from the file
-  char *user = malloc(sizeof(char) * 21); // the line in which to store the printable userline
-  for (int i = 1; i < 11; i++)
+  for (int i = 0; i < 10; i++)
   {
-    strcpy(user, ""); // blank out any existing data stored in user
-    if (i == 1)
-    {
-      sprintf(user, "| %dst  ", i);
-    }
-    else if (i == 2)
-    {
-      sprintf(user, "| %dnd  ", i);
-    }
-    else if (i == 3)
-    {
-      sprintf(user, "| %drd  ", i);
-    }
-    else if (i == 10)
+    char rank[8];
+    const char *suffix = i == 0 ? "st" : i == 1 ? "nd" : i == 2 ? "rd" : "th";
+    snprintf(rank, sizeof(rank), "%d%s", i + 1, suffix);
+    if (i < (int)count)
     {
-      sprintf(user, "| %dth ", i);
+      mvprintw(rowstart++, screen_col(col) - 11, "| %-4s %-3s %7u  |", rank, top[i].name,
+               top[i].score);
     }
     else
     {
-      sprintf(user, "| %dth  ", i);
-    } // format the number depending on rank
-
-    if (fgets(line, 10, scores))
-    {
-      line[strcspn(line, "\n")] = 0; // counts the number of chaarachters till newline and removes it
-      strcat(user, line);
+      mvprintw(rowstart++, screen_col(col) - 11, "| %-4s%14s|", rank, "");
     }
-    else
-    {
-      strcat(user, "        ");
-    } // add the score if it exists and spaces otherwise
-    strcat(user, "     |");
-    mvprintw(rowstart++, screen_col(col) - 11, "%s", user);
   } // print the top 10
   mvprintw(rowstart++, screen_col(col) - 11, "|  p to play again  |");
   mvprintw(rowstart++, screen_col(col) - 11, "|  dif key to exit  |");
   mvprintw(rowstart++, screen_col(col) - 11, "---------------------");
+  if (error != NULL)
+  {
+    mvprintw(rowstart++, screen_col(col) - 11, " %s: %s ", LEADERBOARD_FILE, error);
+  }
 
   refresh();
   sleep(1);
@@ -243,431 +353,1717 @@ void displayScores()
 }
 
 /**
- * Reads a name from the user and increments the score for that name in the file
+ * Run in a thread for the whole session, folding the leaderboard's journal into its snapshot each
+ * time one is asked for. A compaction asked for before the session ends still runs.
  */
-void update_score()
+void *compact_scores(void *arg)
 {
-  // Try to open the file
-  FILE *scores = fopen("scoresheet.csv", "r+");
-  if (scores == NULL)
+  pthread_mutex_lock(&compact_lock);
+  for (;;)
   {
-    perror("Unable to open input file");
-    exit(1);
+    while (!compact_requested && !compactor_stopping)
+    {
+      pthread_cond_wait(&compact_wanted, &compact_lock);
+    }
+    if (!compact_requested)
+    {
+      break;
+    }
+    compact_requested = false;
+    pthread_mutex_unlock(&compact_lock);
+    leaderboard_compact(LEADERBOARD_FILE, LEADERBOARD_COMPACT_RECORDS);
+    pthread_mutex_lock(&compact_lock);
   }
+  pthread_mutex_unlock(&compact_lock);
+  return NULL;
+}
+
+/**
+ * Ask the compactor to fold the journal, or to exit once it has nothing left to do
+ * \param   stop    true to stop it
+ */
+void wake_compactor(bool stop)
+{
+  pthread_mutex_lock(&compact_lock);
+  compact_requested |= !stop;
+  compactor_stopping |= stop;
+  pthread_cond_signal(&compact_wanted);
+  pthread_mutex_unlock(&compact_lock);
+}
 
-  char name[4];
-  name[3] = '\0';
-  for (int i = 0; i < 3; i++)
+/**
+ * Reads a name from the user and gives that name a win on the leaderboard
+ * \param   name    Receives the name
+ */
+void update_score(char name[LEADERBOARD_NAME_LEN + 1])
+{
+  name[LEADERBOARD_NAME_LEN] = '\0';
+  for (int i = 0; i < LEADERBOARD_NAME_LEN; i++)
   {
     int name_ch = toupper(getch());
     name[i] = name_ch;
-    mvaddch(screen_row(BOARD_HEIGHT / 2) + 4, screen_col(BOARD_WIDTH / 2) - 1 + i, name_ch);
+    mvaddch(screen_row(game.height / 2) + 4, screen_col(game.width / 2) - 1 + i, name_ch);
     refresh();
   }
 
-  char *line = malloc(sizeof(char) * 10);
-  // char* score = malloc(sizeof(char) * 5);
-  char *new_score = malloc(sizeof(char) * 5);
-  int updated = 0;
-  bool first = true;
-
-  int scr;
-  int prevScr = 0;
-  char *prevLine = malloc(sizeof(char) * 10);
-  unsigned long prevPos = 0;
-
-  while (fgets(line, 10, scores))
+  if (!leaderboard_record_win(LEADERBOARD_FILE, name))
   {
-    scr = atoi(line + 5); // the integer value of the currently stored score;
-    if (strncmp(name, line, 3) == 0)
-    {
-      // fseek(scores, -2, SEEK_CUR);
-      // strcpy(score, "");
-      scr++;
-
-      fseek(scores, -4, SEEK_CUR); //move cursor to current score position
-      strcpy(new_score, ""); //clear the string that holds the new score/
-      sprintf(new_score, "%d", scr);// turn the score integer into a string
-      fputs(new_score, scores); //save it into the file
-      fseek(scores, 1, SEEK_CUR); // reset the cursor.
-
-      if (!(first) && (prevScr < scr))
-      {
-        fseek(scores, prevPos, SEEK_SET);
-        fgets(prevLine, 10, scores);      // save the previous line,
-        fgets(line, 10, scores);      // save the previous line,
-        fseek(scores, prevPos, SEEK_SET); // once again go back to the start of prevline
-        fputs(line, scores);
-        fputs(prevLine, scores);
-
-      } // if we are not the first value, check if the value above is greater than us, if so, swap our locations.
-      updated = 1;
-      break;
-      // break;
-    }
-    first = false;
-    prevScr = scr;
-    fflush(scores);              // clear internal buffer
-    prevPos = ftell(scores) - 9; // save previous position (for sorting)              // save the previous scores)
+    mvprintw(screen_row(game.height / 2) + 5, screen_col(game.width / 2) - 5,
+             " Score not saved: %s ", strerror(errno));
+    refresh();
+    return;
+  }
 
+  // The first compaction imports the old scoresheet, which the leaderboard shown next needs;
+  // after that the journal is folded in the background once it has grown
+  if (access(LEADERBOARD_FILE, F_OK) != 0)
+  {
+    leaderboard_compact(LEADERBOARD_FILE, 0);
   }
-  if (updated == 0)
+  else
   {
-    char *new_name = malloc(sizeof(char) * 10);
-    new_name[0] = '\0';
-    strcat(new_name, name);
-    strcat(new_name, "  1  \n");
-    fputs(new_name, scores);
+    wake_compactor(false);
   }
-
-  fclose(scores);
-  return;
 }
+
 /**
  * Show a game over message and wait for a key press.
+ * \param   player_num  The winning player, or 0 for a draw
+ * \param   name        Receives the name the winner entered, if there is one
  */
-void end_game(int player_num)
+void end_game(int player_num, char name[LEADERBOARD_NAME_LEN + 1])
 {
-  mvprintw(screen_row(BOARD_HEIGHT / 2) - 1, screen_col(BOARD_WIDTH / 2) - 10, "                    ");
-  mvprintw(screen_row(BOARD_HEIGHT / 2), screen_col(BOARD_WIDTH / 2) - 7, "  Game Over!  ");
+  mvprintw(screen_row(game.height / 2) - 1, screen_col(game.width / 2) - 10, "                    ");
+  mvprintw(screen_row(game.height / 2), screen_col(game.width / 2) - 7, "  Game Over!  ");
 
   if (player_num == 0)
   {
-    mvprintw(screen_row(BOARD_HEIGHT / 2) + 1, screen_col(BOARD_WIDTH / 2) - 7, "    Draw!    ");
-    mvprintw(screen_row(BOARD_HEIGHT / 2) - 1, screen_col(BOARD_WIDTH / 2) - 5, "          ");
+    mvprintw(screen_row(game.height / 2) + 1, screen_col(game.width / 2) - 7, "    Draw!    ");
+    mvprintw(screen_row(game.height / 2) - 1, screen_col(game.width / 2) - 5, "          ");
     refresh();
     timeout(-1);
   }
   else
   {
-    mvprintw(screen_row(BOARD_HEIGHT / 2) + 1, screen_col(BOARD_WIDTH / 2) - 9, "  Player %d wins!  ", player_num);
+    mvprintw(screen_row(game.height / 2) + 1, screen_col(game.width / 2) - 9, "  Player %d wins!  ", player_num);
 
-    mvprintw(screen_row(BOARD_HEIGHT / 2) + 2, screen_col(BOARD_WIDTH / 2) - 14,
+    mvprintw(screen_row(game.height / 2) + 2, screen_col(game.width / 2) - 14,
              "Player %d, please enter your name.", player_num);
-    mvprintw(screen_row(BOARD_HEIGHT / 2) + 3, screen_col(BOARD_WIDTH / 2) - 5, "          ");
-    mvprintw(screen_row(BOARD_HEIGHT / 2) + 4, screen_col(BOARD_WIDTH / 2) - 4,
+    mvprintw(screen_row(game.height / 2) + 3, screen_col(game.width / 2) - 5, "          ");
+    mvprintw(screen_row(game.height / 2) + 4, screen_col(game.width / 2) - 4,
              "   ---   ");
-    mvprintw(screen_row(BOARD_HEIGHT / 2) + 5, screen_col(BOARD_WIDTH / 2) - 5, "          ");
+    mvprintw(screen_row(game.height / 2) + 5, screen_col(game.width / 2) - 5, "          ");
 
     refresh();
     timeout(-1);
     // sleep so we don't accidentally exit right away
     sleep(1);
 
-    update_score();
+    update_score(name);
   }
 
   displayScores();
 }
 
 /**
- * Run in a task to draw the current state of the game board.
+ * Move the session to a new state and wake everyone waiting for it
  */
-void *draw_board(void *arg)
+void set_state(session_state_t state)
 {
+  pthread_mutex_lock(&state_lock);
+  atomic_store(&session_state, state);
+  pthread_cond_broadcast(&state_changed);
+  pthread_mutex_unlock(&state_lock);
+}
 
-  // define color pairs for the bikes and trails
-  use_default_colors();
-  start_color();
-
-  init_pair(1, -1, COLOR_YELLOW); // color pair for player 1 trail
-  init_pair(2, -1, COLOR_CYAN);   // color pair for player 2 trail
-  init_pair(3, -1, COLOR_WHITE);  // color pair for player bikes
+/**
+ * Check whether a round is being played, for the workers' loops
+ */
+bool playing()
+{
+  return atomic_load(&session_state) == STATE_PLAYING;
+}
 
-  do
+/**
+ * Park a worker until the next round starts
+ * \return        false if the session is over instead
+ */
+bool wait_for_round()
+{
+  if (green)
   {
-    // Loop over cells of the game board
-    pthread_mutex_lock(&board_lock);
-    refresh();
-    for (int r = 0; r < BOARD_HEIGHT; r++)
+    parked_workers++;
+    while (atomic_load(&session_state) != STATE_PLAYING &&
+           atomic_load(&session_state) != STATE_QUIT)
     {
-      for (int c = 0; c < BOARD_WIDTH; c++)
-      {
-        if (board[r][c] == 0)
-        { // Draw blank spaces
-          mvaddch(screen_row(r), screen_col(c), ' ');
-        }
-        else if (board[r][c] == 1 || board[r][c] == 3)
-        { // Draw player bikes
-          mvaddch(screen_row(r), screen_col(c), ' ' | COLOR_PAIR(3));
-        }
-        else if (board[r][c] == 2)
-        { // Draw player 1 trail
-          mvaddch(screen_row(r), screen_col(c), ' ' | COLOR_PAIR(1));
-        }
-        else if (board[r][c] == 4)
-        { // Draw player 2 trail
-          mvaddch(screen_row(r), screen_col(c), ' ' | COLOR_PAIR(2));
-        }
-      }
+      task_sleep(SIM_TICK_INTERVAL);
     }
-    pthread_mutex_unlock(&board_lock);
-
-    // Draw the score
-    // mvprintw(screen_row(-2), screen_col(BOARD_WIDTH - 9), "Score %03d\r",
-    //          player_length - INIT_player_LENGTH);
-
-    // Refresh the display
-    // refresh();
+    parked_workers--;
+    return atomic_load(&session_state) != STATE_QUIT;
+  }
 
-    // Sleep for a while before drawing the board again
-    sleep_ms(DRAW_BOARD_INTERVAL);
-  } while (running);
-  return NULL;
+  pthread_mutex_lock(&state_lock);
+  parked_workers++;
+  pthread_cond_broadcast(&state_changed);
+  while (atomic_load(&session_state) != STATE_PLAYING &&
+         atomic_load(&session_state) != STATE_QUIT)
+  {
+    pthread_cond_wait(&state_changed, &state_lock);
+  }
+  parked_workers--;
+  bool quit = atomic_load(&session_state) == STATE_QUIT;
+  pthread_mutex_unlock(&state_lock);
+  return !quit;
 }
 
 /**
- * Run in a task to process user input.
+ * Wait until the round is over and every worker has parked, so the screen and the board are the
+ * main thread's alone
  */
-void *read_input(void *arg)
+void wait_for_game_over()
 {
+  while (green &&
+         (atomic_load(&session_state) != STATE_GAME_OVER || parked_workers < NUM_WORKERS))
+  {
+    task_sleep(SIM_TICK_INTERVAL);
+  }
 
-  int key;
-
-  while (running)
+  pthread_mutex_lock(&state_lock);
+  while (atomic_load(&session_state) != STATE_GAME_OVER || parked_workers < NUM_WORKERS)
   {
+    pthread_cond_wait(&state_changed, &state_lock);
+  }
+  pthread_mutex_unlock(&state_lock);
+}
 
-    // Make sure the input was read correctly
-    if ((key = getch()) == ERR)
-    {
-      // ungetch(0);
-      continue;
-      // end_game();
-      // sleep(3);
-      // running = false;
-      // end_game();
-    }
+// The renderer's private copy of the board, and the rows and cells to redraw in a frame. All
+// curses work happens on this copy with no lock held, so a slow terminal never delays the
+// simulation.
+uint8_t *frame_cells;
+int *frame_rows;
+uint64_t *frame_mask;
 
-    // Handle the key press
-    if (key == KEY_UP && player_dir != DIR_SOUTH)
-    {
-      updated_player_dir = DIR_NORTH; // move player 1 up
-    }
-    else if (key == KEY_RIGHT && player_dir != DIR_WEST)
-    {
-      updated_player_dir = DIR_EAST; // move player 1 right
-    }
-    else if (key == KEY_DOWN && player_dir != DIR_NORTH)
-    {
-      updated_player_dir = DIR_SOUTH; // move player 1 down
-    }
-    else if (key == KEY_LEFT && player_dir != DIR_EAST)
-    {
-      updated_player_dir = DIR_WEST; // move player 1 left
-    }
-    else if (key == 'w' && player_dir_2 != DIR_SOUTH)
-    {
-      updated_player_dir_2 = DIR_NORTH; // move player 2 up
-    }
-    else if (key == 'd' && player_dir_2 != DIR_WEST)
-    {
-      updated_player_dir_2 = DIR_EAST; // move player 2 right
-    }
-    else if (key == 's' && player_dir_2 != DIR_NORTH)
-    {
-      updated_player_dir_2 = DIR_SOUTH; // move player 2 down
-    }
-    else if (key == 'a' && player_dir_2 != DIR_EAST)
-    {
-      updated_player_dir_2 = DIR_WEST; // move player 2 left
-    } // else if (key == 'q') {
-    //   running = false;
-    //   end_game(0); // end the game early
-    // }
+/**
+ * Allocate the renderer's copy of the board
+ */
+void init_frame()
+{
+  snapshot_t *snap = game.snapshot;
+  frame_cells = malloc((size_t)snap->width * snap->height);
+  frame_rows = malloc(sizeof(int) * snap->height);
+  frame_mask = malloc(sizeof(uint64_t) * snap->height * snap->row_words);
+  if (frame_cells == NULL || frame_rows == NULL || frame_mask == NULL)
+  {
+    perror("malloc");
+    exit(2);
   }
-  return NULL;
 }
 
 /**
- * Run in a task to move the player around on the board
+ * Draw the cells that changed since the last frame, or every cell
+ * \param   repaint   Draw every cell
  */
-void *update_player(void *arg)
+void draw_frame(bool repaint)
 {
+  snapshot_t *snap = game.snapshot;
 
-  while (running)
-  {
-
-    int player_num = *(int *)arg;
-    int current_player_dir;
+  // Take ownership of the dirty bits before reading the snapshot, so anything changed while we
+  // draw is picked up next frame
+  repaint |= snapshot_take_repaint(snap);
+  int nrows = snapshot_take_dirty(snap, frame_rows, frame_mask);
 
-    // Update the direction of the player
-    if (player_num == 1)
-    {
-      current_player_dir = updated_player_dir;
-      player_dir = updated_player_dir;
-    }
-    else
+  if (repaint)
+  {
+    snapshot_read(snap, frame_cells, NULL, 0, NULL);
+    render_invalidate(renderer);
+    for (int r = 0; r < snap->height; r++)
     {
-      player_dir_2 = updated_player_dir_2;
-      current_player_dir = updated_player_dir_2;
+      for (int c = 0; c < snap->width; c++)
+      {
+        render_cell(renderer, r, c, frame_cells[r * snap->width + c]);
+      }
     }
-
-    // player_dir = updated_player_dir;
-    // player_dir_2 = updated_player_dir_2;
-
-    int player_row;
-    int player_col;
-
-    // int player_row_2;
-    // int player_col_2;
-
-    pthread_mutex_lock(&board_lock);
-    // "Age" each existing segment of the player
-    for (int r = 0; r < BOARD_HEIGHT; r++)
+    render_flush(renderer);
+  }
+  else if (nrows > 0)
+  {
+    // Only touch the cells the simulation changed since the last frame
+    snapshot_read(snap, frame_cells, frame_rows, nrows, frame_mask);
+    for (int i = 0; i < nrows; i++)
     {
-      for (int c = 0; c < BOARD_WIDTH; c++)
+      int r = frame_rows[i];
+      for (int w = 0; w < snap->row_words; w++)
       {
-        if (board[r][c] == player_num * 2 - 1)
-        { // Found the bike of the player. Save position
-          player_row = r;
-          player_col = c;
-          board[r][c]++;
+        for (uint64_t bits = frame_mask[r * snap->row_words + w]; bits != 0; bits &= bits - 1)
+        {
+          int c = w * 64 + __builtin_ctzll(bits);
+          render_cell(renderer, r, c, frame_cells[r * snap->width + c]);
         }
       }
     }
-    pthread_mutex_unlock(&board_lock);
+    render_flush(renderer);
+  }
+}
 
-    // Move the player into a new space
-    if (current_player_dir == DIR_NORTH)
-    {
-      player_row--;
-    }
-    else if (current_player_dir == DIR_SOUTH)
-    {
-      player_row++;
-    }
-    else if (current_player_dir == DIR_EAST)
-    {
-      player_col++;
-    }
-    else if (current_player_dir == DIR_WEST)
+/**
+ * Run in a task to draw the current state of the game board during each round
+ */
+void *draw_board(void *arg)
+{
+  while (wait_for_round())
+  {
+    // Always repaint everything on a round's first frame
+    bool repaint = true;
+    pacer_start(&frame_pacer);
+    do
     {
-      player_col--;
-    }
+      draw_frame(repaint);
+      repaint = false;
 
-    // Check for edge collisions
-    pthread_mutex_lock(&board_lock);
-    if (player_row < 0 || player_row >= BOARD_HEIGHT || player_col < 0 || player_col >= BOARD_WIDTH)
-    {
-      running = false;
-      end_game(2 / player_num); // current thread lost, so we pass the other player num
-      // Check for head-to-head collisions
-    }
-    else if (board[player_row][player_col] != 0 && board[player_row][player_col] == 3 / player_num)
-    {
-      running = false;
-      end_game(0);
-      // Check for player collisions
-    }
-    else if (board[player_row][player_col] != 0)
-    {
-      running = false;
-      end_game(2 / player_num);
-    }
-    // if no collisions, update the new position of the bike
-    if (running)
-    {
-      board[player_row][player_col] = (player_num * 2) - 1;
-    }
-    pthread_mutex_unlock(&board_lock);
+      // Sleep until the next frame is due; frames missed while drawing are skipped
+      pacer_wait(&frame_pacer);
+    } while (playing());
 
-    // Update the player movement speed to deal with rectangular cursors
-    if (current_player_dir == DIR_NORTH || current_player_dir == DIR_SOUTH)
-    {
-      sleep_ms(player_VERTICAL_INTERVAL);
-    }
-    else
-    {
-      sleep_ms(player_HORIZONTAL_INTERVAL);
-    }
+    // Messages are drawn over the board next, with curses
+    render_sync(renderer);
   }
   return NULL;
 }
 
-// Entry point: Set up the game, create jobs, then run the scheduler
-int main(void)
+/**
+ * Run in a task to process user input.
+ */
+void *read_input(void *arg)
 {
-  use_default_colors();
-
-  // Initialize the ncurses window
-  WINDOW *mainwin = initscr();
-  if (mainwin == NULL)
+  while (wait_for_round())
   {
-    fprintf(stderr, "Error initializing ncurses.\n");
-    exit(2);
-  }
-
-  // Seed random number generator with the time in milliseconds
-  srand(time_ms());
-
-  noecho();               // Don't print keys when pressed
-  keypad(mainwin, true);  // Support arrow keys
-  nodelay(mainwin, true); // Non-blocking keyboard access
-
-  memset(board, 0, BOARD_WIDTH * BOARD_HEIGHT * sizeof(int));
+    pacer_start(&input_pacer);
+    while (playing())
+    {
+      // Once every waiting key has been handled, poll again at the next tick
+      int key = getch();
+      if (key == ERR)
+      {
+        pacer_wait(&input_pacer);
+        continue;
+      }
 
-  // Initialize the game display
-  init_display();
-  curs_set(0);
-  start_game();
+      // Handle the key press
+      if (key == KEY_RESIZE)
+      {
+        snapshot_request_repaint(game.snapshot); // the terminal contents may be gone
+        continue;
+      }
 
-GAMESTART:
-  // Zero out the board contents
+      pthread_mutex_lock(&input_lock);
+      for (int i = 0; i < num_humans; i++)
+      {
+        for (int dir = DIR_NORTH; dir <= DIR_WEST; dir++)
+        {
+          // Players can't turn back onto their own trail
+          if (key == player_keys[i][dir] && game.players[i].dir != (dir + 2) % 4)
+          {
+            requested_dir[i] = dir;
+          }
+        }
+      }
+      pthread_mutex_unlock(&input_lock);
+    }
+  }
+  return NULL;
+}
 
-  // Put the player at the middle of the board
-  board[BOARD_HEIGHT - 2][BOARD_WIDTH / 2] = 1;
-  board[2][BOARD_WIDTH / 2] = 3;
+/**
+ * Run in a task to move every player around the board in lockstep during each round
+ */
+void *update_players(void *arg)
+{
+  while (wait_for_round())
+  {
+    int due = 1; // ticks to run before waiting for the next deadline
+    pacer_start(&tick_pacer);
+    while (playing())
+    {
+      pthread_mutex_lock(&board_lock);
 
-  // Threads for each of the game tasks
-  pthread_t update_player_thread;
-  pthread_t update_player_thread_2;
-  pthread_t draw_board_thread;
-  pthread_t read_input_thread;
+      // Pick up the latest keyboard input
+      pthread_mutex_lock(&input_lock);
+      for (int i = 0; i < num_humans; i++)
+      {
+        game_steer(&game, i, requested_dir[i]);
+      }
+      pthread_mutex_unlock(&input_lock);
 
-  // display a starting screen
+      // Bots decide just before their moves, within a budget far shorter than a tick. External
+      // bots have had since the last tick to answer; they are never waited for.
+      for (int i = num_humans; i < first_pipebot; i++)
+      {
+        if (game_move_due(&game, i))
+        {
+          bot_steer(&bots[i], &game);
+        }
+      }
+      for (int i = first_pipebot; i < game.num_players; i++)
+      {
+        pipebot_steer(&pipebots[i], &game);
+      }
 
-  wrefresh(mainwin);
+      if (recording != NULL)
+      {
+        replay_record_tick(recording, &game);
+      }
+      int result = game_tick(&game);
+      if (result >= 0 && recording != NULL)
+      {
+        replay_end_round(recording, result);
+      }
+      for (int i = first_pipebot; i < game.num_players && result < 0; i++)
+      {
+        pipebot_send(&pipebots[i], &game, round_tick);
+      }
+      round_tick++;
+      game_publish(&game);
+      pthread_mutex_unlock(&board_lock);
 
-  int player_number_1 = 1;
-  int player_number_2 = 2;
+      // The main thread takes over for the game over screen once every worker has parked
+      if (result >= 0)
+      {
+        winner = result;
+        set_state(STATE_GAME_OVER);
+      }
+      else if (--due == 0)
+      {
+        due = pacer_wait(&tick_pacer);
+      }
+    }
+  }
+  return NULL;
+}
 
-  // create the four game threads
-  pthread_create(&update_player_thread, NULL, update_player, (void *)&player_number_1);
-  pthread_create(&update_player_thread_2, NULL, update_player, (void *)&player_number_2);
-  pthread_create(&draw_board_thread, NULL, draw_board, NULL);
-  pthread_create(&read_input_thread, NULL, read_input, NULL);
+// The workers as scheduler tasks, which take no arguments
+void update_players_task()
+{
+  update_players(NULL);
+}
 
-  // wait for all threads to finish
-  pthread_join(update_player_thread, NULL);
-  pthread_join(update_player_thread_2, NULL);
-  pthread_join(draw_board_thread, NULL);
-  pthread_join(read_input_thread, NULL);
+void draw_board_task()
+{
+  draw_board(NULL);
+}
 
-  // Display the end of game message and wait for user input **now handled in update_player**
-  // end_game();
+void read_input_task()
+{
+  read_input(NULL);
+}
 
-  // Clean up window
-  if (play_again)
+/**
+ * Clear the board and put the players back at their starting positions for a new round
+ */
+void reset_round()
+{
+  arena_reset(&round_arena);
+  pthread_mutex_lock(&board_lock);
+  game_reset(&game);
+  game_publish(&game);
+  if (recording != NULL)
+  {
+    replay_start_round(recording, &game);
+  }
+  for (int i = num_humans; i < first_pipebot; i++)
+  {
+    bot_reset(&bots[i]);
+  }
+  for (int i = first_pipebot; i < game.num_players; i++)
   {
-    // player 1 parameters
-    player_dir = DIR_NORTH;
-    updated_player_dir = DIR_NORTH;
+    pipebot_start_round(&pipebots[i], &game);
+  }
+  round_tick = 0;
+  pthread_mutex_unlock(&board_lock);
 
-    // player 2 parameters
-    player_dir_2 = DIR_SOUTH;
-    updated_player_dir_2 = DIR_SOUTH;
+  pthread_mutex_lock(&input_lock);
+  for (int i = 0; i < num_humans; i++)
+  {
+    requested_dir[i] = game.players[i].dir;
+  }
+  pthread_mutex_unlock(&input_lock);
+}
 
-    play_again = false;
-    memset(board, 0, BOARD_WIDTH * BOARD_HEIGHT * sizeof(int));
-    draw_board(NULL);
+/**
+ * Print command line usage
+ * \param   prog    The name the program was run as
+ */
+void usage(const char *prog)
+{
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -p, --players N   number of players, 2-%d (default %d)\n"
+          "  -W, --width N     board width in cells (default %d)\n"
+          "  -H, --height N    board height in cells (default %d)\n"
+          "  --bots N          number of players steered by the computer; these are the last\n"
+          "                    players (default: every player without keyboard controls)\n"
+          "  --search N        in two-player games, bots search ahead on N threads each\n"
+          "  --headless        play computer-controlled games without a terminal, as fast as\n"
+          "                    possible, and report games per second\n"
+          "  --games N         number of headless games (default 1000)\n"
+          "  --threads N       worker threads for headless games (default: one per CPU)\n"
+          "  --seed N          random seed for headless games (default: the current time)\n"
+          "  --record FILE     record a replay of every round, saved after each one\n"
+          "  --replay FILE     play a recorded session back as fast as possible and check it\n"
+          "  --seek R:T        with --replay, print the board at tick T of round R instead\n"
+          "  --serve NAME      run a server that players join from their own terminals\n"
+          "  --join NAME       play on a server, steering with any of the keyboard layouts\n"
+          "  --watch NAME      watch the games on a server\n"
+          "  --bot-cmd CMD     steer the last player not yet taken by another --bot-cmd with a\n"
+          "                    program run by the shell (see pipebot.h for its protocol)\n"
+          "  --render NAME     draw the board with ansi (one write per frame) or curses\n"
+          "                    (default: ansi if the terminal supports it)\n"
+          "  --history FILE    record every match in a match history (default: %s for games on\n"
+          "                    this terminal, none for headless games)\n"
+          "  --stats FILE      report ratings, win rates and head-to-head records from a match\n"
+          "                    history\n"
+          "  --pin CPUS        pin the simulation, render and input threads to these CPUs, e.g.\n"
+          "                    2,3,3 (- leaves a thread free to run on any CPU)\n"
+          "  --realtime        run the simulation thread at SCHED_FIFO priority %d, if permitted\n"
+          "  --green           run the simulation, render and input loops as tasks on one thread\n"
+          "                    (--pin and --realtime then place that thread)\n"
+          "  --host TTY        host a match on the terminal with this device path (see tty(1));\n"
+          "                    repeat for as many matches as wanted, all run by one thread\n"
+          "  --world WxH       play on a world of W by H cells, e.g. 10000x10000, seen through a\n"
+          "                    window that follows player 1; memory grows with the trails\n"
+          "  --trail MS        trails fade MS milliseconds after they are laid (at least %d)\n",
+          prog, MAX_PLAYERS, DEFAULT_PLAYERS, DEFAULT_BOARD_WIDTH, DEFAULT_BOARD_HEIGHT,
+          HISTORY_FILE, AFFINITY_REALTIME_PRIORITY, MIN_TRAIL_TICKS * SIM_TICK_INTERVAL);
+}
 
-    game_countdown();
-    // Is the game running?
-    running = true;
-    goto GAMESTART;
-  }
-  delwin(mainwin);
-  endwin();
+/**
+ * Read the options from the command line. Exits on invalid options.
+ */
+void parse_args(int argc, char **argv, options_t *opts)
+{
+  opts->config.num_players = DEFAULT_PLAYERS;
+  opts->config.width = DEFAULT_BOARD_WIDTH;
+  opts->config.height = DEFAULT_BOARD_HEIGHT;
+  opts->config.trail_length = 0;
+  opts->headless = false;
+  opts->games = 1000;
+  opts->threads = tournament_default_threads();
+  opts->bots = -1;
+  opts->search = 0;
+  opts->seed = time_ms();
+  opts->record = NULL;
+  opts->replay = NULL;
+  opts->seek_round = 0;
+  opts->seek_tick = 0;
+  opts->serve = NULL;
+  opts->join = NULL;
+  opts->watch = NULL;
+  opts->num_bot_cmds = 0;
+  opts->render = NULL;
+  opts->history = NULL;
+  opts->stats = NULL;
+  affinity_parse("", opts->pin, NUM_WORKERS);
+  opts->realtime = false;
+  opts->green = false;
+  opts->num_hosts = 0;
+  opts->world = false;
+
+  enum
+  {
+    OPT_HEADLESS = 256,
+    OPT_BOTS,
+    OPT_SEARCH,
+    OPT_GAMES,
+    OPT_THREADS,
+    OPT_SEED,
+    OPT_RECORD,
+    OPT_REPLAY,
+    OPT_SEEK,
+    OPT_SERVE,
+    OPT_JOIN,
+    OPT_WATCH,
+    OPT_BOT_CMD,
+    OPT_RENDER,
+    OPT_HISTORY,
+    OPT_STATS,
+    OPT_PIN,
+    OPT_REALTIME,
+    OPT_GREEN,
+    OPT_HOST,
+    OPT_WORLD,
+    OPT_TRAIL,
+  };
+
+  struct option options[] = {
+      {"players", required_argument, NULL, 'p'},
+      {"width", required_argument, NULL, 'W'},
+      {"height", required_argument, NULL, 'H'},
+      {"headless", no_argument, NULL, OPT_HEADLESS},
+      {"bots", required_argument, NULL, OPT_BOTS},
+      {"search", required_argument, NULL, OPT_SEARCH},
+      {"games", required_argument, NULL, OPT_GAMES},
+      {"threads", required_argument, NULL, OPT_THREADS},
+      {"seed", required_argument, NULL, OPT_SEED},
+      {"record", required_argument, NULL, OPT_RECORD},
+      {"replay", required_argument, NULL, OPT_REPLAY},
+      {"seek", required_argument, NULL, OPT_SEEK},
+      {"serve", required_argument, NULL, OPT_SERVE},
+      {"join", required_argument, NULL, OPT_JOIN},
+      {"watch", required_argument, NULL, OPT_WATCH},
+      {"bot-cmd", required_argument, NULL, OPT_BOT_CMD},
+      {"render", required_argument, NULL, OPT_RENDER},
+      {"history", required_argument, NULL, OPT_HISTORY},
+      {"stats", required_argument, NULL, OPT_STATS},
+      {"pin", required_argument, NULL, OPT_PIN},
+      {"realtime", no_argument, NULL, OPT_REALTIME},
+      {"green", no_argument, NULL, OPT_GREEN},
+      {"host", required_argument, NULL, OPT_HOST},
+      {"world", required_argument, NULL, OPT_WORLD},
+      {"trail", required_argument, NULL, OPT_TRAIL},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "p:W:H:h", options, NULL)) != -1)
+  {
+    switch (opt)
+    {
+    case 'p':
+      opts->config.num_players = atoi(optarg);
+      break;
+    case 'W':
+      opts->config.width = atoi(optarg);
+      break;
+    case 'H':
+      opts->config.height = atoi(optarg);
+      break;
+    case OPT_HEADLESS:
+      opts->headless = true;
+      break;
+    case OPT_BOTS:
+      opts->bots = atoi(optarg);
+      break;
+    case OPT_SEARCH:
+      opts->search = atoi(optarg) > 0 ? atoi(optarg) : 0;
+      break;
+    case OPT_GAMES:
+      opts->games = atoi(optarg);
+      break;
+    case OPT_THREADS:
+      opts->threads = atoi(optarg) > 0 ? atoi(optarg) : 1;
+      break;
+    case OPT_SEED:
+      opts->seed = strtoull(optarg, NULL, 0);
+      break;
+    case OPT_RECORD:
+      opts->record = optarg;
+      break;
+    case OPT_REPLAY:
+      opts->replay = optarg;
+      break;
+    case OPT_SEEK:
+      if (sscanf(optarg, "%d:%d", &opts->seek_round, &opts->seek_tick) != 2 ||
+          opts->seek_round < 1 || opts->seek_tick < 0)
+      {
+        fprintf(stderr, "Invalid --seek: expected ROUND:TICK, e.g. 1:500.\n");
+        exit(1);
+      }
+      break;
+    case OPT_SERVE:
+      opts->serve = optarg;
+      break;
+    case OPT_JOIN:
+      opts->join = optarg;
+      break;
+    case OPT_WATCH:
+      opts->watch = optarg;
+      break;
+    case OPT_BOT_CMD:
+      if (opts->num_bot_cmds == MAX_PLAYERS)
+      {
+        fprintf(stderr, "Invalid --bot-cmd: at most %d external bots.\n", MAX_PLAYERS);
+        exit(1);
+      }
+      opts->bot_cmds[opts->num_bot_cmds++] = optarg;
+      break;
+    case OPT_RENDER:
+      if (strcmp(optarg, "ansi") != 0 && strcmp(optarg, "curses") != 0)
+      {
+        fprintf(stderr, "Invalid --render: expected ansi or curses.\n");
+        exit(1);
+      }
+      opts->render = optarg;
+      break;
+    case OPT_HISTORY:
+      opts->history = optarg;
+      break;
+    case OPT_STATS:
+      opts->stats = optarg;
+      break;
+    case OPT_PIN:
+    {
+      const char *error = affinity_parse(optarg, opts->pin, NUM_WORKERS);
+      if (error != NULL)
+      {
+        fprintf(stderr, "Invalid --pin: %s.\n", error);
+        exit(1);
+      }
+      break;
+    }
+    case OPT_REALTIME:
+      opts->realtime = true;
+      break;
+    case OPT_GREEN:
+      opts->green = true;
+      break;
+    case OPT_HOST:
+      if (opts->num_hosts == HOST_MAX_MATCHES)
+      {
+        fprintf(stderr, "Invalid --host: at most %d matches.\n", HOST_MAX_MATCHES);
+        exit(1);
+      }
+      opts->hosts[opts->num_hosts++] = optarg;
+      break;
+    case OPT_WORLD:
+      if (sscanf(optarg, "%dx%d", &opts->config.width, &opts->config.height) != 2)
+      {
+        fprintf(stderr, "Invalid --world: expected WIDTHxHEIGHT, e.g. 10000x10000.\n");
+        exit(1);
+      }
+      opts->world = true;
+      break;
+    case OPT_TRAIL:
+    {
+      char *end;
+      errno = 0;
+      long ms = strtol(optarg, &end, 10);
+      if (end == optarg || *end != '\0' || errno != 0 || ms <= 0 || ms > INT_MAX)
+      {
+        fprintf(stderr, "Invalid --trail: expected a positive number of milliseconds.\n");
+        exit(1);
+      }
+      // Rounded up, so a trail too short to fade is rejected instead of becoming one that never does
+      opts->config.trail_length = (int)((ms + SIM_TICK_INTERVAL - 1) / SIM_TICK_INTERVAL);
+      break;
+    }
+    case 'h':
+      usage(argv[0]);
+      exit(0);
+    default:
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  const char *error = opts->world ? world_config_error(&opts->config)
+                                  : game_config_error(&opts->config);
+  if (error != NULL)
+  {
+    fprintf(stderr, "Invalid configuration: %s.\n", error);
+    exit(1);
+  }
+
+  // Headless players without bots wander and server seats are for clients, but every other
+  // interactive player needs a keyboard or a bot
+  int num_players = opts->config.num_players;
+  if (opts->bots < 0 && (opts->headless || opts->serve != NULL))
+  {
+    opts->bots = 0;
+  }
+  else if (opts->bots < 0)
+  {
+    opts->bots = num_players > NUM_KEYBOARD_PLAYERS ? num_players - NUM_KEYBOARD_PLAYERS : 0;
+  }
+  if (opts->num_hosts > 0 && (opts->headless || opts->serve != NULL || opts->join != NULL ||
+                              opts->watch != NULL || opts->replay != NULL ||
+                              opts->num_bot_cmds > 0))
+  {
+    fprintf(stderr, "Invalid configuration: --host only works with games on terminals.\n");
+    exit(1);
+  }
+  if (opts->config.trail_length > 0 &&
+      (opts->serve != NULL || opts->join != NULL || opts->watch != NULL || opts->replay != NULL ||
+       opts->record != NULL || opts->num_hosts > 0 || opts->world))
+  {
+    fprintf(stderr, "Invalid configuration: --trail only works in games played here.\n");
+    exit(1);
+  }
+  if (opts->world && (opts->headless || opts->serve != NULL || opts->join != NULL ||
+                     opts->watch != NULL || opts->replay != NULL || opts->num_hosts > 0 ||
+                     opts->num_bot_cmds > 0 || opts->record != NULL || opts->search > 0))
+  {
+    fprintf(stderr, "Invalid configuration: --world only works with games on this terminal.\n");
+    exit(1);
+  }
+  if (opts->num_bot_cmds > 0)
+  {
+    if (opts->headless || opts->serve != NULL || opts->join != NULL || opts->watch != NULL ||
+        opts->replay != NULL)
+    {
+      fprintf(stderr, "Invalid configuration: --bot-cmd only works in games on this terminal.\n");
+      exit(1);
+    }
+    if (opts->num_bot_cmds > num_players)
+    {
+      fprintf(stderr, "Invalid configuration: more external bots than players.\n");
+      exit(1);
+    }
+    opts->bots = opts->bots > opts->num_bot_cmds ? opts->bots : opts->num_bot_cmds;
+  }
+  if (opts->bots > num_players || (!opts->headless && opts->serve == NULL &&
+                                    num_players - opts->bots > NUM_KEYBOARD_PLAYERS))
+  {
+    fprintf(stderr, "Invalid configuration: at most %d players can use the keyboard.\n",
+            NUM_KEYBOARD_PLAYERS);
+    exit(1);
+  }
+}
+
+/**
+ * Print a board as text: '.' for empty cells, '@' for bikes and a digit or letter for the player
+ * whose trail fills a cell
+ */
+void print_board(const game_t *g, FILE *out)
+{
+  static const char owners[] = "123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ!#$%";
+  for (int r = 0; r < g->height; r++)
+  {
+    for (int c = 0; c < g->width; c++)
+    {
+      uint8_t cell = game_cell(g, r, c);
+      fputc(cell == CELL_EMPTY ? '.' : (cell & CELL_BIKE) ? '@' : owners[CELL_OWNER(cell) - 1],
+            out);
+    }
+    fputc('\n', out);
+  }
+}
+
+/**
+ * Play back a replay file without a terminal, or show the board at one point in it
+ * \return        The exit status for the program
+ */
+int play_replay(const options_t *opts)
+{
+  replay_t replay;
+  const char *error = replay_open(&replay, opts->replay);
+  if (error != NULL)
+  {
+    fprintf(stderr, "Cannot play %s: %s.\n", opts->replay, error);
+    return 1;
+  }
+  printf("%d players on a %dx%d board, seed %llu, %d rounds, %d keyframes, %zu bytes\n",
+         replay.config.num_players, replay.config.width, replay.config.height,
+         (unsigned long long)replay.seed, replay.rounds, replay.keyframes, replay.size);
+
+  game_t g;
+  game_init(&g, &replay.config);
+  int status = 0;
+  if (opts->seek_round > 0)
+  {
+    uint64_t start = time_ns();
+    if (replay_seek(&replay, &g, opts->seek_round, opts->seek_tick))
+    {
+      printf("round %d, tick %d (found in %.1f us)\n", opts->seek_round, opts->seek_tick,
+             (time_ns() - start) / 1000.0);
+      print_board(&g, stdout);
+    }
+    else
+    {
+      fprintf(stderr, "Cannot seek to round %d: no such round, or the replay is corrupt.\n",
+              opts->seek_round);
+      status = 1;
+    }
+  }
+  else
+  {
+    replay_stats_t stats;
+    if (!replay_play(&replay, &g, &stats))
+    {
+      fprintf(stderr, "The replay is corrupt after %d rounds.\n", stats.rounds);
+      status = 1;
+    }
+    else
+    {
+      printf("%d rounds, %llu ticks (%.1f minutes of play) in %.3f ms\n", stats.rounds,
+             (unsigned long long)stats.ticks, stats.ticks * SIM_TICK_INTERVAL / 60000.0,
+             stats.elapsed_ns / 1e6);
+      printf("%d keyframes and %d results checked, %d mismatches\n", stats.keyframes,
+             stats.rounds, stats.mismatches);
+      status = stats.mismatches > 0;
+    }
+  }
+  game_free(&g);
+  replay_close(&replay);
+  return status;
+}
+
+/**
+ * Show the line under the board that says what the server is doing
+ * \param   seat    The player this client steers, or -1 when watching
+ */
+void draw_server_status(const server_status_t *status, int seat)
+{
+  char text[128];
+  int n = seat >= 0 ? snprintf(text, sizeof(text), "You are player %d. ", seat + 1)
+                    : snprintf(text, sizeof(text), "Watching. ");
+  switch (status->state)
+  {
+  case SERVER_WAITING:
+    snprintf(text + n, sizeof(text) - n, "Waiting for players: %d of %d seats taken.",
+             status->seated, status->seats);
+    break;
+  case SERVER_COUNTDOWN:
+    snprintf(text + n, sizeof(text) - n, "Round %d starts in %d.", status->round + 1,
+             status->countdown);
+    break;
+  case SERVER_PLAYING:
+    snprintf(text + n, sizeof(text) - n, "Round %d.", status->round);
+    break;
+  case SERVER_OVER:
+    if (status->winner > 0)
+    {
+      snprintf(text + n, sizeof(text) - n, "Player %d wins round %d!", status->winner,
+               status->round);
+    }
+    else
+    {
+      snprintf(text + n, sizeof(text) - n, "Round %d is a draw!", status->round);
+    }
+    break;
+  default:
+    snprintf(text + n, sizeof(text) - n, "The server has stopped.");
+    break;
+  }
+  mvprintw(screen_row(game.height) + 1, screen_col(-1), "%-*s", game.width + 2, text);
+}
+
+/**
+ * Create the renderer for the board. ncurses must already be initialized.
+ */
+void create_renderer(const options_t *opts)
+{
+  const char *backend = opts->render != NULL ? opts->render : render_default_backend();
+  renderer = render_create(backend, game.width, game.height, screen_row(0), screen_col(0),
+                           STDOUT_FILENO);
+}
+
+/**
+ * Print how much the renderer drew
+ */
+void render_report(FILE *out)
+{
+  if (renderer->frames == 0)
+  {
+    return;
+  }
+  fprintf(out, "%s renderer: %llu frames", renderer->backend->name,
+          (unsigned long long)renderer->frames);
+  if (renderer->bytes > 0)
+  {
+    fprintf(out, ", %.1f bytes per frame", (double)renderer->bytes / renderer->frames);
+  }
+  fprintf(out, "\n");
+}
+
+/**
+ * Draw the border around the part of a world on the screen: solid where it is the world's edge,
+ * dotted where the world goes on
+ * \param   top     The first world row on the screen
+ * \param   left    The first world column on the screen
+ * \param   height  The rows on the screen
+ * \param   width   The columns on the screen
+ */
+void draw_world_border(const world_t *w, int top, int left, int height, int width)
+{
+  chtype horizontal[2] = {ACS_BULLET, ACS_HLINE};
+  chtype vertical[2] = {ACS_BULLET, ACS_VLINE};
+  mvaddch(screen_row(-1), screen_col(-1), ACS_ULCORNER);
+  mvaddch(screen_row(-1), screen_col(width), ACS_URCORNER);
+  mvaddch(screen_row(height), screen_col(-1), ACS_LLCORNER);
+  mvaddch(screen_row(height), screen_col(width), ACS_LRCORNER);
+  for (int col = 0; col < width; col++)
+  {
+    mvaddch(screen_row(-1), screen_col(col), horizontal[top == 0]);
+    mvaddch(screen_row(height), screen_col(col), horizontal[top + height == w->height]);
+  }
+  for (int row = 0; row < height; row++)
+  {
+    mvaddch(screen_row(row), screen_col(-1), vertical[left == 0]);
+    mvaddch(screen_row(row), screen_col(width), vertical[left + width == w->width]);
+  }
+}
+
+/**
+ * Draw the part of a world around player 1, moving the view first if the player is near its edge.
+ * Every cell in view is drawn, so the cost of a frame follows the size of the view, not of the
+ * world or its trails.
+ * \param   view    Draws the cells in view
+ * \param   top     The view's first world row, updated in place
+ * \param   left    The view's first world column, updated in place
+ * \param   cells   Scratch space for one row of the view
+ * \param   status  The line to show under the view
+ */
+void draw_world(const world_t *w, renderer_t *view, int *top, int *left, uint8_t *cells,
+                const char *status)
+{
+  if (world_follow(w, 0, view->height, view->width, top, left))
+  {
+    draw_world_border(w, *top, *left, view->height, view->width);
+  }
+  mvprintw(screen_row(view->height) + 1, screen_col(-1), "%-*s", view->width + 2, status);
+  refresh();
+  for (int r = 0; r < view->height; r++)
+  {
+    world_read_row(w, *top + r, *left, view->width, cells);
+    for (int c = 0; c < view->width; c++)
+    {
+      render_cell(view, r, c, cells[c]);
+    }
+  }
+  render_flush(view);
+}
+
+/**
+ * Steer the keyboard players of a world from the keys waiting
+ * \return        false if q was pressed
+ */
+bool read_world_keys(world_t *w)
+{
+  int key;
+  while ((key = getch()) != ERR)
+  {
+    if (key == 'q')
+    {
+      return false;
+    }
+    for (int i = 0; i < num_humans; i++)
+    {
+      for (int dir = DIR_NORTH; dir <= DIR_WEST; dir++)
+      {
+        if (key == player_keys[i][dir])
+        {
+          world_steer(w, i, dir);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Play rounds on a world much larger than the screen (see world_t), seen through a view that
+ * follows player 1. One thread runs the simulation, the keyboard and the drawing, each at its
+ * usual interval.
+ * \return        The exit status for the program
+ */
+int play_world(const options_t *opts)
+{
+  world_t w;
+  world_init(&w, &opts->config);
+  num_humans = w.num_players - opts->bots;
+
+  WINDOW *mainwin = initscr();
+  if (mainwin == NULL)
+  {
+    fprintf(stderr, "Error initializing ncurses.\n");
+    exit(2);
+  }
+  noecho();
+  keypad(mainwin, true);
+  nodelay(mainwin, true);
+  curs_set(0);
+
+  // The view takes whatever the screen has room for around the title, border and status line
+  int height = LINES - 4 < w.height ? LINES - 4 : w.height;
+  int width = COLS - 3 < w.width ? COLS - 3 : w.width;
+  if (height < 5 || width < 10)
+  {
+    endwin();
+    fprintf(stderr, "The terminal is too small to show a world.\n");
+    exit(2);
+  }
+  const char *backend = opts->render != NULL ? opts->render : render_default_backend();
+  renderer = render_create(backend, width, height, screen_row(0), screen_col(0), STDOUT_FILENO);
+  renderer_t *view = renderer;
+  uint8_t *cells = malloc(width);
+  if (cells == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  pacer_t ticks;
+  pacer_t frames;
+  pacer_init(&ticks, SIM_TICK_INTERVAL * 1000000ull, SIM_MAX_CATCH_UP);
+  pacer_init(&frames, DRAW_BOARD_INTERVAL * 1000000ull, 1);
+  uint64_t rng = time_ms();
+  uint64_t draw_ns = 0;
+  size_t most_chunks = 0;
+  int rounds = 0;
+
+  bool quit = false;
+  while (!quit)
+  {
+    // A view outside the world is centered on the first frame
+    int top = -WORLD_MAX_SIDE;
+    int left = -WORLD_MAX_SIDE;
+    char status[256];
+    clear();
+    mvprintw(0, screen_col(width / 2 - 10), "Tron! %dx%d world", w.width, w.height);
+    render_invalidate(view);
+    pacer_start(&ticks);
+    pacer_start(&frames);
+    int result = -1;
+    while (result < 0 && !quit)
+    {
+      int due = pacer_wait(&ticks);
+      quit = !read_world_keys(&w);
+      for (int t = 0; t < due && result < 0; t++)
+      {
+        for (int i = num_humans; i < w.num_players; i++)
+        {
+          if (world_move_due(&w, i))
+          {
+            world_wander(&w, i, &rng);
+          }
+        }
+        result = world_tick(&w);
+      }
+      most_chunks = w.num_chunks > most_chunks ? w.num_chunks : most_chunks;
+
+      if (result >= 0 || pacer_due(&frames, time_ns()) > 0)
+      {
+        const player_t *p = &w.players[0];
+        int n = snprintf(status, sizeof(status), "Player 1 at row %d, column %d. ", p->row,
+                         p->col);
+        if (result > 0)
+        {
+          snprintf(status + n, sizeof(status) - n, "Player %d wins! Any key plays again, q quits.",
+                   result);
+        }
+        else if (result == 0)
+        {
+          snprintf(status + n, sizeof(status) - n, "A draw! Any key plays again, q quits.");
+        }
+        else
+        {
+          snprintf(status + n, sizeof(status) - n, "%zu chunks, %zu KiB. q quits.",
+                   w.num_chunks, world_memory(&w) / 1024);
+        }
+        uint64_t start = time_ns();
+        draw_world(&w, view, &top, &left, cells, status);
+        draw_ns += time_ns() - start;
+      }
+    }
+
+    // Wait for a key before the next round
+    if (!quit)
+    {
+      rounds++;
+      int key;
+      while ((key = getch()) == ERR)
+      {
+        sleep_ms(READ_INPUT_INTERVAL);
+      }
+      quit = key == 'q';
+      world_reset(&w);
+    }
+  }
+  endwin();
+
+  printf("%dx%d world, %d rounds: at most %zu chunks in use, %zu KiB (%.0f KiB as one array)\n",
+         w.width, w.height, rounds, most_chunks, world_memory(&w) / 1024,
+         (double)w.width * w.height / 1024);
+  if (view->frames > 0)
+  {
+    printf("%dx%d view: %.1f us per frame\n", width, height, draw_ns / 1000.0 / view->frames);
+  }
+  pacer_report(&ticks.stats, "tick pacing", stdout);
+  pacer_report(&frames.stats, "frame pacing", stdout);
+  render_report(stdout);
+  render_free(view);
+  free(cells);
+  world_free(&w);
+  return 0;
+}
+
+/**
+ * Play or watch on a server from this terminal. The board is read straight from the server's
+ * shared memory; key presses are sent over its socket. A player's client predicts each round
+ * locally (see rollback_t) so its own bike turns without waiting for the server.
+ * \return        The exit status for the program
+ */
+int run_client(const options_t *opts)
+{
+  const char *name = opts->join != NULL ? opts->join : opts->watch;
+  shared_board_t board;
+  const char *error = shared_board_attach(&board, name);
+  if (error != NULL)
+  {
+    fprintf(stderr, "Cannot attach to server %s: %s.\n", name, error);
+    return 1;
+  }
+
+  int fd = -1;
+  int seat = -1;
+  if (opts->join != NULL)
+  {
+    fd = server_connect(name, &seat);
+    if (fd < 0)
+    {
+      if (seat == SERVER_FULL)
+      {
+        fprintf(stderr, "Every seat on server %s is taken; try --watch.\n", name);
+      }
+      else
+      {
+        perror("Cannot connect to the server");
+      }
+      shared_board_detach(&board);
+      return 1;
+    }
+  }
+
+  game_config_t config = {.width = board.header->width,
+                          .height = board.header->height,
+                          .num_players = board.header->num_players};
+  game_init(&game, &config);
+
+  WINDOW *mainwin = initscr();
+  if (mainwin == NULL)
+  {
+    fprintf(stderr, "Error initializing ncurses.\n");
+    exit(2);
+  }
+  if (screen_row(game.height) + 1 >= LINES || screen_col(game.width) >= COLS)
+  {
+    endwin();
+    fprintf(stderr, "A %dx%d board needs a terminal of at least %dx%d.\n", game.width,
+            game.height, screen_col(game.width) + 1, screen_row(game.height) + 2);
+    exit(2);
+  }
+  noecho();
+  keypad(mainwin, true);
+  nodelay(mainwin, true);
+  create_renderer(opts);
+  init_display();
+  curs_set(0);
+
+  size_t cells = (size_t)game.width * game.height;
+  uint8_t *frame = malloc(cells);
+  int *rows = malloc(sizeof(int) * game.height);
+  if (frame == NULL || rows == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  memset(frame, CELL_EMPTY, cells);
+
+  // A seated client predicts the round from the moment the server starts it
+  static rollback_t rb;
+  bool predicting = false;
+  int heard_tick = 0;     // the last tick the server confirmed
+  uint64_t heard_ns = 0;  // when that confirmation arrived
+  uint64_t rtt_ns = 0;    // smoothed round trip to the server
+  uint64_t ping_ns = 0;   // when the last ping was sent
+  if (fd >= 0)
+  {
+    rollback_init(&rb, &config, seat);
+  }
+
+  // A player's client runs its prediction every tick; a watcher only draws frames
+  pacer_init(&frame_pacer, (fd >= 0 ? SIM_TICK_INTERVAL : DRAW_BOARD_INTERVAL) * 1000000ull, 1);
+
+  const char *reason = NULL;
+  server_status_t status;
+  bool repaint = false;
+  while (reason == NULL)
+  {
+    // Any of the keyboard layouts steers this client's player
+    int key;
+    while ((key = getch()) != ERR && reason == NULL)
+    {
+      if (key == 'q')
+      {
+        reason = "";
+      }
+      else if (key == KEY_RESIZE)
+      {
+        repaint = true;
+      }
+      for (int i = 0; i < NUM_KEYBOARD_PLAYERS && fd >= 0; i++)
+      {
+        for (int dir = DIR_NORTH; dir <= DIR_WEST; dir++)
+        {
+          if (key != player_keys[i][dir])
+          {
+            continue;
+          }
+          // Turn in the prediction now, and ask the server to turn on the same tick
+          rollback_steer(&rb, dir);
+          if (!server_send_input(fd, dir, predicting ? rb.tick : 0))
+          {
+            reason = "The server has gone away.";
+          }
+        }
+      }
+    }
+
+    uint64_t now = time_ns();
+    server_message_t message;
+    int received;
+    while (fd >= 0 && (received = server_receive(fd, &message, config.num_players)) > 0)
+    {
+      if (message.type == SERVER_MSG_ROUND)
+      {
+        rollback_reset(&rb);
+        predicting = true;
+        heard_tick = -1;
+        heard_ns = now;
+      }
+      else if (message.type == SERVER_MSG_TICK && predicting)
+      {
+        rollback_confirm(&rb, message.tick, message.dirs);
+        heard_tick = message.tick;
+        heard_ns = now;
+      }
+      else if (message.type == SERVER_MSG_PONG)
+      {
+        uint64_t sample = now - message.stamp;
+        rtt_ns = rtt_ns == 0 ? sample : (rtt_ns * 7 + sample) / 8;
+      }
+    }
+    if (fd >= 0 && received < 0)
+    {
+      reason = "The server has gone away.";
+    }
+    if (fd >= 0 && now - ping_ns >= 1000000000ull)
+    {
+      server_send_ping(fd, now);
+      ping_ns = now;
+    }
+
+    // Run ahead of the server by the round trip, so an input sent now arrives in time for the
+    // tick it is tagged with
+    if (predicting)
+    {
+      uint64_t tick_ns = SIM_TICK_INTERVAL * 1000000ull;
+      int lead = (int)((rtt_ns + tick_ns - 1) / tick_ns) + 1;
+      int target = heard_tick + 1 + (int)((now - heard_ns) / tick_ns) + lead;
+      while (rb.tick < target && rollback_advance(&rb))
+      {
+      }
+      if (rb.redo >= 0)
+      {
+        rollback_advance(&rb);
+      }
+    }
+
+    if (shared_board_read(&board, frame, rows, &status) < 0)
+    {
+      reason = "The server has gone away.";
+      break;
+    }
+    if (status.state != SERVER_PLAYING)
+    {
+      predicting = false; // between rounds the server's board is the one to show
+    }
+    if (repaint)
+    {
+      clear();
+      init_display();
+      render_invalidate(renderer);
+      repaint = false;
+    }
+
+    // The renderer only draws the cells that differ from the last frame
+    draw_server_status(&status, seat);
+    refresh();
+    const uint8_t *source = predicting ? rb.game.cells : frame;
+    for (size_t i = 0; i < cells; i++)
+    {
+      render_cell(renderer, i / game.width, i % game.width, source[i]);
+    }
+    render_flush(renderer);
+
+    if (status.state == SERVER_STOPPED)
+    {
+      reason = "The server has stopped.";
+    }
+    pacer_wait(&frame_pacer);
+  }
+
+  endwin();
+  if (reason[0] != '\0')
+  {
+    printf("%s\n", reason);
+  }
+  if (fd >= 0)
+  {
+    printf("%llu rollbacks, %llu ticks simulated again (at most %d at once), %.1f ms round trip\n",
+           (unsigned long long)rb.rollbacks, (unsigned long long)rb.resimulated, rb.max_depth,
+           rtt_ns / 1e6);
+    rollback_free(&rb);
+    close(fd);
+  }
+  pacer_report(&frame_pacer.stats, "frame pacing", stdout);
+  render_report(stdout);
+  render_free(renderer);
+  free(frame);
+  free(rows);
+  shared_board_detach(&board);
+  game_free(&game);
+  return 0;
+}
+
+/**
+ * Print the CPU time the session used and how often its threads were switched out, to compare
+ * running the workers as threads and as tasks
+ * \param   start   When the session started (time_ns)
+ * \param   out     Where to print
+ */
+void report_usage(uint64_t start, FILE *out)
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+  {
+    return;
+  }
+  double elapsed = (time_ns() - start) / 1e9;
+  double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec +
+               usage.ru_stime.tv_usec / 1e6;
+  fprintf(out,
+          "%s: %.2f s of CPU in %.1f s (%.1f%%), %ld voluntary and %ld involuntary context "
+          "switches\n",
+          green ? "tasks" : "threads", cpu, elapsed, elapsed > 0 ? cpu / elapsed * 100 : 0.0,
+          usage.ru_nvcsw, usage.ru_nivcsw);
+}
+
+/**
+ * Bring a match history's statistics up to date, save them and print them
+ * \return        The exit status for the program
+ */
+int show_stats(const options_t *opts)
+{
+  history_stats_t stats;
+  history_stats_init(&stats);
+  uint64_t start = time_ns();
+  const char *error = history_stats_load(&stats, opts->stats);
+  uint64_t loaded = time_ns();
+  if (error != NULL)
+  {
+    fprintf(stderr, "Cannot read %s: %s.\n", opts->stats, error);
+    history_stats_free(&stats);
+    return 1;
+  }
+  if (!history_stats_save(&stats, opts->stats))
+  {
+    fprintf(stderr, "Could not save the statistics for %s: %s.\n", opts->stats, strerror(errno));
+  }
+
+  uint32_t top[10];
+  uint64_t query_start = time_ns();
+  history_stats_top(&stats, 10, top);
+  uint64_t queried = time_ns();
+  history_stats_report(&stats, 10, stdout);
+  printf("\nloaded and brought up to date in %.2f ms, top 10 found in %.1f us\n",
+         (loaded - start) / 1e6, (queried - query_start) / 1e3);
+  history_stats_free(&stats);
+  return 0;
+}
+
+// The name each seat is recorded under in the match history. A keyboard seat keeps the last name
+// its winner entered, so a player's losses count against the same name as their wins until
+// someone else wins at that seat; until then, and for bots, it is the seat and what steers it.
+char seat_names[MAX_PLAYERS][HISTORY_NAME_LEN + 1];
+
+/**
+ * Add the round that just ended to the match history
+ * \param   history     The history's writer
+ * \param   result      The round's result: 0 for a draw, otherwise the winning player
+ * \param   name        The name the winner entered
+ * \return              false if the round could not be written (errno says why)
+ */
+bool record_round(history_writer_t *history, int result, const char *name)
+{
+  const char *names[MAX_PLAYERS];
+  for (int i = 0; i < game.num_players; i++)
+  {
+    if (seat_names[i][0] == '\0')
+    {
+      const char *kind = i < num_humans ? "P" : i < first_pipebot ? "BOT" : "EXT";
+      snprintf(seat_names[i], sizeof(seat_names[i]), "%s%d", kind, i + 1);
+    }
+    if (i + 1 == result && i < num_humans && name[0] != '\0')
+    {
+      snprintf(seat_names[i], sizeof(seat_names[i]), "%s", name);
+    }
+    names[i] = seat_names[i];
+  }
+  history_match_t match;
+  history_match_from_game(&match, &game, result, names);
+  return history_writer_add(history, &match) && history_writer_flush(history);
+}
+
+// Entry point: Set up the game, create jobs, then run the scheduler
+int main(int argc, char **argv)
+{
+  options_t opts;
+  parse_args(argc, argv, &opts);
+
+  if (opts.replay != NULL)
+  {
+    return play_replay(&opts);
+  }
+  if (opts.serve != NULL)
+  {
+    return server_run(opts.serve, &opts.config, opts.bots, opts.search);
+  }
+  if (opts.join != NULL || opts.watch != NULL)
+  {
+    return run_client(&opts);
+  }
+  if (opts.stats != NULL)
+  {
+    return show_stats(&opts);
+  }
+  if (opts.num_hosts > 0)
+  {
+    host_options_t host = {.config = opts.config,
+                           .bots = opts.bots,
+                           .render = opts.render,
+                           .keys = player_keys,
+                           .num_keys = NUM_KEYBOARD_PLAYERS};
+    return host_run(&host, opts.hosts, opts.num_hosts);
+  }
+  if (opts.world)
+  {
+    return play_world(&opts);
+  }
+
+  // Headless games never touch the terminal
+  if (opts.headless)
+  {
+    headless_stats_t stats;
+    tournament_run(&opts.config, opts.games, opts.threads, opts.bots, opts.search, opts.seed,
+                   opts.history, &stats);
+    printf("seed %llu, %d threads\n", (unsigned long long)opts.seed, opts.threads);
+    headless_report(&stats, opts.config.num_players, stdout);
+    return 0;
+  }
+
+  uint64_t session_start = time_ns();
+  green = opts.green;
+  game_init(&game, &opts.config);
+  game.snapshot = snapshot_create(game.width, game.height);
+  arena_init(&round_arena, ROUND_ARENA_SIZE);
+  pacer_init(&tick_pacer, SIM_TICK_INTERVAL * 1000000ull, SIM_MAX_CATCH_UP);
+  pacer_init(&frame_pacer, DRAW_BOARD_INTERVAL * 1000000ull, 1);
+  pacer_init(&input_pacer, SIM_TICK_INTERVAL * 1000000ull, 1);
+  num_humans = game.num_players - opts.bots;
+  first_pipebot = game.num_players - opts.num_bot_cmds;
+  for (int i = first_pipebot; i < game.num_players; i++)
+  {
+    const char *command = opts.bot_cmds[i - first_pipebot];
+    if (!pipebot_init(&pipebots[i], &game, i, command))
+    {
+      fprintf(stderr, "Cannot start %s: %s\n", command, strerror(errno));
+      exit(1);
+    }
+  }
+  for (int i = num_humans; i < first_pipebot; i++)
+  {
+    bot_init(&bots[i], &game, i);
+    if (opts.search > 0)
+    {
+      bot_use_search(&bots[i], &game, opts.search);
+    }
+  }
+  replay_writer_t writer;
+  if (opts.record != NULL)
+  {
+    replay_writer_init(&writer, &opts.config, opts.seed);
+    recording = &writer;
+  }
+  bool record_failed = false;
+  const char *history_path = opts.history != NULL ? opts.history : HISTORY_FILE;
+  history_writer_t history;
+  bool history_open = history_writer_open(&history, history_path);
+  bool history_failed = !history_open;
+  reset_round();
+
+  use_default_colors();
+
+  // Initialize the ncurses window
+  WINDOW *mainwin = initscr();
+  if (mainwin == NULL)
+  {
+    fprintf(stderr, "Error initializing ncurses.\n");
+    exit(2);
+  }
+
+  // The board and its border have to fit on the screen
+  if (screen_row(game.height) >= LINES || screen_col(game.width) >= COLS)
+  {
+    endwin();
+    fprintf(stderr, "A %dx%d board needs a terminal of at least %dx%d.\n", game.width,
+            game.height, screen_col(game.width) + 1, screen_row(game.height) + 1);
+    exit(2);
+  }
+
+  // Seed random number generator with the time in milliseconds
+  srand(time_ms());
+
+  noecho();               // Don't print keys when pressed
+  keypad(mainwin, true);  // Support arrow keys
+  nodelay(mainwin, true); // Non-blocking keyboard access
+
+  // Initialize the game display
+  create_renderer(&opts);
+  init_display();
+  curs_set(0);
+  init_frame();
+
+  // The workers live for the whole session, parked until a round starts, and so does the
+  // leaderboard's compactor. Pinning the workers or raising the simulation's priority is best
+  // effort: a worker that is refused runs as it would anyway. As tasks, the workers all run on
+  // this thread, which is placed as the simulation would be.
+  pthread_t workers[NUM_WORKERS];
+  task_t worker_tasks[NUM_WORKERS];
+  int placed = green ? 1 : NUM_WORKERS;
+  placements[0].priority = opts.realtime ? AFFINITY_REALTIME_PRIORITY : 0;
+  if (green)
+  {
+    placements[0].label = "scheduler";
+    placements[0].cpu = opts.pin[0];
+    affinity_apply(pthread_self(), &placements[0]);
+    scheduler_init();
+    task_fn_t tasks[NUM_WORKERS] = {update_players_task, draw_board_task, read_input_task};
+    for (int i = 0; i < NUM_WORKERS; i++)
+    {
+      task_create(&worker_tasks[i], tasks[i]);
+    }
+    tick_pacer.sleep_until = task_sleep_until;
+    frame_pacer.sleep_until = task_sleep_until;
+    input_pacer.sleep_until = task_sleep_until;
+  }
+  if (pthread_create(&compactor, NULL, compact_scores, NULL) != 0)
+  {
+    perror("pthread_create");
+    exit(2);
+  }
+  for (int i = 0; i < NUM_WORKERS && !green; i++)
+  {
+    void *(*tasks[NUM_WORKERS])(void *) = {update_players, draw_board, read_input};
+    if (pthread_create(&workers[i], NULL, tasks[i], NULL) != 0)
+    {
+      perror("pthread_create");
+      exit(2);
+    }
+    placements[i].cpu = opts.pin[i];
+    affinity_apply(workers[i], &placements[i]);
+  }
+
+  // The lobby: a starting screen that waits for a key
+  start_game();
+  do
+  {
+    set_state(STATE_COUNTDOWN);
+    game_countdown();
+    set_state(STATE_PLAYING);
+    wait_for_game_over();
+
+    // Save the replay before anything else can go wrong
+    if (recording != NULL && !replay_save(recording, opts.record))
+    {
+      record_failed = true;
+    }
+
+    // Display the end of game message and wait for user input, then record the round under the
+    // names the seats last entered
+    char winner_name[LEADERBOARD_NAME_LEN + 1] = "";
+    end_game(winner, winner_name);
+    if (history_open && !record_round(&history, winner, winner_name))
+    {
+      history_failed = true;
+    }
+
+    // Another round starts from the same state, reset in place
+    if (play_again)
+    {
+      play_again = false;
+      reset_round();
+      draw_frame(true);
+      render_sync(renderer);
+    }
+    else
+    {
+      set_state(STATE_QUIT);
+    }
+  } while (atomic_load(&session_state) != STATE_QUIT);
+  for (int i = 0; i < NUM_WORKERS; i++)
+  {
+    if (green)
+    {
+      task_wait(worker_tasks[i]);
+    }
+    else
+    {
+      pthread_join(workers[i], NULL);
+    }
+  }
+
+  delwin(mainwin);
+  endwin();
+  wake_compactor(true);
+  pthread_join(compactor, NULL);
+
+  // Show how long the bots took to decide, to confirm they never held up the simulation
+  bot_stats_t bot_stats = {0};
+  for (int i = num_humans; i < first_pipebot; i++)
+  {
+    bot_add_stats(&bot_stats, &bots[i].stats);
+    bot_free(&bots[i]);
+  }
+  bot_report(&bot_stats, "bot latency", stdout);
+  pacer_report(&tick_pacer.stats, "tick pacing", stdout);
+  pacer_report(&frame_pacer.stats, "frame pacing", stdout);
+  for (int i = 0; i < placed; i++)
+  {
+    affinity_report(&placements[i], stdout);
+  }
+  report_usage(session_start, stdout);
+  render_report(stdout);
+  render_free(renderer);
+  for (int i = first_pipebot; i < game.num_players; i++)
+  {
+    pipebot_free(&pipebots[i]);
+    pipebot_report(&pipebots[i], stdout);
+  }
+
+  if (history_open && !history_writer_close(&history))
+  {
+    history_failed = true;
+  }
+  if (history_failed)
+  {
+    fprintf(stderr, "Could not record the matches in %s.\n", history_path);
+  }
+
+  if (recording != NULL)
+  {
+    if (record_failed)
+    {
+      fprintf(stderr, "Could not save the replay to %s.\n", opts.record);
+    }
+    replay_writer_free(recording);
+  }
+
+  free(frame_cells);
+  free(frame_rows);
+  free(frame_mask);
+  arena_free(&round_arena);
+  snapshot_free(game.snapshot);
+  game_free(&game);
 
   return 0;
 }
@@ -34,3 +34,29 @@ size_t time_ms() {
   // Convert timeval values to milliseconds
   return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
+
+/**
+ * Get the time in nanoseconds from a monotonic clock. Only differences between two calls are
+ * meaningful.
+ */
+uint64_t time_ns() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+    perror("clock_gettime");
+    exit(2);
+  }
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Get the next number from a splitmix64 pseudo-random generator. The generator's whole state is
+ * the value pointed to by state, so every thread (or game) can have its own independent generator
+ * and a run can be repeated exactly from its seed.
+ * \param   state   The generator state, updated in place. Any value is a valid seed.
+ */
+uint64_t rng_next(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
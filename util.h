@@ -10,4 +10,10 @@ void sleep_ms(size_t ms);
 // Get the time in milliseconds since UNIX epoch
 size_t time_ms();
 
+// Get the time in nanoseconds from a monotonic clock (for measuring intervals)
+uint64_t time_ns();
+
+// Get the next number from a pseudo-random generator whose whole state is *state
+uint64_t rng_next(uint64_t *state);
+
 #endif
@@ -0,0 +1,458 @@
+#include "world.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+// Slots in a new world's table
+#define WORLD_INITIAL_SLOTS 64
+
+// One in this many moves turns even when the way ahead is clear, as in wander_steer
+#define WORLD_TURN_CHANCE 16
+
+/**
+ * Check a configuration before starting a world with it
+ * \param   config  The configuration to check
+ * \return          NULL if the configuration is usable, otherwise a message explaining why not
+ */
+const char *world_config_error(const game_config_t *config)
+{
+  if (config->width > WORLD_MAX_SIDE || config->height > WORLD_MAX_SIDE)
+  {
+    return "a world can be at most 1000000 cells on a side";
+  }
+  return game_rules_error(config);
+}
+
+/**
+ * Allocate memory or exit
+ */
+static void *checked_alloc(void *memory)
+{
+  if (memory == NULL)
+  {
+    perror("malloc");
+    exit(2);
+  }
+  return memory;
+}
+
+/**
+ * Get the table key of the chunk holding a cell
+ */
+static uint64_t chunk_key(const world_t *world, int row, int col)
+{
+  return 1 + (uint64_t)(row >> WORLD_CHUNK_SHIFT) * world->chunk_cols + (col >> WORLD_CHUNK_SHIFT);
+}
+
+/**
+ * Find the slot holding a chunk, or the free slot where it would go
+ */
+static world_slot_t *find_slot(const world_t *world, uint64_t key)
+{
+  size_t i = (size_t)((key * 0x9e3779b97f4a7c15ull) >> 32) & (world->capacity - 1);
+  while (world->slots[i].key != 0 && world->slots[i].key != key)
+  {
+    i = (i + 1) & (world->capacity - 1);
+  }
+  return &world->slots[i];
+}
+
+/**
+ * Double the table, keeping every chunk
+ */
+static void grow_table(world_t *world)
+{
+  world_slot_t *old = world->slots;
+  size_t old_capacity = world->capacity;
+  world->capacity *= 2;
+  world->slots = checked_alloc(calloc(world->capacity, sizeof(world_slot_t)));
+  for (size_t i = 0; i < old_capacity; i++)
+  {
+    if (old[i].key != 0)
+    {
+      *find_slot(world, old[i].key) = old[i];
+    }
+  }
+  free(old);
+}
+
+/**
+ * Get the cell a write goes to, adding its chunk (a spare one if there is any) on first use
+ */
+static uint8_t *cell_for_write(world_t *world, int row, int col)
+{
+  uint64_t key = chunk_key(world, row, col);
+  world_slot_t *slot = find_slot(world, key);
+  if (slot->key == 0)
+  {
+    // Keep the table at most half full, so probes stay short
+    if (2 * (world->num_chunks + 1) > world->capacity)
+    {
+      grow_table(world);
+      slot = find_slot(world, key);
+    }
+    slot->key = key;
+    slot->cells = world->num_spare > 0 ? world->spare[--world->num_spare]
+                                       : checked_alloc(calloc(WORLD_CHUNK_CELLS, 1));
+    world->num_chunks++;
+  }
+  int mask = WORLD_CHUNK_SIZE - 1;
+  return &slot->cells[((row & mask) << WORLD_CHUNK_SHIFT) | (col & mask)];
+}
+
+/**
+ * Set up an empty world and put the players at their starting positions
+ * \param   world   The world to initialize
+ * \param   config  A configuration accepted by world_config_error
+ */
+void world_init(world_t *world, const game_config_t *config)
+{
+  world->width = config->width;
+  world->height = config->height;
+  world->num_players = config->num_players;
+  world->chunk_cols = (config->width + WORLD_CHUNK_SIZE - 1) >> WORLD_CHUNK_SHIFT;
+  world->capacity = WORLD_INITIAL_SLOTS;
+  world->slots = checked_alloc(calloc(world->capacity, sizeof(world_slot_t)));
+  world->num_chunks = 0;
+  world->spare = NULL;
+  world->num_spare = 0;
+  world->spare_capacity = 0;
+  world_reset(world);
+}
+
+/**
+ * Release the memory owned by a world
+ */
+void world_free(world_t *world)
+{
+  for (size_t i = 0; i < world->capacity; i++)
+  {
+    free(world->slots[i].cells);
+  }
+  for (size_t i = 0; i < world->num_spare; i++)
+  {
+    free(world->spare[i]);
+  }
+  free(world->slots);
+  free(world->spare);
+  world->slots = NULL;
+  world->spare = NULL;
+}
+
+/**
+ * Clear the world and put every player back at its starting position for a new round
+ */
+void world_reset(world_t *world)
+{
+  // Only the chunks written last round need clearing; they are kept for this one
+  if (world->num_spare + world->num_chunks > world->spare_capacity)
+  {
+    world->spare_capacity = world->num_spare + world->num_chunks;
+    world->spare = checked_alloc(realloc(world->spare, world->spare_capacity * sizeof(uint8_t *)));
+  }
+  for (size_t i = 0; i < world->capacity; i++)
+  {
+    if (world->slots[i].key != 0)
+    {
+      memset(world->slots[i].cells, CELL_EMPTY, WORLD_CHUNK_CELLS);
+      world->spare[world->num_spare++] = world->slots[i].cells;
+    }
+  }
+  memset(world->slots, 0, world->capacity * sizeof(world_slot_t));
+  world->num_chunks = 0;
+  world->tick = 0;
+
+  // The players start as on a default board (see game_reset) in the middle of the world
+  int width = world->width < WORLD_START_WIDTH ? world->width : WORLD_START_WIDTH;
+  int height = world->height < WORLD_START_HEIGHT ? world->height : WORLD_START_HEIGHT;
+  int top = (world->height - height) / 2;
+  int left = (world->width - width) / 2;
+  int bottom_count = (world->num_players + 1) / 2;
+  int top_count = world->num_players / 2;
+  for (int i = 0; i < world->num_players; i++)
+  {
+    player_t *p = &world->players[i];
+    if (i % 2 == 0)
+    {
+      p->row = top + height - 2;
+      p->col = left + (i / 2 + 1) * width / (bottom_count + 1);
+      p->dir = DIR_NORTH;
+    }
+    else
+    {
+      p->row = top + 1 + (height > 5);
+      p->col = left + (i / 2 + 1) * width / (top_count + 1);
+      p->dir = DIR_SOUTH;
+    }
+    p->updated_dir = p->dir;
+    p->elapsed = 0;
+    p->alive = true;
+    p->death = DEATH_NONE;
+    p->died_tick = 0;
+    *cell_for_write(world, p->row, p->col) = (i + 1) | CELL_BIKE;
+  }
+}
+
+/**
+ * Get the contents of a cell
+ * \param   row     The row of the cell, which must be in the world
+ * \param   col     The column of the cell, which must be in the world
+ * \return          The encoded cell
+ */
+uint8_t world_cell(const world_t *world, int row, int col)
+{
+  const world_slot_t *slot = find_slot(world, chunk_key(world, row, col));
+  int mask = WORLD_CHUNK_SIZE - 1;
+  return slot->key == 0 ? CELL_EMPTY
+                        : slot->cells[((row & mask) << WORLD_CHUNK_SHIFT) | (col & mask)];
+}
+
+/**
+ * Copy a run of cells from one row, looking each chunk up once
+ * \param   row     The row, which must be in the world
+ * \param   col     The first column; the run must end inside the world
+ * \param   count   The number of cells
+ * \param   out     Receives count cells
+ */
+void world_read_row(const world_t *world, int row, int col, int count, uint8_t *out)
+{
+  int mask = WORLD_CHUNK_SIZE - 1;
+  while (count > 0)
+  {
+    int offset = col & mask;
+    int run = WORLD_CHUNK_SIZE - offset < count ? WORLD_CHUNK_SIZE - offset : count;
+    const world_slot_t *slot = find_slot(world, chunk_key(world, row, col));
+    if (slot->key == 0)
+    {
+      memset(out, CELL_EMPTY, run);
+    }
+    else
+    {
+      memcpy(out, &slot->cells[((row & mask) << WORLD_CHUNK_SHIFT) | offset], run);
+    }
+    out += run;
+    col += run;
+    count -= run;
+  }
+}
+
+/**
+ * Request a new direction for a player. Reversing onto the player's own trail is ignored.
+ * \param   player  The index of the player (0 for player 1)
+ * \param   dir     One of the DIR_ values
+ */
+void world_steer(world_t *world, int player, int dir)
+{
+  player_t *p = &world->players[player];
+  if (dir != (p->dir + 2) % 4)
+  {
+    p->updated_dir = dir;
+  }
+}
+
+/**
+ * Check whether a player will move on the next tick (if it keeps its requested direction)
+ */
+bool world_move_due(const world_t *world, int player)
+{
+  const player_t *p = &world->players[player];
+  return p->alive && p->elapsed + SIM_TICK_INTERVAL >= game_move_interval(p->updated_dir);
+}
+
+/**
+ * Check whether a cell is off the world or filled
+ */
+static bool blocked(const world_t *world, int row, int col)
+{
+  return row < 0 || row >= world->height || col < 0 || col >= world->width ||
+         world_cell(world, row, col) != CELL_EMPTY;
+}
+
+/**
+ * Pick a direction for a computer-controlled player as wander_steer does on a board
+ * \param   rng     Random generator state (see rng_next)
+ */
+void world_wander(world_t *world, int player, uint64_t *rng)
+{
+  player_t *p = &world->players[player];
+  int options[3] = {p->dir, (p->dir + 1) % 4, (p->dir + 3) % 4};
+  bool open[3];
+  for (int i = 0; i < 3; i++)
+  {
+    int dir = options[i];
+    open[i] = !blocked(world, p->row + (dir == DIR_SOUTH) - (dir == DIR_NORTH),
+                       p->col + (dir == DIR_EAST) - (dir == DIR_WEST));
+  }
+
+  uint64_t r = rng_next(rng);
+  int first = 1 + (int)((r >> 32) & 1);
+  int second = 3 - first;
+  if (open[0] && r % WORLD_TURN_CHANCE != 0)
+  {
+    world_steer(world, player, options[0]);
+  }
+  else if (open[first])
+  {
+    world_steer(world, player, options[first]);
+  }
+  else if (open[second])
+  {
+    world_steer(world, player, options[second]);
+  }
+  else
+  {
+    world_steer(world, player, options[0]);
+  }
+}
+
+/**
+ * Advance the world by one SIM_TICK_INTERVAL time step, by the rules of game_tick. Each move
+ * looks up only the chunk its bike moves into.
+ * \return        -1 if the round continues, 0 for a draw, or the number of the winning player
+ */
+int world_tick(world_t *world)
+{
+  int num_moving = 0;
+  int moving[MAX_PLAYERS];
+  int new_row[MAX_PLAYERS];
+  int new_col[MAX_PLAYERS];
+  uint8_t hit[MAX_PLAYERS]; // what each move runs into, or CELL_EMPTY
+  bool crashed[MAX_PLAYERS];
+  world->tick++;
+
+  // Work out where each player that is due to move will go
+  for (int i = 0; i < world->num_players; i++)
+  {
+    player_t *p = &world->players[i];
+    if (!p->alive)
+    {
+      continue;
+    }
+
+    int dir = p->updated_dir;
+    int interval = game_move_interval(dir);
+    p->elapsed += SIM_TICK_INTERVAL;
+    if (p->elapsed < interval)
+    {
+      continue;
+    }
+    p->elapsed -= interval;
+    p->dir = dir;
+
+    moving[num_moving] = i;
+    new_row[num_moving] = p->row + (dir == DIR_SOUTH) - (dir == DIR_NORTH);
+    new_col[num_moving] = p->col + (dir == DIR_EAST) - (dir == DIR_WEST);
+    num_moving++;
+  }
+
+  // Every move is checked against the world as it was at the start of the tick
+  for (int m = 0; m < num_moving; m++)
+  {
+    int row = new_row[m];
+    int col = new_col[m];
+    bool inside = row >= 0 && row < world->height && col >= 0 && col < world->width;
+    hit[m] = inside ? world_cell(world, row, col) : CELL_EMPTY;
+    crashed[m] = !inside || hit[m] != CELL_EMPTY;
+    for (int n = 0; n < num_moving && !crashed[m]; n++)
+    {
+      crashed[m] = n != m && new_row[n] == row && new_col[n] == col;
+    }
+  }
+
+  // Apply the surviving moves: the old bike position becomes trail
+  for (int m = 0; m < num_moving; m++)
+  {
+    int i = moving[m];
+    player_t *p = &world->players[i];
+    if (crashed[m])
+    {
+      p->alive = false;
+      p->died_tick = world->tick;
+      int row = new_row[m];
+      int col = new_col[m];
+      if (row < 0 || row >= world->height || col < 0 || col >= world->width)
+      {
+        p->death = DEATH_WALL;
+      }
+      else if (hit[m] != CELL_EMPTY)
+      {
+        p->death = CELL_OWNER(hit[m]) == i + 1 ? DEATH_OWN_TRAIL : DEATH_TRAIL;
+      }
+      else
+      {
+        p->death = DEATH_HEAD_ON;
+      }
+      continue;
+    }
+    *cell_for_write(world, p->row, p->col) = i + 1;
+    p->row = new_row[m];
+    p->col = new_col[m];
+    *cell_for_write(world, p->row, p->col) = (i + 1) | CELL_BIKE;
+  }
+
+  int survivors = 0;
+  int last_survivor = 0;
+  for (int i = 0; i < world->num_players; i++)
+  {
+    if (world->players[i].alive)
+    {
+      survivors++;
+      last_survivor = i + 1;
+    }
+  }
+
+  if (survivors > 1)
+  {
+    return -1;
+  }
+  return survivors == 1 ? last_survivor : 0;
+}
+
+/**
+ * Center a viewport on one axis, keeping it inside the world
+ */
+static int center_view(int position, int size, int limit)
+{
+  int start = position - size / 2;
+  start = start > limit - size ? limit - size : start;
+  return start < 0 ? 0 : start;
+}
+
+/**
+ * Move a viewport so it keeps a player in sight: once the player comes within a quarter of the
+ * view of an edge, the view jumps to center it again, without leaving the world
+ * \param   player  The index of the player to follow
+ * \param   height  The viewport's size, at most the world's
+ * \param   width
+ * \param   top     The viewport's first row, updated in place
+ * \param   left    The viewport's first column, updated in place
+ * \return          true if the viewport moved
+ */
+bool world_follow(const world_t *world, int player, int height, int width, int *top, int *left)
+{
+  const player_t *p = &world->players[player];
+  int old_top = *top;
+  int old_left = *left;
+  if (p->row < *top + height / 4 || p->row >= *top + height - height / 4)
+  {
+    *top = center_view(p->row, height, world->height);
+  }
+  if (p->col < *left + width / 4 || p->col >= *left + width - width / 4)
+  {
+    *left = center_view(p->col, width, world->width);
+  }
+  return *top != old_top || *left != old_left;
+}
+
+/**
+ * Get the heap memory a world holds: its chunks, spare chunks and table
+ * \return          The size in bytes
+ */
+size_t world_memory(const world_t *world)
+{
+  return (world->num_chunks + world->num_spare) * WORLD_CHUNK_CELLS +
+         world->capacity * sizeof(world_slot_t) + world->spare_capacity * sizeof(uint8_t *);
+}
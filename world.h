@@ -0,0 +1,142 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// Chunks are square, WORLD_CHUNK_SIZE cells on a side
+#define WORLD_CHUNK_SHIFT 6
+#define WORLD_CHUNK_SIZE (1 << WORLD_CHUNK_SHIFT)
+#define WORLD_CHUNK_CELLS (WORLD_CHUNK_SIZE * WORLD_CHUNK_SIZE)
+
+// Largest world side, in cells
+#define WORLD_MAX_SIDE 1000000
+
+// Players start spread over an area this size in the middle of the world, as on the default board
+#define WORLD_START_WIDTH DEFAULT_BOARD_WIDTH
+#define WORLD_START_HEIGHT DEFAULT_BOARD_HEIGHT
+
+// A chunk in the world's table: key 0 marks a free slot
+typedef struct world_slot
+{
+  uint64_t key; // 1 + the chunk's index in row-major order over the chunk grid
+  uint8_t *cells;
+} world_slot_t;
+
+/**
+ * A board too large to hold as one array, e.g. 10000x10000. Cells are encoded as in game.h and
+ * kept in WORLD_CHUNK_SIZE square chunks, each allocated the first time one of its cells is
+ * written and found through an open-addressing hash table, so memory follows the length of the
+ * trails rather than the area of the world. Reading a cell only looks up the chunk holding it;
+ * cells in chunks never written are empty.
+ *
+ * Rounds play by the same rules as game_tick. A new round keeps the chunks of the last one for
+ * reuse, so a session allocates no more than its longest round needed.
+ */
+typedef struct world
+{
+  int width;
+  int height;
+  int num_players;
+  int chunk_cols; // chunks across the world
+
+  world_slot_t *slots;
+  size_t capacity; // slots in the table, a power of two
+  size_t num_chunks;
+
+  // Chunks cleared for reuse
+  uint8_t **spare;
+  size_t num_spare;
+  size_t spare_capacity;
+
+  player_t players[MAX_PLAYERS];
+  int tick; // ticks played this round
+} world_t;
+
+/**
+ * Check a configuration before starting a world with it
+ * \param   config  The configuration to check
+ * \return          NULL if the configuration is usable, otherwise a message explaining why not
+ */
+const char *world_config_error(const game_config_t *config);
+
+/**
+ * Set up an empty world and put the players at their starting positions
+ * \param   world   The world to initialize
+ * \param   config  A configuration accepted by world_config_error
+ */
+void world_init(world_t *world, const game_config_t *config);
+
+/**
+ * Release the memory owned by a world
+ */
+void world_free(world_t *world);
+
+/**
+ * Clear the world and put every player back at its starting position for a new round
+ */
+void world_reset(world_t *world);
+
+/**
+ * Get the contents of a cell
+ * \param   row     The row of the cell, which must be in the world
+ * \param   col     The column of the cell, which must be in the world
+ * \return          The encoded cell
+ */
+uint8_t world_cell(const world_t *world, int row, int col);
+
+/**
+ * Copy a run of cells from one row, looking each chunk up once
+ * \param   row     The row, which must be in the world
+ * \param   col     The first column; the run must end inside the world
+ * \param   count   The number of cells
+ * \param   out     Receives count cells
+ */
+void world_read_row(const world_t *world, int row, int col, int count, uint8_t *out);
+
+/**
+ * Request a new direction for a player. Reversing onto the player's own trail is ignored.
+ * \param   player  The index of the player (0 for player 1)
+ * \param   dir     One of the DIR_ values
+ */
+void world_steer(world_t *world, int player, int dir);
+
+/**
+ * Check whether a player will move on the next tick (if it keeps its requested direction)
+ */
+bool world_move_due(const world_t *world, int player);
+
+/**
+ * Pick a direction for a computer-controlled player as wander_steer does on a board
+ * \param   rng     Random generator state (see rng_next)
+ */
+void world_wander(world_t *world, int player, uint64_t *rng);
+
+/**
+ * Advance the world by one SIM_TICK_INTERVAL time step, by the rules of game_tick. Each move
+ * looks up only the chunk its bike moves into.
+ * \return        -1 if the round continues, 0 for a draw, or the number of the winning player
+ */
+int world_tick(world_t *world);
+
+/**
+ * Move a viewport so it keeps a player in sight: once the player comes within a quarter of the
+ * view of an edge, the view jumps to center it again, without leaving the world
+ * \param   player  The index of the player to follow
+ * \param   height  The viewport's size, at most the world's
+ * \param   width
+ * \param   top     The viewport's first row, updated in place
+ * \param   left    The viewport's first column, updated in place
+ * \return          true if the viewport moved
+ */
+bool world_follow(const world_t *world, int player, int height, int width, int *top, int *left);
+
+/**
+ * Get the heap memory a world holds: its chunks, spare chunks and table
+ * \return          The size in bytes
+ */
+size_t world_memory(const world_t *world);
+
+#endif